@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdlib.h>
+#include <malloc.h>
+
+
+// The alignment of all the simulation columns, enough for a full cache line and for 512 bit vectors.
+const size_t SimulationColumnAlignment = 64;
+
+
+// Allocates a block of memory that is aligned for vector loads.
+inline void* AllocateAligned(size_t bytes)
+{
+#ifdef _WIN32
+	return _aligned_malloc(bytes, SimulationColumnAlignment);
+#else
+	void* result = NULL;
+	if (posix_memalign(&result, SimulationColumnAlignment, bytes) != 0)
+		return NULL;
+	return result;
+#endif
+}
+
+
+// Frees a block allocated with AllocateAligned.
+inline void FreeAligned(void* memory)
+{
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+
+// Allocates a float column with room for the indicated number of elements.
+inline float* AllocateColumn(int elements)
+{
+	return static_cast<float*>(AllocateAligned(sizeof(float) * (elements > 0 ? elements : 1)));
+}
@@ -0,0 +1,242 @@
+#include "AnalyticPendulum.h"
+#include <math.h>
+
+
+// The largest step the numeric fallback takes.
+const double MaxNumericDeltaTime = 1.0 / 240.0;
+
+
+// We get the anchor position and the physical parameters of the pendulum.
+AnalyticPendulum::AnalyticPendulum(float anchorPoint[3], const PendulumParameters& parameters)
+{
+	m_parameters = parameters;
+	m_externalForce = NULL;
+	m_externalForceUserData = NULL;
+	m_currentTime = 0.0;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_anchorPoint[axis] = anchorPoint[axis];
+		m_currentPosition[axis] = anchorPoint[axis];
+		m_currentVelocity[axis] = 0.0;
+	}
+
+	RebaseReference();
+}
+
+
+// Sets the position of the pendulum at the current time and resets velocity.
+void AnalyticPendulum::SetPendulumPosition(float position[3])
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_currentPosition[axis] = position[axis];
+		m_currentVelocity[axis] = 0.0;
+	}
+
+	RebaseReference();
+}
+
+
+// Updates the simulation.
+void AnalyticPendulum::UpdateSimulation(float deltaTime)
+{
+	SeekTo(m_currentTime + deltaTime);
+}
+
+
+// Moves the pendulum to the indicated time.
+bool AnalyticPendulum::SeekTo(double time)
+{
+	if (!IsAnalytic())
+	{
+		if (time < m_currentTime)
+			return false;
+
+		IntegrateNumerically(time - m_currentTime);
+		m_currentTime = time;
+		return true;
+	}
+
+	double transition[4];
+	ComputeStateTransition(m_parameters, time - m_referenceTime, transition);
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		double gravity = axis == 1 ? m_parameters.m_earthAcceleration : 0.0;
+		double equilibrium = ComputeEquilibrium(m_parameters, m_anchorPoint[axis], gravity);
+		double displacement = m_referencePosition[axis] - equilibrium;
+
+		m_currentPosition[axis] = equilibrium + transition[0] * displacement + transition[1] * m_referenceVelocity[axis];
+		m_currentVelocity[axis] = transition[2] * displacement + transition[3] * m_referenceVelocity[axis];
+	}
+
+	m_currentTime = time;
+	return true;
+}
+
+
+// Obtains the current position of the pendulum.
+void AnalyticPendulum::ObtainCurrentPosition(float position[3])
+{
+	position[0] = static_cast<float>(m_currentPosition[0]);
+	position[1] = static_cast<float>(m_currentPosition[1]);
+	position[2] = static_cast<float>(m_currentPosition[2]);
+}
+
+
+// Obtains the current velocity of the pendulum.
+void AnalyticPendulum::ObtainCurrentVelocity(float velocity[3])
+{
+	velocity[0] = static_cast<float>(m_currentVelocity[0]);
+	velocity[1] = static_cast<float>(m_currentVelocity[1]);
+	velocity[2] = static_cast<float>(m_currentVelocity[2]);
+}
+
+
+// Sets an external force, NULL removes it again.
+// Either way the current state becomes the start of the next closed form segment.
+void AnalyticPendulum::SetExternalForce(ExternalForceFunction force, void* userData)
+{
+	m_externalForce = force;
+	m_externalForceUserData = userData;
+	RebaseReference();
+}
+
+
+// Computes the matrix that maps displacement from equilibrium and velocity of one axis at
+// time zero to the indicated time.
+// With beta = invMass * damping / 2 and omega0^2 = invMass * spring the displacement
+// follows u'' + 2 beta u' + omega0^2 u = 0, which has the usual three regimes.
+void AnalyticPendulum::ComputeStateTransition(const PendulumParameters& parameters, double time, double transition[4])
+{
+	double beta = 0.5 * parameters.m_invMass * parameters.m_dampingVelocity;
+	double omegaSquared = parameters.m_invMass * parameters.m_springConstant;
+	double decay = exp(-beta * time);
+	double discriminant = omegaSquared - beta * beta;
+
+	if (fabs(discriminant) <= 1e-12 * omegaSquared)
+	{
+		// Critically damped.
+		transition[0] = decay * (1.0 + beta * time);
+		transition[1] = decay * time;
+		transition[2] = decay * (-omegaSquared * time);
+		transition[3] = decay * (1.0 - beta * time);
+	}
+	else if (discriminant > 0.0)
+	{
+		// Under damped, the pendulum oscillates.
+		double omega = sqrt(discriminant);
+		double cosine = cos(omega * time);
+		double sine = sin(omega * time);
+		transition[0] = decay * (cosine + beta / omega * sine);
+		transition[1] = decay * (sine / omega);
+		transition[2] = decay * (-omegaSquared / omega * sine);
+		transition[3] = decay * (cosine - beta / omega * sine);
+	}
+	else
+	{
+		// Over damped, the pendulum creeps towards the equilibrium. The decay is folded into the
+		// two modes, as cosh and sinh alone overflow long before the product does.
+		double omega = sqrt(-discriminant);
+		double slowMode = exp((omega - beta) * time);
+		double fastMode = exp(-(omega + beta) * time);
+		double cosine = 0.5 * (slowMode + fastMode);
+		double sine = 0.5 * (slowMode - fastMode);
+		transition[0] = cosine + beta / omega * sine;
+		transition[1] = sine / omega;
+		transition[2] = -omegaSquared / omega * sine;
+		transition[3] = cosine - beta / omega * sine;
+	}
+}
+
+
+// Gets the coordinate along one axis where the spring compensates gravity.
+double AnalyticPendulum::ComputeEquilibrium(const PendulumParameters& parameters, double anchor, double gravity)
+{
+	return anchor + gravity / (parameters.m_invMass * parameters.m_springConstant);
+}
+
+
+// Makes the current state the reference of the closed form.
+void AnalyticPendulum::RebaseReference()
+{
+	m_referenceTime = m_currentTime;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_referencePosition[axis] = m_currentPosition[axis];
+		m_referenceVelocity[axis] = m_currentVelocity[axis];
+	}
+}
+
+
+// Integrates the current state numerically over the indicated duration.
+// We use the classic Runge Kutta scheme in 3d as the external force may couple the axes.
+void AnalyticPendulum::IntegrateNumerically(double duration)
+{
+	int steps = static_cast<int>(ceil(duration / MaxNumericDeltaTime));
+	if (steps == 0)
+		return;
+	double deltaTime = duration / steps;
+
+	double* x = m_currentPosition;
+	double* v = m_currentVelocity;
+
+	for(int step = 0; step < steps; ++step)
+	{
+		double a1[3], a2[3], a3[3], a4[3];
+		double x2[3], v2[3], x3[3], v3[3], x4[3], v4[3];
+
+		ComputeAcceleration(x, v, a1);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			x2[axis] = x[axis] + 0.5 * deltaTime * v[axis];
+			v2[axis] = v[axis] + 0.5 * deltaTime * a1[axis];
+		}
+
+		ComputeAcceleration(x2, v2, a2);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			x3[axis] = x[axis] + 0.5 * deltaTime * v2[axis];
+			v3[axis] = v[axis] + 0.5 * deltaTime * a2[axis];
+		}
+
+		ComputeAcceleration(x3, v3, a3);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			x4[axis] = x[axis] + deltaTime * v3[axis];
+			v4[axis] = v[axis] + deltaTime * a3[axis];
+		}
+
+		ComputeAcceleration(x4, v4, a4);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			x[axis] += deltaTime / 6.0 * (v[axis] + 2.0 * v2[axis] + 2.0 * v3[axis] + v4[axis]);
+			v[axis] += deltaTime / 6.0 * (a1[axis] + 2.0 * a2[axis] + 2.0 * a3[axis] + a4[axis]);
+		}
+	}
+}
+
+
+// Gets the acceleration for the indicated state, including the external force.
+void AnalyticPendulum::ComputeAcceleration(const double position[3], const double velocity[3], double acceleration[3])
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		double gravity = axis == 1 ? m_parameters.m_earthAcceleration : 0.0;
+		acceleration[axis] = gravity + m_parameters.m_invMass * (-velocity[axis] * m_parameters.m_dampingVelocity +
+			m_parameters.m_springConstant * (m_anchorPoint[axis] - position[axis]));
+	}
+
+	if (m_externalForce != NULL)
+	{
+		float floatPosition[3] = {static_cast<float>(position[0]), static_cast<float>(position[1]), static_cast<float>(position[2])};
+		float floatVelocity[3] = {static_cast<float>(velocity[0]), static_cast<float>(velocity[1]), static_cast<float>(velocity[2])};
+		float external[3] = {0.0f, 0.0f, 0.0f};
+		m_externalForce(floatPosition, floatVelocity, external, m_externalForceUserData);
+
+		acceleration[0] += external[0];
+		acceleration[1] += external[1];
+		acceleration[2] += external[2];
+	}
+}
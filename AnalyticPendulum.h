@@ -0,0 +1,83 @@
+#pragma once
+
+#include "PendulumPhysics.h"
+#include <stddef.h>
+
+// An additional force the closed form solution cannot express. It adds its contribution
+// to the acceleration of the pendulum.
+typedef void (*ExternalForceFunction)(const float position[3], const float velocity[3], float acceleration[3], void* userData);
+
+
+// Evaluates the pendulum with the exact solution of the damped spring instead of stepping it.
+// Gravity, the Hooke spring and the linear damping form a linear equation per axis, so the
+// state at any time is a single evaluation of the closed form from a reference state.
+// As soon as an external force is set the pendulum is integrated numerically instead.
+class AnalyticPendulum
+{
+public:
+	// We get the anchor position and the physical parameters of the pendulum.
+	AnalyticPendulum(float anchorPoint[3], const PendulumParameters& parameters = PendulumParameters());
+
+	// Sets the position of the pendulum at the current time and resets velocity.
+	void SetPendulumPosition(float position[3]);
+
+	// Updates the simulation.
+	void UpdateSimulation(float deltaTime);
+
+	// Moves the pendulum to the indicated time. In the numeric mode we can only move forward,
+	// false is returned if an earlier time was requested.
+	bool SeekTo(double time);
+
+	// Obtains the current position of the pendulum.
+	void ObtainCurrentPosition(float position[3]);
+	// Obtains the current velocity of the pendulum.
+	void ObtainCurrentVelocity(float velocity[3]);
+
+	// Gets the time the current state belongs to.
+	double GetCurrentTime() { return m_currentTime; }
+
+	// Sets an external force, NULL removes it again.
+	void SetExternalForce(ExternalForceFunction force, void* userData);
+
+	// Checks if the pendulum is currently evaluated with the closed form.
+	bool IsAnalytic() { return m_externalForce == NULL && m_parameters.m_springConstant > 0.0f && m_parameters.m_invMass > 0.0f; }
+
+	// Computes the matrix that maps displacement from equilibrium and velocity of one axis at
+	// time zero to the indicated time. The matrix is stored row by row.
+	static void ComputeStateTransition(const PendulumParameters& parameters, double time, double transition[4]);
+
+	// Gets the coordinate along one axis where the spring compensates gravity.
+	static double ComputeEquilibrium(const PendulumParameters& parameters, double anchor, double gravity);
+
+private:
+	// The position where the pendulum is anchored.
+	float m_anchorPoint[3];
+	// The physical parameters.
+	PendulumParameters m_parameters;
+
+	// The time of the reference state.
+	double m_referenceTime;
+	// The position at the reference time.
+	double m_referencePosition[3];
+	// The velocity at the reference time.
+	double m_referenceVelocity[3];
+
+	// The time of the current state.
+	double m_currentTime;
+	// The current position of the pendulum.
+	double m_currentPosition[3];
+	// The current velocity of the pendulum.
+	double m_currentVelocity[3];
+
+	// The additional force, if any.
+	ExternalForceFunction m_externalForce;
+	// The user data handed to the external force.
+	void* m_externalForceUserData;
+
+	// Makes the current state the reference of the closed form.
+	void RebaseReference();
+	// Integrates the current state numerically over the indicated duration.
+	void IntegrateNumerically(double duration);
+	// Gets the acceleration for the indicated state, including the external force.
+	void ComputeAcceleration(const double position[3], const double velocity[3], double acceleration[3]);
+};
@@ -0,0 +1,337 @@
+#include "AnchorDriver.h"
+#include "PendulumBatch.h"
+#include <math.h>
+
+
+// The number of updates after which the phasors are computed from the time again, so the
+// rounding of the rotations can not add up to a visible phase error.
+static const int PhasorResyncInterval = 1024;
+
+
+AnchorDriver::AnchorDriver()
+{
+	m_time = 0.0;
+	m_updatesSinceResync = 0;
+	m_sineStepDeltaTime = -1.0f;
+}
+
+
+// Lets the anchor of the pendulum swing around the centre.
+void AnchorDriver::AddSinusoidalAnchor(int pendulum, float centre[3], float amplitude[3], float angularFrequency, float phase)
+{
+	m_sinePendulum.push_back(pendulum);
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_sineCentre[axis].push_back(centre[axis]);
+		m_sineAmplitude[axis].push_back(amplitude[axis]);
+	}
+	m_sineAngularFrequency.push_back(angularFrequency);
+	m_sinePhase.push_back(phase);
+
+	double angle = angularFrequency * m_time + phase;
+	m_sineSin.push_back(static_cast<float>(sin(angle)));
+	m_sineCos.push_back(static_cast<float>(cos(angle)));
+	m_sineStepSin.push_back(0.0f);
+	m_sineStepCos.push_back(1.0f);
+	m_sineStepDeltaTime = -1.0f;
+}
+
+
+// Adds a track through the keyframes and returns its index.
+int AnchorDriver::AddTrack(int numOfKeyframes, const float* times, const float (*positions)[3], bool looping)
+{
+	if (numOfKeyframes < 1)
+		return -1;
+	for(int keyframe = 1; keyframe < numOfKeyframes; ++keyframe)
+	{
+		if (times[keyframe] <= times[keyframe - 1])
+			return -1;
+	}
+
+	Track track = {static_cast<int>(m_keyframeTime.size()), numOfKeyframes, looping && numOfKeyframes > 1};
+	for(int keyframe = 0; keyframe < numOfKeyframes; ++keyframe)
+	{
+		m_keyframeTime.push_back(times[keyframe]);
+		for(int axis = 0; axis < 3; ++axis)
+			m_keyframePosition[axis].push_back(positions[keyframe][axis]);
+	}
+
+	m_tracks.push_back(track);
+	return static_cast<int>(m_tracks.size()) - 1;
+}
+
+
+// Lets the anchor of the pendulum follow the track.
+void AnchorDriver::AddKeyframedAnchor(int pendulum, int track, float timeOffset, float positionOffset[3])
+{
+	m_keyedPendulum.push_back(pendulum);
+	m_keyedTrack.push_back(track);
+	m_keyedTimeOffset.push_back(timeOffset);
+	for(int axis = 0; axis < 3; ++axis)
+		m_keyedOffset[axis].push_back(positionOffset[axis]);
+	m_keyedCursor.push_back(0);
+}
+
+
+// Hangs the anchor of the pendulum at the offset from the bob of the body pendulum.
+void AnchorDriver::AddAttachedAnchor(int pendulum, int body, float offset[3])
+{
+	m_attachedPendulum.push_back(pendulum);
+	m_attachedBody.push_back(body);
+	for(int axis = 0; axis < 3; ++axis)
+		m_attachedOffset[axis].push_back(offset[axis]);
+}
+
+
+// Moves the anchors to their positions at the current time and advances the time by the step.
+void AnchorDriver::Update(float deltaTime, PendulumBatch& batch)
+{
+	int numOfSines = static_cast<int>(m_sinePendulum.size());
+	if (numOfSines > 0)
+	{
+		UpdateSinusoidalAnchors(deltaTime);
+		ApplyOutput(numOfSines, m_sinePendulum.data(), batch);
+	}
+
+	int numOfKeyed = static_cast<int>(m_keyedPendulum.size());
+	if (numOfKeyed > 0)
+	{
+		UpdateKeyframedAnchors();
+		ApplyOutput(numOfKeyed, m_keyedPendulum.data(), batch);
+	}
+
+	int numOfAttached = static_cast<int>(m_attachedPendulum.size());
+	if (numOfAttached > 0)
+	{
+		UpdateAttachedAnchors(batch);
+		ApplyOutput(numOfAttached, m_attachedPendulum.data(), batch);
+	}
+
+	m_time += deltaTime;
+}
+
+
+// Evaluates the sinusoidal anchors and rotates their phasors on by the time step.
+// Instead of a sine and a cosine per anchor and update, every phasor is turned by the
+// rotation of one time step, which is computed once per time step. This keeps the loops free
+// of calls, so they vectorize and only stream the columns. Every axis gets its own loop, which
+// reads the phasors again but keeps the number of concurrent streams low enough for the
+// prefetcher. The length of the phasors is pulled back to 1 by a Newton step every update.
+void AnchorDriver::UpdateSinusoidalAnchors(float deltaTime)
+{
+	int count = static_cast<int>(m_sinePendulum.size());
+	ReserveOutput(count);
+
+	if (m_updatesSinceResync >= PhasorResyncInterval)
+	{
+		for(int i = 0; i < count; ++i)
+		{
+			double angle = m_sineAngularFrequency[i] * m_time + m_sinePhase[i];
+			m_sineSin[i] = static_cast<float>(sin(angle));
+			m_sineCos[i] = static_cast<float>(cos(angle));
+		}
+		m_updatesSinceResync = 0;
+	}
+	++m_updatesSinceResync;
+
+	if (m_sineStepDeltaTime != deltaTime)
+	{
+		for(int i = 0; i < count; ++i)
+		{
+			double angle = static_cast<double>(m_sineAngularFrequency[i]) * deltaTime;
+			m_sineStepSin[i] = static_cast<float>(sin(angle));
+			m_sineStepCos[i] = static_cast<float>(cos(angle));
+		}
+		m_sineStepDeltaTime = deltaTime;
+	}
+
+	const float* __restrict angularFrequency = m_sineAngularFrequency.data();
+	const float* __restrict stepSin = m_sineStepSin.data();
+	const float* __restrict stepCos = m_sineStepCos.data();
+	float* __restrict phasorSin = m_sineSin.data();
+	float* __restrict phasorCos = m_sineCos.data();
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float* __restrict centre = m_sineCentre[axis].data();
+		const float* __restrict amplitude = m_sineAmplitude[axis].data();
+		float* __restrict anchor = m_anchorPoint[axis].data();
+		float* __restrict velocity = m_anchorVelocity[axis].data();
+		for(int i = 0; i < count; ++i)
+		{
+			anchor[i] = centre[i] + amplitude[i] * phasorSin[i];
+			velocity[i] = amplitude[i] * angularFrequency[i] * phasorCos[i];
+		}
+	}
+
+	for(int i = 0; i < count; ++i)
+	{
+		float s = phasorSin[i];
+		float c = phasorCos[i];
+		float nextSin = s * stepCos[i] + c * stepSin[i];
+		float nextCos = c * stepCos[i] - s * stepSin[i];
+		float scale = 1.5f - 0.5f * (nextSin * nextSin + nextCos * nextCos);
+		phasorSin[i] = nextSin * scale;
+		phasorCos[i] = nextCos * scale;
+	}
+}
+
+
+// Evaluates the keyframed anchors at the current time.
+void AnchorDriver::UpdateKeyframedAnchors()
+{
+	int count = static_cast<int>(m_keyedPendulum.size());
+	ReserveOutput(count);
+
+	for(int i = 0; i < count; ++i)
+	{
+		const Track& track = m_tracks[m_keyedTrack[i]];
+		float position[3];
+		float velocity[3];
+		EvaluateTrack(track, static_cast<float>(m_time + m_keyedTimeOffset[i]), m_keyedCursor[i], position, velocity);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_anchorPoint[axis][i] = position[axis] + m_keyedOffset[axis][i];
+			m_anchorVelocity[axis][i] = velocity[axis];
+		}
+	}
+}
+
+
+// Evaluates the attached anchors from the current state of the bodies.
+void AnchorDriver::UpdateAttachedAnchors(PendulumBatch& batch)
+{
+	int count = static_cast<int>(m_attachedPendulum.size());
+	ReserveOutput(count);
+
+	for(int i = 0; i < count; ++i)
+	{
+		float position[3];
+		float velocity[3];
+		batch.ObtainCurrentPosition(m_attachedBody[i], position);
+		batch.ObtainCurrentVelocity(m_attachedBody[i], velocity);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_anchorPoint[axis][i] = position[axis] + m_attachedOffset[axis][i];
+			m_anchorVelocity[axis][i] = velocity[axis];
+		}
+	}
+}
+
+
+// Evaluates a track at the local time.
+// The segments are cubic Hermite curves whose tangents are the Catmull-Rom differences of the
+// neighbouring keyframes over their time distance, so the curve and its velocity are continuous
+// for keyframes at any times. The time only moves forward, so the cursor is usually already in
+// the right segment and the search costs nothing.
+void AnchorDriver::EvaluateTrack(const Track& track, float time, int& cursor, float position[3], float velocity[3])
+{
+	const float* times = m_keyframeTime.data() + track.m_keyframeStart;
+	int last = track.m_numOfKeyframes - 1;
+
+	float localTime = time;
+	if (track.m_looping)
+	{
+		float period = times[last] - times[0];
+		localTime = fmodf(time - times[0], period);
+		if (localTime < 0.0f)
+			localTime += period;
+		localTime += times[0];
+		if (localTime >= times[last])
+			localTime = times[0];
+	}
+
+	bool standsStill = last == 0 || (!track.m_looping && (localTime <= times[0] || localTime >= times[last]));
+	if (standsStill)
+	{
+		int keyframe = localTime <= times[0] ? 0 : last;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			position[axis] = m_keyframePosition[axis][track.m_keyframeStart + keyframe];
+			velocity[axis] = 0.0f;
+		}
+		return;
+	}
+
+	if (cursor >= last || times[cursor] > localTime)
+		cursor = 0;
+	while (localTime >= times[cursor + 1])
+		++cursor;
+
+	// The neighbours of the segment, wrapped around for loops and repeated at the ends otherwise.
+	int start = cursor;
+	int end = cursor + 1;
+	int before = start - 1;
+	int after = end + 1;
+	float beforeTime = 0.0f;
+	float afterTime = 0.0f;
+	if (before >= 0)
+		beforeTime = times[before];
+	else if (track.m_looping)
+	{
+		before = last - 1;
+		beforeTime = times[before] - (times[last] - times[0]);
+	}
+	else
+	{
+		before = start;
+		beforeTime = times[start];
+	}
+	if (after <= last)
+		afterTime = times[after];
+	else if (track.m_looping)
+	{
+		after = 1;
+		afterTime = times[after] + (times[last] - times[0]);
+	}
+	else
+	{
+		after = end;
+		afterTime = times[end];
+	}
+
+	float length = times[end] - times[start];
+	float u = (localTime - times[start]) / length;
+	float u2 = u * u;
+	float u3 = u2 * u;
+	float h00 = 2.0f * u3 - 3.0f * u2 + 1.0f;
+	float h10 = u3 - 2.0f * u2 + u;
+	float h01 = -2.0f * u3 + 3.0f * u2;
+	float h11 = u3 - u2;
+	float d00 = 6.0f * u2 - 6.0f * u;
+	float d10 = 3.0f * u2 - 4.0f * u + 1.0f;
+	float d01 = -6.0f * u2 + 6.0f * u;
+	float d11 = 3.0f * u2 - 2.0f * u;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float* positions = m_keyframePosition[axis].data() + track.m_keyframeStart;
+		float startTangent = (positions[end] - positions[before]) / (times[end] - beforeTime) * length;
+		float endTangent = (positions[after] - positions[start]) / (afterTime - times[start]) * length;
+		position[axis] = h00 * positions[start] + h10 * startTangent + h01 * positions[end] + h11 * endTangent;
+		velocity[axis] = (d00 * positions[start] + d10 * startTangent + d01 * positions[end] + d11 * endTangent) / length;
+	}
+}
+
+
+// Makes the output columns large enough for the indicated number of anchors.
+void AnchorDriver::ReserveOutput(int count)
+{
+	if (static_cast<int>(m_anchorPoint[0].size()) >= count)
+		return;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_anchorPoint[axis].resize(count);
+		m_anchorVelocity[axis].resize(count);
+	}
+}
+
+
+// Hands the first anchors of the output columns to the batch.
+void AnchorDriver::ApplyOutput(int count, const int* pendulums, PendulumBatch& batch)
+{
+	const float* anchorPoint[3] = {m_anchorPoint[0].data(), m_anchorPoint[1].data(), m_anchorPoint[2].data()};
+	const float* anchorVelocity[3] = {m_anchorVelocity[0].data(), m_anchorVelocity[1].data(), m_anchorVelocity[2].data()};
+	batch.SetAnchorMotions(count, pendulums, anchorPoint, anchorVelocity);
+}
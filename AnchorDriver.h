@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+class PendulumBatch;
+
+// Moves the anchors of a PendulumBatch. An anchor either swings on a sine around a centre,
+// follows a keyframed track or hangs at an offset from the bob of another pendulum.
+// Every update evaluates all anchors of a kind in one pass over their columns and hands
+// the positions and velocities to the batch, which lets the anchors move on with their
+// velocity during the step and damps the bobs relative to them.
+class AnchorDriver
+{
+public:
+	AnchorDriver();
+
+	// Lets the anchor of the pendulum swing around the centre: every axis moves by its
+	// amplitude times the sine of the angular frequency times the time plus the phase.
+	void AddSinusoidalAnchor(int pendulum, float centre[3], float amplitude[3], float angularFrequency, float phase);
+
+	// Adds a track through the keyframes and returns its index, or -1 if the keyframes are not
+	// ordered in time. The track is a Catmull-Rom spline through the positions. Before the first
+	// and after the last keyframe it stands still, unless it loops, then it starts over at the
+	// first keyframe after the last, which should be at the same position.
+	int AddTrack(int numOfKeyframes, const float* times, const float (*positions)[3], bool looping);
+	// Lets the anchor of the pendulum follow the track, shifted in time and space by the offsets.
+	void AddKeyframedAnchor(int pendulum, int track, float timeOffset, float positionOffset[3]);
+
+	// Hangs the anchor of the pendulum at the offset from the bob of the body pendulum.
+	// The anchor moves with the bob as it was before the step.
+	void AddAttachedAnchor(int pendulum, int body, float offset[3]);
+
+	// Moves the anchors to their positions at the current time and advances the time by the step.
+	// The batch should be stepped by the same time step afterwards.
+	void Update(float deltaTime, PendulumBatch& batch);
+
+	// Gets the time the anchors are evaluated at next.
+	double GetTime() { return m_time; }
+
+private:
+	// The time of the next evaluation. It is kept in double precision, so long runs do not lose the phase.
+	double m_time;
+	// The number of updates since the phasors were last computed from the time.
+	int m_updatesSinceResync;
+
+	// The sinusoidal anchors, one column per quantity.
+	std::vector<int> m_sinePendulum;
+	std::vector<float> m_sineCentre[3];
+	std::vector<float> m_sineAmplitude[3];
+	std::vector<float> m_sineAngularFrequency;
+	std::vector<float> m_sinePhase;
+	// The sine and cosine of the current angle, rotated on by every update.
+	std::vector<float> m_sineSin;
+	std::vector<float> m_sineCos;
+	// The sine and cosine of the angle every anchor turns by in one time step.
+	std::vector<float> m_sineStepSin;
+	std::vector<float> m_sineStepCos;
+	// The time step the step rotations were computed for, negative if they are outdated.
+	float m_sineStepDeltaTime;
+
+	// A keyframed track: its keyframes are [m_keyframeStart, m_keyframeStart + m_numOfKeyframes).
+	struct Track
+	{
+		int m_keyframeStart;
+		int m_numOfKeyframes;
+		bool m_looping;
+	};
+	std::vector<Track> m_tracks;
+	std::vector<float> m_keyframeTime;
+	std::vector<float> m_keyframePosition[3];
+
+	// The keyframed anchors, one column per quantity.
+	std::vector<int> m_keyedPendulum;
+	std::vector<int> m_keyedTrack;
+	std::vector<float> m_keyedTimeOffset;
+	std::vector<float> m_keyedOffset[3];
+	// The keyframe every anchor was between at the last update, the search starts there.
+	std::vector<int> m_keyedCursor;
+
+	// The attached anchors.
+	std::vector<int> m_attachedPendulum;
+	std::vector<int> m_attachedBody;
+	std::vector<float> m_attachedOffset[3];
+
+	// The positions and velocities of the last update, handed to the batch.
+	std::vector<float> m_anchorPoint[3];
+	std::vector<float> m_anchorVelocity[3];
+
+	// Evaluates the sinusoidal anchors and rotates their phasors on by the time step.
+	void UpdateSinusoidalAnchors(float deltaTime);
+	// Evaluates the keyframed anchors at the current time.
+	void UpdateKeyframedAnchors();
+	// Evaluates the attached anchors from the current state of the bodies.
+	void UpdateAttachedAnchors(PendulumBatch& batch);
+	// Evaluates a track at the local time, the cursor is the keyframe the search starts at.
+	void EvaluateTrack(const Track& track, float time, int& cursor, float position[3], float velocity[3]);
+	// Makes the output columns large enough for the indicated number of anchors.
+	void ReserveOutput(int count);
+	// Hands the first anchors of the output columns to the batch.
+	void ApplyOutput(int count, const int* pendulums, PendulumBatch& batch);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+class WorkStealingPool;
+
+// Two items whose spheres overlap, the first index is always the smaller one.
+struct CollisionPair
+{
+	int m_first;
+	int m_second;
+};
+
+
+// The broadphases the bob collisions can run with.
+enum BroadphaseType
+{
+	// Rebuilds a hashed uniform grid every step, the cost does not depend on the motion.
+	BroadphaseHashGrid = 0,
+	// Keeps the items sorted along one axis and repairs the order every step, cheap as long
+	// as the items only move a little from step to step.
+	BroadphaseSweepAndPrune = 1
+};
+
+
+// Finds the pairs of items that are close to each other among a set of points.
+class Broadphase
+{
+public:
+	virtual ~Broadphase() {}
+
+	// Finds all pairs of items closer than the distance. The positions are given as one column
+	// per axis. Every pair is reported once, in an order that does not depend on the thread pool.
+	virtual void FindPairs(int count, const float* const position[3], float distance, std::vector<CollisionPair>& pairs) = 0;
+
+	// Sets the thread pool the queries are distributed on, NULL runs them on the calling thread.
+	virtual void SetThreadPool(WorkStealingPool* threadPool) = 0;
+};
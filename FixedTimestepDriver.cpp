@@ -0,0 +1,70 @@
+#include "FixedTimestepDriver.h"
+
+
+// We get the integrator to drive, the fixed step and the maximum number of steps per update.
+FixedTimestepDriver::FixedTimestepDriver(PendulumIntegrator* integrator, float fixedDeltaTime, int maxSubsteps)
+{
+	m_integrator = integrator;
+	m_fixedDeltaTime = fixedDeltaTime;
+	m_maxSubsteps = maxSubsteps;
+	m_accumulatedTime = 0.0f;
+	m_numOfDroppedSteps = 0;
+
+	ResetInterpolation();
+}
+
+
+// Consumes the elapsed time in fixed steps and returns the number of steps taken.
+int FixedTimestepDriver::Update(float elapsedTime)
+{
+	m_accumulatedTime += elapsedTime;
+
+	int steps = 0;
+	while (m_accumulatedTime >= m_fixedDeltaTime && steps < m_maxSubsteps)
+	{
+		m_previousPosition[0] = m_currentPosition[0];
+		m_previousPosition[1] = m_currentPosition[1];
+		m_previousPosition[2] = m_currentPosition[2];
+
+		m_integrator->UpdateSimulation(m_fixedDeltaTime);
+		m_integrator->ObtainCurrentPosition(m_currentPosition);
+
+		m_accumulatedTime -= m_fixedDeltaTime;
+		++steps;
+	}
+
+	// After a hitch we rather let the simulation fall behind than try to catch up,
+	// only the fraction of a step is kept for the interpolation.
+	if (m_accumulatedTime >= m_fixedDeltaTime)
+	{
+		int dropped = static_cast<int>(m_accumulatedTime / m_fixedDeltaTime);
+		m_numOfDroppedSteps += dropped;
+		m_accumulatedTime -= dropped * m_fixedDeltaTime;
+	}
+
+	return steps;
+}
+
+
+// Obtains the position interpolated between the last two simulated states.
+void FixedTimestepDriver::ObtainInterpolatedPosition(float position[3])
+{
+	float alpha = m_accumulatedTime / m_fixedDeltaTime;
+	if (alpha > 1.0f)
+		alpha = 1.0f;
+
+	position[0] = m_previousPosition[0] + alpha * (m_currentPosition[0] - m_previousPosition[0]);
+	position[1] = m_previousPosition[1] + alpha * (m_currentPosition[1] - m_previousPosition[1]);
+	position[2] = m_previousPosition[2] + alpha * (m_currentPosition[2] - m_previousPosition[2]);
+}
+
+
+// Restarts the interpolation from the current state, e.g. after the pendulum was moved.
+void FixedTimestepDriver::ResetInterpolation()
+{
+	m_integrator->ObtainCurrentPosition(m_currentPosition);
+
+	m_previousPosition[0] = m_currentPosition[0];
+	m_previousPosition[1] = m_currentPosition[1];
+	m_previousPosition[2] = m_currentPosition[2];
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "PendulumIntegrator.h"
+
+// Drives a pendulum integrator with a constant time step, independent of the frame rate.
+// The elapsed wall time is accumulated and consumed in fixed substeps, the renderer gets
+// the position interpolated between the last two simulated states.
+class FixedTimestepDriver
+{
+public:
+	// We get the integrator to drive, the fixed step and the maximum number of steps per update.
+	FixedTimestepDriver(PendulumIntegrator* integrator, float fixedDeltaTime, int maxSubsteps);
+
+	// Consumes the elapsed time in fixed steps and returns the number of steps taken.
+	int Update(float elapsedTime);
+
+	// Obtains the position interpolated between the last two simulated states.
+	void ObtainInterpolatedPosition(float position[3]);
+
+	// Restarts the interpolation from the current state, e.g. after the pendulum was moved.
+	void ResetInterpolation();
+
+	// Gets how many steps were dropped because the maximum number of substeps was reached.
+	int GetNumOfDroppedSteps() { return m_numOfDroppedSteps; }
+
+private:
+	// The integrator we drive.
+	PendulumIntegrator* m_integrator;
+	// The constant time step of the simulation.
+	float m_fixedDeltaTime;
+	// The maximum number of steps per update, protects against the spiral of death.
+	int m_maxSubsteps;
+	// The wall time not simulated yet.
+	float m_accumulatedTime;
+	// The number of steps we dropped so far.
+	int m_numOfDroppedSteps;
+
+	// The position before the last step.
+	float m_previousPosition[3];
+	// The position after the last step.
+	float m_currentPosition[3];
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "PendulumPhysics.h"
+
+// The integration schemes are policies with a single static Advance function. They are
+// passed as template arguments, so the choice is made by the compiler and the inner loop
+// contains no branches. Every scheme advances one axis of one pendulum, which is all we
+// need as the spring model does not couple the axes.
+
+
+// The spring force along one axis of one pendulum.
+struct AxisSpringForce
+{
+	// The gravity along the axis.
+	float m_gravity;
+	// The anchor coordinate along the axis.
+	float m_anchor;
+	// The anchor velocity along the axis, the damping acts relative to it.
+	float m_anchorVelocity;
+
+	// Gets the acceleration for the indicated state.
+	float operator()(float position, float velocity) const
+	{
+		return PendulumPhysics::ComputeAxisAcceleration(m_gravity, m_anchor, position, velocity - m_anchorVelocity);
+	}
+};
+
+
+// The spring force along one axis of one pendulum with its own parameters.
+struct ParameterizedAxisSpringForce
+{
+	float m_gravity;
+	float m_invMass;
+	float m_dampingVelocity;
+	float m_springConstant;
+	float m_anchor;
+	float m_anchorVelocity;
+
+	// Gets the acceleration for the indicated state.
+	float operator()(float position, float velocity) const
+	{
+		return PendulumPhysics::ComputeAxisAcceleration(m_gravity, m_invMass, m_dampingVelocity, m_springConstant, m_anchor, position, velocity - m_anchorVelocity);
+	}
+};
+
+
+// Explicit Euler, the scheme the integrators have always used. First order and only
+// stable for small time steps.
+struct ExplicitEulerScheme
+{
+	template <class Force>
+	static void Advance(float& position, float& velocity, const Force& force, float deltaTime)
+	{
+		float acceleration = force(position, velocity);
+		position += deltaTime * velocity;
+		velocity += deltaTime * acceleration;
+	}
+};
+
+
+// Semi implicit (symplectic) Euler. Same cost as explicit Euler, but the position is
+// moved with the new velocity, which keeps the energy bounded for the undamped spring.
+struct SymplecticEulerScheme
+{
+	template <class Force>
+	static void Advance(float& position, float& velocity, const Force& force, float deltaTime)
+	{
+		velocity += deltaTime * force(position, velocity);
+		position += deltaTime * velocity;
+	}
+};
+
+
+// Velocity Verlet, second order with two force evaluations. The damping depends on the
+// velocity, so the second evaluation uses the half step velocity.
+struct VelocityVerletScheme
+{
+	template <class Force>
+	static void Advance(float& position, float& velocity, const Force& force, float deltaTime)
+	{
+		float halfDelta = 0.5f * deltaTime;
+		float halfStepVelocity = velocity + halfDelta * force(position, velocity);
+		position += deltaTime * halfStepVelocity;
+		velocity = halfStepVelocity + halfDelta * force(position, halfStepVelocity);
+	}
+};
+
+
+// The classic fourth order Runge Kutta scheme with four force evaluations.
+struct RungeKutta4Scheme
+{
+	template <class Force>
+	static void Advance(float& position, float& velocity, const Force& force, float deltaTime)
+	{
+		float halfDelta = 0.5f * deltaTime;
+
+		float x1 = position;
+		float v1 = velocity;
+		float a1 = force(x1, v1);
+
+		float x2 = position + halfDelta * v1;
+		float v2 = velocity + halfDelta * a1;
+		float a2 = force(x2, v2);
+
+		float x3 = position + halfDelta * v2;
+		float v3 = velocity + halfDelta * a2;
+		float a3 = force(x3, v3);
+
+		float x4 = position + deltaTime * v3;
+		float v4 = velocity + deltaTime * a3;
+		float a4 = force(x4, v4);
+
+		float sixthDelta = deltaTime / 6.0f;
+		position += sixthDelta * (v1 + 2.0f * v2 + 2.0f * v3 + v4);
+		velocity += sixthDelta * (a1 + 2.0f * a2 + 2.0f * a3 + a4);
+	}
+};
@@ -0,0 +1,274 @@
+#include "ParameterSweep.h"
+#include "PendulumBatch.h"
+#include "WorkStealingPool.h"
+#include <math.h>
+#include <string.h>
+
+
+// The version of the file layout.
+static const unsigned int SweepFileVersion = 1;
+// The number of blocks per thread in one wave, so threads that finish early can steal.
+static const int BlocksPerThreadAndWave = 4;
+// Energies below this fraction of the initial energy are rounding noise and not fitted.
+static const double EnergyFloor = 1e-10;
+
+// The names of the columns in the file.
+static const char* const ColumnNames[ParameterSweep::NumOfColumns] =
+{
+	"spring_constant", "damping", "mass", "displacement", "settling_time", "peak_extension", "energy_decay_rate"
+};
+
+
+// Opens a file for writing in binary mode.
+static FILE* OpenFileForWriting(const char* fileName)
+{
+#ifdef _MSC_VER
+	FILE* file = NULL;
+	if (fopen_s(&file, fileName, "wb") != 0)
+		return NULL;
+	return file;
+#else
+	return fopen(fileName, "wb");
+#endif
+}
+
+
+ParameterSweep::ParameterSweep()
+{
+	SweepRange springConstants = {PendulumPhysics::springConstant, PendulumPhysics::springConstant, 1};
+	SweepRange dampings = {PendulumPhysics::dampingVelocity, PendulumPhysics::dampingVelocity, 1};
+	SweepRange masses = {1.0f / PendulumPhysics::invMass, 1.0f / PendulumPhysics::invMass, 1};
+	SweepRange displacements = {1.0f, 1.0f, 1};
+	m_springConstants = springConstants;
+	m_dampings = dampings;
+	m_masses = masses;
+	m_displacements = displacements;
+
+	m_duration = 60.0f;
+	m_deltaTime = 1.0f / 120.0f;
+	m_stepsPerSample = 1;
+	m_settlingBand = 0.02f;
+
+	m_threadPool = NULL;
+}
+
+
+// Sets how long every member is simulated, with which time step and after how many steps the metrics are sampled.
+void ParameterSweep::SetDuration(float duration, float deltaTime, int stepsPerSample)
+{
+	m_duration = duration;
+	m_deltaTime = deltaTime;
+	m_stepsPerSample = stepsPerSample > 0 ? stepsPerSample : 1;
+}
+
+
+// Gets the number of members of the sweep.
+long long ParameterSweep::GetNumOfMembers()
+{
+	return static_cast<long long>(m_springConstants.m_numOfValues) * m_dampings.m_numOfValues * m_masses.m_numOfValues * m_displacements.m_numOfValues;
+}
+
+
+// Checks if the ranges describe a sweep that can be simulated.
+// The exact propagator needs a positive spring constant and mass at both ends of their ranges.
+bool ParameterSweep::HasValidRanges()
+{
+	if (m_springConstants.m_numOfValues < 1 || m_dampings.m_numOfValues < 1 || m_masses.m_numOfValues < 1 || m_displacements.m_numOfValues < 1)
+		return false;
+	if (m_springConstants.m_first <= 0.0f || m_springConstants.m_last <= 0.0f || m_masses.m_first <= 0.0f || m_masses.m_last <= 0.0f)
+		return false;
+	return m_deltaTime > 0.0f && m_duration >= 0.0f;
+}
+
+
+// Simulates all members and writes their metrics to the file.
+// The blocks of a wave are independent tasks, and the wave is written in block order after
+// all of them finished, so the file does not depend on the number of threads.
+long long ParameterSweep::Run(const char* fileName)
+{
+	if (!HasValidRanges())
+		return -1;
+
+	FILE* file = OpenFileForWriting(fileName);
+	if (file == NULL)
+		return -1;
+
+	long long numOfMembers = GetNumOfMembers();
+	unsigned int header[3] = {0, SweepFileVersion, NumOfColumns};
+	memcpy(&header[0], "PSWP", 4);
+	bool written = fwrite(header, sizeof(header), 1, file) == 1;
+	for(int column = 0; column < NumOfColumns; ++column)
+	{
+		char name[32] = {0};
+		memcpy(name, ColumnNames[column], strlen(ColumnNames[column]));
+		written = written && fwrite(name, sizeof(name), 1, file) == 1;
+	}
+	written = written && fwrite(&numOfMembers, sizeof(numOfMembers), 1, file) == 1;
+
+	int numOfThreads = m_threadPool != NULL ? m_threadPool->GetNumOfThreads() : 1;
+	int blocksPerWave = numOfThreads * BlocksPerThreadAndWave;
+	for(int column = 0; column < NumOfColumns; ++column)
+		m_waveColumns[column].resize(static_cast<size_t>(blocksPerWave) * PendulumChunkSize);
+
+	long long numOfBlocks = (numOfMembers + PendulumChunkSize - 1) / PendulumChunkSize;
+	for(long long firstBlock = 0; written && firstBlock < numOfBlocks; firstBlock += blocksPerWave)
+	{
+		int waveBlocks = static_cast<int>(numOfBlocks - firstBlock < blocksPerWave ? numOfBlocks - firstBlock : blocksPerWave);
+		auto simulateBlock = [&](int block)
+		{
+			long long firstMember = (firstBlock + block) * PendulumChunkSize;
+			int count = static_cast<int>(numOfMembers - firstMember < PendulumChunkSize ? numOfMembers - firstMember : PendulumChunkSize);
+			SimulateBlock(firstMember, count, block * PendulumChunkSize);
+		};
+
+		if (m_threadPool != NULL)
+			m_threadPool->ParallelFor(waveBlocks, simulateBlock);
+		else
+		{
+			for(int block = 0; block < waveBlocks; ++block)
+				simulateBlock(block);
+		}
+
+		for(int block = 0; written && block < waveBlocks; ++block)
+		{
+			long long firstMember = (firstBlock + block) * PendulumChunkSize;
+			int count = static_cast<int>(numOfMembers - firstMember < PendulumChunkSize ? numOfMembers - firstMember : PendulumChunkSize);
+			written = WriteRowGroup(file, block * PendulumChunkSize, count);
+		}
+	}
+
+	written = fclose(file) == 0 && written;
+	return written ? numOfMembers : -1;
+}
+
+
+// Simulates a block of members and stores their rows at the indicated offset of the wave columns.
+// The metrics are sampled from the state after every sample interval:
+// - the settling time is the time of the last sample that found the bob outside the band,
+// - the peak extension is the largest distance from the anchor,
+// - the energy decay rate is the negative slope of the least squares line through the
+//   logarithm of the mechanical energy over time, until the energy drops to rounding noise.
+void ParameterSweep::SimulateBlock(long long firstMember, int count, int waveOffset)
+{
+	PendulumBatch batch(count);
+	float anchorPoint[3] = {0.0f, 0.0f, 0.0f};
+
+	std::vector<PendulumParameters> parameters(count);
+	std::vector<float> equilibrium(count);
+	std::vector<float> band(count);
+	std::vector<float> lastOutside(count, 0.0f);
+	std::vector<char> outside(count, 0);
+	std::vector<float> peakExtension(count, 0.0f);
+	std::vector<double> initialEnergy(count);
+	// The sums of the energy fit: samples, time, time squared, log energy, time times log energy.
+	std::vector<double> fitSums[5];
+	for(int sum = 0; sum < 5; ++sum)
+		fitSums[sum].assign(count, 0.0);
+	std::vector<char> fitting(count, 1);
+
+	for(int i = 0; i < count; ++i)
+	{
+		long long member = firstMember + i;
+		int displacementIndex = static_cast<int>(member % m_displacements.m_numOfValues);
+		member /= m_displacements.m_numOfValues;
+		int massIndex = static_cast<int>(member % m_masses.m_numOfValues);
+		member /= m_masses.m_numOfValues;
+		int dampingIndex = static_cast<int>(member % m_dampings.m_numOfValues);
+		int springConstantIndex = static_cast<int>(member / m_dampings.m_numOfValues);
+
+		float springConstant = m_springConstants.GetValue(springConstantIndex);
+		float damping = m_dampings.GetValue(dampingIndex);
+		float mass = m_masses.GetValue(massIndex);
+		float displacement = m_displacements.GetValue(displacementIndex);
+		m_waveColumns[ColumnSpringConstant][waveOffset + i] = springConstant;
+		m_waveColumns[ColumnDamping][waveOffset + i] = damping;
+		m_waveColumns[ColumnMass][waveOffset + i] = mass;
+		m_waveColumns[ColumnDisplacement][waveOffset + i] = displacement;
+
+		parameters[i].m_springConstant = springConstant;
+		parameters[i].m_dampingVelocity = damping;
+		parameters[i].m_invMass = 1.0f / mass;
+		equilibrium[i] = parameters[i].m_earthAcceleration / (parameters[i].m_invMass * parameters[i].m_springConstant);
+		band[i] = m_settlingBand * fabsf(displacement);
+
+		batch.AddPendulum(anchorPoint);
+		batch.SetPendulumParameters(i, parameters[i]);
+		float position[3] = {displacement, equilibrium[i], 0.0f};
+		batch.SetPendulumPosition(i, position);
+		initialEnergy[i] = 0.5 * parameters[i].m_springConstant * static_cast<double>(displacement) * displacement;
+	}
+
+	int numOfSteps = static_cast<int>(ceil(m_duration / m_deltaTime));
+	for(int step = 0; step <= numOfSteps; ++step)
+	{
+		if (step > 0)
+			batch.UpdateSimulationExact(m_deltaTime);
+		if (step % m_stepsPerSample != 0 && step != numOfSteps)
+			continue;
+
+		float time = static_cast<float>(static_cast<double>(step) * m_deltaTime);
+		for(int i = 0; i < count; ++i)
+		{
+			float position[3];
+			float velocity[3];
+			batch.ObtainCurrentPosition(i, position);
+			batch.ObtainCurrentVelocity(i, velocity);
+
+			float dx = position[0];
+			float dy = position[1] - equilibrium[i];
+			float dz = position[2];
+			float squaredDistance = dx * dx + dy * dy + dz * dz;
+			outside[i] = squaredDistance > band[i] * band[i];
+			if (outside[i])
+				lastOutside[i] = time;
+
+			float extension = sqrtf(position[0] * position[0] + position[1] * position[1] + position[2] * position[2]);
+			if (extension > peakExtension[i])
+				peakExtension[i] = extension;
+
+			if (!fitting[i])
+				continue;
+			double squaredSpeed = static_cast<double>(velocity[0]) * velocity[0] + static_cast<double>(velocity[1]) * velocity[1] + static_cast<double>(velocity[2]) * velocity[2];
+			double energy = 0.5 * squaredSpeed / parameters[i].m_invMass + 0.5 * parameters[i].m_springConstant * squaredDistance;
+			if (!(energy > EnergyFloor * initialEnergy[i]))
+			{
+				fitting[i] = 0;
+				continue;
+			}
+			double logEnergy = log(energy);
+			fitSums[0][i] += 1.0;
+			fitSums[1][i] += time;
+			fitSums[2][i] += static_cast<double>(time) * time;
+			fitSums[3][i] += logEnergy;
+			fitSums[4][i] += time * logEnergy;
+		}
+	}
+
+	for(int i = 0; i < count; ++i)
+	{
+		// A bob still outside the band at the end did not settle.
+		m_waveColumns[ColumnSettlingTime][waveOffset + i] = outside[i] ? -1.0f : lastOutside[i];
+		m_waveColumns[ColumnPeakExtension][waveOffset + i] = peakExtension[i];
+
+		double samples = fitSums[0][i];
+		double denominator = samples * fitSums[2][i] - fitSums[1][i] * fitSums[1][i];
+		double slope = samples >= 2.0 && denominator > 0.0 ? (samples * fitSums[4][i] - fitSums[1][i] * fitSums[3][i]) / denominator : 0.0;
+		m_waveColumns[ColumnEnergyDecayRate][waveOffset + i] = static_cast<float>(-slope);
+	}
+}
+
+
+// Writes a row group of the wave columns to the file.
+bool ParameterSweep::WriteRowGroup(FILE* file, int waveOffset, int count)
+{
+	unsigned int numOfRows = static_cast<unsigned int>(count);
+	if (fwrite(&numOfRows, sizeof(numOfRows), 1, file) != 1)
+		return false;
+
+	for(int column = 0; column < NumOfColumns; ++column)
+	{
+		if (fwrite(&m_waveColumns[column][waveOffset], sizeof(float), count, file) != static_cast<size_t>(count))
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+
+class WorkStealingPool;
+
+// The values a parameter takes in a sweep, spaced evenly from the first to the last.
+struct SweepRange
+{
+	float m_first;
+	float m_last;
+	int m_numOfValues;
+
+	// Gets the indicated value of the range.
+	float GetValue(int index) const
+	{
+		return m_numOfValues > 1 ? m_first + (m_last - m_first) * static_cast<float>(index) / static_cast<float>(m_numOfValues - 1) : m_first;
+	}
+};
+
+
+// Simulates every combination of spring constant, damping, mass and initial displacement
+// without a window and writes the metrics of every member to a columnar file.
+//
+// Every member starts at rest, displaced sideways from its equilibrium, and is stepped with
+// the exact propagator, so the metrics carry no integration error. The members are cut into
+// blocks of PendulumChunkSize, one block is one task of the thread pool and takes all its steps
+// while it is in the cache. The blocks run in waves and every wave is written before the next
+// starts, so the memory does not grow with the size of the sweep.
+//
+// The file starts with the magic "PSWP", the version and the number of columns as 32 bit
+// integers, a 32 byte name per column and the number of members as a 64 bit integer.
+// Row groups follow, one per block: the number of rows as a 32 bit integer and then every
+// column as that many 32 bit floats. The rows are in the order of the member index, in which
+// the displacement changes fastest and the spring constant slowest.
+class ParameterSweep
+{
+public:
+	// The columns of the file.
+	enum Column
+	{
+		ColumnSpringConstant,
+		ColumnDamping,
+		ColumnMass,
+		ColumnDisplacement,
+		// The time after which the bob stays within the settling band around its equilibrium,
+		// -1 if it did not settle within the duration.
+		ColumnSettlingTime,
+		// The largest distance of the bob from the anchor.
+		ColumnPeakExtension,
+		// The rate of the exponential that fits the decay of the mechanical energy best.
+		ColumnEnergyDecayRate,
+		NumOfColumns
+	};
+
+	ParameterSweep();
+
+	// Sets the values of the parameters. Spring constants and masses have to be positive.
+	void SetSpringConstants(const SweepRange& range) { m_springConstants = range; }
+	void SetDampings(const SweepRange& range) { m_dampings = range; }
+	void SetMasses(const SweepRange& range) { m_masses = range; }
+	void SetDisplacements(const SweepRange& range) { m_displacements = range; }
+
+	// Sets how long every member is simulated, with which time step and after how many steps the metrics are sampled.
+	void SetDuration(float duration, float deltaTime, int stepsPerSample);
+	// Sets the half width of the settling band as a fraction of the initial displacement.
+	void SetSettlingBand(float fraction) { m_settlingBand = fraction; }
+
+	// Sets the thread pool the blocks are distributed on, NULL runs them on the calling thread.
+	void SetThreadPool(WorkStealingPool* threadPool) { m_threadPool = threadPool; }
+
+	// Gets the number of members of the sweep.
+	long long GetNumOfMembers();
+
+	// Simulates all members and writes their metrics to the file.
+	// Returns the number of members written, or -1 if a range is invalid or the file can not be written.
+	long long Run(const char* fileName);
+
+private:
+	SweepRange m_springConstants;
+	SweepRange m_dampings;
+	SweepRange m_masses;
+	SweepRange m_displacements;
+
+	float m_duration;
+	float m_deltaTime;
+	int m_stepsPerSample;
+	float m_settlingBand;
+
+	// The pool the blocks are run on, NULL for the calling thread.
+	WorkStealingPool* m_threadPool;
+
+	// The metrics of a wave of blocks, one column per file column.
+	std::vector<float> m_waveColumns[NumOfColumns];
+
+	// Checks if the ranges describe a sweep that can be simulated.
+	bool HasValidRanges();
+	// Simulates a block of members and stores their rows at the indicated offset of the wave columns.
+	void SimulateBlock(long long firstMember, int count, int waveOffset);
+	// Writes a row group of the wave columns to the file.
+	bool WriteRowGroup(FILE* file, int waveOffset, int count);
+};
@@ -7,6 +7,9 @@
 #include "resource.h"
 #include "SceneRenderer.h"
 #include "PendulumIntegrator.h"
+#include "FixedTimestepDriver.h"
+#include "PickingBvh.h"
+#include "TrajectoryReplay.h"
 #include <math.h>
 
 
@@ -18,6 +21,22 @@
 //--------------------------------------------------------------------------------------
 SceneRenderer* g_sceneRenderer = NULL;
 PendulumIntegrator* g_integrator = NULL;
+FixedTimestepDriver* g_driver = NULL;
+PickingBvh* g_pickingBvh = NULL;
+// A recorded trajectory the first pendulum of is shown instead of the simulation, if one was given.
+TrajectoryReplay* g_replay = NULL;
+// The simulated time of the recording that is shown.
+double g_replayTime = 0.0;
+// How far the page keys seek in the recording.
+const double g_replaySeekTime = 1.0;
+
+// The point the pendulum hangs from.
+float g_anchorPoint[3] = {0.0f, 10.0f, 0.0f};
+
+// The simulation runs at a fixed rate, independent of the frame rate.
+const float g_simulationDeltaTime = 1.0f / 120.0f;
+// After a hitch we catch up with at most this many steps per frame.
+const int g_maxSubstepsPerFrame = 8;
 
 
 //------------------------------------
@@ -63,11 +82,31 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     DXUTSetCallbackFrameMove( OnFrameMove );
 
     DXUTInit( true, true, NULL ); // Parse the command line, show msgboxes on error, no extra command line params
+
+	// A trajectory file on the command line is replayed instead of simulated, quotes around it are dropped.
+	if (lpCmdLine != NULL && lpCmdLine[0] != 0 && lpCmdLine[0] != L'-')
+	{
+		char fileName[MAX_PATH];
+		bool quoted = lpCmdLine[0] == L'"';
+		int length = WideCharToMultiByte(CP_ACP, 0, lpCmdLine + (quoted ? 1 : 0), -1, fileName, MAX_PATH, NULL, NULL);
+		if (quoted && length > 1 && fileName[length - 2] == '"')
+			fileName[length - 2] = 0;
+		g_replay = new TrajectoryReplay();
+		if (length == 0 || !g_replay->Open(fileName) || g_replay->GetNumberOfFrames() == 0 || g_replay->GetNumberOfPendulums() == 0)
+		{
+			delete g_replay;
+			g_replay = NULL;
+		}
+		else
+			g_replayTime = g_replay->GetStartTime();
+	}
+
     DXUTSetCursorSettings( true, true ); // Show the cursor and clip it when in full screen
     DXUTCreateWindow( L"Pendulum Test" );
     DXUTCreateDevice( true, 640, 640 );
     DXUTMainLoop(); // Enter into the DXUT render loop
 
+	delete g_replay;
     return DXUTGetExitCode();
 }
 
@@ -78,9 +117,16 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
 //--------------------------------------------------------------------------------------
 HRESULT CALLBACK OnD3D10CreateDevice( ID3D10Device* pd3dDevice, const DXGI_SURFACE_DESC* pBufferSurfaceDesc, void* pUserContext )
 {
-	float anchorPoint[3] = {0.0f, 10.0f, 0.0f};
-	g_sceneRenderer = new SceneRenderer(pd3dDevice, anchorPoint);
-	g_integrator = new PendulumIntegrator(anchorPoint);
+	g_sceneRenderer = new SceneRenderer(pd3dDevice, g_anchorPoint);
+	g_integrator = new PendulumIntegrator(g_anchorPoint);
+	g_driver = new FixedTimestepDriver(g_integrator, g_simulationDeltaTime, g_maxSubstepsPerFrame);
+
+	float position[3];
+	g_integrator->ObtainCurrentPosition(position);
+	const float* anchorColumns[3] = {&g_anchorPoint[0], &g_anchorPoint[1], &g_anchorPoint[2]};
+	const float* positionColumns[3] = {&position[0], &position[1], &position[2]};
+	g_pickingBvh = new PickingBvh();
+	g_pickingBvh->Build(1, anchorColumns, positionColumns, PendulumPhysics::bobRadius, PendulumPhysics::springRadius);
 	return S_OK;
 }
 
@@ -91,7 +137,9 @@ HRESULT CALLBACK OnD3D10CreateDevice( ID3D10Device* pd3dDevice, const DXGI_SURFA
 void CALLBACK OnD3D10DestroyDevice( void* pUserContext )
 {
 	delete g_sceneRenderer;
+	delete g_driver;
 	delete g_integrator;
+	delete g_pickingBvh;
 }
 
 //--------------------------------------------------------------------------------------
@@ -151,10 +199,23 @@ void CALLBACK OnFrameMove( double fTime, float fElapsedTime, void* pUserContext
 
 	g_sceneRenderer->ChangeCameraPosition(distanceDelta, angleDelta);
 
-	g_integrator->UpdateSimulation(fElapsedTime);
 	float position[3];
-	g_integrator->ObtainCurrentPosition(position);
+	if (g_replay != NULL)
+	{
+		// The recording plays in real time and starts over at its end.
+		g_replayTime += fElapsedTime;
+		if (g_replayTime > g_replay->GetEndTime())
+			g_replayTime = g_replay->GetStartTime();
+		g_replay->ObtainInterpolatedPosition(g_replayTime, 0, position);
+	}
+	else
+	{
+		g_driver->Update(fElapsedTime);
+		g_driver->ObtainInterpolatedPosition(position);
+	}
 	g_sceneRenderer->SetPositionOfSphere(position);
+	g_integrator->ObtainAnchorPoint(g_anchorPoint);
+	g_sceneRenderer->SetAnchorPointOfCylinder(g_anchorPoint);
 }
 
 
@@ -163,18 +224,42 @@ void CALLBACK OnFrameMove( double fTime, float fElapsedTime, void* pUserContext
 //--------------------------------------------------------------------------------------
 void CALLBACK OnMouse( bool bLeftButtonDown, bool bRightButtonDown, bool bMiddleButtonDown, bool bSideButton1Down, bool bSideButton2Down, int nMouseWheelDelta, int xPos, int yPos, void* pUserContext )
 {
-	if (bLeftButtonDown)
+	// A recorded pendulum can not be grabbed.
+	if (bLeftButtonDown && g_replay == NULL)
 	{
 		float distance = g_sceneRenderer->GetCameraDistanceOrigin();
 		float position[3];
 		float direction[3];
 		g_sceneRenderer->GetPickingRay((float)xPos, (float)yPos, position, direction);
 
+		// If the ray hits the pendulum as it is drawn, it is grabbed at that depth.
+		float drawnPosition[3];
+		g_driver->ObtainInterpolatedPosition(drawnPosition);
+		const float* anchorColumns[3] = {&g_anchorPoint[0], &g_anchorPoint[1], &g_anchorPoint[2]};
+		const float* positionColumns[3] = {&drawnPosition[0], &drawnPosition[1], &drawnPosition[2]};
+		g_pickingBvh->Refit(anchorColumns, positionColumns);
+
+		// The bob is moved to the point of the ray closest to its centre, so it does not jump
+		// toward the camera by its radius. The spring is grabbed by the bob as well.
+		PickingHit hit;
+		if (g_pickingBvh->IntersectRay(position, direction, hit))
+		{
+			float alongRay = 0.0f;
+			float squaredLength = 0.0f;
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				alongRay += (drawnPosition[axis] - position[axis]) * direction[axis];
+				squaredLength += direction[axis] * direction[axis];
+			}
+			distance = alongRay / squaredLength;
+		}
+
 		position[0] += direction[0] * distance;
 		position[1] += direction[1] * distance;
 		position[2] += direction[2] * distance;
 
 		g_integrator->SetPendulumPosition(position);
+		g_driver->ResetInterpolation();
 		
 		
 	}
@@ -199,6 +284,18 @@ void CALLBACK OnKeyboard( UINT nChar, bool bKeyDown, bool bAltDown, void* pUserC
 		if (nChar == VK_RIGHT )
 			g_wasRight = true;
 
+		// The page keys seek in a replayed recording, home goes back to its start.
+		if (g_replay != NULL)
+		{
+			if (nChar == VK_PRIOR)
+				g_replayTime -= g_replaySeekTime;
+			if (nChar == VK_NEXT)
+				g_replayTime += g_replaySeekTime;
+			if (nChar == VK_HOME || g_replayTime < g_replay->GetStartTime())
+				g_replayTime = g_replay->GetStartTime();
+			if (g_replayTime > g_replay->GetEndTime())
+				g_replayTime = g_replay->GetEndTime();
+		}
 	}
 	else
 	{
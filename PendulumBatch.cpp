@@ -0,0 +1,1389 @@
+#include "PendulumBatch.h"
+#include "PendulumCheckpoint.h"
+#include "PendulumPhysics.h"
+#include "PendulumKernels.h"
+#include "WorkStealingPool.h"
+#include "AlignedMemory.h"
+#include <math.h>
+#include <string.h>
+
+
+// The number of pendulums the random forces are drawn for at once, their normal numbers take 3 kB of the stack.
+static const int NoiseBlockSize = 256;
+
+
+// Exchanges two entries of a column.
+template <class Type>
+static void SwapValues(Type* column, int first, int second)
+{
+	Type value = column[first];
+	column[first] = column[second];
+	column[second] = value;
+}
+
+
+// Reserves the memory for the indicated number of pendulums.
+PendulumBatch::PendulumBatch(int capacity)
+{
+	m_capacity = capacity;
+	m_numOfPendulums = 0;
+	m_numOfActivePendulums = 0;
+
+	m_slotOfPendulum = static_cast<int*>(AllocateAligned(sizeof(int) * (capacity > 0 ? capacity : 1)));
+	m_pendulumOfSlot = static_cast<int*>(AllocateAligned(sizeof(int) * (capacity > 0 ? capacity : 1)));
+	m_quietSteps = static_cast<int*>(AllocateAligned(sizeof(int) * (capacity > 0 ? capacity : 1)));
+
+	m_sleepingEnabled = false;
+	m_sleepVelocityThreshold = 0.0f;
+	m_sleepDisplacementThreshold = 0.0f;
+	m_sleepQuietSteps = 0;
+
+	m_earthAcceleration = NULL;
+	m_invMass = NULL;
+	m_dampingVelocity = NULL;
+	m_springConstant = NULL;
+
+	for(int column = 0; column < 5; ++column)
+		m_propagatorColumns[column] = NULL;
+	m_propagatorColumnsDeltaTime = -1.0f;
+
+	m_threadPool = NULL;
+
+	m_stepCount = 0;
+	m_simulationTime = 0.0;
+	m_noiseEnabled = false;
+	m_noiseTemperature = 0.0f;
+	m_noiseSeed = 0;
+
+	m_diagnosticsEnabled = false;
+	m_sleepingMomentsOutdated = true;
+	m_latestDiagnostics = 0;
+	m_numOfDiagnostics = 0;
+
+	m_collisionsEnabled = false;
+	m_bobRadius = PendulumPhysics::bobRadius;
+	m_restitution = 0.0f;
+	m_broadphase = &m_hashGrid;
+	m_broadphaseType = BroadphaseHashGrid;
+
+	m_checkpoint = NULL;
+	m_slotsInOrder = true;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_anchorVelocity[axis] = NULL;
+		m_anchorPoint[axis] = AllocateColumn(capacity);
+		m_currentPendulumPosition[axis] = AllocateColumn(capacity);
+		m_currentPendulumVelocity[axis] = AllocateColumn(capacity);
+	}
+}
+
+
+// Frees the columns.
+PendulumBatch::~PendulumBatch()
+{
+	FreeColumns();
+	delete m_checkpoint;
+}
+
+
+// Frees all columns and sets them to NULL.
+void PendulumBatch::FreeColumns()
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		FreeColumn(m_anchorPoint[axis]);
+		FreeColumn(m_anchorVelocity[axis]);
+		FreeColumn(m_currentPendulumPosition[axis]);
+		FreeColumn(m_currentPendulumVelocity[axis]);
+		m_anchorPoint[axis] = NULL;
+		m_anchorVelocity[axis] = NULL;
+		m_currentPendulumPosition[axis] = NULL;
+		m_currentPendulumVelocity[axis] = NULL;
+	}
+
+	FreeColumn(m_earthAcceleration);
+	FreeColumn(m_invMass);
+	FreeColumn(m_dampingVelocity);
+	FreeColumn(m_springConstant);
+	m_earthAcceleration = NULL;
+	m_invMass = NULL;
+	m_dampingVelocity = NULL;
+	m_springConstant = NULL;
+
+	for(int column = 0; column < 5; ++column)
+	{
+		FreeColumn(m_propagatorColumns[column]);
+		m_propagatorColumns[column] = NULL;
+	}
+	m_propagatorColumnsDeltaTime = -1.0f;
+
+	FreeColumn(m_slotOfPendulum);
+	FreeColumn(m_pendulumOfSlot);
+	FreeColumn(m_quietSteps);
+	m_slotOfPendulum = NULL;
+	m_pendulumOfSlot = NULL;
+	m_quietSteps = NULL;
+}
+
+
+// Frees a column unless it lies in the mapping of a restored checkpoint.
+void PendulumBatch::FreeColumn(void* column)
+{
+	if (m_checkpoint == NULL || !m_checkpoint->Contains(column))
+		FreeAligned(column);
+}
+
+
+// Adds a pendulum anchored at the given point and returns its index.
+// As in the PendulumIntegrator the pendulum starts at rest at the anchor point.
+// It starts awake, so it takes the first sleeping slot and that pendulum moves to the end.
+int PendulumBatch::AddPendulum(float anchorPoint[3])
+{
+	if (m_numOfPendulums == m_capacity)
+		return -1;
+
+	int index = m_numOfPendulums++;
+	int slot = index;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_anchorPoint[axis][slot] = anchorPoint[axis];
+		m_currentPendulumPosition[axis][slot] = anchorPoint[axis];
+		m_currentPendulumVelocity[axis][slot] = 0.0f;
+		if (HasMovingAnchors())
+			m_anchorVelocity[axis][slot] = 0.0f;
+	}
+
+	if (HasIndividualParameters())
+	{
+		m_earthAcceleration[slot] = PendulumPhysics::earthAcceleration;
+		m_invMass[slot] = PendulumPhysics::invMass;
+		m_dampingVelocity[slot] = PendulumPhysics::dampingVelocity;
+		m_springConstant[slot] = PendulumPhysics::springConstant;
+		m_propagatorColumnsDeltaTime = -1.0f;
+	}
+
+	m_slotOfPendulum[index] = slot;
+	m_pendulumOfSlot[slot] = index;
+	m_quietSteps[slot] = 0;
+
+	SwapSlots(slot, m_numOfActivePendulums);
+	++m_numOfActivePendulums;
+
+	return index;
+}
+
+
+// Sets the position of the indicated pendulum and resets its velocity.
+void PendulumBatch::SetPendulumPosition(int index, float position[3])
+{
+	WakePendulum(index);
+
+	int slot = m_slotOfPendulum[index];
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_currentPendulumPosition[axis][slot] = position[axis];
+		m_currentPendulumVelocity[axis][slot] = 0.0f;
+	}
+}
+
+
+// Adds the impulse to the indicated pendulum and wakes it up.
+void PendulumBatch::ApplyImpulse(int index, float impulse[3])
+{
+	WakePendulum(index);
+
+	int slot = m_slotOfPendulum[index];
+	float invMass = HasIndividualParameters() ? m_invMass[slot] : PendulumPhysics::invMass;
+	for(int axis = 0; axis < 3; ++axis)
+		m_currentPendulumVelocity[axis][slot] += invMass * impulse[axis];
+}
+
+
+// Moves the anchors of the indicated pendulums and gives them the velocities.
+// The anchors are written through the slot map in the order of the indices, so indices
+// that follow the slots of the pendulums keep the writes sequential.
+void PendulumBatch::SetAnchorMotions(int count, const int* indices, const float* const anchorPoint[3], const float* const anchorVelocity[3])
+{
+	if (!HasMovingAnchors())
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_anchorVelocity[axis] = AllocateColumn(m_capacity);
+			for(int slot = 0; slot < m_numOfPendulums; ++slot)
+				m_anchorVelocity[axis][slot] = 0.0f;
+		}
+	}
+
+	for(int i = 0; i < count; ++i)
+	{
+		int index = indices[i];
+		int slot = m_slotOfPendulum[index];
+		if (slot >= m_numOfActivePendulums)
+		{
+			bool moves = false;
+			for(int axis = 0; axis < 3; ++axis)
+				moves = moves || anchorVelocity[axis][i] != 0.0f || anchorPoint[axis][i] != m_anchorPoint[axis][slot];
+			if (moves)
+			{
+				WakePendulum(index);
+				slot = m_slotOfPendulum[index];
+			}
+		}
+
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_anchorPoint[axis][slot] = anchorPoint[axis][i];
+			m_anchorVelocity[axis][slot] = anchorVelocity[axis][i];
+		}
+	}
+}
+
+
+// Updates the simulation of all pendulums.
+void PendulumBatch::UpdateSimulation(float deltaTime)
+{
+	Step(deltaTime, 1);
+}
+
+
+// Advances all pendulums by the indicated number of steps.
+// The pendulums do not interact, so every chunk can take all steps while it is in the cache
+// and the chunks can run on any thread in any order. Colliding bobs do interact, so with
+// collisions every step is finished by all chunks before the contacts are resolved.
+void PendulumBatch::Step(float deltaTime, int steps)
+{
+	if (m_collisionsEnabled && steps > 1)
+	{
+		for(int step = 0; step < steps; ++step)
+			Step(deltaTime, 1);
+		return;
+	}
+
+	int numOfChunks = (m_numOfActivePendulums + PendulumChunkSize - 1) / PendulumChunkSize;
+	bool fuseDiagnostics = PrepareChunkMoments();
+	PrepareEvents();
+
+	// On the calling thread the chunks take their steps one after the other as well.
+	if (m_threadPool == NULL || numOfChunks < 2)
+	{
+		for(int begin = 0; begin < m_numOfActivePendulums; begin += PendulumChunkSize)
+		{
+			int end = begin + PendulumChunkSize < m_numOfActivePendulums ? begin + PendulumChunkSize : m_numOfActivePendulums;
+			StepRange(begin, end, deltaTime, steps, fuseDiagnostics);
+		}
+		FinishSteps(deltaTime, steps);
+
+		if (m_collisionsEnabled)
+			ResolveCollisions();
+		if (m_diagnosticsEnabled)
+			RecordDiagnostics();
+		PutQuietPendulumsToSleep();
+		return;
+	}
+
+	// In the deterministic mode the workers round exactly like the calling thread.
+	bool deterministic = PendulumKernels::IsDeterministic();
+	unsigned int floatingPointState = PendulumKernels::ObtainFloatingPointState();
+
+	m_threadPool->ParallelFor(numOfChunks, [&](int chunk)
+	{
+		unsigned int workerState = PendulumKernels::ObtainFloatingPointState();
+		if (deterministic)
+			PendulumKernels::SetFloatingPointState(floatingPointState);
+
+		int begin = chunk * PendulumChunkSize;
+		int end = begin + PendulumChunkSize < m_numOfActivePendulums ? begin + PendulumChunkSize : m_numOfActivePendulums;
+		StepRange(begin, end, deltaTime, steps, fuseDiagnostics);
+
+		if (deterministic)
+			PendulumKernels::SetFloatingPointState(workerState);
+	});
+	FinishSteps(deltaTime, steps);
+
+	if (m_collisionsEnabled)
+		ResolveCollisions();
+	if (m_diagnosticsEnabled)
+		RecordDiagnostics();
+	PutQuietPendulumsToSleep();
+}
+
+
+// Advances a range of pendulums by the indicated number of steps.
+// The force model separates per axis, so every axis is a single streaming pass
+// through the vectorized kernel chosen at startup. The kernels have the constants built in,
+// individual parameters and moving anchors go through the generic loop.
+// The kernels sum up the moments of the last step on the way, unless the noise changes the
+// velocities afterwards, then they are summed up over the chunk after the noise.
+void PendulumBatch::StepRange(int begin, int end, float deltaTime, int steps, bool sumMoments)
+{
+	EventScratch eventScratch;
+	if (HasIndividualParameters())
+	{
+		ColumnParameters parameters = GetColumnParameters();
+		for(int step = 0; step < steps; ++step)
+		{
+			BeginEventStep(begin, end, eventScratch);
+			UpdateRange<ExplicitEulerScheme>(begin, end, deltaTime, parameters);
+			if (m_noiseEnabled)
+				ApplyNoise(begin, end, deltaTime, m_stepCount + step);
+			EndEventStep(begin, end, deltaTime, step, eventScratch);
+			if (m_sleepingEnabled)
+				CountQuietSteps(begin, end);
+		}
+		if (sumMoments)
+			AccumulateChunkMoments(begin, end);
+		return;
+	}
+
+	if (HasMovingAnchors())
+	{
+		for(int step = 0; step < steps; ++step)
+		{
+			BeginEventStep(begin, end, eventScratch);
+			UpdateRange<ExplicitEulerScheme>(begin, end, deltaTime, UniformParameters());
+			if (m_noiseEnabled)
+				ApplyNoise(begin, end, deltaTime, m_stepCount + step);
+			EndEventStep(begin, end, deltaTime, step, eventScratch);
+			if (m_sleepingEnabled)
+				CountQuietSteps(begin, end);
+		}
+		if (sumMoments)
+			AccumulateChunkMoments(begin, end);
+		return;
+	}
+
+	const float gravity[3] = {0.0f, PendulumPhysics::earthAcceleration, 0.0f};
+	EulerAxisKernel updateAxis = PendulumKernels::GetEulerAxisKernel();
+	bool sumAxisMoments = sumMoments && !m_noiseEnabled;
+	for(int step = 0; step < steps; ++step)
+	{
+		BeginEventStep(begin, end, eventScratch);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float lanes[NumOfAxisMoments][MomentLanes] = {};
+			bool sumLanes = sumAxisMoments && step == steps - 1;
+			updateAxis(end - begin, gravity[axis], deltaTime, m_anchorPoint[axis] + begin, m_currentPendulumPosition[axis] + begin, m_currentPendulumVelocity[axis] + begin, sumLanes ? lanes : NULL);
+			if (sumLanes)
+				StoreAxisMoments(axis, begin, lanes);
+		}
+		if (m_noiseEnabled)
+			ApplyNoise(begin, end, deltaTime, m_stepCount + step);
+		EndEventStep(begin, end, deltaTime, step, eventScratch);
+		if (m_sleepingEnabled)
+			CountQuietSteps(begin, end);
+	}
+	if (sumMoments && !sumAxisMoments)
+		AccumulateChunkMoments(begin, end);
+}
+
+
+// Updates the simulation of all pendulums with the exact propagator of the time step.
+// The chunks are finished one after the other, so the noise and the diagnostics find them in the cache.
+void PendulumBatch::UpdateSimulationExact(float deltaTime)
+{
+	if (HasIndividualParameters())
+		UpdatePropagatorColumns(deltaTime);
+	const PendulumPropagator& uniformPropagator = m_propagatorCache.Find(PendulumParameters(), deltaTime);
+
+	bool fuseDiagnostics = PrepareChunkMoments();
+	PrepareEvents();
+	EventScratch eventScratch;
+	for(int begin = 0; begin < m_numOfActivePendulums; begin += PendulumChunkSize)
+	{
+		int end = begin + PendulumChunkSize < m_numOfActivePendulums ? begin + PendulumChunkSize : m_numOfActivePendulums;
+		BeginEventStep(begin, end, eventScratch);
+		PropagateRange(begin, end, deltaTime, uniformPropagator, fuseDiagnostics && !m_noiseEnabled);
+
+		if (m_noiseEnabled)
+			ApplyNoise(begin, end, deltaTime, m_stepCount);
+		EndEventStep(begin, end, deltaTime, 0, eventScratch);
+		if (fuseDiagnostics && m_noiseEnabled)
+			AccumulateChunkMoments(begin, end);
+	}
+	FinishSteps(deltaTime, 1);
+
+	if (m_collisionsEnabled)
+		ResolveCollisions();
+	if (m_diagnosticsEnabled)
+		RecordDiagnostics();
+
+	if (m_sleepingEnabled)
+	{
+		CountQuietSteps(0, m_numOfActivePendulums);
+		PutQuietPendulumsToSleep();
+	}
+}
+
+
+// Applies the propagators of the time step to a range of pendulums and optionally sums up their moments.
+// Relative to an anchor that moves with constant velocity the pendulum follows the same
+// homogeneous equation as for a fixed one, so the propagator is applied to the displacement
+// and the velocity relative to the anchor, and the anchor moves on by its velocity.
+void PendulumBatch::PropagateRange(int begin, int end, float deltaTime, const PendulumPropagator& uniformPropagator, bool sumMoments)
+{
+	if (HasMovingAnchors())
+	{
+		if (HasIndividualParameters())
+			PropagateMovingAnchors<true>(begin, end, deltaTime, uniformPropagator);
+		else
+			PropagateMovingAnchors<false>(begin, end, deltaTime, uniformPropagator);
+	}
+	else if (HasIndividualParameters())
+	{
+		const float* __restrict m00 = m_propagatorColumns[0];
+		const float* __restrict m01 = m_propagatorColumns[1];
+		const float* __restrict m10 = m_propagatorColumns[2];
+		const float* __restrict m11 = m_propagatorColumns[3];
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			const float* __restrict anchor = m_anchorPoint[axis];
+			const float* __restrict offset = m_propagatorColumns[4];
+			float* __restrict position = m_currentPendulumPosition[axis];
+			float* __restrict velocity = m_currentPendulumVelocity[axis];
+			for(int i = begin; i < end; ++i)
+			{
+				float equilibrium = axis == 1 ? anchor[i] + offset[i] : anchor[i];
+				float displacement = position[i] - equilibrium;
+				float v = velocity[i];
+				position[i] = equilibrium + (m00[i] * displacement + m01[i] * v);
+				velocity[i] = m10[i] * displacement + m11[i] * v;
+			}
+		}
+	}
+	else
+	{
+		// The kernel sums up the moments on the way.
+		PropagatorAxisKernel propagateAxis = PendulumKernels::GetPropagatorAxisKernel();
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float lanes[NumOfAxisMoments][MomentLanes] = {};
+			propagateAxis(end - begin, uniformPropagator.m_transition, uniformPropagator.m_equilibriumOffset[axis], m_anchorPoint[axis] + begin, m_currentPendulumPosition[axis] + begin, m_currentPendulumVelocity[axis] + begin, sumMoments ? lanes : NULL);
+			if (sumMoments)
+				StoreAxisMoments(axis, begin, lanes);
+		}
+		return;
+	}
+
+	if (sumMoments)
+		AccumulateChunkMoments(begin, end);
+}
+
+
+// Applies the propagators to a range of pendulums relative to their moving anchors and moves the anchors on.
+// The uniform propagator is used unless the pendulums have individual parameters.
+template <bool IndividualParameters>
+void PendulumBatch::PropagateMovingAnchors(int begin, int end, float deltaTime, const PendulumPropagator& uniformPropagator)
+{
+	const float u00 = uniformPropagator.m_transition[0];
+	const float u01 = uniformPropagator.m_transition[1];
+	const float u10 = uniformPropagator.m_transition[2];
+	const float u11 = uniformPropagator.m_transition[3];
+	const float* __restrict m00 = m_propagatorColumns[0];
+	const float* __restrict m01 = m_propagatorColumns[1];
+	const float* __restrict m10 = m_propagatorColumns[2];
+	const float* __restrict m11 = m_propagatorColumns[3];
+	const float* __restrict offsets = m_propagatorColumns[4];
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float uniformOffset = uniformPropagator.m_equilibriumOffset[axis];
+		float* __restrict anchor = m_anchorPoint[axis];
+		const float* __restrict anchorVelocity = m_anchorVelocity[axis];
+		float* __restrict position = m_currentPendulumPosition[axis];
+		float* __restrict velocity = m_currentPendulumVelocity[axis];
+		for(int i = begin; i < end; ++i)
+		{
+			float offset = IndividualParameters ? (axis == 1 ? offsets[i] : 0.0f) : uniformOffset;
+			float displacement = position[i] - (anchor[i] + offset);
+			float v = velocity[i] - anchorVelocity[i];
+			anchor[i] += anchorVelocity[i] * deltaTime;
+			position[i] = (anchor[i] + offset) + ((IndividualParameters ? m00[i] : u00) * displacement + (IndividualParameters ? m01[i] : u01) * v);
+			velocity[i] = anchorVelocity[i] + ((IndividualParameters ? m10[i] : u10) * displacement + (IndividualParameters ? m11[i] : u11) * v);
+		}
+	}
+}
+
+
+// Obtains the current position of the indicated pendulum.
+void PendulumBatch::ObtainCurrentPosition(int index, float position[3])
+{
+	int slot = m_slotOfPendulum[index];
+	position[0] = m_currentPendulumPosition[0][slot];
+	position[1] = m_currentPendulumPosition[1][slot];
+	position[2] = m_currentPendulumPosition[2][slot];
+}
+
+
+// Obtains the current velocity of the indicated pendulum.
+void PendulumBatch::ObtainCurrentVelocity(int index, float velocity[3])
+{
+	int slot = m_slotOfPendulum[index];
+	velocity[0] = m_currentPendulumVelocity[0][slot];
+	velocity[1] = m_currentPendulumVelocity[1][slot];
+	velocity[2] = m_currentPendulumVelocity[2][slot];
+}
+
+
+// Obtains the current position of the anchor of the indicated pendulum.
+void PendulumBatch::ObtainAnchorPoint(int index, float anchorPoint[3])
+{
+	int slot = m_slotOfPendulum[index];
+	anchorPoint[0] = m_anchorPoint[0][slot];
+	anchorPoint[1] = m_anchorPoint[1][slot];
+	anchorPoint[2] = m_anchorPoint[2][slot];
+}
+
+
+// Obtains the current positions and optionally the velocities of all pendulums in the order of their indices.
+void PendulumBatch::ObtainCurrentStates(float* const positions[3], float* const velocities[3])
+{
+	// Until sleeping moved a pendulum the columns already are in the order of the indices.
+	if (m_slotsInOrder)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			memcpy(positions[axis], m_currentPendulumPosition[axis], sizeof(float) * m_numOfPendulums);
+			if (velocities != NULL)
+				memcpy(velocities[axis], m_currentPendulumVelocity[axis], sizeof(float) * m_numOfPendulums);
+		}
+		return;
+	}
+
+	const int* __restrict slotOfPendulum = m_slotOfPendulum;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float* __restrict position = m_currentPendulumPosition[axis];
+		float* __restrict destination = positions[axis];
+		for(int i = 0; i < m_numOfPendulums; ++i)
+			destination[i] = position[slotOfPendulum[i]];
+	}
+
+	if (velocities == NULL)
+		return;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float* __restrict velocity = m_currentPendulumVelocity[axis];
+		float* __restrict destination = velocities[axis];
+		for(int i = 0; i < m_numOfPendulums; ++i)
+			destination[i] = velocity[slotOfPendulum[i]];
+	}
+}
+
+
+// Adds a random force to every bob after every step.
+// All pendulums are woken up, a sleeping pendulum would not feel the heat bath.
+void PendulumBatch::EnableNoise(float temperature, unsigned int seed)
+{
+	m_noiseEnabled = true;
+	m_noiseTemperature = temperature;
+	m_noiseSeed = seed;
+
+	for(int slot = m_numOfActivePendulums; slot < m_numOfPendulums; ++slot)
+		m_quietSteps[slot] = 0;
+	m_numOfActivePendulums = m_numOfPendulums;
+	m_sleepingMomentsOutdated = true;
+}
+
+
+// Adds the random velocity changes of the indicated step to a range of pendulums.
+// The step is split like in the Euler-Maruyama scheme: the deterministic step is followed by
+// a velocity change with the standard deviation the fluctuation dissipation theorem asks for,
+// sqrt(2 * damping * temperature * time step) / mass, so the damping and the noise balance at
+// the temperature. The normal numbers are drawn per pendulum index, not per slot, and in small
+// blocks that are used while they are still in the cache.
+void PendulumBatch::ApplyNoise(int begin, int end, float deltaTime, unsigned long long step)
+{
+	GaussianNoiseKernel drawNoise = PendulumKernels::GetGaussianNoiseKernel();
+	const float variance = 2.0f * m_noiseTemperature * deltaTime;
+	const float uniformScale = PendulumPhysics::invMass * sqrtf(variance * PendulumPhysics::dampingVelocity);
+
+	float noise[3][NoiseBlockSize];
+	for(int blockBegin = begin; blockBegin < end; blockBegin += NoiseBlockSize)
+	{
+		int blockEnd = end - blockBegin < NoiseBlockSize ? end : blockBegin + NoiseBlockSize;
+		drawNoise(blockEnd - blockBegin, m_pendulumOfSlot + blockBegin, step, m_noiseSeed, noise[0], noise[1], noise[2]);
+
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			const float* __restrict blockNoise = noise[axis] - blockBegin;
+			float* __restrict velocity = m_currentPendulumVelocity[axis];
+			if (HasIndividualParameters())
+			{
+				const float* __restrict invMass = m_invMass;
+				const float* __restrict damping = m_dampingVelocity;
+				for(int i = blockBegin; i < blockEnd; ++i)
+					velocity[i] += invMass[i] * sqrtf(variance * damping[i]) * blockNoise[i];
+			}
+			else
+			{
+				for(int i = blockBegin; i < blockEnd; ++i)
+					velocity[i] += uniformScale * blockNoise[i];
+			}
+		}
+	}
+}
+
+
+// Sums up the partial sums of a moment in a fixed tree.
+static double SumLanes(const float lanes[MomentLanes])
+{
+	double sums[MomentLanes];
+	for(int lane = 0; lane < MomentLanes; ++lane)
+		sums[lane] = lanes[lane];
+	for(int width = MomentLanes / 2; width > 0; width /= 2)
+	{
+		for(int lane = 0; lane < width; ++lane)
+			sums[lane] += sums[lane + width];
+	}
+	return sums[0];
+}
+
+
+// Records the energy and momentum after every update and keeps the last ones.
+void PendulumBatch::EnableDiagnostics(int historyLength)
+{
+	m_diagnosticsEnabled = true;
+	m_diagnosticsHistory.resize(historyLength > 0 ? historyLength : 1);
+	m_latestDiagnostics = 0;
+	m_numOfDiagnostics = 0;
+	m_sleepingMomentsOutdated = true;
+
+	// Without collisions RecordDiagnostics expects the moments of the chunks to be summed up already.
+	if (PrepareChunkMoments())
+	{
+		for(int begin = 0; begin < m_numOfActivePendulums; begin += PendulumChunkSize)
+			AccumulateChunkMoments(begin, begin + PendulumChunkSize < m_numOfActivePendulums ? begin + PendulumChunkSize : m_numOfActivePendulums);
+	}
+	RecordDiagnostics();
+}
+
+
+// Stops recording and clears the history.
+void PendulumBatch::DisableDiagnostics()
+{
+	m_diagnosticsEnabled = false;
+	m_numOfDiagnostics = 0;
+}
+
+
+// Gets the diagnostics recorded the indicated number of records ago.
+const PendulumDiagnostics& PendulumBatch::GetDiagnostics(int age)
+{
+	int size = static_cast<int>(m_diagnosticsHistory.size());
+	return m_diagnosticsHistory[(m_latestDiagnostics - age % size + size) % size];
+}
+
+
+// Makes room for the moments of the active chunks and tells if the steps should sum them up.
+bool PendulumBatch::PrepareChunkMoments()
+{
+	if (!m_diagnosticsEnabled)
+		return false;
+
+	m_chunkMoments.resize((m_numOfActivePendulums + PendulumChunkSize - 1) / PendulumChunkSize);
+	return !m_collisionsEnabled;
+}
+
+
+// Sums up the moments of a chunk of active pendulums.
+void PendulumBatch::AccumulateChunkMoments(int begin, int end)
+{
+	for(int axis = 0; axis < 3; ++axis)
+		AccumulateAxisMoments(axis, begin, end);
+}
+
+
+// Sums up the moments of one axis of a chunk of active pendulums.
+// The parameters are constants unless the pendulums have their own, then the moments are
+// weighted per pendulum with the same partial sums as in the kernels.
+void PendulumBatch::AccumulateAxisMoments(int axis, int begin, int end)
+{
+	double* moments = m_chunkMoments[begin / PendulumChunkSize].m_sums[axis];
+	const float* __restrict anchor = m_anchorPoint[axis];
+	const float* __restrict position = m_currentPendulumPosition[axis];
+	const float* __restrict velocity = m_currentPendulumVelocity[axis];
+	float lanes[NumOfAxisMoments][MomentLanes] = {};
+
+	if (HasIndividualParameters())
+	{
+		for(int i = begin; i < end; ++i)
+		{
+			int lane = (i - begin) % MomentLanes;
+			float mass = 1.0f / m_invMass[i];
+			float gravity = axis == 1 ? m_earthAcceleration[i] : 0.0f;
+			float extension = position[i] - anchor[i];
+			lanes[AxisMomentVelocity][lane] += mass * velocity[i];
+			lanes[AxisMomentSquaredVelocity][lane] += mass * (velocity[i] * velocity[i]);
+			lanes[AxisMomentPosition][lane] += -(mass * gravity) * position[i];
+			lanes[AxisMomentSquaredExtension][lane] += m_springConstant[i] * (extension * extension);
+		}
+		for(int moment = 0; moment < NumOfAxisMoments; ++moment)
+			moments[moment] = SumLanes(lanes[moment]);
+		return;
+	}
+
+	AxisMomentsKernel sumAxis = PendulumKernels::GetAxisMomentsKernel();
+	sumAxis(end - begin, anchor + begin, position + begin, velocity + begin, lanes);
+	StoreAxisMoments(axis, begin, lanes);
+}
+
+
+// Weighs the partial sums of one axis of a chunk with the uniform parameters and stores their totals.
+void PendulumBatch::StoreAxisMoments(int axis, int begin, float lanes[NumOfAxisMoments][MomentLanes])
+{
+	double* moments = m_chunkMoments[begin / PendulumChunkSize].m_sums[axis];
+	const double mass = 1.0 / PendulumPhysics::invMass;
+	const double weights[NumOfAxisMoments] = {mass, mass, axis == 1 ? -mass * PendulumPhysics::earthAcceleration : 0.0, PendulumPhysics::springConstant};
+	for(int moment = 0; moment < NumOfAxisMoments; ++moment)
+		moments[moment] = weights[moment] * SumLanes(lanes[moment]);
+}
+
+
+// Adds the moments of the pendulum in the indicated slot.
+void PendulumBatch::AddSlotMoments(int slot, WeightedMoments& moments)
+{
+	PendulumParameters parameters;
+	ObtainSlotParameters(slot, parameters);
+	double mass = 1.0 / parameters.m_invMass;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		double position = m_currentPendulumPosition[axis][slot];
+		double velocity = m_currentPendulumVelocity[axis][slot];
+		double extension = position - m_anchorPoint[axis][slot];
+		double gravity = axis == 1 ? parameters.m_earthAcceleration : 0.0;
+		moments.m_sums[axis][AxisMomentVelocity] += mass * velocity;
+		moments.m_sums[axis][AxisMomentSquaredVelocity] += mass * velocity * velocity;
+		moments.m_sums[axis][AxisMomentPosition] += -mass * gravity * position;
+		moments.m_sums[axis][AxisMomentSquaredExtension] += parameters.m_springConstant * extension * extension;
+	}
+}
+
+
+// Takes the motion of the pendulum in the indicated slot out of the latest diagnostics,
+// as it is put to sleep and loses its velocity after they were recorded.
+void PendulumBatch::RemoveSlotMotion(int slot)
+{
+	if (m_numOfDiagnostics == 0)
+		return;
+
+	PendulumParameters parameters;
+	ObtainSlotParameters(slot, parameters);
+	double mass = 1.0 / parameters.m_invMass;
+
+	PendulumDiagnostics& diagnostics = m_diagnosticsHistory[m_latestDiagnostics];
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		double velocity = m_currentPendulumVelocity[axis][slot];
+		diagnostics.m_kineticEnergy -= 0.5 * mass * velocity * velocity;
+		diagnostics.m_momentum[axis] -= mass * velocity;
+	}
+}
+
+
+// Combines the moments of the chunks and of the sleeping pendulums into the diagnostics of the step.
+// The chunks are added pairwise in a fixed tree, so the result does not depend on which thread
+// summed up which chunk. With collisions the moments are only summed up now, after the contacts.
+void PendulumBatch::RecordDiagnostics()
+{
+	if (m_collisionsEnabled)
+	{
+		m_chunkMoments.resize((m_numOfActivePendulums + PendulumChunkSize - 1) / PendulumChunkSize);
+		for(int begin = 0; begin < m_numOfActivePendulums; begin += PendulumChunkSize)
+			AccumulateChunkMoments(begin, begin + PendulumChunkSize < m_numOfActivePendulums ? begin + PendulumChunkSize : m_numOfActivePendulums);
+	}
+
+	if (m_sleepingMomentsOutdated)
+	{
+		m_sleepingMoments = WeightedMoments();
+		for(int slot = m_numOfActivePendulums; slot < m_numOfPendulums; ++slot)
+			AddSlotMoments(slot, m_sleepingMoments);
+		m_sleepingMomentsOutdated = false;
+	}
+
+	int numOfSums = static_cast<int>(m_chunkMoments.size());
+	while (numOfSums > 1)
+	{
+		int half = numOfSums / 2;
+		for(int sum = 0; sum < half; ++sum)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				for(int moment = 0; moment < NumOfAxisMoments; ++moment)
+					m_chunkMoments[sum].m_sums[axis][moment] = m_chunkMoments[2 * sum].m_sums[axis][moment] + m_chunkMoments[2 * sum + 1].m_sums[axis][moment];
+			}
+		}
+		if (numOfSums % 2 != 0)
+			m_chunkMoments[half] = m_chunkMoments[numOfSums - 1];
+		numOfSums = half + numOfSums % 2;
+	}
+
+	WeightedMoments total = m_sleepingMoments;
+	if (numOfSums > 0)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			for(int moment = 0; moment < NumOfAxisMoments; ++moment)
+				total.m_sums[axis][moment] += m_chunkMoments[0].m_sums[axis][moment];
+		}
+	}
+
+	m_latestDiagnostics = (m_latestDiagnostics + 1) % static_cast<int>(m_diagnosticsHistory.size());
+	if (m_numOfDiagnostics < static_cast<int>(m_diagnosticsHistory.size()))
+		++m_numOfDiagnostics;
+
+	PendulumDiagnostics& diagnostics = m_diagnosticsHistory[m_latestDiagnostics];
+	diagnostics.m_step = m_stepCount;
+	diagnostics.m_kineticEnergy = 0.0;
+	diagnostics.m_springEnergy = 0.0;
+	diagnostics.m_gravitationalEnergy = 0.0;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		diagnostics.m_kineticEnergy += 0.5 * total.m_sums[axis][AxisMomentSquaredVelocity];
+		diagnostics.m_springEnergy += 0.5 * total.m_sums[axis][AxisMomentSquaredExtension];
+		diagnostics.m_gravitationalEnergy += total.m_sums[axis][AxisMomentPosition];
+		diagnostics.m_momentum[axis] = total.m_sums[axis][AxisMomentVelocity];
+	}
+}
+
+
+// Makes room for the events of the active chunks.
+void PendulumBatch::PrepareEvents()
+{
+	if (m_eventDetector.HasPredicates())
+		m_eventDetector.PrepareChunks((m_numOfActivePendulums + PendulumChunkSize - 1) / PendulumChunkSize);
+}
+
+
+// Remembers the state of a chunk before a step if any predicate is watched.
+void PendulumBatch::BeginEventStep(int begin, int end, EventScratch& scratch)
+{
+	if (!m_eventDetector.HasPredicates())
+		return;
+
+	EventColumns columns = GetEventColumns();
+	m_eventDetector.BeginStep(columns, begin, end, scratch);
+}
+
+
+// Finds the events of a chunk in the indicated step of the current update.
+// The steps of the update start at the time simulated so far, which is only moved on after all chunks are done.
+void PendulumBatch::EndEventStep(int begin, int end, float deltaTime, int step, EventScratch& scratch)
+{
+	if (!m_eventDetector.HasPredicates())
+		return;
+
+	EventColumns columns = GetEventColumns();
+	double startTime = m_simulationTime + static_cast<double>(deltaTime) * step;
+	m_eventDetector.EndStep(columns, begin, end, begin / PendulumChunkSize, startTime, deltaTime, m_stepCount + step, scratch);
+}
+
+
+// Merges the events of the chunks and counts the steps of the update.
+void PendulumBatch::FinishSteps(float deltaTime, int steps)
+{
+	if (m_eventDetector.HasPredicates())
+		m_eventDetector.MergeChunkEvents();
+
+	m_stepCount += steps;
+	m_simulationTime += static_cast<double>(deltaTime) * steps;
+}
+
+
+// Gets the columns the events are detected on.
+EventColumns PendulumBatch::GetEventColumns()
+{
+	EventColumns columns;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		columns.m_anchorPoint[axis] = m_anchorPoint[axis];
+		columns.m_anchorVelocity[axis] = m_anchorVelocity[axis];
+		columns.m_position[axis] = m_currentPendulumPosition[axis];
+		columns.m_velocity[axis] = m_currentPendulumVelocity[axis];
+	}
+	columns.m_pendulumOfSlot = m_pendulumOfSlot;
+	return columns;
+}
+
+
+// Lets the bobs collide as spheres of the indicated radius after every step.
+void PendulumBatch::EnableCollisions(float bobRadius, float restitution)
+{
+	m_collisionsEnabled = true;
+	m_bobRadius = bobRadius;
+	m_restitution = restitution;
+}
+
+
+// Chooses how the overlapping bobs are found.
+void PendulumBatch::SetBroadphase(BroadphaseType type)
+{
+	m_broadphaseType = type;
+	if (type == BroadphaseSweepAndPrune)
+		m_broadphase = &m_sweepAndPrune;
+	else
+		m_broadphase = &m_hashGrid;
+}
+
+
+// Pushes overlapping bobs apart and lets them bounce off.
+// Both broadphases stay linear in the number of bobs: the grid is rebuilt with a single
+// counting sort, the sweep and prune only repairs the order of the last step. The contacts are resolved one after the other
+// in the order the grid reports them, which does not depend on the threads.
+void PendulumBatch::ResolveCollisions()
+{
+	const float contactDistance = 2.0f * m_bobRadius;
+	// Overlaps below this depth are left alone, so bobs resting against each other do not keep waking up.
+	const float allowedPenetration = 0.01f * m_bobRadius;
+
+	m_broadphase->FindPairs(m_numOfPendulums, m_currentPendulumPosition, contactDistance, m_contacts);
+
+	m_pendulumsToWake.clear();
+	for(size_t contact = 0; contact < m_contacts.size(); ++contact)
+	{
+		int first = m_contacts[contact].m_first;
+		int second = m_contacts[contact].m_second;
+		bool firstSleeps = first >= m_numOfActivePendulums;
+		bool secondSleeps = second >= m_numOfActivePendulums;
+		if (firstSleeps && secondSleeps)
+			continue;
+
+		float normal[3];
+		float squaredLength = 0.0f;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			normal[axis] = m_currentPendulumPosition[axis][second] - m_currentPendulumPosition[axis][first];
+			squaredLength += normal[axis] * normal[axis];
+		}
+
+		// Bobs at the same point are separated vertically.
+		float length = sqrtf(squaredLength);
+		if (length > 0.0f)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+				normal[axis] /= length;
+		}
+		else
+		{
+			normal[0] = 0.0f;
+			normal[1] = 1.0f;
+			normal[2] = 0.0f;
+		}
+
+		float firstInvMass = HasIndividualParameters() ? m_invMass[first] : PendulumPhysics::invMass;
+		float secondInvMass = HasIndividualParameters() ? m_invMass[second] : PendulumPhysics::invMass;
+		float invMassSum = firstInvMass + secondInvMass;
+		if (invMassSum <= 0.0f)
+			continue;
+
+		bool touched = false;
+
+		float penetration = contactDistance - length;
+		if (penetration > allowedPenetration)
+		{
+			float correction = penetration / invMassSum;
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				m_currentPendulumPosition[axis][first] -= correction * firstInvMass * normal[axis];
+				m_currentPendulumPosition[axis][second] += correction * secondInvMass * normal[axis];
+			}
+			touched = true;
+		}
+
+		float approach = 0.0f;
+		for(int axis = 0; axis < 3; ++axis)
+			approach += (m_currentPendulumVelocity[axis][second] - m_currentPendulumVelocity[axis][first]) * normal[axis];
+		if (approach < 0.0f)
+		{
+			float impulse = -(1.0f + m_restitution) * approach / invMassSum;
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				m_currentPendulumVelocity[axis][first] -= impulse * firstInvMass * normal[axis];
+				m_currentPendulumVelocity[axis][second] += impulse * secondInvMass * normal[axis];
+			}
+			touched = true;
+		}
+
+		if (!touched)
+			continue;
+
+		// The quiet steps were counted before the contacts, so a touched pendulum that is awake
+		// starts counting again; else it could fall asleep right away and lose the impulse.
+		// Waking moves slots, so it waits until all contacts are done.
+		if (firstSleeps)
+			m_pendulumsToWake.push_back(m_pendulumOfSlot[first]);
+		else
+			m_quietSteps[first] = 0;
+		if (secondSleeps)
+			m_pendulumsToWake.push_back(m_pendulumOfSlot[second]);
+		else
+			m_quietSteps[second] = 0;
+	}
+
+	for(size_t index = 0; index < m_pendulumsToWake.size(); ++index)
+		WakePendulum(m_pendulumsToWake[index]);
+}
+
+
+// Lets pendulums sleep after they were quiet for the indicated number of steps.
+void PendulumBatch::EnableSleeping(float velocityThreshold, float displacementThreshold, int quietSteps)
+{
+	m_sleepingEnabled = true;
+	m_sleepVelocityThreshold = velocityThreshold;
+	m_sleepDisplacementThreshold = displacementThreshold;
+	m_sleepQuietSteps = quietSteps;
+
+	for(int slot = 0; slot < m_numOfPendulums; ++slot)
+		m_quietSteps[slot] = 0;
+}
+
+
+// Wakes all pendulums and stops putting them to sleep.
+void PendulumBatch::DisableSleeping()
+{
+	m_sleepingEnabled = false;
+	m_numOfActivePendulums = m_numOfPendulums;
+	m_sleepingMomentsOutdated = true;
+}
+
+
+// Wakes the indicated pendulum up by moving it to the first sleeping slot.
+void PendulumBatch::WakePendulum(int index)
+{
+	int slot = m_slotOfPendulum[index];
+	if (slot < m_numOfActivePendulums)
+	{
+		m_quietSteps[slot] = 0;
+		return;
+	}
+
+	SwapSlots(slot, m_numOfActivePendulums);
+	m_quietSteps[m_numOfActivePendulums] = 0;
+	++m_numOfActivePendulums;
+	m_sleepingMomentsOutdated = true;
+}
+
+
+// Counts the steps the pendulums in a range of slots have been quiet for.
+// A pendulum is quiet if it is slow and close to the point where the spring carries it.
+// A pendulum whose anchor moves is never quiet, sleeping would stop its anchor.
+void PendulumBatch::CountQuietSteps(int begin, int end)
+{
+	const float velocityThreshold = m_sleepVelocityThreshold * m_sleepVelocityThreshold;
+	const float displacementThreshold = m_sleepDisplacementThreshold * m_sleepDisplacementThreshold;
+	const float uniformOffset = PendulumPhysics::earthAcceleration / (PendulumPhysics::invMass * PendulumPhysics::springConstant);
+
+	for(int slot = begin; slot < end; ++slot)
+	{
+		// Without a spring there is no equilibrium, the offset is not finite then and the pendulum never sleeps.
+		float offset = HasIndividualParameters() ? m_earthAcceleration[slot] / (m_invMass[slot] * m_springConstant[slot]) : uniformOffset;
+
+		float dx = m_currentPendulumPosition[0][slot] - m_anchorPoint[0][slot];
+		float dy = m_currentPendulumPosition[1][slot] - (m_anchorPoint[1][slot] + offset);
+		float dz = m_currentPendulumPosition[2][slot] - m_anchorPoint[2][slot];
+		float vx = m_currentPendulumVelocity[0][slot];
+		float vy = m_currentPendulumVelocity[1][slot];
+		float vz = m_currentPendulumVelocity[2][slot];
+
+		bool quiet = vx * vx + vy * vy + vz * vz < velocityThreshold && dx * dx + dy * dy + dz * dz < displacementThreshold;
+		if (HasMovingAnchors())
+			quiet = quiet && m_anchorVelocity[0][slot] == 0.0f && m_anchorVelocity[1][slot] == 0.0f && m_anchorVelocity[2][slot] == 0.0f;
+		quiet = quiet && !m_noiseEnabled;
+		m_quietSteps[slot] = quiet ? m_quietSteps[slot] + 1 : 0;
+	}
+}
+
+
+// Moves the pendulums that were quiet long enough behind the active ones.
+// The last active pendulum takes the free slot, so the active slots stay contiguous.
+void PendulumBatch::PutQuietPendulumsToSleep()
+{
+	if (!m_sleepingEnabled)
+		return;
+
+	int slot = 0;
+	while (slot < m_numOfActivePendulums)
+	{
+		if (m_quietSteps[slot] < m_sleepQuietSteps)
+		{
+			++slot;
+			continue;
+		}
+
+		if (m_diagnosticsEnabled)
+			RemoveSlotMotion(slot);
+		for(int axis = 0; axis < 3; ++axis)
+			m_currentPendulumVelocity[axis][slot] = 0.0f;
+		if (m_diagnosticsEnabled)
+			AddSlotMoments(slot, m_sleepingMoments);
+
+		--m_numOfActivePendulums;
+		SwapSlots(slot, m_numOfActivePendulums);
+	}
+}
+
+
+// Exchanges the content of two slots.
+void PendulumBatch::SwapSlots(int first, int second)
+{
+	if (first == second)
+		return;
+	m_slotsInOrder = false;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		SwapValues(m_anchorPoint[axis], first, second);
+		SwapValues(m_currentPendulumPosition[axis], first, second);
+		SwapValues(m_currentPendulumVelocity[axis], first, second);
+		if (HasMovingAnchors())
+			SwapValues(m_anchorVelocity[axis], first, second);
+	}
+
+	if (HasIndividualParameters())
+	{
+		SwapValues(m_earthAcceleration, first, second);
+		SwapValues(m_invMass, first, second);
+		SwapValues(m_dampingVelocity, first, second);
+		SwapValues(m_springConstant, first, second);
+	}
+
+	if (m_propagatorColumns[0] != NULL)
+	{
+		for(int column = 0; column < 5; ++column)
+			SwapValues(m_propagatorColumns[column], first, second);
+	}
+
+	SwapValues(m_quietSteps, first, second);
+	SwapValues(m_pendulumOfSlot, first, second);
+	m_slotOfPendulum[m_pendulumOfSlot[first]] = first;
+	m_slotOfPendulum[m_pendulumOfSlot[second]] = second;
+}
+
+
+// Writes the complete state to a checkpoint file.
+bool PendulumBatch::SaveCheckpoint(const char* fileName)
+{
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	header.m_numOfPendulums = m_numOfPendulums;
+	header.m_numOfActivePendulums = m_numOfActivePendulums;
+	header.m_flags = (m_sleepingEnabled ? CheckpointSleeping : 0) | (m_noiseEnabled ? CheckpointNoise : 0) | (m_collisionsEnabled ? CheckpointCollisions : 0);
+	header.m_broadphaseType = m_broadphaseType;
+	header.m_stepCount = m_stepCount;
+	header.m_simulationTime = m_simulationTime;
+	header.m_sleepVelocityThreshold = m_sleepVelocityThreshold;
+	header.m_sleepDisplacementThreshold = m_sleepDisplacementThreshold;
+	header.m_sleepQuietSteps = m_sleepQuietSteps;
+	header.m_noiseTemperature = m_noiseTemperature;
+	header.m_noiseSeed = m_noiseSeed;
+	header.m_bobRadius = m_bobRadius;
+	header.m_restitution = m_restitution;
+
+	const void* columns[NumOfCheckpointColumns];
+	columns[CheckpointSlotOfPendulum] = m_slotOfPendulum;
+	columns[CheckpointPendulumOfSlot] = m_pendulumOfSlot;
+	columns[CheckpointQuietSteps] = m_quietSteps;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		columns[CheckpointAnchorPoint + axis] = m_anchorPoint[axis];
+		columns[CheckpointAnchorVelocity + axis] = m_anchorVelocity[axis];
+		columns[CheckpointPosition + axis] = m_currentPendulumPosition[axis];
+		columns[CheckpointVelocity + axis] = m_currentPendulumVelocity[axis];
+	}
+	columns[CheckpointEarthAcceleration] = m_earthAcceleration;
+	columns[CheckpointInvMass] = m_invMass;
+	columns[CheckpointDampingVelocity] = m_dampingVelocity;
+	columns[CheckpointSpringConstant] = m_springConstant;
+
+	return WriteCheckpoint(fileName, header, columns);
+}
+
+
+// Replaces the state with that of a checkpoint file, the columns point into its mapping.
+// The propagator columns are computed again on the next exact update, and the diagnostics
+// start a new history with the restored state.
+bool PendulumBatch::RestoreCheckpoint(const char* fileName, bool verifyChecksum)
+{
+	CheckpointMapping* checkpoint = new CheckpointMapping();
+	if (!checkpoint->Open(fileName, verifyChecksum))
+	{
+		delete checkpoint;
+		return false;
+	}
+
+	FreeColumns();
+	delete m_checkpoint;
+	m_checkpoint = checkpoint;
+
+	const CheckpointHeader& header = checkpoint->GetHeader();
+	m_capacity = header.m_numOfPendulums;
+	m_numOfPendulums = header.m_numOfPendulums;
+	m_numOfActivePendulums = header.m_numOfActivePendulums;
+
+	m_slotOfPendulum = static_cast<int*>(checkpoint->GetColumn(CheckpointSlotOfPendulum));
+	m_pendulumOfSlot = static_cast<int*>(checkpoint->GetColumn(CheckpointPendulumOfSlot));
+	m_quietSteps = static_cast<int*>(checkpoint->GetColumn(CheckpointQuietSteps));
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_anchorPoint[axis] = static_cast<float*>(checkpoint->GetColumn(CheckpointAnchorPoint + axis));
+		m_anchorVelocity[axis] = static_cast<float*>(checkpoint->GetColumn(CheckpointAnchorVelocity + axis));
+		m_currentPendulumPosition[axis] = static_cast<float*>(checkpoint->GetColumn(CheckpointPosition + axis));
+		m_currentPendulumVelocity[axis] = static_cast<float*>(checkpoint->GetColumn(CheckpointVelocity + axis));
+	}
+	m_earthAcceleration = static_cast<float*>(checkpoint->GetColumn(CheckpointEarthAcceleration));
+	m_invMass = static_cast<float*>(checkpoint->GetColumn(CheckpointInvMass));
+	m_dampingVelocity = static_cast<float*>(checkpoint->GetColumn(CheckpointDampingVelocity));
+	m_springConstant = static_cast<float*>(checkpoint->GetColumn(CheckpointSpringConstant));
+
+	m_slotsInOrder = true;
+	for(int index = 0; index < m_numOfPendulums; ++index)
+	{
+		if (m_slotOfPendulum[index] != index)
+			m_slotsInOrder = false;
+	}
+
+	m_stepCount = header.m_stepCount;
+	m_simulationTime = header.m_simulationTime;
+	m_sleepingEnabled = (header.m_flags & CheckpointSleeping) != 0;
+	m_sleepVelocityThreshold = header.m_sleepVelocityThreshold;
+	m_sleepDisplacementThreshold = header.m_sleepDisplacementThreshold;
+	m_sleepQuietSteps = header.m_sleepQuietSteps;
+	m_noiseEnabled = (header.m_flags & CheckpointNoise) != 0;
+	m_noiseTemperature = header.m_noiseTemperature;
+	m_noiseSeed = header.m_noiseSeed;
+	m_collisionsEnabled = (header.m_flags & CheckpointCollisions) != 0;
+	m_bobRadius = header.m_bobRadius;
+	m_restitution = header.m_restitution;
+	SetBroadphase(header.m_broadphaseType == BroadphaseSweepAndPrune ? BroadphaseSweepAndPrune : BroadphaseHashGrid);
+
+	m_sleepingMomentsOutdated = true;
+	if (m_diagnosticsEnabled)
+		EnableDiagnostics(static_cast<int>(m_diagnosticsHistory.size()));
+	return true;
+}
+
+
+// Computes a hash over the bits of all positions and velocities.
+// Two runs that agree in every bit have the same hash, which is what regression runs compare.
+// The pendulums are visited by index, so the order of the slots does not matter.
+unsigned long long PendulumBatch::ComputeStateHash()
+{
+	const unsigned long long prime = 1099511628211ULL;
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const unsigned int* positionBits = reinterpret_cast<const unsigned int*>(m_currentPendulumPosition[axis]);
+		const unsigned int* velocityBits = reinterpret_cast<const unsigned int*>(m_currentPendulumVelocity[axis]);
+		for(int index = 0; index < m_numOfPendulums; ++index)
+		{
+			int slot = m_slotOfPendulum[index];
+			hash = (hash ^ positionBits[slot]) * prime;
+			hash = (hash ^ velocityBits[slot]) * prime;
+		}
+	}
+
+	return hash;
+}
+
+
+// Sets the physical parameters of the indicated pendulum.
+void PendulumBatch::SetPendulumParameters(int index, const PendulumParameters& parameters)
+{
+	if (!HasIndividualParameters())
+	{
+		PendulumParameters defaults;
+		if (parameters.m_earthAcceleration == defaults.m_earthAcceleration && parameters.m_invMass == defaults.m_invMass &&
+			parameters.m_dampingVelocity == defaults.m_dampingVelocity && parameters.m_springConstant == defaults.m_springConstant)
+			return;
+
+		CreateParameterColumns();
+	}
+
+	int slot = m_slotOfPendulum[index];
+	m_earthAcceleration[slot] = parameters.m_earthAcceleration;
+	m_invMass[slot] = parameters.m_invMass;
+	m_dampingVelocity[slot] = parameters.m_dampingVelocity;
+	m_springConstant[slot] = parameters.m_springConstant;
+	m_propagatorColumnsDeltaTime = -1.0f;
+
+	// Other parameters move the equilibrium, so the pendulum has to find its rest again.
+	WakePendulum(index);
+}
+
+
+// Obtains the physical parameters of the indicated pendulum.
+void PendulumBatch::ObtainPendulumParameters(int index, PendulumParameters& parameters)
+{
+	ObtainSlotParameters(m_slotOfPendulum[index], parameters);
+}
+
+
+// Obtains the physical parameters of the pendulum in the indicated slot.
+void PendulumBatch::ObtainSlotParameters(int slot, PendulumParameters& parameters)
+{
+	parameters = PendulumParameters();
+	if (!HasIndividualParameters())
+		return;
+
+	parameters.m_earthAcceleration = m_earthAcceleration[slot];
+	parameters.m_invMass = m_invMass[slot];
+	parameters.m_dampingVelocity = m_dampingVelocity[slot];
+	parameters.m_springConstant = m_springConstant[slot];
+}
+
+
+// Creates the parameter columns, filled with the constants.
+void PendulumBatch::CreateParameterColumns()
+{
+	m_earthAcceleration = AllocateColumn(m_capacity);
+	m_invMass = AllocateColumn(m_capacity);
+	m_dampingVelocity = AllocateColumn(m_capacity);
+	m_springConstant = AllocateColumn(m_capacity);
+
+	for(int i = 0; i < m_numOfPendulums; ++i)
+	{
+		m_earthAcceleration[i] = PendulumPhysics::earthAcceleration;
+		m_invMass[i] = PendulumPhysics::invMass;
+		m_dampingVelocity[i] = PendulumPhysics::dampingVelocity;
+		m_springConstant[i] = PendulumPhysics::springConstant;
+	}
+}
+
+
+// Gets the parameter columns for the batched integrators.
+ColumnParameters PendulumBatch::GetColumnParameters()
+{
+	ColumnParameters parameters = {m_earthAcceleration, m_invMass, m_dampingVelocity, m_springConstant};
+	return parameters;
+}
+
+
+// Fills the propagator columns for the indicated time step.
+// Pendulums with equal parameters share the propagator from the cache, so a fleet built
+// from a few designs only computes a few matrices.
+void PendulumBatch::UpdatePropagatorColumns(float deltaTime)
+{
+	if (m_propagatorColumnsDeltaTime == deltaTime)
+		return;
+
+	if (m_propagatorColumns[0] == NULL)
+	{
+		for(int column = 0; column < 5; ++column)
+			m_propagatorColumns[column] = AllocateColumn(m_capacity);
+	}
+
+	for(int i = 0; i < m_numOfPendulums; ++i)
+	{
+		PendulumParameters parameters;
+		ObtainSlotParameters(i, parameters);
+		const PendulumPropagator& propagator = m_propagatorCache.Find(parameters, deltaTime);
+
+		for(int entry = 0; entry < 4; ++entry)
+			m_propagatorColumns[entry][i] = propagator.m_transition[entry];
+		m_propagatorColumns[4][i] = propagator.m_equilibriumOffset[1];
+	}
+
+	m_propagatorColumnsDeltaTime = deltaTime;
+}
@@ -0,0 +1,422 @@
+#pragma once
+
+#include "IntegrationSchemes.h"
+#include "PendulumEvents.h"
+#include "PendulumKernels.h"
+#include "PendulumPropagator.h"
+#include "SpatialHashGrid.h"
+#include "SweepAndPrune.h"
+#include <stddef.h>
+#include <vector>
+
+class WorkStealingPool;
+class CheckpointMapping;
+
+// The number of pendulums stepped as one unit of work. The nine state columns of a chunk
+// take 72 kB, which stays in the L2 cache of every core while it takes all its steps.
+const int PendulumChunkSize = 2048;
+
+// The energy and momentum of all pendulums of a batch after a step. The gravitational energy
+// is zero at the height 0, the spring energy at the anchor, the spring has no rest length.
+struct PendulumDiagnostics
+{
+	// The number of steps the batch had taken.
+	unsigned long long m_step;
+	double m_kineticEnergy;
+	double m_springEnergy;
+	double m_gravitationalEnergy;
+	double m_momentum[3];
+
+	// Gets the sum of the energies.
+	double GetTotalEnergy() const { return m_kineticEnergy + m_springEnergy + m_gravitationalEnergy; }
+};
+
+// Integrates a whole set of pendulums at once. Other than the PendulumIntegrator
+// the state is kept as one contiguous column per axis, so one update walks
+// linear memory and the inner loop can be vectorized by the compiler.
+// With sleeping enabled, pendulums that came to rest are moved behind the active ones,
+// so the columns are ordered by slot and the pendulum indices are mapped to slots.
+class PendulumBatch
+{
+public:
+	// Reserves the memory for the indicated number of pendulums.
+	PendulumBatch(int capacity);
+	~PendulumBatch();
+
+	// Adds a pendulum anchored at the given point and returns its index.
+	int AddPendulum(float anchorPoint[3]);
+
+	// Sets the position of the indicated pendulum and resets its velocity.
+	// A sleeping pendulum is woken up.
+	void SetPendulumPosition(int index, float position[3]);
+
+	// Adds the impulse to the indicated pendulum and wakes it up.
+	void ApplyImpulse(int index, float impulse[3]);
+
+	// Moves the anchors of the indicated pendulums to the positions and gives them the velocities,
+	// one column per axis. The anchors keep moving with their velocity during the following steps
+	// and the damping acts on the velocity relative to the anchor. A sleeping pendulum whose anchor
+	// moves is woken up. Until this is first called all anchors are fixed and no velocity columns exist.
+	void SetAnchorMotions(int count, const int* indices, const float* const anchorPoint[3], const float* const anchorVelocity[3]);
+	// Checks if any anchor was ever given a motion.
+	bool HasMovingAnchors() { return m_anchorVelocity[0] != NULL; }
+
+	// Updates the simulation of all pendulums.
+	void UpdateSimulation(float deltaTime);
+
+	// Advances all pendulums by the indicated number of steps, on the thread pool if one is set.
+	// Pendulums do not interact and the chunks are fixed, so the result does not depend on the
+	// number of threads. With PendulumKernels::SetDeterministic it does not depend on the
+	// vector width either.
+	void Step(float deltaTime, int steps);
+
+	// Sets the thread pool the steps are distributed on, NULL runs them on the calling thread.
+	void SetThreadPool(WorkStealingPool* threadPool) { m_threadPool = threadPool; m_hashGrid.SetThreadPool(threadPool); m_sweepAndPrune.SetThreadPool(threadPool); }
+
+	// Updates the simulation of all pendulums with the indicated integration scheme.
+	// The chunks are finished one after the other, so the noise and the diagnostics find them in the cache.
+	template <class IntegrationScheme>
+	void UpdateSimulation(float deltaTime)
+	{
+		bool fuseDiagnostics = PrepareChunkMoments();
+		PrepareEvents();
+		EventScratch eventScratch;
+		for(int begin = 0; begin < m_numOfActivePendulums; begin += PendulumChunkSize)
+		{
+			int end = begin + PendulumChunkSize < m_numOfActivePendulums ? begin + PendulumChunkSize : m_numOfActivePendulums;
+			BeginEventStep(begin, end, eventScratch);
+			if (HasIndividualParameters())
+				UpdateRange<IntegrationScheme>(begin, end, deltaTime, GetColumnParameters());
+			else
+				UpdateRange<IntegrationScheme>(begin, end, deltaTime, UniformParameters());
+
+			if (m_noiseEnabled)
+				ApplyNoise(begin, end, deltaTime, m_stepCount);
+			EndEventStep(begin, end, deltaTime, 0, eventScratch);
+			if (fuseDiagnostics)
+				AccumulateChunkMoments(begin, end);
+		}
+		FinishSteps(deltaTime, 1);
+
+		if (m_collisionsEnabled)
+			ResolveCollisions();
+		if (m_diagnosticsEnabled)
+			RecordDiagnostics();
+
+		if (m_sleepingEnabled)
+		{
+			CountQuietSteps(0, m_numOfActivePendulums);
+			PutQuietPendulumsToSleep();
+		}
+	}
+
+	// Updates the simulation of all pendulums with the exact propagator of the time step.
+	// The result carries no integration error and costs about as much as an Euler step.
+	// This holds for anchors moving with constant velocity during the step as well.
+	// Every pendulum needs a positive spring constant and inverse mass for this.
+	void UpdateSimulationExact(float deltaTime);
+
+	// Sets the physical parameters of the indicated pendulum.
+	// As long as all pendulums use the default constants no parameter columns exist.
+	void SetPendulumParameters(int index, const PendulumParameters& parameters);
+	// Obtains the physical parameters of the indicated pendulum.
+	void ObtainPendulumParameters(int index, PendulumParameters& parameters);
+
+	// Checks if the pendulums have their own parameters or all use the constants.
+	bool HasIndividualParameters() { return m_invMass != NULL; }
+
+	// Lets pendulums sleep after their speed and their distance from the equilibrium stayed
+	// below the thresholds for the indicated number of steps. Sleeping pendulums are not
+	// integrated until they are moved or get an impulse.
+	void EnableSleeping(float velocityThreshold, float displacementThreshold, int quietSteps);
+	// Wakes all pendulums and stops putting them to sleep.
+	void DisableSleeping();
+
+	// Wakes the indicated pendulum up.
+	void WakePendulum(int index);
+	// Checks if the indicated pendulum sleeps.
+	bool IsSleeping(int index) { return m_slotOfPendulum[index] >= m_numOfActivePendulums; }
+	// Gets the number of pendulums that are integrated.
+	int GetNumOfActivePendulums() { return m_numOfActivePendulums; }
+
+	// Lets the bobs collide as spheres of the indicated radius after every step. Overlapping
+	// bobs are pushed apart and bounce off with the restitution, 0 for plastic and 1 for
+	// elastic contacts. Sleeping bobs that are hit wake up.
+	void EnableCollisions(float bobRadius, float restitution);
+	// Lets the bobs pass through each other again.
+	void DisableCollisions() { m_collisionsEnabled = false; }
+	// Chooses how the overlapping bobs are found, the hash grid is the default.
+	void SetBroadphase(BroadphaseType type);
+	// Gets the broadphase the collisions run with.
+	BroadphaseType GetBroadphase() { return m_broadphaseType; }
+	// Gets the number of contacts resolved in the last step.
+	int GetNumOfContacts() { return static_cast<int>(m_contacts.size()); }
+
+	// Adds a random force to every bob after every step, which together with the damping
+	// is a Langevin thermostat: the bobs jiggle like in a heat bath of the indicated temperature,
+	// in units of energy, and every axis ends up with a mean energy of half of it. The force of a
+	// bob only depends on its index, the number of the step and the seed, so the result does not
+	// depend on the threads or on other pendulums. Bobs with noise do not sleep.
+	void EnableNoise(float temperature, unsigned int seed);
+	// Stops the random forces.
+	void DisableNoise() { m_noiseEnabled = false; }
+	// Gets the number of steps taken so far, the random forces of a step are keyed by it.
+	unsigned long long GetStepCount() { return m_stepCount; }
+	// Gets the time simulated so far.
+	double GetSimulationTime() { return m_simulationTime; }
+
+	// Reports an event whenever the predicate of an awake bob changes its sign during a step,
+	// with the time and the state refined to the root within the step. Returns the number of the
+	// predicate or -1 if it is incomplete. Changes made between the updates, by collisions,
+	// impulses or moving the bobs, are not watched.
+	int AddEventPredicate(const EventPredicate& predicate) { return m_eventDetector.AddPredicate(predicate); }
+	// Stops watching all predicates.
+	void ClearEventPredicates() { m_eventDetector.ClearPredicates(); }
+	// Gets the number of events found since they were last cleared.
+	int GetNumOfEvents() { return m_eventDetector.GetNumOfEvents(); }
+	// Gets the indicated event. They are ordered by time and the order does not depend on the threads.
+	const PendulumEvent& GetEvent(int index) { return m_eventDetector.GetEvent(index); }
+	// Forgets the events found so far.
+	void ClearEvents() { m_eventDetector.ClearEvents(); }
+
+	// Records the energy and momentum of all pendulums after every update, the last ones are kept
+	// in a history of the indicated length. The state at the time of the call is recorded first.
+	// The sums are taken by the stepping loops while a chunk is still in the cache and reduced
+	// in a fixed order, so they do not depend on the threads or the vector width.
+	// Step records once per call, after the last of its steps.
+	void EnableDiagnostics(int historyLength);
+	// Stops recording and clears the history.
+	void DisableDiagnostics();
+	// Gets the number of diagnostics in the history.
+	int GetNumOfDiagnostics() { return m_numOfDiagnostics; }
+	// Gets the diagnostics recorded the indicated number of records ago, 0 for the latest.
+	const PendulumDiagnostics& GetDiagnostics(int age);
+
+	// Obtains the current position of the indicated pendulum.
+	void ObtainCurrentPosition(int index, float position[3]);
+	// Obtains the current velocity of the indicated pendulum.
+	void ObtainCurrentVelocity(int index, float velocity[3]);
+	// Obtains the current position of the anchor of the indicated pendulum.
+	void ObtainAnchorPoint(int index, float anchorPoint[3]);
+	// Obtains the current positions and optionally the velocities of all pendulums, one column
+	// per axis in the order of the pendulum indices. The velocities can be NULL.
+	void ObtainCurrentStates(float* const positions[3], float* const velocities[3]);
+
+	// Writes the complete state to a checkpoint file: the columns of all pendulums with their
+	// slots, the number of steps and the time simulated so far and the settings of sleeping,
+	// noise and collisions. The diagnostics, the events and the thread pool are not part of it.
+	// Returns false if the file could not be written.
+	bool SaveCheckpoint(const char* fileName);
+	// Replaces the state with that of a checkpoint file. The file is mapped copy on write and the
+	// columns are used right where they are, so nothing is parsed or copied and every page is read
+	// from the file when it is first touched. The capacity becomes the number of pendulums in it.
+	// With verification the checksum is compared first, which reads the whole file. Returns false
+	// and keeps the state if the file is no intact checkpoint of this version.
+	bool RestoreCheckpoint(const char* fileName, bool verifyChecksum);
+
+	// Computes a hash over the bits of all positions and velocities.
+	unsigned long long ComputeStateHash();
+
+	// Gets the number of pendulums in the batch.
+	int GetNumberOfPendulums() { return m_numOfPendulums; }
+
+private:
+	PendulumBatch(const PendulumBatch&) = delete;
+	PendulumBatch& operator=(const PendulumBatch&) = delete;
+
+	// The number of pendulums we have memory for.
+	int m_capacity;
+	// The number of pendulums in use.
+	int m_numOfPendulums;
+	// The number of pendulums that are awake, they occupy the first slots.
+	int m_numOfActivePendulums;
+
+	// The slot of every pendulum and the pendulum in every slot.
+	int* m_slotOfPendulum;
+	int* m_pendulumOfSlot;
+	// Whether every pendulum is still in the slot of its index, which no swap has changed yet.
+	bool m_slotsInOrder;
+
+	// Whether quiet pendulums are put to sleep.
+	bool m_sleepingEnabled;
+	// The speed below which a pendulum counts as quiet.
+	float m_sleepVelocityThreshold;
+	// The distance from the equilibrium below which a pendulum counts as quiet.
+	float m_sleepDisplacementThreshold;
+	// The number of quiet steps after which a pendulum goes to sleep.
+	int m_sleepQuietSteps;
+	// The number of steps every slot has been quiet for.
+	int* m_quietSteps;
+
+	// The positions where the pendulums are anchored, one column per axis.
+	float* m_anchorPoint[3];
+	// The velocities of the anchors, one column per axis. NULL while all anchors are fixed.
+	float* m_anchorVelocity[3];
+	// The current positions of the pendulums, one column per axis.
+	float* m_currentPendulumPosition[3];
+	// The current velocities of the pendulums, one column per axis.
+	float* m_currentPendulumVelocity[3];
+
+	// The individual parameters, one column per parameter. NULL while all pendulums use the constants.
+	float* m_earthAcceleration;
+	float* m_invMass;
+	float* m_dampingVelocity;
+	float* m_springConstant;
+
+	// The propagators for the time steps used so far.
+	PropagatorCache m_propagatorCache;
+	// The propagator of every pendulum for individual parameters: the four matrix
+	// entries and the vertical equilibrium offset. NULL until first needed.
+	float* m_propagatorColumns[5];
+	// The time step the propagator columns were computed for, negative if they are outdated.
+	float m_propagatorColumnsDeltaTime;
+
+	// The pool the chunks are stepped on, NULL for the calling thread.
+	WorkStealingPool* m_threadPool;
+
+	// The number of steps taken so far and the time they covered.
+	unsigned long long m_stepCount;
+	double m_simulationTime;
+	// Whether the bobs get random forces, with which temperature and seed.
+	bool m_noiseEnabled;
+	float m_noiseTemperature;
+	unsigned int m_noiseSeed;
+
+	// The moments of a set of pendulums per axis, weighted to be physical quantities: the momentum,
+	// twice the kinetic energy, the gravitational energy and twice the spring energy.
+	struct WeightedMoments
+	{
+		double m_sums[3][NumOfAxisMoments];
+	};
+
+	// Whether the diagnostics are recorded.
+	bool m_diagnosticsEnabled;
+	// The moments of every chunk of active pendulums in the current step.
+	std::vector<WeightedMoments> m_chunkMoments;
+	// The moments of the sleeping pendulums, and whether they have to be summed up again
+	// because a pendulum woke up. Pendulums that fall asleep are added one by one.
+	WeightedMoments m_sleepingMoments;
+	bool m_sleepingMomentsOutdated;
+	// The recorded diagnostics as a ring buffer and the position of the latest in it.
+	std::vector<PendulumDiagnostics> m_diagnosticsHistory;
+	int m_latestDiagnostics;
+	int m_numOfDiagnostics;
+
+	// Whether the bobs collide, with which radius and restitution.
+	bool m_collisionsEnabled;
+	float m_bobRadius;
+	float m_restitution;
+	// The broadphases that find the overlapping bobs and the one in use.
+	SpatialHashGrid m_hashGrid;
+	SweepAndPrune m_sweepAndPrune;
+	Broadphase* m_broadphase;
+	BroadphaseType m_broadphaseType;
+	// The pairs of slots that overlapped in the last step.
+	std::vector<CollisionPair> m_contacts;
+	// The pendulums hit by a contact while they were sleeping.
+	std::vector<int> m_pendulumsToWake;
+
+	// Finds the sign changes of the event predicates.
+	EventDetector m_eventDetector;
+
+	// The checkpoint the columns were restored from, NULL if they were all allocated.
+	CheckpointMapping* m_checkpoint;
+
+	// Frees all columns and sets them to NULL, those of a restored checkpoint stay in its mapping.
+	void FreeColumns();
+	// Frees a column unless it lies in the mapping of a restored checkpoint.
+	void FreeColumn(void* column);
+
+	// Advances a range of pendulums by the indicated number of steps and optionally sums up the moments of the last one.
+	void StepRange(int begin, int end, float deltaTime, int steps, bool sumMoments);
+
+	// Pushes overlapping bobs apart and lets them bounce off.
+	void ResolveCollisions();
+	// Adds the random velocity changes of the indicated step to a range of pendulums.
+	void ApplyNoise(int begin, int end, float deltaTime, unsigned long long step);
+
+	// Makes room for the moments of the active chunks. Returns whether the steps should sum
+	// them up, which is not worth it with collisions as the contacts change the state afterwards.
+	bool PrepareChunkMoments();
+	// Sums up the moments of a chunk of active pendulums, the range has to start at a chunk.
+	void AccumulateChunkMoments(int begin, int end);
+	// Sums up the moments of one axis of a chunk of active pendulums.
+	void AccumulateAxisMoments(int axis, int begin, int end);
+	// Weighs the partial sums of one axis of a chunk with the uniform parameters and stores their totals.
+	void StoreAxisMoments(int axis, int begin, float lanes[NumOfAxisMoments][MomentLanes]);
+	// Adds the moments of the pendulum in the indicated slot.
+	void AddSlotMoments(int slot, WeightedMoments& moments);
+	// Takes the motion of the pendulum in the indicated slot out of the latest diagnostics.
+	void RemoveSlotMotion(int slot);
+	// Combines the moments of the chunks and of the sleeping pendulums into the diagnostics of the step.
+	void RecordDiagnostics();
+
+	// Makes room for the events of the active chunks.
+	void PrepareEvents();
+	// Remembers the state of a chunk before a step if any predicate is watched.
+	void BeginEventStep(int begin, int end, EventScratch& scratch);
+	// Finds the events of a chunk in the indicated step of the current update.
+	void EndEventStep(int begin, int end, float deltaTime, int step, EventScratch& scratch);
+	// Merges the events of the chunks and counts the steps of the update.
+	void FinishSteps(float deltaTime, int steps);
+	// Gets the columns the events are detected on.
+	EventColumns GetEventColumns();
+
+	// Counts the steps the pendulums in a range of slots have been quiet for.
+	void CountQuietSteps(int begin, int end);
+	// Moves the pendulums that were quiet long enough behind the active ones.
+	void PutQuietPendulumsToSleep();
+	// Exchanges the content of two slots.
+	void SwapSlots(int first, int second);
+
+	// Creates the parameter columns, filled with the constants.
+	void CreateParameterColumns();
+	// Obtains the physical parameters of the pendulum in the indicated slot.
+	void ObtainSlotParameters(int slot, PendulumParameters& parameters);
+	// Gets the parameter columns for the batched integrators.
+	ColumnParameters GetColumnParameters();
+	// Fills the propagator columns for the indicated time step.
+	void UpdatePropagatorColumns(float deltaTime);
+	// Applies the propagators of the time step to a range of pendulums and optionally sums up their moments.
+	void PropagateRange(int begin, int end, float deltaTime, const PendulumPropagator& uniformPropagator, bool sumMoments);
+	// Applies the propagators relative to the moving anchors and moves the anchors on.
+	template <bool IndividualParameters>
+	void PropagateMovingAnchors(int begin, int end, float deltaTime, const PendulumPropagator& uniformPropagator);
+
+	// Advances a range of pendulums with the indicated scheme and parameter source.
+	template <class IntegrationScheme, class Parameters>
+	void UpdateRange(int begin, int end, float deltaTime, const Parameters& parameters)
+	{
+		if (HasMovingAnchors())
+		{
+			UpdateAxisRange<IntegrationScheme, Parameters, false, true>(0, begin, end, deltaTime, parameters);
+			UpdateAxisRange<IntegrationScheme, Parameters, true, true>(1, begin, end, deltaTime, parameters);
+			UpdateAxisRange<IntegrationScheme, Parameters, false, true>(2, begin, end, deltaTime, parameters);
+		}
+		else
+		{
+			UpdateAxisRange<IntegrationScheme, Parameters, false, false>(0, begin, end, deltaTime, parameters);
+			UpdateAxisRange<IntegrationScheme, Parameters, true, false>(1, begin, end, deltaTime, parameters);
+			UpdateAxisRange<IntegrationScheme, Parameters, false, false>(2, begin, end, deltaTime, parameters);
+		}
+	}
+
+	// Advances one axis of a range of pendulums, gravity only acts on the vertical axis.
+	// Moving anchors are held during the step and then moved on with their velocity.
+	template <class IntegrationScheme, class Parameters, bool Vertical, bool MovingAnchors>
+	void UpdateAxisRange(int axis, int begin, int end, float deltaTime, const Parameters& parameters)
+	{
+		float* __restrict anchor = m_anchorPoint[axis];
+		const float* __restrict anchorVelocity = m_anchorVelocity[axis];
+		float* __restrict position = m_currentPendulumPosition[axis];
+		float* __restrict velocity = m_currentPendulumVelocity[axis];
+		for(int i = begin; i < end; ++i)
+		{
+			ParameterizedAxisSpringForce force = {Vertical ? parameters.GetEarthAcceleration(i) : 0.0f, parameters.GetInvMass(i),
+				parameters.GetDampingVelocity(i), parameters.GetSpringConstant(i), anchor[i], MovingAnchors ? anchorVelocity[i] : 0.0f};
+			IntegrationScheme::Advance(position[i], velocity[i], force, deltaTime);
+			if (MovingAnchors)
+				anchor[i] += anchorVelocity[i] * deltaTime;
+		}
+	}
+};
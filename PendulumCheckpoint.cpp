@@ -0,0 +1,326 @@
+#include "PendulumCheckpoint.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// The tag every checkpoint file starts with.
+static const char CheckpointMagic[8] = {'P', 'N', 'D', 'C', 'K', 'P', 'T', 0};
+
+// The primes of the checksum rounds.
+static const unsigned long long ChecksumPrime1 = 11400714785074694791ULL;
+static const unsigned long long ChecksumPrime2 = 14029467366897019727ULL;
+static const unsigned long long ChecksumPrime3 = 1609587929392840237ULL;
+static const unsigned long long ChecksumPrime4 = 9650029242287828579ULL;
+static const unsigned long long ChecksumPrime5 = 2870177450012600261ULL;
+
+
+// Rotates the bits of a value to the left.
+static inline unsigned long long RotateLeft(unsigned long long value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+
+// Mixes eight bytes into a lane of the checksum.
+static inline unsigned long long MixChecksumLane(unsigned long long lane, unsigned long long input)
+{
+	return RotateLeft(lane + input * ChecksumPrime2, 31) * ChecksumPrime1;
+}
+
+
+// Reads eight bytes at any alignment.
+static inline unsigned long long ReadWord(const unsigned char* bytes)
+{
+	unsigned long long word;
+	memcpy(&word, bytes, sizeof(word));
+	return word;
+}
+
+
+// Computes the checksum of a block of memory, continuing the checksum passed in.
+// The rounds are those of xxHash64, so the lanes pipeline and every bit of the input
+// reaches every bit of the result.
+unsigned long long ComputeCheckpointChecksum(const void* data, size_t bytes, unsigned long long checksum)
+{
+	const unsigned char* input = static_cast<const unsigned char*>(data);
+	const unsigned char* end = input + bytes;
+
+	unsigned long long lanes[4] = {checksum + ChecksumPrime1 + ChecksumPrime2, checksum + ChecksumPrime2, checksum, checksum - ChecksumPrime1};
+	for(; end - input >= 32; input += 32)
+	{
+		lanes[0] = MixChecksumLane(lanes[0], ReadWord(input));
+		lanes[1] = MixChecksumLane(lanes[1], ReadWord(input + 8));
+		lanes[2] = MixChecksumLane(lanes[2], ReadWord(input + 16));
+		lanes[3] = MixChecksumLane(lanes[3], ReadWord(input + 24));
+	}
+
+	unsigned long long result = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+	result += bytes;
+	for(; end - input >= 8; input += 8)
+		result = RotateLeft(result ^ MixChecksumLane(0, ReadWord(input)), 27) * ChecksumPrime1 + ChecksumPrime4;
+	for(; input < end; ++input)
+		result = RotateLeft(result ^ (*input * ChecksumPrime5), 11) * ChecksumPrime1;
+
+	result ^= result >> 33;
+	result *= ChecksumPrime2;
+	result ^= result >> 29;
+	result *= ChecksumPrime3;
+	result ^= result >> 32;
+	return result;
+}
+
+
+// Gets the number of bytes of a column of the indicated number of pendulums.
+static size_t GetColumnBytes(int numOfPendulums)
+{
+	return sizeof(float) * static_cast<size_t>(numOfPendulums);
+}
+
+
+// Rounds the number of bytes up to the alignment of the file.
+static size_t AlignCheckpointBytes(size_t bytes)
+{
+	return (bytes + CheckpointAlignment - 1) / CheckpointAlignment * CheckpointAlignment;
+}
+
+
+// Gets the number of bytes a column takes in the file. Even an empty column takes space,
+// so every column of a mapped file lies inside the mapping.
+static size_t GetReservedColumnBytes(int numOfPendulums)
+{
+	size_t columnBytes = GetColumnBytes(numOfPendulums);
+	return columnBytes > 0 ? AlignCheckpointBytes(columnBytes) : CheckpointAlignment;
+}
+
+
+// Computes the checksum over the header, with the checksum field zero, and the columns.
+static unsigned long long ComputeChecksum(const CheckpointHeader& header, const void* const columns[NumOfCheckpointColumns])
+{
+	CheckpointHeader zeroedHeader = header;
+	zeroedHeader.m_checksum = 0;
+	unsigned long long checksum = ComputeCheckpointChecksum(&zeroedHeader, sizeof(zeroedHeader), 0);
+	for(int column = 0; column < NumOfCheckpointColumns; ++column)
+	{
+		if (columns[column] != NULL)
+			checksum = ComputeCheckpointChecksum(columns[column], GetColumnBytes(header.m_numOfPendulums), checksum);
+	}
+	return checksum;
+}
+
+
+// Opens a file for writing in binary mode.
+static FILE* OpenFileForWriting(const char* fileName)
+{
+#ifdef _MSC_VER
+	FILE* file = NULL;
+	if (fopen_s(&file, fileName, "wb") != 0)
+		return NULL;
+	return file;
+#else
+	return fopen(fileName, "wb");
+#endif
+}
+
+
+// Writes the zeros between the end of the written bytes and the end of the reserved ones.
+static bool WritePadding(FILE* file, size_t writtenBytes, size_t reservedBytes)
+{
+	static const char zeros[CheckpointAlignment] = {0};
+	size_t padding = reservedBytes - writtenBytes;
+	return padding == 0 || fwrite(zeros, 1, padding, file) == padding;
+}
+
+
+// Writes a checkpoint: the header and then every column that is not NULL, each aligned.
+// The stream is not buffered, so every column goes to the file in one large sequential write.
+bool WriteCheckpoint(const char* fileName, CheckpointHeader& header, const void* const columns[NumOfCheckpointColumns])
+{
+	memcpy(header.m_magic, CheckpointMagic, sizeof(header.m_magic));
+	header.m_version = CheckpointVersion;
+	header.m_headerSize = sizeof(CheckpointHeader);
+
+	size_t columnBytes = GetColumnBytes(header.m_numOfPendulums);
+	size_t offset = AlignCheckpointBytes(sizeof(CheckpointHeader));
+	for(int column = 0; column < NumOfCheckpointColumns; ++column)
+	{
+		header.m_columnOffsets[column] = columns[column] != NULL ? offset : 0;
+		if (columns[column] != NULL)
+			offset += GetReservedColumnBytes(header.m_numOfPendulums);
+	}
+	header.m_fileSize = offset;
+	header.m_checksum = ComputeChecksum(header, columns);
+
+	FILE* file = OpenFileForWriting(fileName);
+	if (file == NULL)
+		return false;
+	setvbuf(file, NULL, _IONBF, 0);
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 && WritePadding(file, sizeof(header), AlignCheckpointBytes(sizeof(header)));
+	for(int column = 0; written && column < NumOfCheckpointColumns; ++column)
+	{
+		if (columns[column] != NULL)
+			written = fwrite(columns[column], 1, columnBytes, file) == columnBytes && WritePadding(file, columnBytes, GetReservedColumnBytes(header.m_numOfPendulums));
+	}
+	return fclose(file) == 0 && written;
+}
+
+
+CheckpointMapping::CheckpointMapping()
+{
+	m_base = NULL;
+	m_size = 0;
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#endif
+}
+
+
+CheckpointMapping::~CheckpointMapping()
+{
+	Close();
+}
+
+
+// Maps the file copy on write and checks the header.
+bool CheckpointMapping::Open(const char* fileName, bool verifyChecksum)
+{
+	Close();
+
+#ifdef _WIN32
+	m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(CheckpointHeader)))
+	{
+		Close();
+		return false;
+	}
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (m_mapping != NULL)
+		m_base = MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (m_base == NULL)
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = open(fileName, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(CheckpointHeader)))
+	{
+		close(file);
+		return false;
+	}
+	void* base = mmap(NULL, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if (base == MAP_FAILED)
+		return false;
+	m_base = base;
+	m_size = static_cast<size_t>(status.st_size);
+#endif
+
+	if (!IsConsistent())
+	{
+		Close();
+		return false;
+	}
+
+	if (verifyChecksum)
+	{
+		const void* columns[NumOfCheckpointColumns];
+		for(int column = 0; column < NumOfCheckpointColumns; ++column)
+			columns[column] = GetColumn(column);
+		if (ComputeChecksum(GetHeader(), columns) != GetHeader().m_checksum)
+		{
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// Gets the indicated column, or NULL if the checkpoint does not have it.
+void* CheckpointMapping::GetColumn(int column)
+{
+	unsigned long long offset = GetHeader().m_columnOffsets[column];
+	return offset != 0 ? static_cast<char*>(m_base) + offset : NULL;
+}
+
+
+// Unmaps the file.
+void CheckpointMapping::Close()
+{
+#ifdef _WIN32
+	if (m_base != NULL)
+		UnmapViewOfFile(m_base);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#else
+	if (m_base != NULL)
+		munmap(m_base, m_size);
+#endif
+	m_base = NULL;
+	m_size = 0;
+}
+
+
+// Checks that the header and the column offsets fit the file. The columns every batch has must
+// be present, the anchor velocities and the parameters either completely or not at all.
+bool CheckpointMapping::IsConsistent()
+{
+	const CheckpointHeader& header = GetHeader();
+	if (memcmp(header.m_magic, CheckpointMagic, sizeof(header.m_magic)) != 0 || header.m_version != CheckpointVersion)
+		return false;
+	if (header.m_headerSize != sizeof(CheckpointHeader) || header.m_fileSize != m_size)
+		return false;
+	if (header.m_numOfPendulums < 0 || header.m_numOfActivePendulums < 0 || header.m_numOfActivePendulums > header.m_numOfPendulums)
+		return false;
+
+	size_t columnBytes = GetReservedColumnBytes(header.m_numOfPendulums);
+	for(int column = 0; column < NumOfCheckpointColumns; ++column)
+	{
+		unsigned long long offset = header.m_columnOffsets[column];
+		if (offset == 0)
+			continue;
+		if (offset % CheckpointAlignment != 0 || offset < sizeof(CheckpointHeader) || offset + columnBytes > m_size)
+			return false;
+	}
+
+	for(int column = 0; column < CheckpointEarthAcceleration; ++column)
+	{
+		bool optional = column >= CheckpointAnchorVelocity && column < CheckpointPosition;
+		if (!optional && header.m_columnOffsets[column] == 0)
+			return false;
+	}
+	for(int axis = 1; axis < 3; ++axis)
+	{
+		if ((header.m_columnOffsets[CheckpointAnchorVelocity + axis] == 0) != (header.m_columnOffsets[CheckpointAnchorVelocity] == 0))
+			return false;
+	}
+	for(int column = CheckpointInvMass; column < NumOfCheckpointColumns; ++column)
+	{
+		if ((header.m_columnOffsets[column] == 0) != (header.m_columnOffsets[CheckpointEarthAcceleration] == 0))
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+
+// The version of the checkpoint layout, a file of another version is not restored.
+const unsigned int CheckpointVersion = 1;
+// The alignment of the header and of every column in the file. A page, so the columns of a
+// mapped file start on a page of their own and are aligned for every vector load.
+const size_t CheckpointAlignment = 4096;
+
+// The columns of a checkpoint in the order they are stored, every entry takes four bytes.
+enum CheckpointColumn
+{
+	CheckpointSlotOfPendulum = 0,
+	CheckpointPendulumOfSlot,
+	CheckpointQuietSteps,
+	CheckpointAnchorPoint,
+	CheckpointAnchorVelocity = CheckpointAnchorPoint + 3,
+	CheckpointPosition = CheckpointAnchorVelocity + 3,
+	CheckpointVelocity = CheckpointPosition + 3,
+	CheckpointEarthAcceleration = CheckpointVelocity + 3,
+	CheckpointInvMass,
+	CheckpointDampingVelocity,
+	CheckpointSpringConstant,
+	NumOfCheckpointColumns
+};
+
+// The flags of the settings that were enabled.
+enum CheckpointFlags
+{
+	CheckpointSleeping = 1,
+	CheckpointNoise = 2,
+	CheckpointCollisions = 4
+};
+
+// The start of a checkpoint file. All fields have a fixed size and the file is written in the
+// byte order of the machine, so the header and the columns are used as they are in memory.
+struct CheckpointHeader
+{
+	// "PNDCKPT" and a zero.
+	char m_magic[8];
+	unsigned int m_version;
+	// The size of this structure, the columns start at the next multiple of the alignment.
+	unsigned int m_headerSize;
+	unsigned long long m_fileSize;
+	// The checksum over the header, with this field zero, and the entries of all columns.
+	unsigned long long m_checksum;
+
+	int m_numOfPendulums;
+	int m_numOfActivePendulums;
+	unsigned int m_flags;
+	int m_broadphaseType;
+	unsigned long long m_stepCount;
+	double m_simulationTime;
+
+	float m_sleepVelocityThreshold;
+	float m_sleepDisplacementThreshold;
+	int m_sleepQuietSteps;
+	float m_noiseTemperature;
+	unsigned int m_noiseSeed;
+	float m_bobRadius;
+	float m_restitution;
+	int m_reserved;
+
+	// The position of every column in the file, 0 for the columns the batch did not have.
+	unsigned long long m_columnOffsets[NumOfCheckpointColumns];
+};
+
+// Computes the checksum of a block of memory, continuing the checksum passed in.
+// Four independent lanes take eight bytes each per round, so it runs at the speed of memory.
+unsigned long long ComputeCheckpointChecksum(const void* data, size_t bytes, unsigned long long checksum);
+
+// Writes a checkpoint: the header and then every column that is not NULL, each aligned.
+// The header gets the offsets, the size and the checksum. Returns false if writing failed.
+bool WriteCheckpoint(const char* fileName, CheckpointHeader& header, const void* const columns[NumOfCheckpointColumns]);
+
+// A checkpoint file mapped into memory. The mapping is private and copy on write, so the
+// columns can be simulated on right where they are without changing the file, and a page
+// is only read from the file when it is first touched.
+class CheckpointMapping
+{
+public:
+	CheckpointMapping();
+	~CheckpointMapping();
+
+	// Maps the file and checks the header. With verification the checksum is compared as well,
+	// which reads the whole file. Returns false if the file is no intact checkpoint of this version.
+	bool Open(const char* fileName, bool verifyChecksum);
+
+	// Gets the header of the mapped file.
+	const CheckpointHeader& GetHeader() { return *static_cast<const CheckpointHeader*>(m_base); }
+	// Gets the indicated column, or NULL if the checkpoint does not have it.
+	void* GetColumn(int column);
+	// Checks if the memory lies inside the mapping.
+	bool Contains(const void* memory) { return memory >= m_base && memory < static_cast<const char*>(m_base) + m_size; }
+
+private:
+	CheckpointMapping(const CheckpointMapping&) = delete;
+	CheckpointMapping& operator=(const CheckpointMapping&) = delete;
+
+	// The mapped file and its size.
+	void* m_base;
+	size_t m_size;
+#ifdef _WIN32
+	// The handles of the file and of the mapping object.
+	void* m_file;
+	void* m_mapping;
+#endif
+
+	// Unmaps the file.
+	void Close();
+	// Checks that the header and the column offsets fit the file.
+	bool IsConsistent();
+};
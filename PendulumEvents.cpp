@@ -0,0 +1,315 @@
+#include "PendulumEvents.h"
+#include <math.h>
+#include <algorithm>
+
+
+// The number of secant iterations a root is refined with at most.
+static const int MaxRootIterations = 16;
+// The width of the bracket, as a fraction of the step, below which a root counts as found.
+static const double RootTolerance = 1e-6;
+// The number of values screened for sign changes at once.
+static const int EventScreenBlockSize = 64;
+
+
+// Gets the value of a predicate for the state of a bob.
+static float EvaluateState(const EventPredicate& predicate, const float position[3], const float velocity[3], const float anchorPoint[3], const float anchorVelocity[3])
+{
+	switch(predicate.m_function)
+	{
+	case EventDisplacement:
+		return position[predicate.m_axis] - anchorPoint[predicate.m_axis] - predicate.m_threshold;
+
+	case EventExtension:
+	{
+		float dx = position[0] - anchorPoint[0];
+		float dy = position[1] - anchorPoint[1];
+		float dz = position[2] - anchorPoint[2];
+		return sqrtf(dx * dx + dy * dy + dz * dz) - predicate.m_threshold;
+	}
+
+	case EventExtensionRate:
+		return (position[0] - anchorPoint[0]) * (velocity[0] - anchorVelocity[0]) + (position[1] - anchorPoint[1]) * (velocity[1] - anchorVelocity[1])
+			+ (position[2] - anchorPoint[2]) * (velocity[2] - anchorVelocity[2]);
+
+	case EventSpeed:
+		return sqrtf(velocity[0] * velocity[0] + velocity[1] * velocity[1] + velocity[2] * velocity[2]) - predicate.m_threshold;
+
+	default:
+		return predicate.m_stateFunction(position, velocity, anchorPoint, predicate.m_userData);
+	}
+}
+
+
+// Gets the EventDirection of the sign change from the old to the new value, or 0 if there is none.
+// A value that reaches zero has changed its sign, one that leaves it has not.
+static inline int GetSignChanges(float oldValue, float newValue)
+{
+	int rising = (oldValue < 0.0f) & (newValue >= 0.0f);
+	int falling = (oldValue > 0.0f) & (newValue <= 0.0f);
+	return rising * EventRising | falling * EventFalling;
+}
+
+
+// Checks if two values lie on the same side of zero, zero counting as positive.
+static bool IsSameSide(double first, double second)
+{
+	return (first < 0.0) == (second < 0.0);
+}
+
+
+// Adds a predicate and returns its number, or -1 if it is incomplete.
+int EventDetector::AddPredicate(const EventPredicate& predicate)
+{
+	if (predicate.m_function < EventDisplacement || predicate.m_function > EventCustom)
+		return -1;
+	if (predicate.m_function == EventDisplacement && (predicate.m_axis < 0 || predicate.m_axis > 2))
+		return -1;
+	if (predicate.m_function == EventCustom && predicate.m_stateFunction == NULL)
+		return -1;
+	if ((predicate.m_directions & EventEitherDirection) == 0)
+		return -1;
+
+	m_predicates.push_back(predicate);
+	return static_cast<int>(m_predicates.size()) - 1;
+}
+
+
+// Makes room for the buffers of the indicated number of chunks.
+void EventDetector::PrepareChunks(int numOfChunks)
+{
+	if (static_cast<int>(m_chunkEvents.size()) < numOfChunks)
+		m_chunkEvents.resize(numOfChunks);
+}
+
+
+// Remembers the state of a range of slots before a step. The values of the predicates are
+// only evaluated if the scratch does not hold those of the last step of the same range.
+void EventDetector::BeginStep(const EventColumns& columns, int begin, int end, EventScratch& scratch)
+{
+	int count = end - begin;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		scratch.m_position[axis].assign(columns.m_position[axis] + begin, columns.m_position[axis] + end);
+		scratch.m_velocity[axis].assign(columns.m_velocity[axis] + begin, columns.m_velocity[axis] + end);
+	}
+
+	if (scratch.m_hasValues && scratch.m_begin == begin && scratch.m_end == end)
+		return;
+
+	scratch.m_values.resize(m_predicates.size() * count);
+	scratch.m_newValues.resize(m_predicates.size() * count);
+	for(size_t predicate = 0; predicate < m_predicates.size(); ++predicate)
+		EvaluateRange(m_predicates[predicate], columns, begin, end, &scratch.m_values[predicate * count]);
+	scratch.m_begin = begin;
+	scratch.m_end = end;
+	scratch.m_hasValues = true;
+}
+
+
+// Evaluates the predicates after the step and adds the sign changes of the range to the buffer of the chunk.
+// The values after the step are kept as those before the next one.
+void EventDetector::EndStep(const EventColumns& columns, int begin, int end, int chunk, double startTime, float deltaTime, unsigned long long step, EventScratch& scratch)
+{
+	int count = end - begin;
+	std::vector<PendulumEvent>& events = m_chunkEvents[chunk];
+	for(size_t predicate = 0; predicate < m_predicates.size(); ++predicate)
+	{
+		const float* oldValues = &scratch.m_values[predicate * count];
+		float* newValues = &scratch.m_newValues[predicate * count];
+		EvaluateRange(m_predicates[predicate], columns, begin, end, newValues);
+
+		// Sign changes are rare, so a block is first screened by a loop without branches that
+		// the compiler can vectorize, and only the blocks with a candidate are searched.
+		// A sign change makes the product of the values zero or negative.
+		int directions = m_predicates[predicate].m_directions;
+		for(int first = 0; first < count; first += EventScreenBlockSize)
+		{
+			int last = first + EventScreenBlockSize < count ? first + EventScreenBlockSize : count;
+			int candidates = 0;
+			for(int i = first; i < last; ++i)
+				candidates |= oldValues[i] * newValues[i] <= 0.0f;
+			if (candidates == 0)
+				continue;
+
+			for(int i = first; i < last; ++i)
+			{
+				if (GetSignChanges(oldValues[i], newValues[i]) & directions)
+					AddEvent(columns, begin + i, static_cast<int>(predicate), oldValues[i], newValues[i], scratch, startTime, deltaTime, step, events);
+			}
+		}
+	}
+	scratch.m_values.swap(scratch.m_newValues);
+}
+
+
+// Moves the events of all chunk buffers behind the events found so far, ordered by time.
+// Ties are broken by the pendulum and the predicate, so the order does not depend on the threads.
+void EventDetector::MergeChunkEvents()
+{
+	size_t firstNew = m_events.size();
+	for(size_t chunk = 0; chunk < m_chunkEvents.size(); ++chunk)
+	{
+		m_events.insert(m_events.end(), m_chunkEvents[chunk].begin(), m_chunkEvents[chunk].end());
+		m_chunkEvents[chunk].clear();
+	}
+
+	std::sort(m_events.begin() + firstNew, m_events.end(), [](const PendulumEvent& first, const PendulumEvent& second)
+	{
+		if (first.m_time != second.m_time)
+			return first.m_time < second.m_time;
+		if (first.m_pendulum != second.m_pendulum)
+			return first.m_pendulum < second.m_pendulum;
+		return first.m_predicate < second.m_predicate;
+	});
+}
+
+
+// Evaluates a predicate for a range of slots. The built in quantities run in plain loops over
+// the columns that the compiler can vectorize, the user functions are called bob by bob.
+void EventDetector::EvaluateRange(const EventPredicate& predicate, const EventColumns& columns, int begin, int end, float* values)
+{
+	int count = end - begin;
+	const float* const* anchor = columns.m_anchorPoint;
+	const float* const* position = columns.m_position;
+	const float* const* velocity = columns.m_velocity;
+
+	switch(predicate.m_function)
+	{
+	case EventDisplacement:
+	{
+		const float* __restrict axisAnchor = anchor[predicate.m_axis] + begin;
+		const float* __restrict axisPosition = position[predicate.m_axis] + begin;
+		float threshold = predicate.m_threshold;
+		for(int i = 0; i < count; ++i)
+			values[i] = axisPosition[i] - axisAnchor[i] - threshold;
+		break;
+	}
+
+	case EventExtension:
+	case EventExtensionRate:
+	case EventSpeed:
+		for(int i = 0; i < count; ++i)
+			values[i] = 0.0f;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			const float* __restrict axisAnchor = anchor[axis] + begin;
+			const float* __restrict axisPosition = position[axis] + begin;
+			const float* __restrict axisVelocity = velocity[axis] + begin;
+			const float* __restrict axisAnchorVelocity = columns.m_anchorVelocity[axis] != NULL ? columns.m_anchorVelocity[axis] + begin : NULL;
+			if (predicate.m_function == EventExtension)
+			{
+				for(int i = 0; i < count; ++i)
+					values[i] += (axisPosition[i] - axisAnchor[i]) * (axisPosition[i] - axisAnchor[i]);
+			}
+			else if (predicate.m_function == EventSpeed)
+			{
+				for(int i = 0; i < count; ++i)
+					values[i] += axisVelocity[i] * axisVelocity[i];
+			}
+			else if (axisAnchorVelocity != NULL)
+			{
+				for(int i = 0; i < count; ++i)
+					values[i] += (axisPosition[i] - axisAnchor[i]) * (axisVelocity[i] - axisAnchorVelocity[i]);
+			}
+			else
+			{
+				for(int i = 0; i < count; ++i)
+					values[i] += (axisPosition[i] - axisAnchor[i]) * axisVelocity[i];
+			}
+		}
+		if (predicate.m_function != EventExtensionRate)
+		{
+			float threshold = predicate.m_threshold;
+			for(int i = 0; i < count; ++i)
+				values[i] = sqrtf(values[i]) - threshold;
+		}
+		break;
+
+	default:
+		for(int i = begin; i < end; ++i)
+		{
+			float bobPosition[3] = {position[0][i], position[1][i], position[2][i]};
+			float bobVelocity[3] = {velocity[0][i], velocity[1][i], velocity[2][i]};
+			float anchorPoint[3] = {anchor[0][i], anchor[1][i], anchor[2][i]};
+			values[i - begin] = predicate.m_stateFunction(bobPosition, bobVelocity, anchorPoint, predicate.m_userData);
+		}
+		break;
+	}
+}
+
+
+// Refines the root of a sign change of the slot and stores the event.
+// Within the step the bob follows the cubic Hermite curve through the positions and velocities
+// at both ends, and the anchor moves linearly with its velocity. The root is searched on the
+// fraction of the step with the Illinois variant of the secant method, which keeps the root
+// bracketed and halves the value at an end that stays put, so it converges on curved predicates.
+void EventDetector::AddEvent(const EventColumns& columns, int slot, int predicate, float oldValue, float newValue, const EventScratch& scratch,
+	double startTime, float deltaTime, unsigned long long step, std::vector<PendulumEvent>& events)
+{
+	const EventPredicate& eventPredicate = m_predicates[predicate];
+	int i = slot - scratch.m_begin;
+	float anchorVelocity[3];
+	for(int axis = 0; axis < 3; ++axis)
+		anchorVelocity[axis] = columns.m_anchorVelocity[axis] != NULL ? columns.m_anchorVelocity[axis][slot] : 0.0f;
+
+	PendulumEvent event;
+	event.m_step = step;
+	event.m_pendulum = columns.m_pendulumOfSlot[slot];
+	event.m_predicate = predicate;
+	event.m_direction = oldValue < 0.0f ? EventRising : EventFalling;
+
+	double lower = 0.0;
+	double upper = 1.0;
+	double lowerValue = oldValue;
+	double upperValue = newValue;
+	double fraction = 1.0;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		event.m_position[axis] = columns.m_position[axis][slot];
+		event.m_velocity[axis] = columns.m_velocity[axis][slot];
+	}
+
+	for(int iteration = 0; iteration < MaxRootIterations && upperValue != 0.0 && fabs(upper - lower) > RootTolerance; ++iteration)
+	{
+		fraction = (lower * upperValue - upper * lowerValue) / (upperValue - lowerValue);
+
+		// The Hermite basis and its derivative for the fraction of the step.
+		double s = fraction;
+		double s2 = s * s;
+		double s3 = s2 * s;
+		double h00 = 2.0 * s3 - 3.0 * s2 + 1.0;
+		double h10 = s3 - 2.0 * s2 + s;
+		double h01 = -2.0 * s3 + 3.0 * s2;
+		double h11 = s3 - s2;
+		double d00 = 6.0 * s2 - 6.0 * s;
+		double d10 = 3.0 * s2 - 4.0 * s + 1.0;
+		double d01 = -d00;
+		double d11 = 3.0 * s2 - 2.0 * s;
+
+		float anchorPoint[3];
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			double p0 = scratch.m_position[axis][i];
+			double v0 = scratch.m_velocity[axis][i];
+			double p1 = columns.m_position[axis][slot];
+			double v1 = columns.m_velocity[axis][slot];
+			event.m_position[axis] = static_cast<float>(h00 * p0 + h10 * deltaTime * v0 + h01 * p1 + h11 * deltaTime * v1);
+			event.m_velocity[axis] = static_cast<float>((d00 * p0 + d01 * p1) / deltaTime + d10 * v0 + d11 * v1);
+			anchorPoint[axis] = static_cast<float>(columns.m_anchorPoint[axis][slot] - anchorVelocity[axis] * deltaTime * (1.0 - s));
+		}
+
+		double value = EvaluateState(eventPredicate, event.m_position, event.m_velocity, anchorPoint, anchorVelocity);
+		if (!IsSameSide(value, upperValue))
+		{
+			lower = upper;
+			lowerValue = upperValue;
+		}
+		else
+			lowerValue *= 0.5;
+		upper = fraction;
+		upperValue = value;
+	}
+
+	event.m_time = startTime + fraction * deltaTime;
+	events.push_back(event);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// The quantities of the state of a bob an event predicate can watch. An event happens
+// when the value of the predicate changes its sign during a step.
+enum EventFunction
+{
+	// The displacement from the anchor along an axis minus the threshold. Its sign changes
+	// where the bob crosses the plane at that distance, with 0 at the zero crossings.
+	EventDisplacement = 0,
+	// The distance from the anchor minus the threshold, rising where the bob leaves the sphere.
+	EventExtension = 1,
+	// The displacement from the anchor times the velocity relative to it, half the rate at which
+	// the squared distance changes. It falls through zero at the turning points of maximum
+	// extension and rises through zero at those of minimum extension.
+	EventExtensionRate = 2,
+	// The speed minus the threshold.
+	EventSpeed = 3,
+	// A function of the state given by the user.
+	EventCustom = 4
+};
+
+// The directions of the sign changes a predicate reports, they can be combined.
+enum EventDirection
+{
+	EventRising = 1,
+	EventFalling = 2,
+	EventEitherDirection = 3
+};
+
+// Gets the value of a user predicate for the state of a bob, its position, velocity and anchor point.
+typedef float (*EventStateFunction)(const float position[3], const float velocity[3], const float anchorPoint[3], void* userData);
+
+// Describes which sign changes of which quantity are reported as events.
+struct EventPredicate
+{
+	EventPredicate()
+		: m_function(EventDisplacement), m_axis(0), m_threshold(0.0f), m_directions(EventEitherDirection),
+		m_stateFunction(NULL), m_userData(NULL)
+	{
+	}
+
+	EventFunction m_function;
+	// The axis of EventDisplacement.
+	int m_axis;
+	// The value subtracted from the quantity, unused by EventExtensionRate and EventCustom.
+	float m_threshold;
+	// The EventDirection flags of the sign changes that are reported.
+	int m_directions;
+	// The function of EventCustom and the data passed to it.
+	EventStateFunction m_stateFunction;
+	void* m_userData;
+};
+
+// A sign change of a predicate, with the time and the state of the bob at the root.
+struct PendulumEvent
+{
+	// The simulated time of the root.
+	double m_time;
+	// The number of the step the root lies in, counted from 0.
+	unsigned long long m_step;
+	// The pendulum and the predicate that changed its sign.
+	int m_pendulum;
+	int m_predicate;
+	// EventRising or EventFalling.
+	int m_direction;
+	// The state of the bob at the root.
+	float m_position[3];
+	float m_velocity[3];
+};
+
+// The columns of the stepped pendulums the events are detected on, indexed by slot.
+struct EventColumns
+{
+	const float* m_anchorPoint[3];
+	// NULL while all anchors are fixed.
+	const float* m_anchorVelocity[3];
+	const float* m_position[3];
+	const float* m_velocity[3];
+	const int* m_pendulumOfSlot;
+};
+
+// The state of a range of slots before a step and the values of the predicates before and
+// after it. It belongs to the thread that steps the range, so the detection takes no locks.
+struct EventScratch
+{
+	EventScratch() : m_begin(0), m_end(0), m_hasValues(false) {}
+
+	std::vector<float> m_position[3];
+	std::vector<float> m_velocity[3];
+	// The values of all predicates, one block of the size of the range per predicate.
+	std::vector<float> m_values;
+	std::vector<float> m_newValues;
+	// The range the values were evaluated for, and whether they are still those of its state.
+	int m_begin;
+	int m_end;
+	bool m_hasValues;
+};
+
+// Finds the sign changes of event predicates during the steps of a batch. The predicates are
+// evaluated over the columns of a chunk before and after every step. A sign change is refined
+// to the root within the step with a secant search on a cubic Hermite interpolation of the
+// state through the positions and velocities at both ends.
+// Every chunk collects its events in a buffer of its own, so the chunks can run on any thread
+// without locks, and after the update the buffers are merged in the order of time.
+class EventDetector
+{
+public:
+	// Adds a predicate and returns its number, or -1 if it is incomplete.
+	int AddPredicate(const EventPredicate& predicate);
+	// Removes all predicates.
+	void ClearPredicates() { m_predicates.clear(); }
+	// Checks if any predicate is watched.
+	bool HasPredicates() { return !m_predicates.empty(); }
+	// Gets the number of predicates.
+	int GetNumOfPredicates() { return static_cast<int>(m_predicates.size()); }
+
+	// Makes room for the buffers of the indicated number of chunks.
+	void PrepareChunks(int numOfChunks);
+	// Remembers the state of a range of slots before a step.
+	void BeginStep(const EventColumns& columns, int begin, int end, EventScratch& scratch);
+	// Evaluates the predicates after the step and adds the sign changes of the range to the buffer
+	// of the chunk. The step started at the indicated time and has the indicated number.
+	void EndStep(const EventColumns& columns, int begin, int end, int chunk, double startTime, float deltaTime, unsigned long long step, EventScratch& scratch);
+	// Moves the events of all chunk buffers behind the events found so far, ordered by time.
+	void MergeChunkEvents();
+
+	// Gets the number of events found since they were last cleared.
+	int GetNumOfEvents() { return static_cast<int>(m_events.size()); }
+	// Gets the indicated event, they are ordered by time.
+	const PendulumEvent& GetEvent(int index) { return m_events[index]; }
+	// Forgets the events found so far.
+	void ClearEvents() { m_events.clear(); }
+
+private:
+	// The predicates in the order of their numbers.
+	std::vector<EventPredicate> m_predicates;
+	// The events found by every chunk in the current update.
+	std::vector<std::vector<PendulumEvent> > m_chunkEvents;
+	// The events found so far in the order of time.
+	std::vector<PendulumEvent> m_events;
+
+	// Evaluates a predicate for a range of slots.
+	void EvaluateRange(const EventPredicate& predicate, const EventColumns& columns, int begin, int end, float* values);
+	// Refines the root of a sign change of the slot and stores the event.
+	void AddEvent(const EventColumns& columns, int slot, int predicate, float oldValue, float newValue, const EventScratch& scratch,
+		double startTime, float deltaTime, unsigned long long step, std::vector<PendulumEvent>& events);
+};
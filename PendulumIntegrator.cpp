@@ -1,4 +1,5 @@
 #include "PendulumIntegrator.h"
+#include "PendulumPhysics.h"
 
 
 // We get the ancor position of the pendulum.
@@ -8,6 +9,10 @@ PendulumIntegrator::PendulumIntegrator(float anchorPoint[3])
 	m_anchorPoint[1] = anchorPoint[1];
 	m_anchorPoint[2] = anchorPoint[2];
 
+	m_anchorVelocity[0] = 0.0f;
+	m_anchorVelocity[1] = 0.0f;
+	m_anchorVelocity[2] = 0.0f;
+
 	m_currentPendulumPosition[0] = anchorPoint[0];
 	m_currentPendulumPosition[1] = anchorPoint[1];
 	m_currentPendulumPosition[2] = anchorPoint[2];
@@ -30,6 +35,29 @@ void PendulumIntegrator::SetPendulumPosition(float position[3])
 	m_currentPendulumVelocity[2] = 0.0f;
 }
 
+
+// Moves the anchor.
+void PendulumIntegrator::SetAnchorPoint(float anchorPoint[3], float anchorVelocity[3])
+{
+	m_anchorPoint[0] = anchorPoint[0];
+	m_anchorPoint[1] = anchorPoint[1];
+	m_anchorPoint[2] = anchorPoint[2];
+
+	m_anchorVelocity[0] = anchorVelocity[0];
+	m_anchorVelocity[1] = anchorVelocity[1];
+	m_anchorVelocity[2] = anchorVelocity[2];
+}
+
+
+// Obtains the current position of the anchor.
+void PendulumIntegrator::ObtainAnchorPoint(float anchorPoint[3])
+{
+	anchorPoint[0] = m_anchorPoint[0];
+	anchorPoint[1] = m_anchorPoint[1];
+	anchorPoint[2] = m_anchorPoint[2];
+}
+
+
 // Updates the simulation.
 void PendulumIntegrator::UpdateSimulation(float deltaTime)
 {
@@ -59,16 +87,7 @@ void PendulumIntegrator::ObtainCurrentPosition(float position[3])
 // Gets the current acceleration vector.
 void PendulumIntegrator::ComputeCurrentAcceleration(float acceleration[3])
 {
-	const float earthAcceleration = -9.81f;
-	const float invMass = 2.0f;
-	const float dampingVelocity = 0.05f;
-	const float springConstant = 0.5f;
-
-	acceleration[0] = 0.0f;
-	acceleration[1] = earthAcceleration;
-	acceleration[2] = 0.0f;
-
-	acceleration[0] += invMass * (-m_currentPendulumVelocity[0] * dampingVelocity + springConstant * (m_anchorPoint[0] - m_currentPendulumPosition[0]));
-	acceleration[1] += invMass * (-m_currentPendulumVelocity[1] * dampingVelocity + springConstant * (m_anchorPoint[1] - m_currentPendulumPosition[1]));
-	acceleration[2] += invMass * (-m_currentPendulumVelocity[2] * dampingVelocity + springConstant * (m_anchorPoint[2] - m_currentPendulumPosition[2]));
+	acceleration[0] = PendulumPhysics::ComputeAxisAcceleration(0.0f, m_anchorPoint[0], m_currentPendulumPosition[0], m_currentPendulumVelocity[0] - m_anchorVelocity[0]);
+	acceleration[1] = PendulumPhysics::ComputeAxisAcceleration(PendulumPhysics::earthAcceleration, m_anchorPoint[1], m_currentPendulumPosition[1], m_currentPendulumVelocity[1] - m_anchorVelocity[1]);
+	acceleration[2] = PendulumPhysics::ComputeAxisAcceleration(0.0f, m_anchorPoint[2], m_currentPendulumPosition[2], m_currentPendulumVelocity[2] - m_anchorVelocity[2]);
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "IntegrationSchemes.h"
+
 // The class that can integrate the position of the pendulum.
 class PendulumIntegrator
 {
@@ -10,15 +12,34 @@ public:
 	// Sets the position of the pendulum and resets velocity.
 	void SetPendulumPosition(float position[3]);
 
+	// Moves the anchor. The damping acts on the bob velocity relative to the anchor velocity.
+	void SetAnchorPoint(float anchorPoint[3], float anchorVelocity[3]);
+	// Obtains the current position of the anchor.
+	void ObtainAnchorPoint(float anchorPoint[3]);
+
 	// Updates the simulation.
 	void UpdateSimulation(float deltaTime);
 
+	// Updates the simulation with the indicated integration scheme.
+	template <class IntegrationScheme>
+	void UpdateSimulation(float deltaTime)
+	{
+		const float gravity[3] = {0.0f, PendulumPhysics::earthAcceleration, 0.0f};
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			AxisSpringForce force = {gravity[axis], m_anchorPoint[axis], m_anchorVelocity[axis]};
+			IntegrationScheme::Advance(m_currentPendulumPosition[axis], m_currentPendulumVelocity[axis], force, deltaTime);
+		}
+	}
+
 	// Obtains the current position of the pendulum.
 	void ObtainCurrentPosition(float position[3]);
 
 private:
 	// The position where the pendulum is anchored.
 	float m_anchorPoint[3];
+	// The velocity of the anchor.
+	float m_anchorVelocity[3];
 	// The current position of the pendulum.
 	float m_currentPendulumPosition[3];
 	// The current velocity of the pendulum.
@@ -0,0 +1,1712 @@
+#include "PendulumKernels.h"
+#include "PendulumPhysics.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PENDULUM_KERNELS_X86
+// The 512 bit intrinsics of gcc 12 pass a deliberately undefined vector as the unused source of
+// their masked builtins, which -Wmaybe-uninitialized reports once they are inlined into our
+// kernels. The warning is attributed to the header, so it is silenced only there.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// The deterministic kernels rely on every multiply and every add being rounded on its own,
+// so the compiler must not fuse them on its own, neither in scalar code nor in intrinsics.
+#if defined(_MSC_VER)
+#pragma fp_contract (off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+// MSVC allows every intrinsic in every function, gcc and clang have to be told per function.
+#ifdef _MSC_VER
+#define KERNEL_TARGET(isa)
+#else
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Scalar reference
+//--------------------------------------------------------------------------------------
+
+// Adds the moments of one axis to the partial sums without any explicit vectorization.
+static void AxisMomentsScalar(int count, const float* anchor, const float* position, const float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	for(int first = 0; first < count; first += MomentLanes)
+	{
+		int lanes = count - first < MomentLanes ? count - first : MomentLanes;
+		for(int lane = 0; lane < lanes; ++lane)
+		{
+			int i = first + lane;
+			float extension = position[i] - anchor[i];
+			moments[AxisMomentVelocity][lane] += velocity[i];
+			moments[AxisMomentSquaredVelocity][lane] += velocity[i] * velocity[i];
+			moments[AxisMomentPosition][lane] += position[i];
+			moments[AxisMomentSquaredExtension][lane] += extension * extension;
+		}
+	}
+}
+
+
+// Advances one axis by an explicit Euler step without any explicit vectorization.
+static void EulerAxisScalar(int count, float gravity, float deltaTime, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	const float* __restrict anchorColumn = anchor;
+	float* __restrict positionColumn = position;
+	float* __restrict velocityColumn = velocity;
+
+	for(int i = 0; i < count; ++i)
+	{
+		float acceleration = PendulumPhysics::ComputeAxisAcceleration(gravity, anchorColumn[i], positionColumn[i], velocityColumn[i]);
+		positionColumn[i] += deltaTime * velocityColumn[i];
+		velocityColumn[i] += deltaTime * acceleration;
+	}
+
+	if (moments != NULL)
+		AxisMomentsScalar(count, anchor, position, velocity, moments);
+}
+
+
+// Advances one axis with the exact propagator without any explicit vectorization.
+static void PropagatorAxisScalar(int count, const float transition[4], float equilibriumOffset, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	const float* __restrict anchorColumn = anchor;
+	float* __restrict positionColumn = position;
+	float* __restrict velocityColumn = velocity;
+	const float m00 = transition[0], m01 = transition[1], m10 = transition[2], m11 = transition[3];
+
+	for(int i = 0; i < count; ++i)
+	{
+		float equilibrium = anchorColumn[i] + equilibriumOffset;
+		float displacement = positionColumn[i] - equilibrium;
+		float v = velocityColumn[i];
+		positionColumn[i] = equilibrium + (m00 * displacement + m01 * v);
+		velocityColumn[i] = m10 * displacement + m11 * v;
+	}
+
+	if (moments != NULL)
+		AxisMomentsScalar(count, anchor, position, velocity, moments);
+}
+
+
+// The constants of the Philox4x32 generator: the multipliers of the two rounds and the
+// increments of the two key words, the golden ratio and sqrt(3) - 1.
+static const unsigned int PhiloxMultiplier0 = 0xD2511F53u;
+static const unsigned int PhiloxMultiplier1 = 0xCD9E8D57u;
+static const unsigned int PhiloxIncrement0 = 0x9E3779B9u;
+static const unsigned int PhiloxIncrement1 = 0xBB67AE85u;
+static const int PhiloxRounds = 10;
+
+// The constants of the Box-Muller transform. The vector kernels use the same constants and do
+// the same operations in the same order without fused multiply add, so every level gives the
+// same bits as the scalar reference.
+static const float NoiseUnit = 1.0f / 16777216.0f;
+static const float NoiseQuarterAngleUnit = 1.5707963267948966f / 16777216.0f;
+static const float NoiseSqrt2 = 1.41421356f;
+static const float NoiseLn2 = 0.693147181f;
+
+
+// Applies the rounds of Philox4x32 to the counter.
+static void PhiloxScalar(unsigned int counter[4], unsigned int key0, unsigned int key1)
+{
+	for(int round = 0; round < PhiloxRounds; ++round)
+	{
+		unsigned long long product0 = static_cast<unsigned long long>(PhiloxMultiplier0) * counter[0];
+		unsigned long long product1 = static_cast<unsigned long long>(PhiloxMultiplier1) * counter[2];
+		unsigned int next0 = static_cast<unsigned int>(product1 >> 32) ^ counter[1] ^ key0;
+		unsigned int next1 = static_cast<unsigned int>(product1);
+		unsigned int next2 = static_cast<unsigned int>(product0 >> 32) ^ counter[3] ^ key1;
+		unsigned int next3 = static_cast<unsigned int>(product0);
+		counter[0] = next0;
+		counter[1] = next1;
+		counter[2] = next2;
+		counter[3] = next3;
+		key0 += PhiloxIncrement0;
+		key1 += PhiloxIncrement1;
+	}
+}
+
+
+// Gets the natural logarithm of a number in (0, 1]. The mantissa is brought into
+// [sqrt(0.5), sqrt(2)] and its logarithm is taken from the atanh series.
+static float LogScalar(float x)
+{
+	unsigned int bits;
+	memcpy(&bits, &x, sizeof(bits));
+	int exponent = static_cast<int>(bits >> 23) - 127;
+	bits = (bits & 0x007FFFFFu) | 0x3F800000u;
+	float mantissa;
+	memcpy(&mantissa, &bits, sizeof(mantissa));
+	if (mantissa > NoiseSqrt2)
+	{
+		mantissa = mantissa * 0.5f;
+		exponent += 1;
+	}
+
+	float s = (mantissa - 1.0f) / (mantissa + 1.0f);
+	float s2 = s * s;
+	float series = 1.0f + s2 * (0.333333343f + s2 * (0.2f + s2 * (0.142857149f + s2 * 0.111111112f)));
+	return static_cast<float>(exponent) * NoiseLn2 + (s + s) * series;
+}
+
+
+// Turns two random words into two independent standard normal numbers with the Box-Muller transform.
+// The first word gives the radius, the second the angle: its top two bits pick the quadrant and
+// the next 24 bits the angle within [-pi/4, pi/4), where short polynomials are exact to float precision.
+static void BoxMullerScalar(unsigned int radiusBits, unsigned int angleBits, float& first, float& second)
+{
+	float u = static_cast<float>(static_cast<int>((radiusBits >> 8) + 1)) * NoiseUnit;
+	float radius = sqrtf(-2.0f * LogScalar(u));
+
+	float angle = static_cast<float>(static_cast<int>((angleBits >> 6) & 0x00FFFFFFu) - 0x00800000) * NoiseQuarterAngleUnit;
+	float angle2 = angle * angle;
+	float sine = angle + angle * angle2 * (-0.166666672f + angle2 * (0.00833333377f + angle2 * (-0.000198412701f + angle2 * 2.75573188e-06f)));
+	float cosine = 1.0f + angle2 * (-0.5f + angle2 * (0.0416666679f + angle2 * (-0.00138888892f + angle2 * 2.48015876e-05f)));
+
+	// Turning by a quarter swaps sine and cosine, the signs follow from the quadrant.
+	unsigned int quadrant = angleBits >> 30;
+	float swappedSine = (quadrant & 1) ? cosine : sine;
+	float swappedCosine = (quadrant & 1) ? sine : cosine;
+	unsigned int sineBits;
+	unsigned int cosineBits;
+	memcpy(&sineBits, &swappedSine, sizeof(sineBits));
+	memcpy(&cosineBits, &swappedCosine, sizeof(cosineBits));
+	sineBits ^= (quadrant >> 1) << 31;
+	cosineBits ^= ((quadrant ^ (quadrant >> 1)) & 1) << 31;
+	memcpy(&swappedSine, &sineBits, sizeof(sineBits));
+	memcpy(&swappedCosine, &cosineBits, sizeof(cosineBits));
+
+	first = radius * swappedCosine;
+	second = radius * swappedSine;
+}
+
+
+// Draws three standard normal numbers for every stream without any explicit vectorization.
+static void GaussianNoiseScalar(int count, const int* streams, unsigned long long step, unsigned int seed, float* normalX, float* normalY, float* normalZ)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		unsigned int counter[4] = {static_cast<unsigned int>(streams[i]), 0u, static_cast<unsigned int>(step), static_cast<unsigned int>(step >> 32)};
+		PhiloxScalar(counter, seed, 0u);
+
+		float unused;
+		BoxMullerScalar(counter[0], counter[1], normalX[i], normalY[i]);
+		BoxMullerScalar(counter[2], counter[3], normalZ[i], unused);
+	}
+}
+
+
+#ifdef PENDULUM_KERNELS_X86
+
+//--------------------------------------------------------------------------------------
+// SSE, four pendulums per instruction
+//--------------------------------------------------------------------------------------
+
+// The moments of four pendulums or their partial sums, one vector per moment.
+struct MomentVectorsSSE
+{
+	__m128 m_velocity;
+	__m128 m_squaredVelocity;
+	__m128 m_position;
+	__m128 m_squaredExtension;
+};
+
+
+// The constants of the explicit Euler step, broadcast to every lane. They are passed by
+// reference, as 32 bit MSVC can not pass more than three aligned vectors by value.
+struct EulerConstantsSSE
+{
+	__m128 m_earth;
+	__m128 m_invMass;
+	__m128 m_damping;
+	__m128 m_spring;
+	__m128 m_delta;
+};
+
+// The transition matrix and the equilibrium offset of the exact propagator, broadcast to every lane.
+struct PropagatorConstantsSSE
+{
+	__m128 m_m00;
+	__m128 m_m01;
+	__m128 m_m10;
+	__m128 m_m11;
+	__m128 m_offset;
+};
+
+
+// Broadcasts the constants of the explicit Euler step.
+KERNEL_TARGET("sse2")
+static inline void LoadEulerConstantsSSE(float gravity, float deltaTime, EulerConstantsSSE& constants)
+{
+	constants.m_earth = _mm_set1_ps(gravity);
+	constants.m_invMass = _mm_set1_ps(PendulumPhysics::invMass);
+	constants.m_damping = _mm_set1_ps(PendulumPhysics::dampingVelocity);
+	constants.m_spring = _mm_set1_ps(PendulumPhysics::springConstant);
+	constants.m_delta = _mm_set1_ps(deltaTime);
+}
+
+
+// Broadcasts the transition matrix and the equilibrium offset of the exact propagator.
+KERNEL_TARGET("sse2")
+static inline void LoadPropagatorConstantsSSE(const float transition[4], float equilibriumOffset, PropagatorConstantsSSE& constants)
+{
+	constants.m_m00 = _mm_set1_ps(transition[0]);
+	constants.m_m01 = _mm_set1_ps(transition[1]);
+	constants.m_m10 = _mm_set1_ps(transition[2]);
+	constants.m_m11 = _mm_set1_ps(transition[3]);
+	constants.m_offset = _mm_set1_ps(equilibriumOffset);
+}
+
+
+// Loads the partial sums of the moments from the first lane on.
+KERNEL_TARGET("sse2")
+static inline void LoadMomentsSSE(float moments[NumOfAxisMoments][MomentLanes], int firstLane, MomentVectorsSSE& sums)
+{
+	sums.m_velocity = _mm_loadu_ps(&moments[AxisMomentVelocity][firstLane]);
+	sums.m_squaredVelocity = _mm_loadu_ps(&moments[AxisMomentSquaredVelocity][firstLane]);
+	sums.m_position = _mm_loadu_ps(&moments[AxisMomentPosition][firstLane]);
+	sums.m_squaredExtension = _mm_loadu_ps(&moments[AxisMomentSquaredExtension][firstLane]);
+}
+
+
+// Stores the partial sums of the moments back from the first lane on.
+KERNEL_TARGET("sse2")
+static inline void StoreMomentsSSE(float moments[NumOfAxisMoments][MomentLanes], int firstLane, const MomentVectorsSSE& sums)
+{
+	_mm_storeu_ps(&moments[AxisMomentVelocity][firstLane], sums.m_velocity);
+	_mm_storeu_ps(&moments[AxisMomentSquaredVelocity][firstLane], sums.m_squaredVelocity);
+	_mm_storeu_ps(&moments[AxisMomentPosition][firstLane], sums.m_position);
+	_mm_storeu_ps(&moments[AxisMomentSquaredExtension][firstLane], sums.m_squaredExtension);
+}
+
+
+// Gets the moments of the state of four pendulums.
+KERNEL_TARGET("sse2")
+static inline void ObtainMomentsSSE(__m128 anchor, __m128 position, __m128 velocity, MomentVectorsSSE& values)
+{
+	__m128 extension = _mm_sub_ps(position, anchor);
+	values.m_velocity = velocity;
+	values.m_squaredVelocity = _mm_mul_ps(velocity, velocity);
+	values.m_position = position;
+	values.m_squaredExtension = _mm_mul_ps(extension, extension);
+}
+
+
+// Adds the moments of four pendulums to their partial sums.
+KERNEL_TARGET("sse2")
+static inline void AddMomentsSSE(MomentVectorsSSE& sums, const MomentVectorsSSE& values)
+{
+	sums.m_velocity = _mm_add_ps(sums.m_velocity, values.m_velocity);
+	sums.m_squaredVelocity = _mm_add_ps(sums.m_squaredVelocity, values.m_squaredVelocity);
+	sums.m_position = _mm_add_ps(sums.m_position, values.m_position);
+	sums.m_squaredExtension = _mm_add_ps(sums.m_squaredExtension, values.m_squaredExtension);
+}
+
+
+// Advances four pendulums by an explicit Euler step and gets the moments of their new state.
+KERNEL_TARGET("sse2")
+static inline void EulerVectorSSE(const EulerConstantsSSE& constants, const float* anchor, float* position, float* velocity, MomentVectorsSSE& values)
+{
+	__m128 a = _mm_loadu_ps(anchor);
+	__m128 x = _mm_loadu_ps(position);
+	__m128 v = _mm_loadu_ps(velocity);
+
+	__m128 force = _mm_sub_ps(_mm_mul_ps(constants.m_spring, _mm_sub_ps(a, x)), _mm_mul_ps(v, constants.m_damping));
+	__m128 acceleration = _mm_add_ps(constants.m_earth, _mm_mul_ps(constants.m_invMass, force));
+
+	__m128 newX = _mm_add_ps(x, _mm_mul_ps(constants.m_delta, v));
+	__m128 newV = _mm_add_ps(v, _mm_mul_ps(constants.m_delta, acceleration));
+	_mm_storeu_ps(position, newX);
+	_mm_storeu_ps(velocity, newV);
+	ObtainMomentsSSE(a, newX, newV, values);
+}
+
+
+// Advances one axis by an explicit Euler step with 128 bit vectors.
+// With moments the pendulums are taken in blocks of four vectors, every vector of a block
+// has its own partial sums, so they stay in registers.
+KERNEL_TARGET("sse2")
+static void EulerAxisSSE(int count, float gravity, float deltaTime, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	EulerConstantsSSE constants;
+	LoadEulerConstantsSSE(gravity, deltaTime, constants);
+
+	int i = 0;
+	if (moments == NULL)
+	{
+		for(; i + 4 <= count; i += 4)
+		{
+			MomentVectorsSSE unused;
+			EulerVectorSSE(constants, anchor + i, position + i, velocity + i, unused);
+		}
+	}
+	else
+	{
+		MomentVectorsSSE firstSums, secondSums, thirdSums, fourthSums;
+		LoadMomentsSSE(moments, 0, firstSums);
+		LoadMomentsSSE(moments, 4, secondSums);
+		LoadMomentsSSE(moments, 8, thirdSums);
+		LoadMomentsSSE(moments, 12, fourthSums);
+		for(; i + MomentLanes <= count; i += MomentLanes)
+		{
+			MomentVectorsSSE first, second, third, fourth;
+			EulerVectorSSE(constants, anchor + i, position + i, velocity + i, first);
+			EulerVectorSSE(constants, anchor + i + 4, position + i + 4, velocity + i + 4, second);
+			EulerVectorSSE(constants, anchor + i + 8, position + i + 8, velocity + i + 8, third);
+			EulerVectorSSE(constants, anchor + i + 12, position + i + 12, velocity + i + 12, fourth);
+			AddMomentsSSE(firstSums, first);
+			AddMomentsSSE(secondSums, second);
+			AddMomentsSSE(thirdSums, third);
+			AddMomentsSSE(fourthSums, fourth);
+		}
+		StoreMomentsSSE(moments, 0, firstSums);
+		StoreMomentsSSE(moments, 4, secondSums);
+		StoreMomentsSSE(moments, 8, thirdSums);
+		StoreMomentsSSE(moments, 12, fourthSums);
+	}
+
+	// The remainder uses the same operations without fused multiply add.
+	EulerAxisScalar(count - i, gravity, deltaTime, anchor + i, position + i, velocity + i, moments);
+}
+
+
+// Applies the exact propagator to four pendulums and gets the moments of their new state.
+KERNEL_TARGET("sse2")
+static inline void PropagateVectorSSE(const PropagatorConstantsSSE& constants, const float* anchor, float* position, float* velocity, MomentVectorsSSE& values)
+{
+	__m128 a = _mm_loadu_ps(anchor);
+	__m128 equilibrium = _mm_add_ps(a, constants.m_offset);
+	__m128 displacement = _mm_sub_ps(_mm_loadu_ps(position), equilibrium);
+	__m128 v = _mm_loadu_ps(velocity);
+
+	__m128 newX = _mm_add_ps(equilibrium, _mm_add_ps(_mm_mul_ps(constants.m_m00, displacement), _mm_mul_ps(constants.m_m01, v)));
+	__m128 newV = _mm_add_ps(_mm_mul_ps(constants.m_m10, displacement), _mm_mul_ps(constants.m_m11, v));
+	_mm_storeu_ps(position, newX);
+	_mm_storeu_ps(velocity, newV);
+	ObtainMomentsSSE(a, newX, newV, values);
+}
+
+
+// Advances one axis with the exact propagator with 128 bit vectors.
+KERNEL_TARGET("sse2")
+static void PropagatorAxisSSE(int count, const float transition[4], float equilibriumOffset, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	PropagatorConstantsSSE constants;
+	LoadPropagatorConstantsSSE(transition, equilibriumOffset, constants);
+
+	int i = 0;
+	if (moments == NULL)
+	{
+		for(; i + 4 <= count; i += 4)
+		{
+			MomentVectorsSSE unused;
+			PropagateVectorSSE(constants, anchor + i, position + i, velocity + i, unused);
+		}
+	}
+	else
+	{
+		MomentVectorsSSE firstSums, secondSums, thirdSums, fourthSums;
+		LoadMomentsSSE(moments, 0, firstSums);
+		LoadMomentsSSE(moments, 4, secondSums);
+		LoadMomentsSSE(moments, 8, thirdSums);
+		LoadMomentsSSE(moments, 12, fourthSums);
+		for(; i + MomentLanes <= count; i += MomentLanes)
+		{
+			MomentVectorsSSE first, second, third, fourth;
+			PropagateVectorSSE(constants, anchor + i, position + i, velocity + i, first);
+			PropagateVectorSSE(constants, anchor + i + 4, position + i + 4, velocity + i + 4, second);
+			PropagateVectorSSE(constants, anchor + i + 8, position + i + 8, velocity + i + 8, third);
+			PropagateVectorSSE(constants, anchor + i + 12, position + i + 12, velocity + i + 12, fourth);
+			AddMomentsSSE(firstSums, first);
+			AddMomentsSSE(secondSums, second);
+			AddMomentsSSE(thirdSums, third);
+			AddMomentsSSE(fourthSums, fourth);
+		}
+		StoreMomentsSSE(moments, 0, firstSums);
+		StoreMomentsSSE(moments, 4, secondSums);
+		StoreMomentsSSE(moments, 8, thirdSums);
+		StoreMomentsSSE(moments, 12, fourthSums);
+	}
+
+	PropagatorAxisScalar(count - i, transition, equilibriumOffset, anchor + i, position + i, velocity + i, moments);
+}
+
+
+// Multiplies the lanes by the multiplier and splits the 64 bit products into their halves.
+// The even and odd lanes are multiplied separately, as SSE2 only multiplies every other lane.
+KERNEL_TARGET("sse2")
+static inline void MultiplyWideSSE(__m128i value, __m128i multiplier, __m128i& high, __m128i& low)
+{
+	const __m128i lowHalves = _mm_set_epi32(0, -1, 0, -1);
+	__m128i even = _mm_mul_epu32(value, multiplier);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(value, 32), multiplier);
+	low = _mm_or_si128(_mm_and_si128(even, lowHalves), _mm_slli_epi64(odd, 32));
+	high = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(lowHalves, odd));
+}
+
+
+// Applies the rounds of Philox4x32 to four counters.
+KERNEL_TARGET("sse2")
+static inline void PhiloxSSE(__m128i counter[4], unsigned int key0, unsigned int key1)
+{
+	const __m128i multiplier0 = _mm_set1_epi32(static_cast<int>(PhiloxMultiplier0));
+	const __m128i multiplier1 = _mm_set1_epi32(static_cast<int>(PhiloxMultiplier1));
+
+	for(int round = 0; round < PhiloxRounds; ++round)
+	{
+		__m128i high0, low0, high1, low1;
+		MultiplyWideSSE(counter[0], multiplier0, high0, low0);
+		MultiplyWideSSE(counter[2], multiplier1, high1, low1);
+		__m128i next0 = _mm_xor_si128(_mm_xor_si128(high1, counter[1]), _mm_set1_epi32(static_cast<int>(key0)));
+		__m128i next2 = _mm_xor_si128(_mm_xor_si128(high0, counter[3]), _mm_set1_epi32(static_cast<int>(key1)));
+		counter[0] = next0;
+		counter[1] = low1;
+		counter[2] = next2;
+		counter[3] = low0;
+		key0 += PhiloxIncrement0;
+		key1 += PhiloxIncrement1;
+	}
+}
+
+
+// Gets the natural logarithm of four numbers in (0, 1], like LogScalar.
+KERNEL_TARGET("sse2")
+static inline __m128 LogSSE(__m128 x)
+{
+	__m128i bits = _mm_castps_si128(x);
+	__m128i exponent = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+	__m128 mantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000)));
+	__m128 large = _mm_cmpgt_ps(mantissa, _mm_set1_ps(NoiseSqrt2));
+	mantissa = _mm_or_ps(_mm_and_ps(large, _mm_mul_ps(mantissa, _mm_set1_ps(0.5f))), _mm_andnot_ps(large, mantissa));
+	exponent = _mm_sub_epi32(exponent, _mm_castps_si128(large));
+
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 s = _mm_div_ps(_mm_sub_ps(mantissa, one), _mm_add_ps(mantissa, one));
+	__m128 s2 = _mm_mul_ps(s, s);
+	__m128 series = _mm_add_ps(_mm_set1_ps(0.142857149f), _mm_mul_ps(s2, _mm_set1_ps(0.111111112f)));
+	series = _mm_add_ps(_mm_set1_ps(0.2f), _mm_mul_ps(s2, series));
+	series = _mm_add_ps(_mm_set1_ps(0.333333343f), _mm_mul_ps(s2, series));
+	series = _mm_add_ps(one, _mm_mul_ps(s2, series));
+	return _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(exponent), _mm_set1_ps(NoiseLn2)), _mm_mul_ps(_mm_add_ps(s, s), series));
+}
+
+
+// Turns two random words per lane into two standard normal numbers, like BoxMullerScalar.
+KERNEL_TARGET("sse2")
+static inline void BoxMullerSSE(__m128i radiusBits, __m128i angleBits, __m128& first, __m128& second)
+{
+	__m128 u = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_srli_epi32(radiusBits, 8), _mm_set1_epi32(1))), _mm_set1_ps(NoiseUnit));
+	__m128 radius = _mm_sqrt_ps(_mm_mul_ps(_mm_set1_ps(-2.0f), LogSSE(u)));
+
+	__m128i angleSteps = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(angleBits, 6), _mm_set1_epi32(0x00FFFFFF)), _mm_set1_epi32(0x00800000));
+	__m128 angle = _mm_mul_ps(_mm_cvtepi32_ps(angleSteps), _mm_set1_ps(NoiseQuarterAngleUnit));
+	__m128 angle2 = _mm_mul_ps(angle, angle);
+	__m128 sine = _mm_add_ps(_mm_set1_ps(-0.000198412701f), _mm_mul_ps(angle2, _mm_set1_ps(2.75573188e-06f)));
+	sine = _mm_add_ps(_mm_set1_ps(0.00833333377f), _mm_mul_ps(angle2, sine));
+	sine = _mm_add_ps(_mm_set1_ps(-0.166666672f), _mm_mul_ps(angle2, sine));
+	sine = _mm_add_ps(angle, _mm_mul_ps(_mm_mul_ps(angle, angle2), sine));
+	__m128 cosine = _mm_add_ps(_mm_set1_ps(-0.00138888892f), _mm_mul_ps(angle2, _mm_set1_ps(2.48015876e-05f)));
+	cosine = _mm_add_ps(_mm_set1_ps(0.0416666679f), _mm_mul_ps(angle2, cosine));
+	cosine = _mm_add_ps(_mm_set1_ps(-0.5f), _mm_mul_ps(angle2, cosine));
+	cosine = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(angle2, cosine));
+
+	const __m128i one = _mm_set1_epi32(1);
+	__m128i quadrant = _mm_srli_epi32(angleBits, 30);
+	__m128 odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+	__m128 swappedSine = _mm_or_ps(_mm_and_ps(odd, cosine), _mm_andnot_ps(odd, sine));
+	__m128 swappedCosine = _mm_or_ps(_mm_and_ps(odd, sine), _mm_andnot_ps(odd, cosine));
+	__m128i sineSign = _mm_slli_epi32(_mm_srli_epi32(quadrant, 1), 31);
+	__m128i cosineSign = _mm_slli_epi32(_mm_and_si128(_mm_xor_si128(quadrant, _mm_srli_epi32(quadrant, 1)), one), 31);
+	swappedSine = _mm_xor_ps(swappedSine, _mm_castsi128_ps(sineSign));
+	swappedCosine = _mm_xor_ps(swappedCosine, _mm_castsi128_ps(cosineSign));
+
+	first = _mm_mul_ps(radius, swappedCosine);
+	second = _mm_mul_ps(radius, swappedSine);
+}
+
+
+// Draws three standard normal numbers for four streams at once, bitwise equal to the scalar kernel.
+KERNEL_TARGET("sse2")
+static void GaussianNoiseSSE(int count, const int* streams, unsigned long long step, unsigned int seed, float* normalX, float* normalY, float* normalZ)
+{
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i counter[4] = {_mm_loadu_si128(reinterpret_cast<const __m128i*>(streams + i)), _mm_setzero_si128(),
+			_mm_set1_epi32(static_cast<int>(step)), _mm_set1_epi32(static_cast<int>(step >> 32))};
+		PhiloxSSE(counter, seed, 0u);
+
+		__m128 x, y, z, unused;
+		BoxMullerSSE(counter[0], counter[1], x, y);
+		BoxMullerSSE(counter[2], counter[3], z, unused);
+		_mm_storeu_ps(normalX + i, x);
+		_mm_storeu_ps(normalY + i, y);
+		_mm_storeu_ps(normalZ + i, z);
+	}
+
+	GaussianNoiseScalar(count - i, streams + i, step, seed, normalX + i, normalY + i, normalZ + i);
+}
+
+
+// Adds the moments of one axis to the partial sums with 128 bit vectors, bitwise equal to the scalar kernel.
+KERNEL_TARGET("sse2")
+static void AxisMomentsSSE(int count, const float* anchor, const float* position, const float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	MomentVectorsSSE firstSums, secondSums, thirdSums, fourthSums;
+	LoadMomentsSSE(moments, 0, firstSums);
+	LoadMomentsSSE(moments, 4, secondSums);
+	LoadMomentsSSE(moments, 8, thirdSums);
+	LoadMomentsSSE(moments, 12, fourthSums);
+
+	int i = 0;
+	for(; i + MomentLanes <= count; i += MomentLanes)
+	{
+		MomentVectorsSSE first, second, third, fourth;
+		ObtainMomentsSSE(_mm_loadu_ps(anchor + i), _mm_loadu_ps(position + i), _mm_loadu_ps(velocity + i), first);
+		ObtainMomentsSSE(_mm_loadu_ps(anchor + i + 4), _mm_loadu_ps(position + i + 4), _mm_loadu_ps(velocity + i + 4), second);
+		ObtainMomentsSSE(_mm_loadu_ps(anchor + i + 8), _mm_loadu_ps(position + i + 8), _mm_loadu_ps(velocity + i + 8), third);
+		ObtainMomentsSSE(_mm_loadu_ps(anchor + i + 12), _mm_loadu_ps(position + i + 12), _mm_loadu_ps(velocity + i + 12), fourth);
+		AddMomentsSSE(firstSums, first);
+		AddMomentsSSE(secondSums, second);
+		AddMomentsSSE(thirdSums, third);
+		AddMomentsSSE(fourthSums, fourth);
+	}
+
+	StoreMomentsSSE(moments, 0, firstSums);
+	StoreMomentsSSE(moments, 4, secondSums);
+	StoreMomentsSSE(moments, 8, thirdSums);
+	StoreMomentsSSE(moments, 12, fourthSums);
+
+	// The remainder starts at a multiple of the lanes, so its pendulums go to the same partial sums.
+	AxisMomentsScalar(count - i, anchor + i, position + i, velocity + i, moments);
+}
+
+
+//--------------------------------------------------------------------------------------
+// AVX2 with FMA, eight pendulums per instruction
+//--------------------------------------------------------------------------------------
+
+// The moments of eight pendulums or their partial sums, one vector per moment.
+struct MomentVectorsAVX2
+{
+	__m256 m_velocity;
+	__m256 m_squaredVelocity;
+	__m256 m_position;
+	__m256 m_squaredExtension;
+};
+
+
+// The constants of the explicit Euler step, broadcast to every lane like in EulerConstantsSSE.
+struct EulerConstantsAVX2
+{
+	__m256 m_earth;
+	__m256 m_invMass;
+	__m256 m_damping;
+	__m256 m_spring;
+	__m256 m_delta;
+};
+
+// The transition matrix and the equilibrium offset of the exact propagator, broadcast to every lane.
+struct PropagatorConstantsAVX2
+{
+	__m256 m_m00;
+	__m256 m_m01;
+	__m256 m_m10;
+	__m256 m_m11;
+	__m256 m_offset;
+};
+
+
+// Broadcasts the constants of the explicit Euler step.
+KERNEL_TARGET("avx2")
+static inline void LoadEulerConstantsAVX2(float gravity, float deltaTime, EulerConstantsAVX2& constants)
+{
+	constants.m_earth = _mm256_set1_ps(gravity);
+	constants.m_invMass = _mm256_set1_ps(PendulumPhysics::invMass);
+	constants.m_damping = _mm256_set1_ps(PendulumPhysics::dampingVelocity);
+	constants.m_spring = _mm256_set1_ps(PendulumPhysics::springConstant);
+	constants.m_delta = _mm256_set1_ps(deltaTime);
+}
+
+
+// Broadcasts the transition matrix and the equilibrium offset of the exact propagator.
+KERNEL_TARGET("avx2")
+static inline void LoadPropagatorConstantsAVX2(const float transition[4], float equilibriumOffset, PropagatorConstantsAVX2& constants)
+{
+	constants.m_m00 = _mm256_set1_ps(transition[0]);
+	constants.m_m01 = _mm256_set1_ps(transition[1]);
+	constants.m_m10 = _mm256_set1_ps(transition[2]);
+	constants.m_m11 = _mm256_set1_ps(transition[3]);
+	constants.m_offset = _mm256_set1_ps(equilibriumOffset);
+}
+
+
+// Loads the partial sums of the moments from the first lane on.
+KERNEL_TARGET("avx2")
+static inline void LoadMomentsAVX2(float moments[NumOfAxisMoments][MomentLanes], int firstLane, MomentVectorsAVX2& sums)
+{
+	sums.m_velocity = _mm256_loadu_ps(&moments[AxisMomentVelocity][firstLane]);
+	sums.m_squaredVelocity = _mm256_loadu_ps(&moments[AxisMomentSquaredVelocity][firstLane]);
+	sums.m_position = _mm256_loadu_ps(&moments[AxisMomentPosition][firstLane]);
+	sums.m_squaredExtension = _mm256_loadu_ps(&moments[AxisMomentSquaredExtension][firstLane]);
+}
+
+
+// Stores the partial sums of the moments back from the first lane on.
+KERNEL_TARGET("avx2")
+static inline void StoreMomentsAVX2(float moments[NumOfAxisMoments][MomentLanes], int firstLane, const MomentVectorsAVX2& sums)
+{
+	_mm256_storeu_ps(&moments[AxisMomentVelocity][firstLane], sums.m_velocity);
+	_mm256_storeu_ps(&moments[AxisMomentSquaredVelocity][firstLane], sums.m_squaredVelocity);
+	_mm256_storeu_ps(&moments[AxisMomentPosition][firstLane], sums.m_position);
+	_mm256_storeu_ps(&moments[AxisMomentSquaredExtension][firstLane], sums.m_squaredExtension);
+}
+
+
+// Gets the moments of the state of eight pendulums.
+KERNEL_TARGET("avx2")
+static inline void ObtainMomentsAVX2(__m256 anchor, __m256 position, __m256 velocity, MomentVectorsAVX2& values)
+{
+	__m256 extension = _mm256_sub_ps(position, anchor);
+	values.m_velocity = velocity;
+	values.m_squaredVelocity = _mm256_mul_ps(velocity, velocity);
+	values.m_position = position;
+	values.m_squaredExtension = _mm256_mul_ps(extension, extension);
+}
+
+
+// Adds the moments of eight pendulums to their partial sums.
+KERNEL_TARGET("avx2")
+static inline void AddMomentsAVX2(MomentVectorsAVX2& sums, const MomentVectorsAVX2& values)
+{
+	sums.m_velocity = _mm256_add_ps(sums.m_velocity, values.m_velocity);
+	sums.m_squaredVelocity = _mm256_add_ps(sums.m_squaredVelocity, values.m_squaredVelocity);
+	sums.m_position = _mm256_add_ps(sums.m_position, values.m_position);
+	sums.m_squaredExtension = _mm256_add_ps(sums.m_squaredExtension, values.m_squaredExtension);
+}
+
+
+// Gets the mask of the lanes below the number of remaining pendulums.
+KERNEL_TARGET("avx2")
+static inline __m256i ObtainRemainderMaskAVX2(int remaining)
+{
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	return _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining), lanes);
+}
+
+
+// Advances eight pendulums by an explicit Euler step with fused multiply add and gets the moments of their new state.
+KERNEL_TARGET("avx2,fma")
+static inline void EulerVectorAVX2(const EulerConstantsAVX2& constants, const float* anchor, float* position, float* velocity, MomentVectorsAVX2& values)
+{
+	__m256 a = _mm256_loadu_ps(anchor);
+	__m256 x = _mm256_loadu_ps(position);
+	__m256 v = _mm256_loadu_ps(velocity);
+
+	__m256 force = _mm256_fmsub_ps(constants.m_spring, _mm256_sub_ps(a, x), _mm256_mul_ps(v, constants.m_damping));
+	__m256 acceleration = _mm256_fmadd_ps(constants.m_invMass, force, constants.m_earth);
+
+	__m256 newX = _mm256_fmadd_ps(constants.m_delta, v, x);
+	__m256 newV = _mm256_fmadd_ps(constants.m_delta, acceleration, v);
+	_mm256_storeu_ps(position, newX);
+	_mm256_storeu_ps(velocity, newV);
+	ObtainMomentsAVX2(a, newX, newV, values);
+}
+
+
+// Like EulerVectorAVX2 for the remaining pendulums at the end, with masked loads so every
+// pendulum sees the same arithmetic. The moments of the lanes beyond the end are zero.
+KERNEL_TARGET("avx2,fma")
+static inline void EulerRemainderAVX2(const EulerConstantsAVX2& constants, int remaining, const float* anchor, float* position, float* velocity, MomentVectorsAVX2& values)
+{
+	__m256i mask = ObtainRemainderMaskAVX2(remaining);
+	__m256 a = _mm256_maskload_ps(anchor, mask);
+	__m256 x = _mm256_maskload_ps(position, mask);
+	__m256 v = _mm256_maskload_ps(velocity, mask);
+
+	__m256 force = _mm256_fmsub_ps(constants.m_spring, _mm256_sub_ps(a, x), _mm256_mul_ps(v, constants.m_damping));
+	__m256 acceleration = _mm256_fmadd_ps(constants.m_invMass, force, constants.m_earth);
+
+	__m256 newX = _mm256_fmadd_ps(constants.m_delta, v, x);
+	__m256 newV = _mm256_fmadd_ps(constants.m_delta, acceleration, v);
+	_mm256_maskstore_ps(position, mask, newX);
+	_mm256_maskstore_ps(velocity, mask, newV);
+
+	__m256 valid = _mm256_castsi256_ps(mask);
+	ObtainMomentsAVX2(a, _mm256_and_ps(newX, valid), _mm256_and_ps(newV, valid), values);
+}
+
+
+// Advances one axis by an explicit Euler step with 256 bit vectors and fused multiply add.
+// With moments the pendulums are taken in blocks of two vectors with their own partial sums.
+KERNEL_TARGET("avx2,fma")
+static void EulerAxisAVX2(int count, float gravity, float deltaTime, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	EulerConstantsAVX2 constants;
+	LoadEulerConstantsAVX2(gravity, deltaTime, constants);
+
+	if (moments == NULL)
+	{
+		MomentVectorsAVX2 unused;
+		int i = 0;
+		for(; i + 8 <= count; i += 8)
+			EulerVectorAVX2(constants, anchor + i, position + i, velocity + i, unused);
+		if (i < count)
+			EulerRemainderAVX2(constants, count - i, anchor + i, position + i, velocity + i, unused);
+		return;
+	}
+
+	MomentVectorsAVX2 lowerSums, upperSums;
+	LoadMomentsAVX2(moments, 0, lowerSums);
+	LoadMomentsAVX2(moments, 8, upperSums);
+	for(int i = 0; i < count; i += MomentLanes)
+	{
+		MomentVectorsAVX2 first, second;
+		if (i + MomentLanes <= count)
+		{
+			EulerVectorAVX2(constants, anchor + i, position + i, velocity + i, first);
+			EulerVectorAVX2(constants, anchor + i + 8, position + i + 8, velocity + i + 8, second);
+		}
+		else
+		{
+			EulerRemainderAVX2(constants, count - i, anchor + i, position + i, velocity + i, first);
+			if (count - i > 8)
+				EulerRemainderAVX2(constants, count - i - 8, anchor + i + 8, position + i + 8, velocity + i + 8, second);
+			else
+				ObtainMomentsAVX2(_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), second);
+		}
+		AddMomentsAVX2(lowerSums, first);
+		AddMomentsAVX2(upperSums, second);
+	}
+	StoreMomentsAVX2(moments, 0, lowerSums);
+	StoreMomentsAVX2(moments, 8, upperSums);
+}
+
+
+// Applies the exact propagator with fused multiply add to the remaining pendulums, at most eight,
+// and gets the moments of their new state. The moments of the lanes beyond the end are zero.
+KERNEL_TARGET("avx2,fma")
+static inline void PropagateRemainderAVX2(const PropagatorConstantsAVX2& constants, int remaining, const float* anchor, float* position, float* velocity, MomentVectorsAVX2& values)
+{
+	__m256i mask = ObtainRemainderMaskAVX2(remaining);
+	__m256 a = _mm256_maskload_ps(anchor, mask);
+	__m256 equilibrium = _mm256_add_ps(a, constants.m_offset);
+	__m256 displacement = _mm256_sub_ps(_mm256_maskload_ps(position, mask), equilibrium);
+	__m256 v = _mm256_maskload_ps(velocity, mask);
+
+	__m256 newX = _mm256_add_ps(equilibrium, _mm256_fmadd_ps(constants.m_m00, displacement, _mm256_mul_ps(constants.m_m01, v)));
+	__m256 newV = _mm256_fmadd_ps(constants.m_m10, displacement, _mm256_mul_ps(constants.m_m11, v));
+	_mm256_maskstore_ps(position, mask, newX);
+	_mm256_maskstore_ps(velocity, mask, newV);
+
+	__m256 valid = _mm256_castsi256_ps(mask);
+	ObtainMomentsAVX2(a, _mm256_and_ps(newX, valid), _mm256_and_ps(newV, valid), values);
+}
+
+
+// Advances one axis with the exact propagator with 256 bit vectors and fused multiply add.
+// Every vector is loaded masked, with moments they are taken in blocks of two like in EulerAxisAVX2.
+KERNEL_TARGET("avx2,fma")
+static void PropagatorAxisAVX2(int count, const float transition[4], float equilibriumOffset, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	PropagatorConstantsAVX2 constants;
+	LoadPropagatorConstantsAVX2(transition, equilibriumOffset, constants);
+
+	if (moments == NULL)
+	{
+		MomentVectorsAVX2 unused;
+		for(int i = 0; i < count; i += 8)
+			PropagateRemainderAVX2(constants, count - i, anchor + i, position + i, velocity + i, unused);
+		return;
+	}
+
+	MomentVectorsAVX2 lowerSums, upperSums;
+	LoadMomentsAVX2(moments, 0, lowerSums);
+	LoadMomentsAVX2(moments, 8, upperSums);
+	for(int i = 0; i < count; i += MomentLanes)
+	{
+		MomentVectorsAVX2 first, second;
+		PropagateRemainderAVX2(constants, count - i, anchor + i, position + i, velocity + i, first);
+		if (count - i > 8)
+			PropagateRemainderAVX2(constants, count - i - 8, anchor + i + 8, position + i + 8, velocity + i + 8, second);
+		else
+			ObtainMomentsAVX2(_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), second);
+		AddMomentsAVX2(lowerSums, first);
+		AddMomentsAVX2(upperSums, second);
+	}
+	StoreMomentsAVX2(moments, 0, lowerSums);
+	StoreMomentsAVX2(moments, 8, upperSums);
+}
+
+
+// Multiplies the lanes by the multiplier and splits the 64 bit products into their halves.
+// The even and odd lanes are multiplied separately, as AVX2 only multiplies every other lane.
+KERNEL_TARGET("avx2")
+static inline void MultiplyWideAVX2(__m256i value, __m256i multiplier, __m256i& high, __m256i& low)
+{
+	const __m256i lowHalves = _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1);
+	__m256i even = _mm256_mul_epu32(value, multiplier);
+	__m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(value, 32), multiplier);
+	low = _mm256_or_si256(_mm256_and_si256(even, lowHalves), _mm256_slli_epi64(odd, 32));
+	high = _mm256_or_si256(_mm256_srli_epi64(even, 32), _mm256_andnot_si256(lowHalves, odd));
+}
+
+
+// Applies the rounds of Philox4x32 to eight counters.
+KERNEL_TARGET("avx2")
+static inline void PhiloxAVX2(__m256i counter[4], unsigned int key0, unsigned int key1)
+{
+	const __m256i multiplier0 = _mm256_set1_epi32(static_cast<int>(PhiloxMultiplier0));
+	const __m256i multiplier1 = _mm256_set1_epi32(static_cast<int>(PhiloxMultiplier1));
+
+	for(int round = 0; round < PhiloxRounds; ++round)
+	{
+		__m256i high0, low0, high1, low1;
+		MultiplyWideAVX2(counter[0], multiplier0, high0, low0);
+		MultiplyWideAVX2(counter[2], multiplier1, high1, low1);
+		__m256i next0 = _mm256_xor_si256(_mm256_xor_si256(high1, counter[1]), _mm256_set1_epi32(static_cast<int>(key0)));
+		__m256i next2 = _mm256_xor_si256(_mm256_xor_si256(high0, counter[3]), _mm256_set1_epi32(static_cast<int>(key1)));
+		counter[0] = next0;
+		counter[1] = low1;
+		counter[2] = next2;
+		counter[3] = low0;
+		key0 += PhiloxIncrement0;
+		key1 += PhiloxIncrement1;
+	}
+}
+
+
+// Gets the natural logarithm of eight numbers in (0, 1], like LogScalar.
+KERNEL_TARGET("avx2")
+static inline __m256 LogAVX2(__m256 x)
+{
+	__m256i bits = _mm256_castps_si256(x);
+	__m256i exponent = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+	__m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F800000)));
+	__m256 large = _mm256_cmp_ps(mantissa, _mm256_set1_ps(NoiseSqrt2), _CMP_GT_OQ);
+	mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(0.5f)), large);
+	exponent = _mm256_sub_epi32(exponent, _mm256_castps_si256(large));
+
+	const __m256 one = _mm256_set1_ps(1.0f);
+	__m256 s = _mm256_div_ps(_mm256_sub_ps(mantissa, one), _mm256_add_ps(mantissa, one));
+	__m256 s2 = _mm256_mul_ps(s, s);
+	__m256 series = _mm256_add_ps(_mm256_set1_ps(0.142857149f), _mm256_mul_ps(s2, _mm256_set1_ps(0.111111112f)));
+	series = _mm256_add_ps(_mm256_set1_ps(0.2f), _mm256_mul_ps(s2, series));
+	series = _mm256_add_ps(_mm256_set1_ps(0.333333343f), _mm256_mul_ps(s2, series));
+	series = _mm256_add_ps(one, _mm256_mul_ps(s2, series));
+	return _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(exponent), _mm256_set1_ps(NoiseLn2)), _mm256_mul_ps(_mm256_add_ps(s, s), series));
+}
+
+
+// Turns two random words per lane into two standard normal numbers, like BoxMullerScalar.
+KERNEL_TARGET("avx2")
+static inline void BoxMullerAVX2(__m256i radiusBits, __m256i angleBits, __m256& first, __m256& second)
+{
+	__m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_srli_epi32(radiusBits, 8), _mm256_set1_epi32(1))), _mm256_set1_ps(NoiseUnit));
+	__m256 radius = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.0f), LogAVX2(u)));
+
+	__m256i angleSteps = _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(angleBits, 6), _mm256_set1_epi32(0x00FFFFFF)), _mm256_set1_epi32(0x00800000));
+	__m256 angle = _mm256_mul_ps(_mm256_cvtepi32_ps(angleSteps), _mm256_set1_ps(NoiseQuarterAngleUnit));
+	__m256 angle2 = _mm256_mul_ps(angle, angle);
+	__m256 sine = _mm256_add_ps(_mm256_set1_ps(-0.000198412701f), _mm256_mul_ps(angle2, _mm256_set1_ps(2.75573188e-06f)));
+	sine = _mm256_add_ps(_mm256_set1_ps(0.00833333377f), _mm256_mul_ps(angle2, sine));
+	sine = _mm256_add_ps(_mm256_set1_ps(-0.166666672f), _mm256_mul_ps(angle2, sine));
+	sine = _mm256_add_ps(angle, _mm256_mul_ps(_mm256_mul_ps(angle, angle2), sine));
+	__m256 cosine = _mm256_add_ps(_mm256_set1_ps(-0.00138888892f), _mm256_mul_ps(angle2, _mm256_set1_ps(2.48015876e-05f)));
+	cosine = _mm256_add_ps(_mm256_set1_ps(0.0416666679f), _mm256_mul_ps(angle2, cosine));
+	cosine = _mm256_add_ps(_mm256_set1_ps(-0.5f), _mm256_mul_ps(angle2, cosine));
+	cosine = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(angle2, cosine));
+
+	const __m256i one = _mm256_set1_epi32(1);
+	__m256i quadrant = _mm256_srli_epi32(angleBits, 30);
+	__m256 odd = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+	__m256 swappedSine = _mm256_blendv_ps(sine, cosine, odd);
+	__m256 swappedCosine = _mm256_blendv_ps(cosine, sine, odd);
+	__m256i sineSign = _mm256_slli_epi32(_mm256_srli_epi32(quadrant, 1), 31);
+	__m256i cosineSign = _mm256_slli_epi32(_mm256_and_si256(_mm256_xor_si256(quadrant, _mm256_srli_epi32(quadrant, 1)), one), 31);
+	swappedSine = _mm256_xor_ps(swappedSine, _mm256_castsi256_ps(sineSign));
+	swappedCosine = _mm256_xor_ps(swappedCosine, _mm256_castsi256_ps(cosineSign));
+
+	first = _mm256_mul_ps(radius, swappedCosine);
+	second = _mm256_mul_ps(radius, swappedSine);
+}
+
+
+// Draws three standard normal numbers for eight streams at once, bitwise equal to the scalar kernel.
+KERNEL_TARGET("avx2")
+static void GaussianNoiseAVX2(int count, const int* streams, unsigned long long step, unsigned int seed, float* normalX, float* normalY, float* normalZ)
+{
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i counter[4] = {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(streams + i)), _mm256_setzero_si256(),
+			_mm256_set1_epi32(static_cast<int>(step)), _mm256_set1_epi32(static_cast<int>(step >> 32))};
+		PhiloxAVX2(counter, seed, 0u);
+
+		__m256 x, y, z, unused;
+		BoxMullerAVX2(counter[0], counter[1], x, y);
+		BoxMullerAVX2(counter[2], counter[3], z, unused);
+		_mm256_storeu_ps(normalX + i, x);
+		_mm256_storeu_ps(normalY + i, y);
+		_mm256_storeu_ps(normalZ + i, z);
+	}
+
+	GaussianNoiseScalar(count - i, streams + i, step, seed, normalX + i, normalY + i, normalZ + i);
+}
+
+
+// Adds the moments of one axis to the partial sums with 256 bit vectors, bitwise equal to the scalar kernel.
+KERNEL_TARGET("avx2")
+static void AxisMomentsAVX2(int count, const float* anchor, const float* position, const float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	MomentVectorsAVX2 lowerSums, upperSums;
+	LoadMomentsAVX2(moments, 0, lowerSums);
+	LoadMomentsAVX2(moments, 8, upperSums);
+
+	int i = 0;
+	for(; i + MomentLanes <= count; i += MomentLanes)
+	{
+		MomentVectorsAVX2 lower, upper;
+		ObtainMomentsAVX2(_mm256_loadu_ps(anchor + i), _mm256_loadu_ps(position + i), _mm256_loadu_ps(velocity + i), lower);
+		ObtainMomentsAVX2(_mm256_loadu_ps(anchor + i + 8), _mm256_loadu_ps(position + i + 8), _mm256_loadu_ps(velocity + i + 8), upper);
+		AddMomentsAVX2(lowerSums, lower);
+		AddMomentsAVX2(upperSums, upper);
+	}
+
+	StoreMomentsAVX2(moments, 0, lowerSums);
+	StoreMomentsAVX2(moments, 8, upperSums);
+
+	AxisMomentsScalar(count - i, anchor + i, position + i, velocity + i, moments);
+}
+
+
+//--------------------------------------------------------------------------------------
+// AVX-512, sixteen pendulums per instruction
+//--------------------------------------------------------------------------------------
+
+// The moments of sixteen pendulums or their partial sums, one vector per moment.
+struct MomentVectorsAVX512
+{
+	__m512 m_velocity;
+	__m512 m_squaredVelocity;
+	__m512 m_position;
+	__m512 m_squaredExtension;
+};
+
+
+// Gets the moments of the state of sixteen pendulums.
+KERNEL_TARGET("avx512f")
+static inline void ObtainMomentsAVX512(__m512 anchor, __m512 position, __m512 velocity, MomentVectorsAVX512& values)
+{
+	__m512 extension = _mm512_sub_ps(position, anchor);
+	values.m_velocity = velocity;
+	values.m_squaredVelocity = _mm512_mul_ps(velocity, velocity);
+	values.m_position = position;
+	values.m_squaredExtension = _mm512_mul_ps(extension, extension);
+}
+
+
+// Loads the partial sums of the moments.
+KERNEL_TARGET("avx512f")
+static inline void LoadMomentsAVX512(float moments[NumOfAxisMoments][MomentLanes], MomentVectorsAVX512& sums)
+{
+	sums.m_velocity = _mm512_loadu_ps(moments[AxisMomentVelocity]);
+	sums.m_squaredVelocity = _mm512_loadu_ps(moments[AxisMomentSquaredVelocity]);
+	sums.m_position = _mm512_loadu_ps(moments[AxisMomentPosition]);
+	sums.m_squaredExtension = _mm512_loadu_ps(moments[AxisMomentSquaredExtension]);
+}
+
+
+// Stores the partial sums of the moments back.
+KERNEL_TARGET("avx512f")
+static inline void StoreMomentsAVX512(float moments[NumOfAxisMoments][MomentLanes], const MomentVectorsAVX512& sums)
+{
+	_mm512_storeu_ps(moments[AxisMomentVelocity], sums.m_velocity);
+	_mm512_storeu_ps(moments[AxisMomentSquaredVelocity], sums.m_squaredVelocity);
+	_mm512_storeu_ps(moments[AxisMomentPosition], sums.m_position);
+	_mm512_storeu_ps(moments[AxisMomentSquaredExtension], sums.m_squaredExtension);
+}
+
+
+// Adds the moments of sixteen pendulums to their partial sums.
+KERNEL_TARGET("avx512f")
+static inline void AddMomentsAVX512(MomentVectorsAVX512& sums, const MomentVectorsAVX512& values)
+{
+	sums.m_velocity = _mm512_add_ps(sums.m_velocity, values.m_velocity);
+	sums.m_squaredVelocity = _mm512_add_ps(sums.m_squaredVelocity, values.m_squaredVelocity);
+	sums.m_position = _mm512_add_ps(sums.m_position, values.m_position);
+	sums.m_squaredExtension = _mm512_add_ps(sums.m_squaredExtension, values.m_squaredExtension);
+}
+
+
+// Advances one axis by an explicit Euler step with 512 bit vectors and fused multiply add.
+// The lanes beyond the end add zeros to the partial sums.
+KERNEL_TARGET("avx512f")
+static void EulerAxisAVX512(int count, float gravity, float deltaTime, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	const __m512 earth = _mm512_set1_ps(gravity);
+	const __m512 invMass = _mm512_set1_ps(PendulumPhysics::invMass);
+	const __m512 damping = _mm512_set1_ps(PendulumPhysics::dampingVelocity);
+	const __m512 spring = _mm512_set1_ps(PendulumPhysics::springConstant);
+	const __m512 delta = _mm512_set1_ps(deltaTime);
+
+	MomentVectorsAVX512 sums = {};
+	if (moments != NULL)
+		LoadMomentsAVX512(moments, sums);
+
+	for(int i = 0; i < count; i += 16)
+	{
+		int remaining = count - i;
+		__mmask16 mask = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1u);
+
+		__m512 a = _mm512_maskz_loadu_ps(mask, anchor + i);
+		__m512 x = _mm512_maskz_loadu_ps(mask, position + i);
+		__m512 v = _mm512_maskz_loadu_ps(mask, velocity + i);
+
+		__m512 force = _mm512_fmsub_ps(spring, _mm512_sub_ps(a, x), _mm512_mul_ps(v, damping));
+		__m512 acceleration = _mm512_fmadd_ps(invMass, force, earth);
+
+		__m512 newX = _mm512_fmadd_ps(delta, v, x);
+		__m512 newV = _mm512_fmadd_ps(delta, acceleration, v);
+		_mm512_mask_storeu_ps(position + i, mask, newX);
+		_mm512_mask_storeu_ps(velocity + i, mask, newV);
+
+		if (moments != NULL)
+		{
+			MomentVectorsAVX512 values;
+			ObtainMomentsAVX512(a, _mm512_maskz_mov_ps(mask, newX), _mm512_maskz_mov_ps(mask, newV), values);
+			AddMomentsAVX512(sums, values);
+		}
+	}
+
+	if (moments != NULL)
+		StoreMomentsAVX512(moments, sums);
+}
+
+
+// Advances one axis with the exact propagator with 512 bit vectors and fused multiply add.
+KERNEL_TARGET("avx512f")
+static void PropagatorAxisAVX512(int count, const float transition[4], float equilibriumOffset, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	const __m512 m00 = _mm512_set1_ps(transition[0]);
+	const __m512 m01 = _mm512_set1_ps(transition[1]);
+	const __m512 m10 = _mm512_set1_ps(transition[2]);
+	const __m512 m11 = _mm512_set1_ps(transition[3]);
+	const __m512 offset = _mm512_set1_ps(equilibriumOffset);
+
+	MomentVectorsAVX512 sums = {};
+	if (moments != NULL)
+		LoadMomentsAVX512(moments, sums);
+
+	for(int i = 0; i < count; i += 16)
+	{
+		int remaining = count - i;
+		__mmask16 mask = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1u);
+
+		__m512 a = _mm512_maskz_loadu_ps(mask, anchor + i);
+		__m512 equilibrium = _mm512_add_ps(a, offset);
+		__m512 displacement = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, position + i), equilibrium);
+		__m512 v = _mm512_maskz_loadu_ps(mask, velocity + i);
+
+		__m512 newX = _mm512_add_ps(equilibrium, _mm512_fmadd_ps(m00, displacement, _mm512_mul_ps(m01, v)));
+		__m512 newV = _mm512_fmadd_ps(m10, displacement, _mm512_mul_ps(m11, v));
+		_mm512_mask_storeu_ps(position + i, mask, newX);
+		_mm512_mask_storeu_ps(velocity + i, mask, newV);
+
+		if (moments != NULL)
+		{
+			MomentVectorsAVX512 values;
+			ObtainMomentsAVX512(a, _mm512_maskz_mov_ps(mask, newX), _mm512_maskz_mov_ps(mask, newV), values);
+			AddMomentsAVX512(sums, values);
+		}
+	}
+
+	if (moments != NULL)
+		StoreMomentsAVX512(moments, sums);
+}
+
+
+// Multiplies the lanes by the multiplier and splits the 64 bit products into their halves.
+KERNEL_TARGET("avx512f")
+static inline void MultiplyWideAVX512(__m512i value, __m512i multiplier, __m512i& high, __m512i& low)
+{
+	const __m512i lowHalves = _mm512_set1_epi64(0x00000000FFFFFFFFll);
+	__m512i even = _mm512_mul_epu32(value, multiplier);
+	__m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(value, 32), multiplier);
+	low = _mm512_or_si512(_mm512_and_si512(even, lowHalves), _mm512_slli_epi64(odd, 32));
+	high = _mm512_or_si512(_mm512_srli_epi64(even, 32), _mm512_andnot_si512(lowHalves, odd));
+}
+
+
+// Applies the rounds of Philox4x32 to sixteen counters.
+KERNEL_TARGET("avx512f")
+static inline void PhiloxAVX512(__m512i counter[4], unsigned int key0, unsigned int key1)
+{
+	const __m512i multiplier0 = _mm512_set1_epi32(static_cast<int>(PhiloxMultiplier0));
+	const __m512i multiplier1 = _mm512_set1_epi32(static_cast<int>(PhiloxMultiplier1));
+
+	for(int round = 0; round < PhiloxRounds; ++round)
+	{
+		__m512i high0, low0, high1, low1;
+		MultiplyWideAVX512(counter[0], multiplier0, high0, low0);
+		MultiplyWideAVX512(counter[2], multiplier1, high1, low1);
+		__m512i next0 = _mm512_xor_si512(_mm512_xor_si512(high1, counter[1]), _mm512_set1_epi32(static_cast<int>(key0)));
+		__m512i next2 = _mm512_xor_si512(_mm512_xor_si512(high0, counter[3]), _mm512_set1_epi32(static_cast<int>(key1)));
+		counter[0] = next0;
+		counter[1] = low1;
+		counter[2] = next2;
+		counter[3] = low0;
+		key0 += PhiloxIncrement0;
+		key1 += PhiloxIncrement1;
+	}
+}
+
+
+// Gets the natural logarithm of sixteen numbers in (0, 1], like LogScalar.
+KERNEL_TARGET("avx512f")
+static inline __m512 LogAVX512(__m512 x)
+{
+	__m512i bits = _mm512_castps_si512(x);
+	__m512i exponent = _mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(127));
+	__m512 mantissa = _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007FFFFF)), _mm512_set1_epi32(0x3F800000)));
+	__mmask16 large = _mm512_cmp_ps_mask(mantissa, _mm512_set1_ps(NoiseSqrt2), _CMP_GT_OQ);
+	mantissa = _mm512_mask_mul_ps(mantissa, large, mantissa, _mm512_set1_ps(0.5f));
+	exponent = _mm512_mask_add_epi32(exponent, large, exponent, _mm512_set1_epi32(1));
+
+	const __m512 one = _mm512_set1_ps(1.0f);
+	__m512 s = _mm512_div_ps(_mm512_sub_ps(mantissa, one), _mm512_add_ps(mantissa, one));
+	__m512 s2 = _mm512_mul_ps(s, s);
+	__m512 series = _mm512_add_ps(_mm512_set1_ps(0.142857149f), _mm512_mul_ps(s2, _mm512_set1_ps(0.111111112f)));
+	series = _mm512_add_ps(_mm512_set1_ps(0.2f), _mm512_mul_ps(s2, series));
+	series = _mm512_add_ps(_mm512_set1_ps(0.333333343f), _mm512_mul_ps(s2, series));
+	series = _mm512_add_ps(one, _mm512_mul_ps(s2, series));
+	return _mm512_add_ps(_mm512_mul_ps(_mm512_cvtepi32_ps(exponent), _mm512_set1_ps(NoiseLn2)), _mm512_mul_ps(_mm512_add_ps(s, s), series));
+}
+
+
+// Turns two random words per lane into two standard normal numbers, like BoxMullerScalar.
+KERNEL_TARGET("avx512f")
+static inline void BoxMullerAVX512(__m512i radiusBits, __m512i angleBits, __m512& first, __m512& second)
+{
+	__m512 u = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(_mm512_srli_epi32(radiusBits, 8), _mm512_set1_epi32(1))), _mm512_set1_ps(NoiseUnit));
+	__m512 radius = _mm512_sqrt_ps(_mm512_mul_ps(_mm512_set1_ps(-2.0f), LogAVX512(u)));
+
+	__m512i angleSteps = _mm512_sub_epi32(_mm512_and_si512(_mm512_srli_epi32(angleBits, 6), _mm512_set1_epi32(0x00FFFFFF)), _mm512_set1_epi32(0x00800000));
+	__m512 angle = _mm512_mul_ps(_mm512_cvtepi32_ps(angleSteps), _mm512_set1_ps(NoiseQuarterAngleUnit));
+	__m512 angle2 = _mm512_mul_ps(angle, angle);
+	__m512 sine = _mm512_add_ps(_mm512_set1_ps(-0.000198412701f), _mm512_mul_ps(angle2, _mm512_set1_ps(2.75573188e-06f)));
+	sine = _mm512_add_ps(_mm512_set1_ps(0.00833333377f), _mm512_mul_ps(angle2, sine));
+	sine = _mm512_add_ps(_mm512_set1_ps(-0.166666672f), _mm512_mul_ps(angle2, sine));
+	sine = _mm512_add_ps(angle, _mm512_mul_ps(_mm512_mul_ps(angle, angle2), sine));
+	__m512 cosine = _mm512_add_ps(_mm512_set1_ps(-0.00138888892f), _mm512_mul_ps(angle2, _mm512_set1_ps(2.48015876e-05f)));
+	cosine = _mm512_add_ps(_mm512_set1_ps(0.0416666679f), _mm512_mul_ps(angle2, cosine));
+	cosine = _mm512_add_ps(_mm512_set1_ps(-0.5f), _mm512_mul_ps(angle2, cosine));
+	cosine = _mm512_add_ps(_mm512_set1_ps(1.0f), _mm512_mul_ps(angle2, cosine));
+
+	const __m512i one = _mm512_set1_epi32(1);
+	__m512i quadrant = _mm512_srli_epi32(angleBits, 30);
+	__mmask16 odd = _mm512_test_epi32_mask(quadrant, one);
+	__m512 swappedSine = _mm512_mask_blend_ps(odd, sine, cosine);
+	__m512 swappedCosine = _mm512_mask_blend_ps(odd, cosine, sine);
+	__m512i sineSign = _mm512_slli_epi32(_mm512_srli_epi32(quadrant, 1), 31);
+	__m512i cosineSign = _mm512_slli_epi32(_mm512_and_si512(_mm512_xor_si512(quadrant, _mm512_srli_epi32(quadrant, 1)), one), 31);
+	swappedSine = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(swappedSine), sineSign));
+	swappedCosine = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(swappedCosine), cosineSign));
+
+	first = _mm512_mul_ps(radius, swappedCosine);
+	second = _mm512_mul_ps(radius, swappedSine);
+}
+
+
+// Draws three standard normal numbers for sixteen streams at once, bitwise equal to the scalar kernel.
+KERNEL_TARGET("avx512f")
+static void GaussianNoiseAVX512(int count, const int* streams, unsigned long long step, unsigned int seed, float* normalX, float* normalY, float* normalZ)
+{
+	int i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m512i counter[4] = {_mm512_loadu_si512(streams + i), _mm512_setzero_si512(),
+			_mm512_set1_epi32(static_cast<int>(step)), _mm512_set1_epi32(static_cast<int>(step >> 32))};
+		PhiloxAVX512(counter, seed, 0u);
+
+		__m512 x, y, z, unused;
+		BoxMullerAVX512(counter[0], counter[1], x, y);
+		BoxMullerAVX512(counter[2], counter[3], z, unused);
+		_mm512_storeu_ps(normalX + i, x);
+		_mm512_storeu_ps(normalY + i, y);
+		_mm512_storeu_ps(normalZ + i, z);
+	}
+
+	GaussianNoiseScalar(count - i, streams + i, step, seed, normalX + i, normalY + i, normalZ + i);
+}
+
+
+// Adds the moments of one axis to the partial sums with 512 bit vectors, bitwise equal to the scalar kernel.
+KERNEL_TARGET("avx512f")
+static void AxisMomentsAVX512(int count, const float* anchor, const float* position, const float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	MomentVectorsAVX512 sums = {};
+	LoadMomentsAVX512(moments, sums);
+
+	int i = 0;
+	for(; i + MomentLanes <= count; i += MomentLanes)
+	{
+		MomentVectorsAVX512 values;
+		ObtainMomentsAVX512(_mm512_loadu_ps(anchor + i), _mm512_loadu_ps(position + i), _mm512_loadu_ps(velocity + i), values);
+		AddMomentsAVX512(sums, values);
+	}
+
+	StoreMomentsAVX512(moments, sums);
+
+	AxisMomentsScalar(count - i, anchor + i, position + i, velocity + i, moments);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Deterministic AVX2 and AVX-512. They do the operations of the scalar reference in the
+// same order without fused multiply add, so they give the same bits.
+//--------------------------------------------------------------------------------------
+
+// Advances eight pendulums by an explicit Euler step without fused multiply add and gets the moments of their new state.
+KERNEL_TARGET("avx2")
+static inline void EulerVectorAVX2Deterministic(const EulerConstantsAVX2& constants, const float* anchor, float* position, float* velocity, MomentVectorsAVX2& values)
+{
+	__m256 a = _mm256_loadu_ps(anchor);
+	__m256 x = _mm256_loadu_ps(position);
+	__m256 v = _mm256_loadu_ps(velocity);
+
+	__m256 force = _mm256_sub_ps(_mm256_mul_ps(constants.m_spring, _mm256_sub_ps(a, x)), _mm256_mul_ps(v, constants.m_damping));
+	__m256 acceleration = _mm256_add_ps(constants.m_earth, _mm256_mul_ps(constants.m_invMass, force));
+
+	__m256 newX = _mm256_add_ps(x, _mm256_mul_ps(constants.m_delta, v));
+	__m256 newV = _mm256_add_ps(v, _mm256_mul_ps(constants.m_delta, acceleration));
+	_mm256_storeu_ps(position, newX);
+	_mm256_storeu_ps(velocity, newV);
+	ObtainMomentsAVX2(a, newX, newV, values);
+}
+
+
+// Advances one axis by an explicit Euler step with 256 bit vectors, bitwise equal to the scalar kernel.
+KERNEL_TARGET("avx2")
+static void EulerAxisAVX2Deterministic(int count, float gravity, float deltaTime, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	EulerConstantsAVX2 constants;
+	LoadEulerConstantsAVX2(gravity, deltaTime, constants);
+
+	int i = 0;
+	if (moments == NULL)
+	{
+		MomentVectorsAVX2 unused;
+		for(; i + 8 <= count; i += 8)
+			EulerVectorAVX2Deterministic(constants, anchor + i, position + i, velocity + i, unused);
+	}
+	else
+	{
+		MomentVectorsAVX2 lowerSums, upperSums;
+		LoadMomentsAVX2(moments, 0, lowerSums);
+		LoadMomentsAVX2(moments, 8, upperSums);
+		for(; i + MomentLanes <= count; i += MomentLanes)
+		{
+			MomentVectorsAVX2 first, second;
+			EulerVectorAVX2Deterministic(constants, anchor + i, position + i, velocity + i, first);
+			EulerVectorAVX2Deterministic(constants, anchor + i + 8, position + i + 8, velocity + i + 8, second);
+			AddMomentsAVX2(lowerSums, first);
+			AddMomentsAVX2(upperSums, second);
+		}
+		StoreMomentsAVX2(moments, 0, lowerSums);
+		StoreMomentsAVX2(moments, 8, upperSums);
+	}
+
+	EulerAxisScalar(count - i, gravity, deltaTime, anchor + i, position + i, velocity + i, moments);
+}
+
+
+// Applies the exact propagator to eight pendulums without fused multiply add and gets the moments of their new state.
+KERNEL_TARGET("avx2")
+static inline void PropagateVectorAVX2Deterministic(const PropagatorConstantsAVX2& constants, const float* anchor, float* position, float* velocity, MomentVectorsAVX2& values)
+{
+	__m256 a = _mm256_loadu_ps(anchor);
+	__m256 equilibrium = _mm256_add_ps(a, constants.m_offset);
+	__m256 displacement = _mm256_sub_ps(_mm256_loadu_ps(position), equilibrium);
+	__m256 v = _mm256_loadu_ps(velocity);
+
+	__m256 newX = _mm256_add_ps(equilibrium, _mm256_add_ps(_mm256_mul_ps(constants.m_m00, displacement), _mm256_mul_ps(constants.m_m01, v)));
+	__m256 newV = _mm256_add_ps(_mm256_mul_ps(constants.m_m10, displacement), _mm256_mul_ps(constants.m_m11, v));
+	_mm256_storeu_ps(position, newX);
+	_mm256_storeu_ps(velocity, newV);
+	ObtainMomentsAVX2(a, newX, newV, values);
+}
+
+
+// Advances one axis with the exact propagator with 256 bit vectors, bitwise equal to the scalar kernel.
+KERNEL_TARGET("avx2")
+static void PropagatorAxisAVX2Deterministic(int count, const float transition[4], float equilibriumOffset, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	PropagatorConstantsAVX2 constants;
+	LoadPropagatorConstantsAVX2(transition, equilibriumOffset, constants);
+
+	int i = 0;
+	if (moments == NULL)
+	{
+		MomentVectorsAVX2 unused;
+		for(; i + 8 <= count; i += 8)
+			PropagateVectorAVX2Deterministic(constants, anchor + i, position + i, velocity + i, unused);
+	}
+	else
+	{
+		MomentVectorsAVX2 lowerSums, upperSums;
+		LoadMomentsAVX2(moments, 0, lowerSums);
+		LoadMomentsAVX2(moments, 8, upperSums);
+		for(; i + MomentLanes <= count; i += MomentLanes)
+		{
+			MomentVectorsAVX2 first, second;
+			PropagateVectorAVX2Deterministic(constants, anchor + i, position + i, velocity + i, first);
+			PropagateVectorAVX2Deterministic(constants, anchor + i + 8, position + i + 8, velocity + i + 8, second);
+			AddMomentsAVX2(lowerSums, first);
+			AddMomentsAVX2(upperSums, second);
+		}
+		StoreMomentsAVX2(moments, 0, lowerSums);
+		StoreMomentsAVX2(moments, 8, upperSums);
+	}
+
+	PropagatorAxisScalar(count - i, transition, equilibriumOffset, anchor + i, position + i, velocity + i, moments);
+}
+
+
+// Advances one axis by an explicit Euler step with 512 bit vectors, bitwise equal to the scalar kernel.
+KERNEL_TARGET("avx512f")
+static void EulerAxisAVX512Deterministic(int count, float gravity, float deltaTime, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	const __m512 earth = _mm512_set1_ps(gravity);
+	const __m512 invMass = _mm512_set1_ps(PendulumPhysics::invMass);
+	const __m512 damping = _mm512_set1_ps(PendulumPhysics::dampingVelocity);
+	const __m512 spring = _mm512_set1_ps(PendulumPhysics::springConstant);
+	const __m512 delta = _mm512_set1_ps(deltaTime);
+
+	MomentVectorsAVX512 sums = {};
+	if (moments != NULL)
+		LoadMomentsAVX512(moments, sums);
+
+	int i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m512 a = _mm512_loadu_ps(anchor + i);
+		__m512 x = _mm512_loadu_ps(position + i);
+		__m512 v = _mm512_loadu_ps(velocity + i);
+
+		__m512 force = _mm512_sub_ps(_mm512_mul_ps(spring, _mm512_sub_ps(a, x)), _mm512_mul_ps(v, damping));
+		__m512 acceleration = _mm512_add_ps(earth, _mm512_mul_ps(invMass, force));
+
+		__m512 newX = _mm512_add_ps(x, _mm512_mul_ps(delta, v));
+		__m512 newV = _mm512_add_ps(v, _mm512_mul_ps(delta, acceleration));
+		_mm512_storeu_ps(position + i, newX);
+		_mm512_storeu_ps(velocity + i, newV);
+
+		if (moments != NULL)
+		{
+			MomentVectorsAVX512 values;
+			ObtainMomentsAVX512(a, newX, newV, values);
+			AddMomentsAVX512(sums, values);
+		}
+	}
+
+	if (moments != NULL)
+		StoreMomentsAVX512(moments, sums);
+
+	EulerAxisScalar(count - i, gravity, deltaTime, anchor + i, position + i, velocity + i, moments);
+}
+
+
+// Advances one axis with the exact propagator with 512 bit vectors, bitwise equal to the scalar kernel.
+KERNEL_TARGET("avx512f")
+static void PropagatorAxisAVX512Deterministic(int count, const float transition[4], float equilibriumOffset, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes])
+{
+	const __m512 m00 = _mm512_set1_ps(transition[0]);
+	const __m512 m01 = _mm512_set1_ps(transition[1]);
+	const __m512 m10 = _mm512_set1_ps(transition[2]);
+	const __m512 m11 = _mm512_set1_ps(transition[3]);
+	const __m512 offset = _mm512_set1_ps(equilibriumOffset);
+
+	MomentVectorsAVX512 sums = {};
+	if (moments != NULL)
+		LoadMomentsAVX512(moments, sums);
+
+	int i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m512 a = _mm512_loadu_ps(anchor + i);
+		__m512 equilibrium = _mm512_add_ps(a, offset);
+		__m512 displacement = _mm512_sub_ps(_mm512_loadu_ps(position + i), equilibrium);
+		__m512 v = _mm512_loadu_ps(velocity + i);
+
+		__m512 newX = _mm512_add_ps(equilibrium, _mm512_add_ps(_mm512_mul_ps(m00, displacement), _mm512_mul_ps(m01, v)));
+		__m512 newV = _mm512_add_ps(_mm512_mul_ps(m10, displacement), _mm512_mul_ps(m11, v));
+		_mm512_storeu_ps(position + i, newX);
+		_mm512_storeu_ps(velocity + i, newV);
+
+		if (moments != NULL)
+		{
+			MomentVectorsAVX512 values;
+			ObtainMomentsAVX512(a, newX, newV, values);
+			AddMomentsAVX512(sums, values);
+		}
+	}
+
+	if (moments != NULL)
+		StoreMomentsAVX512(moments, sums);
+
+	PropagatorAxisScalar(count - i, transition, equilibriumOffset, anchor + i, position + i, velocity + i, moments);
+}
+
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Dispatch
+//--------------------------------------------------------------------------------------
+
+#ifdef PENDULUM_KERNELS_X86
+#ifdef _MSC_VER
+// Checks the cpuid feature bits together with the register state the operating system saves.
+static SimdLevel QueryProcessor()
+{
+	int info[4];
+	__cpuid(info, 0);
+	int highestLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+	bool hasFMA = (info[2] & (1 << 12)) != 0;
+	bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+	bool hasAVX = (info[2] & (1 << 28)) != 0;
+
+	if (!hasSSE2)
+		return SimdLevelScalar;
+	if (!hasOSXSAVE || !hasAVX || highestLeaf < 7)
+		return SimdLevelSSE;
+
+	// The operating system has to save the ymm (bits 1, 2) and zmm (bits 5 - 7) registers.
+	unsigned long long enabledState = _xgetbv(0);
+	if ((enabledState & 0x6) != 0x6)
+		return SimdLevelSSE;
+
+	__cpuidex(info, 7, 0);
+	bool hasAVX2 = (info[1] & (1 << 5)) != 0;
+	bool hasAVX512F = (info[1] & (1 << 16)) != 0;
+
+	if (hasAVX512F && (enabledState & 0xE6) == 0xE6)
+		return SimdLevelAVX512;
+	if (hasAVX2 && hasFMA)
+		return SimdLevelAVX2;
+	return SimdLevelSSE;
+}
+#else
+// The gcc builtins already check the register state the operating system saves.
+static SimdLevel QueryProcessor()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SimdLevelAVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SimdLevelAVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SimdLevelSSE;
+	return SimdLevelScalar;
+}
+#endif
+#else
+// Without x86 there is only the scalar kernel.
+static SimdLevel QueryProcessor()
+{
+	return SimdLevelScalar;
+}
+#endif
+
+
+// The level of the processor, detected once at startup.
+static const SimdLevel s_detectedLevel = QueryProcessor();
+// The level currently in use.
+static SimdLevel s_currentLevel = s_detectedLevel;
+// Whether only kernels bitwise equal to the scalar reference may be used.
+static bool s_deterministic = false;
+
+
+// Asks the processor which instruction sets it and the operating system support.
+SimdLevel PendulumKernels::DetectSimdLevel()
+{
+	return s_detectedLevel;
+}
+
+
+// Gets the level the kernels currently run with.
+SimdLevel PendulumKernels::GetSimdLevel()
+{
+	return s_currentLevel;
+}
+
+
+// Restricts the kernels to the indicated level, it is clamped to what the processor supports.
+void PendulumKernels::SetSimdLevel(SimdLevel level)
+{
+	s_currentLevel = level < s_detectedLevel ? level : s_detectedLevel;
+}
+
+
+// Restricts the kernels to those that give the same bits as the scalar reference.
+void PendulumKernels::SetDeterministic(bool deterministic)
+{
+	s_deterministic = deterministic;
+}
+
+
+// Checks if only kernels bitwise equal to the scalar reference are used.
+bool PendulumKernels::IsDeterministic()
+{
+	return s_deterministic;
+}
+
+
+// Gets the state of the floating point unit that influences rounding results.
+unsigned int PendulumKernels::ObtainFloatingPointState()
+{
+#ifdef PENDULUM_KERNELS_X86
+	return _mm_getcsr();
+#else
+	return 0;
+#endif
+}
+
+
+// Sets the state of the floating point unit, e.g. on a worker thread to match the caller.
+void PendulumKernels::SetFloatingPointState(unsigned int state)
+{
+#ifdef PENDULUM_KERNELS_X86
+	_mm_setcsr(state);
+#else
+	(void)state;
+#endif
+}
+
+
+// Gets the Euler kernel for the current level.
+EulerAxisKernel PendulumKernels::GetEulerAxisKernel()
+{
+	return GetEulerAxisKernel(s_currentLevel);
+}
+
+
+// Gets the Euler kernel for the indicated level, the level has to be supported.
+EulerAxisKernel PendulumKernels::GetEulerAxisKernel(SimdLevel level)
+{
+#ifdef PENDULUM_KERNELS_X86
+	switch (level)
+	{
+	case SimdLevelAVX512:
+		return s_deterministic ? EulerAxisAVX512Deterministic : EulerAxisAVX512;
+	case SimdLevelAVX2:
+		return s_deterministic ? EulerAxisAVX2Deterministic : EulerAxisAVX2;
+	case SimdLevelSSE:
+		return EulerAxisSSE;
+	default:
+		break;
+	}
+#endif
+	return EulerAxisScalar;
+}
+
+
+// Gets the propagator kernel for the current level.
+PropagatorAxisKernel PendulumKernels::GetPropagatorAxisKernel()
+{
+	return GetPropagatorAxisKernel(s_currentLevel);
+}
+
+
+// Gets the propagator kernel for the indicated level, the level has to be supported.
+PropagatorAxisKernel PendulumKernels::GetPropagatorAxisKernel(SimdLevel level)
+{
+#ifdef PENDULUM_KERNELS_X86
+	switch (level)
+	{
+	case SimdLevelAVX512:
+		return s_deterministic ? PropagatorAxisAVX512Deterministic : PropagatorAxisAVX512;
+	case SimdLevelAVX2:
+		return s_deterministic ? PropagatorAxisAVX2Deterministic : PropagatorAxisAVX2;
+	case SimdLevelSSE:
+		return PropagatorAxisSSE;
+	default:
+		break;
+	}
+#endif
+	return PropagatorAxisScalar;
+}
+
+
+// Gets the noise kernel for the current level.
+GaussianNoiseKernel PendulumKernels::GetGaussianNoiseKernel()
+{
+	return GetGaussianNoiseKernel(s_currentLevel);
+}
+
+
+// Gets the noise kernel for the indicated level, the level has to be supported.
+// None of them uses fused multiply add, so the deterministic mode makes no difference.
+GaussianNoiseKernel PendulumKernels::GetGaussianNoiseKernel(SimdLevel level)
+{
+#ifdef PENDULUM_KERNELS_X86
+	switch (level)
+	{
+	case SimdLevelAVX512:
+		return GaussianNoiseAVX512;
+	case SimdLevelAVX2:
+		return GaussianNoiseAVX2;
+	case SimdLevelSSE:
+		return GaussianNoiseSSE;
+	default:
+		break;
+	}
+#endif
+	return GaussianNoiseScalar;
+}
+
+
+// Gets the moment kernel for the current level.
+AxisMomentsKernel PendulumKernels::GetAxisMomentsKernel()
+{
+	return GetAxisMomentsKernel(s_currentLevel);
+}
+
+
+// Gets the moment kernel for the indicated level, the level has to be supported.
+// They only add and multiply, without fused multiply add, so every level is deterministic.
+AxisMomentsKernel PendulumKernels::GetAxisMomentsKernel(SimdLevel level)
+{
+#ifdef PENDULUM_KERNELS_X86
+	switch (level)
+	{
+	case SimdLevelAVX512:
+		return AxisMomentsAVX512;
+	case SimdLevelAVX2:
+		return AxisMomentsAVX2;
+	case SimdLevelSSE:
+		return AxisMomentsSSE;
+	default:
+		break;
+	}
+#endif
+	return AxisMomentsScalar;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// The instruction set levels we have kernels for, ordered from the weakest to the strongest.
+enum SimdLevel
+{
+	SimdLevelScalar = 0,
+	SimdLevelSSE = 1,
+	SimdLevelAVX2 = 2,
+	SimdLevelAVX512 = 3
+};
+
+
+// The sums the kernels take over one axis of a range of pendulums.
+enum AxisMoment
+{
+	AxisMomentVelocity,
+	AxisMomentSquaredVelocity,
+	AxisMomentPosition,
+	// The square of the position relative to the anchor.
+	AxisMomentSquaredExtension,
+	NumOfAxisMoments
+};
+
+// The number of partial sums every moment is split into. Pendulum i is added to the partial
+// sum i % MomentLanes on every level, so the sums do not depend on the vector width.
+const int MomentLanes = 16;
+
+// Advances one axis of a range of pendulums by an explicit Euler step.
+// The columns hold anchor, position and velocity of the same axis. If moments is not NULL,
+// the moments of the new state are added to the partial sums on the way.
+typedef void (*EulerAxisKernel)(int count, float gravity, float deltaTime, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes]);
+
+// Advances one axis of a range of pendulums with an exact propagator, see PendulumPropagator.
+// The moments are summed up like in the Euler kernel.
+typedef void (*PropagatorAxisKernel)(int count, const float transition[4], float equilibriumOffset, const float* anchor, float* position, float* velocity, float moments[NumOfAxisMoments][MomentLanes]);
+
+// Draws three standard normal numbers for every stream of a range at the indicated step.
+// The numbers only depend on the stream, the step and the seed: they come from the counter
+// based generator Philox4x32-10 with the counter (stream, 0, step) and the key (seed, 0),
+// so they do not depend on the order the streams are drawn in or on the thread that draws them.
+typedef void (*GaussianNoiseKernel)(int count, const int* streams, unsigned long long step, unsigned int seed, float* normalX, float* normalY, float* normalZ);
+
+// Adds the moments of one axis of a range of pendulums to the partial sums.
+typedef void (*AxisMomentsKernel)(int count, const float* anchor, const float* position, const float* velocity, float moments[NumOfAxisMoments][MomentLanes]);
+
+
+// The vectorized stepping kernels of the spring model. The best kernel the processor
+// supports is chosen once at startup with cpuid, so one binary runs on every host.
+// In the deterministic mode all levels give the same bits as the scalar reference.
+class PendulumKernels
+{
+public:
+	// Asks the processor which instruction sets it and the operating system support.
+	static SimdLevel DetectSimdLevel();
+
+	// Gets the level the kernels currently run with.
+	static SimdLevel GetSimdLevel();
+	// Restricts the kernels to the indicated level, it is clamped to what the processor supports.
+	static void SetSimdLevel(SimdLevel level);
+
+	// Restricts the kernels to those that give the same bits as the scalar reference, no
+	// matter how wide the vectors are. The fused multiply add kernels are not used then.
+	static void SetDeterministic(bool deterministic);
+	// Checks if only kernels bitwise equal to the scalar reference are used.
+	static bool IsDeterministic();
+
+	// Gets the state of the floating point unit that influences rounding results.
+	static unsigned int ObtainFloatingPointState();
+	// Sets the state of the floating point unit, e.g. on a worker thread to match the caller.
+	static void SetFloatingPointState(unsigned int state);
+
+	// Gets the Euler kernel for the current level.
+	static EulerAxisKernel GetEulerAxisKernel();
+	// Gets the Euler kernel for the indicated level, the level has to be supported.
+	static EulerAxisKernel GetEulerAxisKernel(SimdLevel level);
+
+	// Gets the propagator kernel for the current level.
+	static PropagatorAxisKernel GetPropagatorAxisKernel();
+	// Gets the propagator kernel for the indicated level, the level has to be supported.
+	static PropagatorAxisKernel GetPropagatorAxisKernel(SimdLevel level);
+
+	// Gets the noise kernel for the current level. All levels give the same bits.
+	static GaussianNoiseKernel GetGaussianNoiseKernel();
+	// Gets the noise kernel for the indicated level, the level has to be supported.
+	static GaussianNoiseKernel GetGaussianNoiseKernel(SimdLevel level);
+
+	// Gets the moment kernel for the current level. All levels give the same bits.
+	static AxisMomentsKernel GetAxisMomentsKernel();
+	// Gets the moment kernel for the indicated level, the level has to be supported.
+	static AxisMomentsKernel GetAxisMomentsKernel(SimdLevel level);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+// The physical constants of the spring model. They are shared by every integrator so that
+// all of them simulate exactly the same pendulum.
+struct PendulumPhysics
+{
+	static constexpr float earthAcceleration = -9.81f;
+	static constexpr float invMass = 2.0f;
+	static constexpr float dampingVelocity = 0.05f;
+	static constexpr float springConstant = 0.5f;
+	// The radius of the bob, the renderer draws it as a sphere of this size.
+	static constexpr float bobRadius = 3.0f;
+	// The radius of the spring, the renderer draws it as a cylinder of this size.
+	static constexpr float springRadius = 1.0f;
+
+	// Gets the acceleration along one axis. Gravity is only non zero for the y axis.
+	// The damping acts on the velocity relative to the anchor, so for a moving anchor
+	// the velocity passed in is the bob velocity minus the anchor velocity.
+	static float ComputeAxisAcceleration(float gravity, float anchor, float position, float velocity)
+	{
+		return ComputeAxisAcceleration(gravity, invMass, dampingVelocity, springConstant, anchor, position, velocity);
+	}
+
+	// Gets the acceleration along one axis for explicitly given parameters.
+	static float ComputeAxisAcceleration(float gravity, float invMass, float dampingVelocity, float springConstant, float anchor, float position, float velocity)
+	{
+		return gravity + invMass * (-velocity * dampingVelocity + springConstant * (anchor - position));
+	}
+};
+
+
+// The physical parameters of a single pendulum. By default these are the constants above.
+struct PendulumParameters
+{
+	PendulumParameters()
+		: m_earthAcceleration(PendulumPhysics::earthAcceleration), m_invMass(PendulumPhysics::invMass),
+		m_dampingVelocity(PendulumPhysics::dampingVelocity), m_springConstant(PendulumPhysics::springConstant)
+	{
+	}
+
+	float m_earthAcceleration;
+	float m_invMass;
+	float m_dampingVelocity;
+	float m_springConstant;
+};
+
+
+// The parameter source of the batched integrators if all pendulums use the constants.
+// Everything is known at compile time, so the compiler folds the parameters into the loop.
+struct UniformParameters
+{
+	float GetEarthAcceleration(int) const { return PendulumPhysics::earthAcceleration; }
+	float GetInvMass(int) const { return PendulumPhysics::invMass; }
+	float GetDampingVelocity(int) const { return PendulumPhysics::dampingVelocity; }
+	float GetSpringConstant(int) const { return PendulumPhysics::springConstant; }
+};
+
+
+// The parameter source of the batched integrators if every pendulum has its own parameters.
+// The parameters are read from one column per parameter.
+struct ColumnParameters
+{
+	const float* m_earthAcceleration;
+	const float* m_invMass;
+	const float* m_dampingVelocity;
+	const float* m_springConstant;
+
+	float GetEarthAcceleration(int index) const { return m_earthAcceleration[index]; }
+	float GetInvMass(int index) const { return m_invMass[index]; }
+	float GetDampingVelocity(int index) const { return m_dampingVelocity[index]; }
+	float GetSpringConstant(int index) const { return m_springConstant[index]; }
+};
@@ -0,0 +1,39 @@
+#include "PendulumPropagator.h"
+#include "AnalyticPendulum.h"
+
+
+// Computes the propagator for the indicated parameters and time step.
+// The matrix is evaluated in double precision and only rounded once at the end.
+PendulumPropagator PendulumPropagator::Compute(const PendulumParameters& parameters, float deltaTime)
+{
+	PendulumPropagator result;
+
+	double transition[4];
+	AnalyticPendulum::ComputeStateTransition(parameters, deltaTime, transition);
+	for(int i = 0; i < 4; ++i)
+		result.m_transition[i] = static_cast<float>(transition[i]);
+
+	result.m_equilibriumOffset[0] = 0.0f;
+	result.m_equilibriumOffset[1] = static_cast<float>(AnalyticPendulum::ComputeEquilibrium(parameters, 0.0, parameters.m_earthAcceleration));
+	result.m_equilibriumOffset[2] = 0.0f;
+
+	return result;
+}
+
+
+// Gets the propagator, computing it on the first request.
+const PendulumPropagator& PropagatorCache::Find(const PendulumParameters& parameters, float deltaTime)
+{
+	Key key;
+	key.m_values[0] = parameters.m_springConstant;
+	key.m_values[1] = parameters.m_dampingVelocity;
+	key.m_values[2] = parameters.m_invMass;
+	key.m_values[3] = parameters.m_earthAcceleration;
+	key.m_values[4] = deltaTime;
+
+	std::map<Key, PendulumPropagator>::iterator entry = m_propagators.find(key);
+	if (entry == m_propagators.end())
+		entry = m_propagators.insert(std::make_pair(key, PendulumPropagator::Compute(parameters, deltaTime))).first;
+
+	return entry->second;
+}
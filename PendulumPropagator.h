@@ -0,0 +1,63 @@
+#pragma once
+
+#include "PendulumPhysics.h"
+#include <map>
+
+// The exact discrete propagator of the spring model for one fixed time step.
+// With the equilibrium e = anchor + offset of an axis the step is
+//   position' = e + m00 * (position - e) + m01 * velocity
+//   velocity' =     m10 * (position - e) + m11 * velocity
+// which is the closed form solution evaluated after the time step, so it carries no
+// integration error no matter how large the step is.
+struct PendulumPropagator
+{
+	// The state transition matrix, row by row.
+	float m_transition[4];
+	// The distance of the equilibrium from the anchor per axis.
+	float m_equilibriumOffset[3];
+
+	// Checks if the parameters have an equilibrium and therefore a propagator.
+	static bool IsAvailable(const PendulumParameters& parameters)
+	{
+		return parameters.m_springConstant > 0.0f && parameters.m_invMass > 0.0f;
+	}
+
+	// Computes the propagator for the indicated parameters and time step.
+	static PendulumPropagator Compute(const PendulumParameters& parameters, float deltaTime);
+};
+
+
+// Remembers the propagators already computed, keyed by the parameters and the time step.
+// Pendulums with the same parameters share one propagator.
+class PropagatorCache
+{
+public:
+	// Gets the propagator, computing it on the first request.
+	const PendulumPropagator& Find(const PendulumParameters& parameters, float deltaTime);
+
+	// Forgets all propagators.
+	void Clear() { m_propagators.clear(); }
+
+	// Gets the number of propagators in the cache.
+	int GetNumOfPropagators() { return static_cast<int>(m_propagators.size()); }
+
+private:
+	// The tuple the propagators are keyed by.
+	struct Key
+	{
+		float m_values[5];
+
+		bool operator<(const Key& other) const
+		{
+			for(int i = 0; i < 5; ++i)
+			{
+				if (m_values[i] != other.m_values[i])
+					return m_values[i] < other.m_values[i];
+			}
+			return false;
+		}
+	};
+
+	// The propagators computed so far.
+	std::map<Key, PendulumPropagator> m_propagators;
+};
@@ -0,0 +1,358 @@
+#include "PickingBvh.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PICKING_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+
+// The number of objects in a leaf, one per SSE lane.
+static const int LeafSize = 4;
+
+
+PickingBvh::PickingBvh()
+{
+	m_numOfPendulums = 0;
+	m_bobRadius = 0.0f;
+	m_springRadius = 0.0f;
+}
+
+
+// Builds the tree over the indicated pendulums.
+// Every pendulum brings two objects, its bob and its spring.
+void PickingBvh::Build(int numOfPendulums, const float* const anchor[3], const float* const position[3], float bobRadius, float springRadius)
+{
+	m_numOfPendulums = numOfPendulums;
+	m_bobRadius = bobRadius;
+	m_springRadius = springRadius;
+
+	int numOfObjects = 2 * numOfPendulums;
+	std::vector<int> objects(numOfObjects);
+	std::vector<float> centre[3];
+	for(int axis = 0; axis < 3; ++axis)
+		centre[axis].resize(numOfObjects);
+
+	for(int pendulum = 0; pendulum < numOfPendulums; ++pendulum)
+	{
+		objects[2 * pendulum] = 2 * pendulum;
+		objects[2 * pendulum + 1] = 2 * pendulum + 1;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			centre[axis][2 * pendulum] = position[axis][pendulum];
+			centre[axis][2 * pendulum + 1] = 0.5f * (anchor[axis][pendulum] + position[axis][pendulum]);
+		}
+	}
+
+	m_nodes.clear();
+	m_leafObjects.clear();
+	if (numOfObjects > 0)
+		BuildNode(objects, 0, numOfObjects, centre);
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_start[axis].resize(m_leafObjects.size());
+		m_end[axis].resize(m_leafObjects.size());
+	}
+	m_radius.resize(m_leafObjects.size());
+
+	Refit(anchor, position);
+}
+
+
+// Fits the boxes of the tree to the new positions.
+// The objects are gathered into leaf order first, so the ray tests read them linearly.
+// The children come after their parents, so one backward pass fits all boxes.
+void PickingBvh::Refit(const float* const anchor[3], const float* const position[3])
+{
+	int numOfSlots = static_cast<int>(m_leafObjects.size());
+	for(int slot = 0; slot < numOfSlots; ++slot)
+	{
+		int object = m_leafObjects[slot];
+		int pendulum = object >> 1;
+		bool isSpring = (object & 1) != 0;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_start[axis][slot] = isSpring ? anchor[axis][pendulum] : position[axis][pendulum];
+			m_end[axis][slot] = position[axis][pendulum];
+		}
+		m_radius[slot] = isSpring ? m_springRadius : m_bobRadius;
+	}
+
+	for(int index = static_cast<int>(m_nodes.size()) - 1; index >= 0; --index)
+	{
+		Node& node = m_nodes[index];
+		if (node.m_count > 0)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				node.m_min[axis] = FLT_MAX;
+				node.m_max[axis] = -FLT_MAX;
+				for(int slot = node.m_index; slot < node.m_index + LeafSize; ++slot)
+				{
+					float low = std::min(m_start[axis][slot], m_end[axis][slot]) - m_radius[slot];
+					float high = std::max(m_start[axis][slot], m_end[axis][slot]) + m_radius[slot];
+					node.m_min[axis] = std::min(node.m_min[axis], low);
+					node.m_max[axis] = std::max(node.m_max[axis], high);
+				}
+			}
+			continue;
+		}
+
+		const Node& left = m_nodes[index + 1];
+		const Node& right = m_nodes[node.m_index];
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			node.m_min[axis] = std::min(left.m_min[axis], right.m_min[axis]);
+			node.m_max[axis] = std::max(left.m_max[axis], right.m_max[axis]);
+		}
+	}
+}
+
+
+// Finds the object the ray hits first.
+// The nodes are visited nearest box first and skipped once their box starts behind the
+// nearest hit so far.
+bool PickingBvh::IntersectRay(const float origin[3], const float direction[3], PickingHit& hit)
+{
+	if (m_nodes.empty())
+		return false;
+
+	// The leaf tests expect a normalized direction, the distance is scaled back at the end.
+	float length = sqrtf(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+	if (length <= 0.0f)
+		return false;
+	float unitDirection[3] = {direction[0] / length, direction[1] / length, direction[2] / length};
+	float inverseDirection[3];
+	for(int axis = 0; axis < 3; ++axis)
+		inverseDirection[axis] = 1.0f / unitDirection[axis];
+
+	float nearest = FLT_MAX;
+	int nearestObject = -1;
+
+	int stack[64];
+	float stackDistance[64];
+	int stackSize = 0;
+	stack[stackSize] = 0;
+	stackDistance[stackSize++] = 0.0f;
+
+	while (stackSize > 0)
+	{
+		--stackSize;
+		if (stackDistance[stackSize] >= nearest)
+			continue;
+
+		const Node& node = m_nodes[stack[stackSize]];
+		if (node.m_count > 0)
+		{
+			IntersectLeaf(node, origin, unitDirection, nearest, nearestObject);
+			continue;
+		}
+
+		// Slab test of both children, the nearer one is pushed last to be visited first.
+		int children[2] = {stack[stackSize] + 1, node.m_index};
+		float entry[2];
+		for(int child = 0; child < 2; ++child)
+		{
+			const Node& box = m_nodes[children[child]];
+			float tNear = 0.0f;
+			float tFar = nearest;
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				float t0 = (box.m_min[axis] - origin[axis]) * inverseDirection[axis];
+				float t1 = (box.m_max[axis] - origin[axis]) * inverseDirection[axis];
+				tNear = std::max(tNear, std::min(t0, t1));
+				tFar = std::min(tFar, std::max(t0, t1));
+			}
+			entry[child] = tNear <= tFar ? tNear : FLT_MAX;
+		}
+
+		int first = entry[0] <= entry[1] ? 0 : 1;
+		int second = 1 - first;
+		if (entry[second] < nearest && stackSize < 64)
+		{
+			stack[stackSize] = children[second];
+			stackDistance[stackSize++] = entry[second];
+		}
+		if (entry[first] < nearest && stackSize < 64)
+		{
+			stack[stackSize] = children[first];
+			stackDistance[stackSize++] = entry[first];
+		}
+	}
+
+	if (nearestObject < 0)
+		return false;
+
+	hit.m_pendulum = nearestObject >> 1;
+	hit.m_isSpring = (nearestObject & 1) != 0;
+	hit.m_distance = nearest / length;
+	return true;
+}
+
+
+// Builds the subtree over a range of objects and returns its node.
+// The objects are split at the median of their centres along the axis the centres spread most.
+int PickingBvh::BuildNode(std::vector<int>& objects, int begin, int end, const std::vector<float> centre[3])
+{
+	int index = static_cast<int>(m_nodes.size());
+	m_nodes.push_back(Node());
+
+	if (end - begin <= LeafSize)
+	{
+		// Short leaves repeat their first object, a second hit on it changes nothing.
+		m_nodes[index].m_index = static_cast<int>(m_leafObjects.size());
+		m_nodes[index].m_count = end - begin;
+		for(int slot = 0; slot < LeafSize; ++slot)
+			m_leafObjects.push_back(objects[begin + slot < end ? begin + slot : begin]);
+		return index;
+	}
+
+	float low[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float high[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for(int object = begin; object < end; ++object)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			low[axis] = std::min(low[axis], centre[axis][objects[object]]);
+			high[axis] = std::max(high[axis], centre[axis][objects[object]]);
+		}
+	}
+
+	int splitAxis = 0;
+	for(int axis = 1; axis < 3; ++axis)
+	{
+		if (high[axis] - low[axis] > high[splitAxis] - low[splitAxis])
+			splitAxis = axis;
+	}
+
+	int middle = begin + (end - begin) / 2;
+	const std::vector<float>& key = centre[splitAxis];
+	std::nth_element(objects.begin() + begin, objects.begin() + middle, objects.begin() + end, [&key](int first, int second) { return key[first] < key[second]; });
+
+	BuildNode(objects, begin, middle, centre);
+	int right = BuildNode(objects, middle, end, centre);
+	m_nodes[index].m_index = right;
+	m_nodes[index].m_count = 0;
+	return index;
+}
+
+
+// Tests the ray against the four objects of a leaf and keeps the nearest hit.
+//
+// Every object is a capsule, a bob is one with both ends in its centre. The ray is first
+// intersected with the infinite cylinder around the axis; if it enters the cylinder
+// between the ends that is the hit, otherwise the sphere around the nearer end is tested.
+// For a bob the cylinder degenerates, its terms become NaN, no comparison with them holds
+// and the sphere test is what remains.
+void PickingBvh::IntersectLeaf(const Node& node, const float origin[3], const float direction[3], float& nearest, int& nearestObject)
+{
+	const int first = node.m_index;
+
+#ifdef PICKING_BVH_SSE
+	__m128 ro[3], rd[3], start[3], end[3], ba[3], oa[3];
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		ro[axis] = _mm_set1_ps(origin[axis]);
+		rd[axis] = _mm_set1_ps(direction[axis]);
+		start[axis] = _mm_loadu_ps(&m_start[axis][first]);
+		end[axis] = _mm_loadu_ps(&m_end[axis][first]);
+		ba[axis] = _mm_sub_ps(end[axis], start[axis]);
+		oa[axis] = _mm_sub_ps(ro[axis], start[axis]);
+	}
+	__m128 radius = _mm_loadu_ps(&m_radius[first]);
+	__m128 squaredRadius = _mm_mul_ps(radius, radius);
+	__m128 zero = _mm_setzero_ps();
+
+	#define DOT3(a, b) _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]))
+	__m128 baba = DOT3(ba, ba);
+	__m128 bard = DOT3(ba, rd);
+	__m128 baoa = DOT3(ba, oa);
+	__m128 rdoa = DOT3(rd, oa);
+	__m128 oaoa = DOT3(oa, oa);
+
+	__m128 a = _mm_sub_ps(baba, _mm_mul_ps(bard, bard));
+	__m128 b = _mm_sub_ps(_mm_mul_ps(baba, rdoa), _mm_mul_ps(baoa, bard));
+	__m128 c = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(baba, oaoa), _mm_mul_ps(baoa, baoa)), _mm_mul_ps(squaredRadius, baba));
+	__m128 h = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+	__m128 cylinderValid = _mm_cmpge_ps(h, zero);
+
+	__m128 t = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(zero, b), _mm_sqrt_ps(_mm_max_ps(h, zero))), a);
+	__m128 y = _mm_add_ps(baoa, _mm_mul_ps(t, bard));
+	__m128 bodyHit = _mm_and_ps(_mm_and_ps(cylinderValid, _mm_cmpgt_ps(t, zero)), _mm_and_ps(_mm_cmpgt_ps(y, zero), _mm_cmplt_ps(y, baba)));
+
+	// The cap is the start sphere if the cylinder was entered before the start, else the end sphere.
+	__m128 beforeStart = _mm_cmple_ps(y, zero);
+	__m128 oc[3];
+	for(int axis = 0; axis < 3; ++axis)
+		oc[axis] = _mm_or_ps(_mm_and_ps(beforeStart, oa[axis]), _mm_andnot_ps(beforeStart, _mm_sub_ps(ro[axis], end[axis])));
+	__m128 capB = DOT3(rd, oc);
+	__m128 capC = _mm_sub_ps(DOT3(oc, oc), squaredRadius);
+	__m128 capH = _mm_sub_ps(_mm_mul_ps(capB, capB), capC);
+	__m128 capT = _mm_sub_ps(_mm_sub_ps(zero, capB), _mm_sqrt_ps(_mm_max_ps(capH, zero)));
+	__m128 capHit = _mm_and_ps(_mm_and_ps(cylinderValid, _mm_cmpgt_ps(capH, zero)), _mm_cmpgt_ps(capT, zero));
+	#undef DOT3
+
+	__m128 infinity = _mm_set1_ps(FLT_MAX);
+	__m128 result = _mm_or_ps(_mm_and_ps(capHit, capT), _mm_andnot_ps(capHit, infinity));
+	result = _mm_or_ps(_mm_and_ps(bodyHit, t), _mm_andnot_ps(bodyHit, result));
+
+	float distances[LeafSize];
+	_mm_storeu_ps(distances, result);
+#else
+	float distances[LeafSize];
+	for(int lane = 0; lane < LeafSize; ++lane)
+	{
+		int slot = first + lane;
+		float ba[3], oa[3];
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			ba[axis] = m_end[axis][slot] - m_start[axis][slot];
+			oa[axis] = origin[axis] - m_start[axis][slot];
+		}
+		float squaredRadius = m_radius[slot] * m_radius[slot];
+		float baba = ba[0] * ba[0] + ba[1] * ba[1] + ba[2] * ba[2];
+		float bard = ba[0] * direction[0] + ba[1] * direction[1] + ba[2] * direction[2];
+		float baoa = ba[0] * oa[0] + ba[1] * oa[1] + ba[2] * oa[2];
+		float rdoa = direction[0] * oa[0] + direction[1] * oa[1] + direction[2] * oa[2];
+		float oaoa = oa[0] * oa[0] + oa[1] * oa[1] + oa[2] * oa[2];
+
+		float a = baba - bard * bard;
+		float b = baba * rdoa - baoa * bard;
+		float c = baba * oaoa - baoa * baoa - squaredRadius * baba;
+		float h = b * b - a * c;
+
+		distances[lane] = FLT_MAX;
+		if (!(h >= 0.0f))
+			continue;
+
+		float t = (-b - sqrtf(h)) / a;
+		float y = baoa + t * bard;
+		if (t > 0.0f && y > 0.0f && y < baba)
+		{
+			distances[lane] = t;
+			continue;
+		}
+
+		float oc[3];
+		for(int axis = 0; axis < 3; ++axis)
+			oc[axis] = y <= 0.0f ? oa[axis] : origin[axis] - m_end[axis][slot];
+		float capB = direction[0] * oc[0] + direction[1] * oc[1] + direction[2] * oc[2];
+		float capH = capB * capB - (oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - squaredRadius);
+		float capT = -capB - sqrtf(capH > 0.0f ? capH : 0.0f);
+		if (capH > 0.0f && capT > 0.0f)
+			distances[lane] = capT;
+	}
+#endif
+
+	for(int lane = 0; lane < LeafSize; ++lane)
+	{
+		if (distances[lane] < nearest)
+		{
+			nearest = distances[lane];
+			nearestObject = m_leafObjects[first + lane];
+		}
+	}
+}
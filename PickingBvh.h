@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// The object a picking ray hit first.
+struct PickingHit
+{
+	// The index of the pendulum.
+	int m_pendulum;
+	// Whether the spring was hit rather than the bob.
+	bool m_isSpring;
+	// The distance along the ray, in units of the ray direction.
+	float m_distance;
+};
+
+
+// A bounding volume hierarchy over the bobs and springs of a set of pendulums for picking.
+// Bobs are spheres, springs are capsules from the anchor to the bob. The tree is built once
+// and only refit when the pendulums move, which keeps its shape but costs a single pass.
+// The leaves hold four objects each, and the ray is tested against all four at once with SSE.
+class PickingBvh
+{
+public:
+	PickingBvh();
+
+	// Builds the tree over the indicated pendulums, the positions are given as one column per axis.
+	void Build(int numOfPendulums, const float* const anchor[3], const float* const position[3], float bobRadius, float springRadius);
+
+	// Fits the boxes of the tree to the new positions, the pendulums stay in their leaves.
+	void Refit(const float* const anchor[3], const float* const position[3]);
+
+	// Finds the object the ray hits first, returns false if it misses all.
+	bool IntersectRay(const float origin[3], const float direction[3], PickingHit& hit);
+
+	// Gets the number of pendulums in the tree.
+	int GetNumOfPendulums() { return m_numOfPendulums; }
+
+private:
+	// A node of the tree. The left child of an inner node follows it directly, the right
+	// child is referenced. A leaf references a block of four objects.
+	struct Node
+	{
+		float m_min[3];
+		float m_max[3];
+		// The right child of an inner node or the first object of a leaf.
+		int m_index;
+		// The number of objects of a leaf, 0 for inner nodes.
+		int m_count;
+	};
+
+	int m_numOfPendulums;
+	float m_bobRadius;
+	float m_springRadius;
+
+	// The nodes in depth first order, every child comes after its parent.
+	std::vector<Node> m_nodes;
+	// The objects in leaf order, every leaf owns a block of four. Object o is the bob of
+	// pendulum o / 2 if o is even and its spring if o is odd.
+	std::vector<int> m_leafObjects;
+	// The capsules in leaf order, one column per axis for both ends. A bob has both ends at its centre.
+	std::vector<float> m_start[3];
+	std::vector<float> m_end[3];
+	std::vector<float> m_radius;
+
+	// Builds the subtree over a range of objects and returns its node.
+	int BuildNode(std::vector<int>& objects, int begin, int end, const std::vector<float> centre[3]);
+	// Tests the ray against the four objects of a leaf and keeps the nearest hit.
+	void IntersectLeaf(const Node& node, const float origin[3], const float direction[3], float& nearest, int& nearestObject);
+};
@@ -1,4 +1,5 @@
 #include "SceneRenderer.h"
+#include "PendulumPhysics.h"
 #include <math.h>
 
 
@@ -148,6 +149,15 @@ void SceneRenderer::SetPositionOfSphere(float spherePosition[3])
 }
 
 
+// Moves the point the cylinder hangs from.
+void SceneRenderer::SetAnchorPointOfCylinder(float anchorPoint[3])
+{
+	m_anchorPointOfCylinder.x = anchorPoint[0];
+	m_anchorPointOfCylinder.y = anchorPoint[1];
+	m_anchorPointOfCylinder.z = anchorPoint[2];
+}
+
+
 // Changes the position of the camera.
 void SceneRenderer::ChangeCameraPosition(float radius, float angle)
 {
@@ -264,7 +274,7 @@ void SceneRenderer::UpdateCameraMatrix()
 // Creates the description of the sphere vertex structure.
 SceneRenderer::InternalVertexFormat* SceneRenderer::GenerateSphereVertexStructure(int rings, int slices, int& numOfVerticesGenerated)
 {
-	const float radius = 3.0f;
+	const float radius = PendulumPhysics::bobRadius;
 
 	numOfVerticesGenerated = rings * slices;
 	SceneRenderer::InternalVertexFormat* result = new SceneRenderer::InternalVertexFormat[numOfVerticesGenerated];
@@ -322,7 +332,7 @@ DWORD* SceneRenderer::GenerateSphereIndexStructure(int rings, int slices, int& n
 // Creates the vertex description for the cylinder structure.
 SceneRenderer::InternalVertexFormat* SceneRenderer::GenerateCylinderVertexStructure(int sectors, int& numOfVerticesGenerated)
 {
-	const float radius = 1.0f;
+	const float radius = PendulumPhysics::springRadius;
 
 	numOfVerticesGenerated = sectors * 2;
 	SceneRenderer::InternalVertexFormat* result = new SceneRenderer::InternalVertexFormat[numOfVerticesGenerated];
@@ -18,6 +18,8 @@ public:
 	void Render(ID3D10Device* basicRenderingDeviceDevice);
 	// Resets the position of the sphere.
 	void SetPositionOfSphere(float spherePosition[3]);
+	// Moves the point the cylinder hangs from.
+	void SetAnchorPointOfCylinder(float anchorPoint[3]);
 	// Changes the position of the camera.
 	void ChangeCameraPosition(float radius, float angle);
 
@@ -0,0 +1,161 @@
+#include "SpatialHashGrid.h"
+#include "WorkStealingPool.h"
+#include <math.h>
+
+
+// The number of sorted items one task of a query works on.
+static const int QueryChunkSize = 4096;
+
+
+SpatialHashGrid::SpatialHashGrid()
+{
+	m_cellSize = 1.0f;
+	m_numOfBuckets = 1;
+	m_numOfItems = 0;
+	m_threadPool = NULL;
+}
+
+
+// Sorts the items into cells of the indicated edge length.
+// The table has at least twice as many buckets as items, so few cells share a bucket.
+void SpatialHashGrid::Build(int count, const float* const position[3], float cellSize)
+{
+	m_cellSize = cellSize;
+	m_numOfItems = count;
+
+	int numOfBuckets = 1;
+	while (numOfBuckets < 2 * count)
+		numOfBuckets *= 2;
+	m_numOfBuckets = numOfBuckets;
+
+	m_bucketStart.assign(numOfBuckets + 1, 0);
+	m_bucketOfItem.resize(count);
+	m_sortedItems.resize(count);
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_sortedCell[axis].resize(count);
+		m_sortedPosition[axis].resize(count);
+	}
+
+	// Count the items of every bucket.
+	const float inverseCellSize = 1.0f / cellSize;
+	for(int item = 0; item < count; ++item)
+	{
+		int x = static_cast<int>(floorf(position[0][item] * inverseCellSize));
+		int y = static_cast<int>(floorf(position[1][item] * inverseCellSize));
+		int z = static_cast<int>(floorf(position[2][item] * inverseCellSize));
+		int bucket = GetBucket(x, y, z);
+		m_bucketOfItem[item] = bucket;
+		++m_bucketStart[bucket + 1];
+	}
+
+	for(int bucket = 0; bucket < numOfBuckets; ++bucket)
+		m_bucketStart[bucket + 1] += m_bucketStart[bucket];
+
+	// Scatter the items behind the start of their bucket, the start moves along and is
+	// restored afterwards from the end of the bucket before.
+	for(int item = 0; item < count; ++item)
+	{
+		int sorted = m_bucketStart[m_bucketOfItem[item]]++;
+		m_sortedItems[sorted] = item;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_sortedPosition[axis][sorted] = position[axis][item];
+			m_sortedCell[axis][sorted] = static_cast<int>(floorf(position[axis][item] * inverseCellSize));
+		}
+	}
+
+	for(int bucket = numOfBuckets; bucket > 0; --bucket)
+		m_bucketStart[bucket] = m_bucketStart[bucket - 1];
+	m_bucketStart[0] = 0;
+}
+
+
+// Finds all pairs of items closer than the distance.
+void SpatialHashGrid::FindPairs(float distance, std::vector<CollisionPair>& pairs)
+{
+	pairs.clear();
+
+	int numOfChunks = (m_numOfItems + QueryChunkSize - 1) / QueryChunkSize;
+	if (m_threadPool == NULL || numOfChunks < 2)
+	{
+		FindPairsInRange(0, m_numOfItems, distance, pairs);
+		return;
+	}
+
+	if (static_cast<int>(m_chunkPairs.size()) < numOfChunks)
+		m_chunkPairs.resize(numOfChunks);
+
+	m_threadPool->ParallelFor(numOfChunks, [&](int chunk)
+	{
+		int begin = chunk * QueryChunkSize;
+		int end = begin + QueryChunkSize < m_numOfItems ? begin + QueryChunkSize : m_numOfItems;
+		m_chunkPairs[chunk].clear();
+		FindPairsInRange(begin, end, distance, m_chunkPairs[chunk]);
+	});
+
+	for(int chunk = 0; chunk < numOfChunks; ++chunk)
+		pairs.insert(pairs.end(), m_chunkPairs[chunk].begin(), m_chunkPairs[chunk].end());
+}
+
+
+// Builds the grid with cells as large as the distance and finds all pairs closer than it.
+void SpatialHashGrid::FindPairs(int count, const float* const position[3], float distance, std::vector<CollisionPair>& pairs)
+{
+	Build(count, position, distance);
+	FindPairs(distance, pairs);
+}
+
+
+// Finds the pairs of a range of sorted items with the items after them.
+// Every item looks at the 27 cells around it. Cells that share a bucket are told apart by
+// their coordinates, so every pair is seen once per side, and it is only reported by the
+// item that comes first in the sorted order.
+void SpatialHashGrid::FindPairsInRange(int begin, int end, float distance, std::vector<CollisionPair>& pairs)
+{
+	const float squaredDistance = distance * distance;
+	const float* positionX = m_sortedPosition[0].data();
+	const float* positionY = m_sortedPosition[1].data();
+	const float* positionZ = m_sortedPosition[2].data();
+	const int* sortedCellX = m_sortedCell[0].data();
+	const int* sortedCellY = m_sortedCell[1].data();
+	const int* sortedCellZ = m_sortedCell[2].data();
+
+	for(int sorted = begin; sorted < end; ++sorted)
+	{
+		int cellX = sortedCellX[sorted];
+		int cellY = sortedCellY[sorted];
+		int cellZ = sortedCellZ[sorted];
+		float x = positionX[sorted];
+		float y = positionY[sorted];
+		float z = positionZ[sorted];
+
+		for(int neighbourZ = cellZ - 1; neighbourZ <= cellZ + 1; ++neighbourZ)
+		{
+			for(int neighbourY = cellY - 1; neighbourY <= cellY + 1; ++neighbourY)
+			{
+				for(int neighbourX = cellX - 1; neighbourX <= cellX + 1; ++neighbourX)
+				{
+					int bucket = GetBucket(neighbourX, neighbourY, neighbourZ);
+					int first = m_bucketStart[bucket] > sorted + 1 ? m_bucketStart[bucket] : sorted + 1;
+					for(int other = first; other < m_bucketStart[bucket + 1]; ++other)
+					{
+						if (sortedCellX[other] != neighbourX || sortedCellY[other] != neighbourY || sortedCellZ[other] != neighbourZ)
+							continue;
+
+						float ox = positionX[other] - x;
+						float oy = positionY[other] - y;
+						float oz = positionZ[other] - z;
+						if (ox * ox + oy * oy + oz * oz >= squaredDistance)
+							continue;
+
+						int item = m_sortedItems[sorted];
+						int otherItem = m_sortedItems[other];
+						CollisionPair pair = {item < otherItem ? item : otherItem, item < otherItem ? otherItem : item};
+						pairs.push_back(pair);
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Broadphase.h"
+#include <stddef.h>
+#include <vector>
+
+// A uniform grid over space whose cells are hashed into a table, so it needs no bounds and
+// its memory only grows with the number of items. Build sorts the items by bucket with a
+// counting sort and keeps a copy of their positions in that order, so the items of a cell
+// and those of the cells next to it are read from contiguous memory.
+class SpatialHashGrid : public Broadphase
+{
+public:
+	SpatialHashGrid();
+
+	// Sorts the items into cells of the indicated edge length.
+	// The positions are given as one column per axis.
+	void Build(int count, const float* const position[3], float cellSize);
+
+	// Finds all pairs of items closer than the distance, which must not exceed the cell size.
+	// Every pair is reported once, in an order that does not depend on the thread pool.
+	void FindPairs(float distance, std::vector<CollisionPair>& pairs);
+
+	// Builds the grid with cells as large as the distance and finds all pairs closer than it.
+	virtual void FindPairs(int count, const float* const position[3], float distance, std::vector<CollisionPair>& pairs);
+
+	// Sets the thread pool the queries are distributed on, NULL runs them on the calling thread.
+	virtual void SetThreadPool(WorkStealingPool* threadPool) { m_threadPool = threadPool; }
+
+	// Gets the number of buckets of the hash table.
+	int GetNumOfBuckets() { return m_numOfBuckets; }
+
+private:
+	// The edge length of a cell.
+	float m_cellSize;
+	// The number of buckets, a power of two.
+	int m_numOfBuckets;
+	// The number of items of the last build.
+	int m_numOfItems;
+
+	// The items of bucket b are [m_bucketStart[b], m_bucketStart[b + 1]) of the sorted order.
+	std::vector<int> m_bucketStart;
+	// The items in sorted order.
+	std::vector<int> m_sortedItems;
+	// The bucket of every item.
+	std::vector<int> m_bucketOfItem;
+	// The cell coordinates of the items in sorted order.
+	std::vector<int> m_sortedCell[3];
+	// The positions of the items in sorted order.
+	std::vector<float> m_sortedPosition[3];
+
+	// The pairs found by every chunk of a query, joined in chunk order.
+	std::vector<std::vector<CollisionPair> > m_chunkPairs;
+
+	// The pool the queries are run on, NULL for the calling thread.
+	WorkStealingPool* m_threadPool;
+
+	// Gets the bucket of a cell.
+	int GetBucket(int x, int y, int z) const
+	{
+		unsigned int hash = (static_cast<unsigned int>(x) * 73856093u) ^ (static_cast<unsigned int>(y) * 19349663u) ^ (static_cast<unsigned int>(z) * 83492791u);
+		return static_cast<int>(hash & static_cast<unsigned int>(m_numOfBuckets - 1));
+	}
+
+	// Finds the pairs of a range of sorted items with the items after them.
+	void FindPairsInRange(int begin, int end, float distance, std::vector<CollisionPair>& pairs);
+};
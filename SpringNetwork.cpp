@@ -0,0 +1,945 @@
+#include "SpringNetwork.h"
+#include "WorkStealingPool.h"
+#include "AlignedMemory.h"
+#include <math.h>
+
+
+// Reserves the memory for the indicated number of nodes and springs.
+SpringNetwork::SpringNetwork(int nodeCapacity, int springCapacity)
+{
+	m_nodeCapacity = nodeCapacity;
+	m_springCapacity = springCapacity;
+	m_numOfNodes = 0;
+	m_numOfSprings = 0;
+
+	m_earthAcceleration = PendulumPhysics::earthAcceleration;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_position[axis] = AllocateColumn(nodeCapacity);
+		m_velocity[axis] = AllocateColumn(nodeCapacity);
+		m_acceleration[axis] = AllocateColumn(nodeCapacity);
+	}
+	m_invMass = AllocateColumn(nodeCapacity);
+
+	m_springFirstNode = static_cast<int*>(AllocateAligned(sizeof(int) * (springCapacity > 0 ? springCapacity : 1)));
+	m_springSecondNode = static_cast<int*>(AllocateAligned(sizeof(int) * (springCapacity > 0 ? springCapacity : 1)));
+	m_springConstant = AllocateColumn(springCapacity);
+	m_springDamping = AllocateColumn(springCapacity);
+	m_springRestLength = AllocateColumn(springCapacity);
+
+	m_rowStart = static_cast<int*>(AllocateAligned(sizeof(int) * (nodeCapacity + 1)));
+	m_entryNeighbour = static_cast<int*>(AllocateAligned(sizeof(int) * (springCapacity > 0 ? 2 * springCapacity : 1)));
+	m_entrySpring = static_cast<int*>(AllocateAligned(sizeof(int) * (springCapacity > 0 ? 2 * springCapacity : 1)));
+	m_entrySpringConstant = AllocateColumn(2 * springCapacity);
+	m_entryDamping = AllocateColumn(2 * springCapacity);
+	m_entryRestLength = AllocateColumn(2 * springCapacity);
+	m_rowStart[0] = 0;
+	m_topologyOutdated = false;
+
+	m_threadPool = NULL;
+
+	m_solverTolerance = 1e-4f;
+	m_solverMaxIterations = 50;
+	m_solverIterations = 0;
+
+	m_mass = NULL;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_deltaVelocity[axis] = NULL;
+		m_residual[axis] = NULL;
+		m_searchDirection[axis] = NULL;
+		m_product[axis] = NULL;
+		m_preconditioned[axis] = NULL;
+		m_diagonal[axis] = NULL;
+	}
+	m_entryStiffness = NULL;
+	m_entryDirectionalStiffness = NULL;
+	m_partialSums = NULL;
+
+	m_xpbdIterations = 4;
+	m_xpbdSubsteps = 2;
+	m_colorSprings = NULL;
+	m_colorStart.push_back(0);
+	m_colorsOutdated = true;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_previousPosition[axis] = NULL;
+		m_lambda[axis] = NULL;
+	}
+}
+
+
+// Frees the columns.
+SpringNetwork::~SpringNetwork()
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		FreeAligned(m_position[axis]);
+		FreeAligned(m_velocity[axis]);
+		FreeAligned(m_acceleration[axis]);
+	}
+	FreeAligned(m_invMass);
+
+	FreeAligned(m_springFirstNode);
+	FreeAligned(m_springSecondNode);
+	FreeAligned(m_springConstant);
+	FreeAligned(m_springDamping);
+	FreeAligned(m_springRestLength);
+
+	FreeAligned(m_rowStart);
+	FreeAligned(m_entryNeighbour);
+	FreeAligned(m_entrySpring);
+	FreeAligned(m_entrySpringConstant);
+	FreeAligned(m_entryDamping);
+	FreeAligned(m_entryRestLength);
+
+	FreeAligned(m_mass);
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		FreeAligned(m_deltaVelocity[axis]);
+		FreeAligned(m_residual[axis]);
+		FreeAligned(m_searchDirection[axis]);
+		FreeAligned(m_product[axis]);
+		FreeAligned(m_preconditioned[axis]);
+		FreeAligned(m_diagonal[axis]);
+	}
+	FreeAligned(m_entryStiffness);
+	FreeAligned(m_entryDirectionalStiffness);
+	FreeAligned(m_partialSums);
+
+	FreeAligned(m_colorSprings);
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		FreeAligned(m_previousPosition[axis]);
+		FreeAligned(m_lambda[axis]);
+	}
+}
+
+
+// Adds a node at rest at the indicated position and returns its index.
+int SpringNetwork::AddNode(float position[3], float invMass)
+{
+	if (m_numOfNodes == m_nodeCapacity)
+		return -1;
+
+	int node = m_numOfNodes++;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_position[axis][node] = position[axis];
+		m_velocity[axis][node] = 0.0f;
+	}
+	m_invMass[node] = invMass;
+
+	if (m_mass != NULL)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+			m_deltaVelocity[axis][node] = 0.0f;
+	}
+
+	m_topologyOutdated = true;
+	return node;
+}
+
+
+// Connects two nodes by a spring and returns its index.
+int SpringNetwork::AddSpring(int firstNode, int secondNode, float springConstant, float dampingVelocity, float restLength)
+{
+	if (m_numOfSprings == m_springCapacity || firstNode == secondNode)
+		return -1;
+	if (firstNode < 0 || firstNode >= m_numOfNodes || secondNode < 0 || secondNode >= m_numOfNodes)
+		return -1;
+
+	int spring = m_numOfSprings++;
+	m_springFirstNode[spring] = firstNode;
+	m_springSecondNode[spring] = secondNode;
+	m_springConstant[spring] = springConstant;
+	m_springDamping[spring] = dampingVelocity;
+	m_springRestLength[spring] = restLength;
+
+	m_topologyOutdated = true;
+	m_colorsOutdated = true;
+	return spring;
+}
+
+
+// Hangs a chain of bobs with the default parameters below the indicated node.
+int SpringNetwork::AddChain(int anchorNode, int numOfLinks, float linkOffset[3])
+{
+	int previous = anchorNode;
+	for(int link = 0; link < numOfLinks; ++link)
+	{
+		float position[3];
+		for(int axis = 0; axis < 3; ++axis)
+			position[axis] = m_position[axis][previous] + linkOffset[axis];
+
+		int node = AddNode(position, PendulumPhysics::invMass);
+		if (node < 0)
+			return -1;
+		if (AddSpring(previous, node, PendulumPhysics::springConstant, PendulumPhysics::dampingVelocity, 0.0f) < 0)
+			return -1;
+		previous = node;
+	}
+
+	return previous;
+}
+
+
+// Sets the position of the indicated node and resets its velocity.
+void SpringNetwork::SetNodePosition(int node, float position[3])
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_position[axis][node] = position[axis];
+		m_velocity[axis][node] = 0.0f;
+	}
+}
+
+
+// Updates the simulation of all nodes.
+void SpringNetwork::UpdateSimulation(float deltaTime)
+{
+	Step(deltaTime, 1);
+}
+
+
+// Advances all nodes by the indicated number of explicit Euler steps.
+// The forces of a step need the positions of the neighbours before the step, so every step
+// is one pass over all nodes for the accelerations and one for the integration.
+void SpringNetwork::Step(float deltaTime, int steps)
+{
+	if (m_topologyOutdated)
+		BuildTopology();
+
+	int numOfChunks = (m_numOfNodes + SpringNetworkChunkSize - 1) / SpringNetworkChunkSize;
+
+	if (m_threadPool == NULL || numOfChunks < 2)
+	{
+		for(int step = 0; step < steps; ++step)
+		{
+			ComputeAccelerations(0, m_numOfNodes);
+			IntegrateRange(0, m_numOfNodes, deltaTime);
+		}
+		return;
+	}
+
+	for(int step = 0; step < steps; ++step)
+	{
+		m_threadPool->ParallelFor(numOfChunks, [&](int chunk)
+		{
+			int begin = chunk * SpringNetworkChunkSize;
+			int end = begin + SpringNetworkChunkSize < m_numOfNodes ? begin + SpringNetworkChunkSize : m_numOfNodes;
+			ComputeAccelerations(begin, end);
+		});
+
+		m_threadPool->ParallelFor(numOfChunks, [&](int chunk)
+		{
+			int begin = chunk * SpringNetworkChunkSize;
+			int end = begin + SpringNetworkChunkSize < m_numOfNodes ? begin + SpringNetworkChunkSize : m_numOfNodes;
+			IntegrateRange(begin, end, deltaTime);
+		});
+	}
+}
+
+
+// Advances all nodes by the indicated number of backward Euler steps.
+void SpringNetwork::StepImplicit(float deltaTime, int steps)
+{
+	if (m_topologyOutdated)
+		BuildTopology();
+	if (m_mass == NULL)
+		CreateSolverColumns();
+
+	for(int step = 0; step < steps; ++step)
+	{
+		SolveImplicitStep(deltaTime);
+
+		// The new velocity moves the position, as in the symplectic step that backward Euler reduces to for one node.
+		ForEachChunk([&](int begin, int end)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				float* __restrict position = m_position[axis];
+				float* __restrict velocity = m_velocity[axis];
+				const float* __restrict deltaVelocity = m_deltaVelocity[axis];
+				for(int node = begin; node < end; ++node)
+				{
+					velocity[node] += deltaVelocity[node];
+					position[node] += deltaTime * velocity[node];
+				}
+			}
+		});
+	}
+}
+
+
+// Sets when the conjugate gradient of the implicit step stops.
+void SpringNetwork::SetSolverTolerance(float relativeTolerance, int maxIterations)
+{
+	m_solverTolerance = relativeTolerance;
+	m_solverMaxIterations = maxIterations;
+}
+
+
+// Advances all nodes by the indicated number of frames of extended position based dynamics.
+// Every substep moves the nodes freely under gravity, then pulls them back with the
+// constraints color by color. The springs of one color share no node, so they are projected
+// in parallel and the result still is that of a sequential Gauss Seidel sweep.
+void SpringNetwork::StepXpbd(float deltaTime, int steps)
+{
+	if (m_topologyOutdated)
+		BuildTopology();
+	if (m_previousPosition[0] == NULL)
+		CreateXpbdColumns();
+	if (m_colorsOutdated)
+		ColorSprings();
+
+	const float substepDeltaTime = deltaTime / m_xpbdSubsteps;
+	const float inverseSubstepDeltaTime = 1.0f / substepDeltaTime;
+	const int numOfColors = static_cast<int>(m_colorStart.size()) - 1;
+
+	for(int substep = 0; substep < steps * m_xpbdSubsteps; ++substep)
+	{
+		ForEachChunk([&](int begin, int end)
+		{
+			for(int node = begin; node < end; ++node)
+			{
+				float gravity = m_invMass[node] > 0.0f ? m_earthAcceleration : 0.0f;
+				m_velocity[1][node] += substepDeltaTime * gravity;
+			}
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				float* __restrict position = m_position[axis];
+				float* __restrict previousPosition = m_previousPosition[axis];
+				const float* __restrict velocity = m_velocity[axis];
+				for(int node = begin; node < end; ++node)
+				{
+					previousPosition[node] = position[node];
+					position[node] += substepDeltaTime * velocity[node];
+				}
+			}
+		});
+
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			for(int spring = 0; spring < m_numOfSprings; ++spring)
+				m_lambda[axis][spring] = 0.0f;
+		}
+
+		for(int iteration = 0; iteration < m_xpbdIterations; ++iteration)
+		{
+			for(int color = 0; color < numOfColors; ++color)
+			{
+				int colorBegin = m_colorStart[color];
+				int colorEnd = m_colorStart[color + 1];
+				int numOfChunks = (colorEnd - colorBegin + SpringNetworkChunkSize - 1) / SpringNetworkChunkSize;
+
+				if (m_threadPool == NULL || numOfChunks < 2)
+				{
+					ProjectSprings(colorBegin, colorEnd, substepDeltaTime);
+					continue;
+				}
+
+				m_threadPool->ParallelFor(numOfChunks, [&](int chunk)
+				{
+					int begin = colorBegin + chunk * SpringNetworkChunkSize;
+					int end = begin + SpringNetworkChunkSize < colorEnd ? begin + SpringNetworkChunkSize : colorEnd;
+					ProjectSprings(begin, end, substepDeltaTime);
+				});
+			}
+		}
+
+		ForEachChunk([&](int begin, int end)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				const float* __restrict position = m_position[axis];
+				const float* __restrict previousPosition = m_previousPosition[axis];
+				float* __restrict velocity = m_velocity[axis];
+				for(int node = begin; node < end; ++node)
+					velocity[node] = (position[node] - previousPosition[node]) * inverseSubstepDeltaTime;
+			}
+		});
+	}
+}
+
+
+// Gets the number of colors the springs were split into.
+int SpringNetwork::GetNumOfColors()
+{
+	if (m_topologyOutdated)
+		BuildTopology();
+	if (m_colorSprings == NULL)
+		CreateXpbdColumns();
+	if (m_colorsOutdated)
+		ColorSprings();
+
+	return static_cast<int>(m_colorStart.size()) - 1;
+}
+
+
+// Obtains the current position of the indicated node.
+void SpringNetwork::ObtainNodePosition(int node, float position[3])
+{
+	position[0] = m_position[0][node];
+	position[1] = m_position[1][node];
+	position[2] = m_position[2][node];
+}
+
+
+// Obtains the current velocity of the indicated node.
+void SpringNetwork::ObtainNodeVelocity(int node, float velocity[3])
+{
+	velocity[0] = m_velocity[0][node];
+	velocity[1] = m_velocity[1][node];
+	velocity[2] = m_velocity[2][node];
+}
+
+
+// Builds the adjacency from the spring list with a counting sort by node.
+// Within a row the entries keep the order the springs were added in, which fixes the
+// summation order of the forces.
+void SpringNetwork::BuildTopology()
+{
+	for(int node = 0; node <= m_numOfNodes; ++node)
+		m_rowStart[node] = 0;
+
+	for(int spring = 0; spring < m_numOfSprings; ++spring)
+	{
+		++m_rowStart[m_springFirstNode[spring] + 1];
+		++m_rowStart[m_springSecondNode[spring] + 1];
+	}
+
+	for(int node = 0; node < m_numOfNodes; ++node)
+		m_rowStart[node + 1] += m_rowStart[node];
+
+	int* cursor = static_cast<int*>(AllocateAligned(sizeof(int) * (m_numOfNodes > 0 ? m_numOfNodes : 1)));
+	for(int node = 0; node < m_numOfNodes; ++node)
+		cursor[node] = m_rowStart[node];
+
+	for(int spring = 0; spring < m_numOfSprings; ++spring)
+	{
+		int ends[2] = {m_springFirstNode[spring], m_springSecondNode[spring]};
+		for(int end = 0; end < 2; ++end)
+		{
+			int entry = cursor[ends[end]]++;
+			m_entryNeighbour[entry] = ends[1 - end];
+			m_entrySpring[entry] = spring;
+			m_entrySpringConstant[entry] = m_springConstant[spring];
+			m_entryDamping[entry] = m_springDamping[spring];
+			m_entryRestLength[entry] = m_springRestLength[spring];
+		}
+	}
+	FreeAligned(cursor);
+
+	m_topologyOutdated = false;
+}
+
+
+// Sums the spring forces of a range of nodes and stores their accelerations.
+// A spring pulls with k * (other - own) and damps with c * (other velocity - own velocity),
+// for a fixed other end this is the law of PendulumPhysics. With a rest length the pull
+// is scaled down to the stretch beyond it.
+void SpringNetwork::ComputeAccelerations(int begin, int end)
+{
+	const float* __restrict px = m_position[0];
+	const float* __restrict py = m_position[1];
+	const float* __restrict pz = m_position[2];
+	const float* __restrict vx = m_velocity[0];
+	const float* __restrict vy = m_velocity[1];
+	const float* __restrict vz = m_velocity[2];
+	const int* __restrict neighbour = m_entryNeighbour;
+	const float* __restrict springConstant = m_entrySpringConstant;
+	const float* __restrict damping = m_entryDamping;
+	const float* __restrict restLength = m_entryRestLength;
+
+	for(int node = begin; node < end; ++node)
+	{
+		float x = px[node];
+		float y = py[node];
+		float z = pz[node];
+		float u = vx[node];
+		float v = vy[node];
+		float w = vz[node];
+
+		float fx = 0.0f;
+		float fy = 0.0f;
+		float fz = 0.0f;
+		for(int entry = m_rowStart[node]; entry < m_rowStart[node + 1]; ++entry)
+		{
+			int other = neighbour[entry];
+			float dx = px[other] - x;
+			float dy = py[other] - y;
+			float dz = pz[other] - z;
+
+			float pull = springConstant[entry];
+			if (restLength[entry] > 0.0f)
+			{
+				float length = sqrtf(dx * dx + dy * dy + dz * dz);
+				pull = length > 0.0f ? pull * (1.0f - restLength[entry] / length) : 0.0f;
+			}
+
+			float c = damping[entry];
+			fx += c * (vx[other] - u) + pull * dx;
+			fy += c * (vy[other] - v) + pull * dy;
+			fz += c * (vz[other] - w) + pull * dz;
+		}
+
+		// Fixed nodes neither feel gravity nor the springs.
+		float invMass = m_invMass[node];
+		float gravity = invMass > 0.0f ? m_earthAcceleration : 0.0f;
+		m_acceleration[0][node] = invMass * fx;
+		m_acceleration[1][node] = gravity + invMass * fy;
+		m_acceleration[2][node] = invMass * fz;
+	}
+}
+
+
+// Moves a range of nodes by one explicit Euler step with the stored accelerations.
+void SpringNetwork::IntegrateRange(int begin, int end, float deltaTime)
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		float* __restrict position = m_position[axis];
+		float* __restrict velocity = m_velocity[axis];
+		const float* __restrict acceleration = m_acceleration[axis];
+		for(int node = begin; node < end; ++node)
+		{
+			position[node] += deltaTime * velocity[node];
+			velocity[node] += deltaTime * acceleration[node];
+		}
+	}
+}
+
+
+// Runs the task on every chunk of nodes, on the thread pool if one is set.
+// The chunks are the same with and without the pool, so are the partial sums of the solver.
+void SpringNetwork::ForEachChunk(const std::function<void(int begin, int end)>& task)
+{
+	int numOfChunks = (m_numOfNodes + SpringNetworkChunkSize - 1) / SpringNetworkChunkSize;
+
+	auto runChunk = [&](int chunk)
+	{
+		int begin = chunk * SpringNetworkChunkSize;
+		int end = begin + SpringNetworkChunkSize < m_numOfNodes ? begin + SpringNetworkChunkSize : m_numOfNodes;
+		task(begin, end);
+	};
+
+	if (m_threadPool == NULL || numOfChunks < 2)
+	{
+		for(int chunk = 0; chunk < numOfChunks; ++chunk)
+			runChunk(chunk);
+		return;
+	}
+
+	m_threadPool->ParallelFor(numOfChunks, runChunk);
+}
+
+
+// Creates the columns of the implicit step.
+void SpringNetwork::CreateSolverColumns()
+{
+	m_mass = AllocateColumn(m_nodeCapacity);
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_deltaVelocity[axis] = AllocateColumn(m_nodeCapacity);
+		m_residual[axis] = AllocateColumn(m_nodeCapacity);
+		m_searchDirection[axis] = AllocateColumn(m_nodeCapacity);
+		m_product[axis] = AllocateColumn(m_nodeCapacity);
+		m_preconditioned[axis] = AllocateColumn(m_nodeCapacity);
+		m_diagonal[axis] = AllocateColumn(m_nodeCapacity);
+
+		for(int node = 0; node < m_numOfNodes; ++node)
+			m_deltaVelocity[axis][node] = 0.0f;
+	}
+	m_entryStiffness = AllocateColumn(2 * m_springCapacity);
+	m_entryDirectionalStiffness = AllocateColumn(2 * m_springCapacity);
+
+	int maxNumOfChunks = m_nodeCapacity / SpringNetworkChunkSize + 1;
+	m_partialSums = static_cast<double*>(AllocateAligned(sizeof(double) * 3 * maxNumOfChunks));
+}
+
+
+// Linearizes the springs of a range of nodes and sets up their part of the system.
+//
+// Backward Euler asks for the velocity change dv with
+//   M dv = h * (F(x + h * (v + dv), v + dv))
+// and linearizing the forces around the current state gives
+//   (M + h * C + h^2 * K) dv = h * (F + h * K' v)
+// where K and C are the stiffness and damping of the springs between the nodes and K' v
+// the spring forces of the current velocities. The right side goes into the residual.
+void SpringNetwork::PrepareImplicitRange(int begin, int end, float deltaTime)
+{
+	ComputeAccelerations(begin, end);
+
+	const float squaredDeltaTime = deltaTime * deltaTime;
+	for(int node = begin; node < end; ++node)
+	{
+		float invMass = m_invMass[node];
+		if (invMass <= 0.0f)
+		{
+			// Fixed nodes do not take part, the identity keeps their velocity change at zero.
+			m_mass[node] = 0.0f;
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				m_diagonal[axis][node] = 1.0f;
+				m_residual[axis][node] = 0.0f;
+			}
+			for(int entry = m_rowStart[node]; entry < m_rowStart[node + 1]; ++entry)
+			{
+				m_entryStiffness[entry] = 0.0f;
+				m_entryDirectionalStiffness[entry] = 0.0f;
+			}
+			continue;
+		}
+
+		float mass = 1.0f / invMass;
+		float diagonal[3] = {mass, mass, mass};
+		float stiffnessOfVelocity[3] = {0.0f, 0.0f, 0.0f};
+
+		for(int entry = m_rowStart[node]; entry < m_rowStart[node + 1]; ++entry)
+		{
+			int other = m_entryNeighbour[entry];
+			float d[3];
+			for(int axis = 0; axis < 3; ++axis)
+				d[axis] = m_position[axis][other] - m_position[axis][node];
+
+			// The derivative of k * (1 - L / |d|) * d is k * (1 - L / |d|) * I + k * L / |d|^3 * d * d^T.
+			// A compressed spring would make the first part negative, it is clamped to keep the system positive definite.
+			float stiffness = m_entrySpringConstant[entry];
+			float directionalStiffness = 0.0f;
+			float restLength = m_entryRestLength[entry];
+			if (restLength > 0.0f)
+			{
+				float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+				if (length > 0.0f)
+				{
+					directionalStiffness = stiffness * restLength / (length * length * length);
+					stiffness *= 1.0f - restLength / length;
+					if (stiffness < 0.0f)
+						stiffness = 0.0f;
+				}
+				else
+					stiffness = 0.0f;
+			}
+			m_entryStiffness[entry] = stiffness;
+			m_entryDirectionalStiffness[entry] = directionalStiffness;
+
+			float coupling = deltaTime * m_entryDamping[entry] + squaredDeltaTime * stiffness;
+			float relativeVelocity[3];
+			for(int axis = 0; axis < 3; ++axis)
+				relativeVelocity[axis] = m_velocity[axis][other] - m_velocity[axis][node];
+			float projection = d[0] * relativeVelocity[0] + d[1] * relativeVelocity[1] + d[2] * relativeVelocity[2];
+
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				diagonal[axis] += coupling + squaredDeltaTime * directionalStiffness * d[axis] * d[axis];
+				stiffnessOfVelocity[axis] += stiffness * relativeVelocity[axis] + directionalStiffness * projection * d[axis];
+			}
+		}
+
+		m_mass[node] = mass;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_diagonal[axis][node] = diagonal[axis];
+			m_residual[axis][node] = deltaTime * (mass * m_acceleration[axis][node] + deltaTime * stiffnessOfVelocity[axis]);
+		}
+	}
+}
+
+
+// Multiplies a range of nodes of the vector with the system matrix M + h * C + h^2 * K.
+// The matrix is never stored, every product walks the adjacency like the force loop.
+void SpringNetwork::ApplySystemRange(int begin, int end, float deltaTime, float* const input[3], float* const output[3])
+{
+	const float squaredDeltaTime = deltaTime * deltaTime;
+	for(int node = begin; node < end; ++node)
+	{
+		float mass = m_mass[node];
+		if (mass == 0.0f)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+				output[axis][node] = input[axis][node];
+			continue;
+		}
+
+		float result[3];
+		for(int axis = 0; axis < 3; ++axis)
+			result[axis] = mass * input[axis][node];
+
+		for(int entry = m_rowStart[node]; entry < m_rowStart[node + 1]; ++entry)
+		{
+			int other = m_entryNeighbour[entry];
+			float d[3];
+			float difference[3];
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				d[axis] = m_position[axis][other] - m_position[axis][node];
+				difference[axis] = input[axis][other] - input[axis][node];
+			}
+
+			float coupling = deltaTime * m_entryDamping[entry] + squaredDeltaTime * m_entryStiffness[entry];
+			float projection = squaredDeltaTime * m_entryDirectionalStiffness[entry] * (d[0] * difference[0] + d[1] * difference[1] + d[2] * difference[2]);
+			for(int axis = 0; axis < 3; ++axis)
+				result[axis] -= coupling * difference[axis] + projection * d[axis];
+		}
+
+		for(int axis = 0; axis < 3; ++axis)
+			output[axis][node] = result[axis];
+	}
+}
+
+
+// Solves the system of one implicit step for the velocity change with a Jacobi preconditioned
+// conjugate gradient. The velocity change of the previous step is the start value, it is
+// close to the solution as long as the motion is smooth.
+void SpringNetwork::SolveImplicitStep(float deltaTime)
+{
+	int numOfChunks = (m_numOfNodes + SpringNetworkChunkSize - 1) / SpringNetworkChunkSize;
+	double* partialSums = m_partialSums;
+	auto sumPartials = [&](double sums[3])
+	{
+		sums[0] = sums[1] = sums[2] = 0.0;
+		for(int chunk = 0; chunk < numOfChunks; ++chunk)
+		{
+			sums[0] += partialSums[3 * chunk];
+			sums[1] += partialSums[3 * chunk + 1];
+			sums[2] += partialSums[3 * chunk + 2];
+		}
+	};
+
+	// r = b - A x, z = D^-1 r, p = z
+	ForEachChunk([&](int begin, int end)
+	{
+		PrepareImplicitRange(begin, end, deltaTime);
+		ApplySystemRange(begin, end, deltaTime, m_deltaVelocity, m_product);
+
+		double rightSide = 0.0;
+		double residual = 0.0;
+		double residualPreconditioned = 0.0;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			for(int node = begin; node < end; ++node)
+			{
+				float b = m_residual[axis][node];
+				float r = b - m_product[axis][node];
+				float z = r / m_diagonal[axis][node];
+				m_residual[axis][node] = r;
+				m_preconditioned[axis][node] = z;
+				m_searchDirection[axis][node] = z;
+				rightSide += static_cast<double>(b) * b;
+				residual += static_cast<double>(r) * r;
+				residualPreconditioned += static_cast<double>(r) * z;
+			}
+		}
+
+		int chunk = begin / SpringNetworkChunkSize;
+		partialSums[3 * chunk] = rightSide;
+		partialSums[3 * chunk + 1] = residual;
+		partialSums[3 * chunk + 2] = residualPreconditioned;
+	});
+
+	double sums[3];
+	sumPartials(sums);
+	double targetResidual = static_cast<double>(m_solverTolerance) * m_solverTolerance * sums[0];
+	double residual = sums[1];
+	double residualPreconditioned = sums[2];
+
+	m_solverIterations = 0;
+	while (m_solverIterations < m_solverMaxIterations && residual > targetResidual)
+	{
+		// q = A p, alpha = r.z / p.q
+		ForEachChunk([&](int begin, int end)
+		{
+			ApplySystemRange(begin, end, deltaTime, m_searchDirection, m_product);
+
+			double curvature = 0.0;
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				for(int node = begin; node < end; ++node)
+					curvature += static_cast<double>(m_searchDirection[axis][node]) * m_product[axis][node];
+			}
+
+			int chunk = begin / SpringNetworkChunkSize;
+			partialSums[3 * chunk] = curvature;
+			partialSums[3 * chunk + 1] = 0.0;
+			partialSums[3 * chunk + 2] = 0.0;
+		});
+
+		sumPartials(sums);
+		if (sums[0] <= 0.0)
+			break;
+		float alpha = static_cast<float>(residualPreconditioned / sums[0]);
+
+		// x += alpha p, r -= alpha q, z = D^-1 r
+		ForEachChunk([&](int begin, int end)
+		{
+			double newResidual = 0.0;
+			double newResidualPreconditioned = 0.0;
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				for(int node = begin; node < end; ++node)
+				{
+					m_deltaVelocity[axis][node] += alpha * m_searchDirection[axis][node];
+					float r = m_residual[axis][node] - alpha * m_product[axis][node];
+					float z = r / m_diagonal[axis][node];
+					m_residual[axis][node] = r;
+					m_preconditioned[axis][node] = z;
+					newResidual += static_cast<double>(r) * r;
+					newResidualPreconditioned += static_cast<double>(r) * z;
+				}
+			}
+
+			int chunk = begin / SpringNetworkChunkSize;
+			partialSums[3 * chunk] = 0.0;
+			partialSums[3 * chunk + 1] = newResidual;
+			partialSums[3 * chunk + 2] = newResidualPreconditioned;
+		});
+
+		sumPartials(sums);
+		float beta = static_cast<float>(sums[2] / residualPreconditioned);
+		residual = sums[1];
+		residualPreconditioned = sums[2];
+		++m_solverIterations;
+
+		if (residual <= targetResidual)
+			break;
+
+		// p = z + beta p
+		ForEachChunk([&](int begin, int end)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				for(int node = begin; node < end; ++node)
+					m_searchDirection[axis][node] = m_preconditioned[axis][node] + beta * m_searchDirection[axis][node];
+			}
+		});
+	}
+}
+
+
+// Assigns the springs greedily to colors so that no two springs of a color share a node.
+// Every spring takes the lowest color none of the springs at its nodes has taken so far,
+// which needs at most twice the highest node degree of colors and two for a chain.
+void SpringNetwork::ColorSprings()
+{
+	std::vector<int> colorOfSpring(m_numOfSprings, -1);
+	std::vector<int> forbiddenBy;
+	std::vector<int> numOfSpringsOfColor;
+
+	for(int spring = 0; spring < m_numOfSprings; ++spring)
+	{
+		int ends[2] = {m_springFirstNode[spring], m_springSecondNode[spring]};
+		for(int end = 0; end < 2; ++end)
+		{
+			for(int entry = m_rowStart[ends[end]]; entry < m_rowStart[ends[end] + 1]; ++entry)
+			{
+				int color = colorOfSpring[m_entrySpring[entry]];
+				if (color >= 0)
+					forbiddenBy[color] = spring;
+			}
+		}
+
+		int color = 0;
+		while (color < static_cast<int>(forbiddenBy.size()) && forbiddenBy[color] == spring)
+			++color;
+		if (color == static_cast<int>(forbiddenBy.size()))
+		{
+			forbiddenBy.push_back(-1);
+			numOfSpringsOfColor.push_back(0);
+		}
+
+		colorOfSpring[spring] = color;
+		++numOfSpringsOfColor[color];
+	}
+
+	int numOfColors = static_cast<int>(numOfSpringsOfColor.size());
+	m_colorStart.assign(numOfColors + 1, 0);
+	for(int color = 0; color < numOfColors; ++color)
+		m_colorStart[color + 1] = m_colorStart[color] + numOfSpringsOfColor[color];
+
+	std::vector<int> cursor(m_colorStart.begin(), m_colorStart.end() - 1);
+	for(int spring = 0; spring < m_numOfSprings; ++spring)
+		m_colorSprings[cursor[colorOfSpring[spring]]++] = spring;
+
+	m_colorsOutdated = false;
+}
+
+
+// Creates the columns of the position based step.
+void SpringNetwork::CreateXpbdColumns()
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_previousPosition[axis] = AllocateColumn(m_nodeCapacity);
+		m_lambda[axis] = AllocateColumn(m_springCapacity);
+	}
+	m_colorSprings = static_cast<int*>(AllocateAligned(sizeof(int) * (m_springCapacity > 0 ? m_springCapacity : 1)));
+}
+
+
+// Projects a range of springs of one color.
+//
+// A spring with stiffness k and damping c is a constraint with the compliance 1 / k and
+// the damping c / k. The zero length spring has the vector constraint C = x1 - x2, the
+// spring with rest length L the distance constraint C = |x1 - x2| - L. Both give
+//   dlambda = (-C - a * lambda - g * grad C . (x - x_prev)) / ((1 + g) * (w1 + w2) + a)
+// with a = 1 / (k h^2) and g = c / (k h), after which the nodes move by w * dlambda along grad C.
+void SpringNetwork::ProjectSprings(int begin, int end, float substepDeltaTime)
+{
+	for(int colorEntry = begin; colorEntry < end; ++colorEntry)
+	{
+		int spring = m_colorSprings[colorEntry];
+		float springConstant = m_springConstant[spring];
+		if (springConstant <= 0.0f)
+			continue;
+
+		int first = m_springFirstNode[spring];
+		int second = m_springSecondNode[spring];
+		float firstInvMass = m_invMass[first];
+		float secondInvMass = m_invMass[second];
+		float invMassSum = firstInvMass + secondInvMass;
+		if (invMassSum <= 0.0f)
+			continue;
+
+		float compliance = 1.0f / (springConstant * substepDeltaTime * substepDeltaTime);
+		float damping = m_springDamping[spring] / (springConstant * substepDeltaTime);
+		float denominator = (1.0f + damping) * invMassSum + compliance;
+
+		float difference[3];
+		float motion[3];
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			difference[axis] = m_position[axis][first] - m_position[axis][second];
+			motion[axis] = (m_position[axis][first] - m_previousPosition[axis][first]) - (m_position[axis][second] - m_previousPosition[axis][second]);
+		}
+
+		float restLength = m_springRestLength[spring];
+		if (restLength <= 0.0f)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+			{
+				float deltaLambda = (-difference[axis] - compliance * m_lambda[axis][spring] - damping * motion[axis]) / denominator;
+				m_lambda[axis][spring] += deltaLambda;
+				m_position[axis][first] += firstInvMass * deltaLambda;
+				m_position[axis][second] -= secondInvMass * deltaLambda;
+			}
+			continue;
+		}
+
+		float length = sqrtf(difference[0] * difference[0] + difference[1] * difference[1] + difference[2] * difference[2]);
+		if (length <= 0.0f)
+			continue;
+
+		float direction[3] = {difference[0] / length, difference[1] / length, difference[2] / length};
+		float constraint = length - restLength;
+		float projectedMotion = direction[0] * motion[0] + direction[1] * motion[1] + direction[2] * motion[2];
+		float deltaLambda = (-constraint - compliance * m_lambda[0][spring] - damping * projectedMotion) / denominator;
+		m_lambda[0][spring] += deltaLambda;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_position[axis][first] += firstInvMass * deltaLambda * direction[axis];
+			m_position[axis][second] -= secondInvMass * deltaLambda * direction[axis];
+		}
+	}
+}
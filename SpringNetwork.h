@@ -0,0 +1,208 @@
+#pragma once
+
+#include "PendulumPhysics.h"
+#include <stddef.h>
+#include <functional>
+#include <vector>
+
+class WorkStealingPool;
+
+// The number of nodes that form one unit of work when the network is stepped on a thread pool.
+const int SpringNetworkChunkSize = 4096;
+
+// Simulates bobs that are connected by springs in an arbitrary graph, e.g. chains where
+// every bob is the anchor of the next one. A node with an inverse mass of 0 does not move
+// and takes the place of the fixed anchor point.
+//
+// Every spring follows the law of the single pendulum: it pulls with the spring constant
+// times the distance and damps with the damping constant times the velocity, both relative
+// to the other end. A spring with rest length 0 between a bob and a fixed node therefore
+// moves the bob exactly like the PendulumIntegrator.
+//
+// The springs are kept as a compressed sparse row adjacency: the entries of a node are
+// contiguous and carry a copy of the spring parameters. The force loop walks them in
+// order and only gathers the state of the neighbours, so no two nodes write to the same
+// memory and the nodes can be split over threads without atomics.
+class SpringNetwork
+{
+public:
+	// Reserves the memory for the indicated number of nodes and springs.
+	SpringNetwork(int nodeCapacity, int springCapacity);
+	~SpringNetwork();
+
+	// Adds a node at rest at the indicated position and returns its index, or -1 if the network is full.
+	// An inverse mass of 0 makes a fixed node.
+	int AddNode(float position[3], float invMass);
+
+	// Connects two nodes by a spring and returns its index, or -1 if the network is full.
+	int AddSpring(int firstNode, int secondNode, float springConstant, float dampingVelocity, float restLength);
+
+	// Hangs a chain of bobs with the default parameters below the indicated node. Every link
+	// starts displaced from the previous one by the offset. Returns the index of the last bob,
+	// or -1 if the network is full.
+	int AddChain(int anchorNode, int numOfLinks, float linkOffset[3]);
+
+	// Sets the position of the indicated node and resets its velocity.
+	void SetNodePosition(int node, float position[3]);
+
+	// Sets the gravity along the vertical axis, it acts on every node that is not fixed.
+	void SetEarthAcceleration(float earthAcceleration) { m_earthAcceleration = earthAcceleration; }
+
+	// Updates the simulation of all nodes.
+	void UpdateSimulation(float deltaTime);
+
+	// Advances all nodes by the indicated number of explicit Euler steps, on the thread pool if one is set.
+	// Every node sums its own forces in a fixed order, so the result does not depend on the number of threads.
+	void Step(float deltaTime, int steps);
+
+	// Advances all nodes by the indicated number of backward Euler steps. The springs are
+	// linearized at the start of every step and the linear system for the velocity change is
+	// solved by a conjugate gradient that never builds the matrix. The step stays stable for
+	// stiff springs, where the explicit step needs a tiny time step.
+	void StepImplicit(float deltaTime, int steps);
+
+	// Sets when the conjugate gradient of the implicit step stops: once the residual fell by the
+	// relative tolerance or after the maximum number of iterations.
+	void SetSolverTolerance(float relativeTolerance, int maxIterations);
+	// Gets the number of conjugate gradient iterations the last implicit step took.
+	int GetNumOfSolverIterations() { return m_solverIterations; }
+
+	// Advances all nodes by the indicated number of frames of extended position based dynamics.
+	// Every spring is a compliant constraint: a zero length spring keeps the two nodes together,
+	// a spring with rest length keeps their distance. The compliance is the inverse spring
+	// constant, so the springs keep their stiffness independent of the time step and the
+	// iterations. The step is stable for any stiffness and time step; more iterations and
+	// substeps bring it closer to the exact solution.
+	void StepXpbd(float deltaTime, int steps);
+
+	// Sets the number of constraint iterations per substep of the position based step.
+	void SetXpbdIterations(int iterations) { m_xpbdIterations = iterations > 0 ? iterations : 1; }
+	// Sets the number of substeps the frame of the position based step is split into.
+	void SetXpbdSubsteps(int substeps) { m_xpbdSubsteps = substeps > 0 ? substeps : 1; }
+	// Gets the number of constraint iterations per substep of the position based step.
+	int GetXpbdIterations() { return m_xpbdIterations; }
+	// Gets the number of substeps the frame of the position based step is split into.
+	int GetXpbdSubsteps() { return m_xpbdSubsteps; }
+	// Gets the number of colors the springs were split into, the springs of one color share no node.
+	int GetNumOfColors();
+
+	// Sets the thread pool the steps are distributed on, NULL runs them on the calling thread.
+	void SetThreadPool(WorkStealingPool* threadPool) { m_threadPool = threadPool; }
+
+	// Obtains the current position of the indicated node.
+	void ObtainNodePosition(int node, float position[3]);
+	// Obtains the current velocity of the indicated node.
+	void ObtainNodeVelocity(int node, float velocity[3]);
+
+	// Gets the number of nodes in the network.
+	int GetNumOfNodes() { return m_numOfNodes; }
+	// Gets the number of springs in the network.
+	int GetNumOfSprings() { return m_numOfSprings; }
+
+private:
+	SpringNetwork(const SpringNetwork&) = delete;
+	SpringNetwork& operator=(const SpringNetwork&) = delete;
+
+	// The number of nodes and springs we have memory for.
+	int m_nodeCapacity;
+	int m_springCapacity;
+	// The number of nodes and springs in use.
+	int m_numOfNodes;
+	int m_numOfSprings;
+
+	// The gravity along the vertical axis.
+	float m_earthAcceleration;
+
+	// The state of the nodes, one column per axis.
+	float* m_position[3];
+	float* m_velocity[3];
+	// The accelerations of the current step, one column per axis.
+	float* m_acceleration[3];
+	// The inverse mass of every node, 0 for fixed nodes.
+	float* m_invMass;
+
+	// The springs in the order they were added.
+	int* m_springFirstNode;
+	int* m_springSecondNode;
+	float* m_springConstant;
+	float* m_springDamping;
+	float* m_springRestLength;
+
+	// The adjacency: the entries of node n are [m_rowStart[n], m_rowStart[n + 1]).
+	// Every spring has one entry at each of its nodes.
+	int* m_rowStart;
+	int* m_entryNeighbour;
+	int* m_entrySpring;
+	float* m_entrySpringConstant;
+	float* m_entryDamping;
+	float* m_entryRestLength;
+	// Set when springs or nodes were added after the adjacency was built.
+	bool m_topologyOutdated;
+
+	// The pool the chunks are stepped on, NULL for the calling thread.
+	WorkStealingPool* m_threadPool;
+
+	// The stop criteria of the conjugate gradient and the iterations of the last implicit step.
+	float m_solverTolerance;
+	int m_solverMaxIterations;
+	int m_solverIterations;
+
+	// The columns of the implicit step, NULL until the first implicit step.
+	// The mass of every node, 0 for fixed nodes.
+	float* m_mass;
+	// The velocity change of the last step, the start value of the next solve.
+	float* m_deltaVelocity[3];
+	// The vectors of the conjugate gradient, one column per axis.
+	float* m_residual[3];
+	float* m_searchDirection[3];
+	float* m_product[3];
+	float* m_preconditioned[3];
+	// The diagonal of the system, the Jacobi preconditioner.
+	float* m_diagonal[3];
+	// The linearized stiffness of every entry: k' * y + k'' * d * (d . y) for a displacement y
+	// and the spring vector d.
+	float* m_entryStiffness;
+	float* m_entryDirectionalStiffness;
+	// Two partial sums per chunk, added up in chunk order so the solver does not depend on the threads.
+	double* m_partialSums;
+
+	// The iterations and substeps of the position based step.
+	int m_xpbdIterations;
+	int m_xpbdSubsteps;
+	// The springs sorted by color, the springs of color c are [m_colorStart[c], m_colorStart[c + 1]).
+	int* m_colorSprings;
+	std::vector<int> m_colorStart;
+	// Set when springs were added after the colors were assigned.
+	bool m_colorsOutdated;
+	// The columns of the position based step, NULL until the first such step.
+	// The positions at the start of the substep, one column per axis.
+	float* m_previousPosition[3];
+	// The accumulated constraint impulse of every spring, one column per axis.
+	// Springs with a rest length only use the first.
+	float* m_lambda[3];
+
+	// Builds the adjacency from the spring list with a counting sort by node.
+	void BuildTopology();
+	// Sums the spring forces of a range of nodes and stores their accelerations.
+	void ComputeAccelerations(int begin, int end);
+	// Moves a range of nodes by one explicit Euler step with the stored accelerations.
+	void IntegrateRange(int begin, int end, float deltaTime);
+
+	// Runs the task on every chunk of nodes, on the thread pool if one is set.
+	void ForEachChunk(const std::function<void(int begin, int end)>& task);
+	// Creates the columns of the implicit step.
+	void CreateSolverColumns();
+	// Linearizes the springs of a range of nodes and sets up their part of the system.
+	void PrepareImplicitRange(int begin, int end, float deltaTime);
+	// Multiplies a range of nodes of the vector with the system matrix.
+	void ApplySystemRange(int begin, int end, float deltaTime, float* const input[3], float* const output[3]);
+	// Solves the system of one implicit step for the velocity change.
+	void SolveImplicitStep(float deltaTime);
+
+	// Assigns the springs greedily to colors so that no two springs of a color share a node.
+	void ColorSprings();
+	// Creates the columns of the position based step.
+	void CreateXpbdColumns();
+	// Projects a range of springs of one color.
+	void ProjectSprings(int begin, int end, float substepDeltaTime);
+};
@@ -0,0 +1,223 @@
+#include "SweepAndPrune.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+
+// The number of sorted items one task of a sweep works on.
+static const int SweepChunkSize = 4096;
+// How many times the variance along another axis has to exceed the one along the sort axis
+// before the order is rebuilt along it, so items spread like a cube do not flip between axes.
+static const double SortAxisSwitchRatio = 2.0;
+
+
+SweepAndPrune::SweepAndPrune()
+{
+	m_sortAxis = 0;
+	m_numOfSwaps = 0;
+	m_numOfRebuilds = 0;
+	m_checkSortAxis = false;
+	m_threadPool = NULL;
+}
+
+
+// Repairs the order and finds all pairs of items closer than the distance.
+void SweepAndPrune::FindPairs(int count, const float* const position[3], float distance, std::vector<CollisionPair>& pairs)
+{
+	UpdateOrder(count, position);
+	Sweep(distance, pairs);
+}
+
+
+// Repairs the order of the items at their new positions and gathers their positions in that order.
+// A sort from scratch costs about n log n swaps, the repair gives up beyond that, so its worst
+// case stays the one of the sort. A repair that moved the items a lot makes the next update check
+// whether another axis separates them better by now.
+void SweepAndPrune::UpdateOrder(int count, const float* const position[3])
+{
+	if (static_cast<int>(m_sortedItems.size()) != count)
+	{
+		Rebuild(count, position, ChooseSortAxis(count, position, -1));
+	}
+	else if (m_checkSortAxis)
+	{
+		int sortAxis = ChooseSortAxis(count, position, m_sortAxis);
+		if (sortAxis != m_sortAxis)
+			Rebuild(count, position, sortAxis);
+	}
+	m_checkSortAxis = false;
+
+	// About n log2 n swaps, the comparisons of a sort from scratch.
+	long long maxNumOfSwaps = count;
+	for(int size = count; size > 1; size /= 2)
+		maxNumOfSwaps += count;
+
+	ReadKeys(count, position[m_sortAxis]);
+	if (RepairOrder(count, maxNumOfSwaps))
+	{
+		m_checkSortAxis = m_numOfSwaps > count;
+	}
+	else
+	{
+		Rebuild(count, position, ChooseSortAxis(count, position, -1));
+		ReadKeys(count, position[m_sortAxis]);
+	}
+
+	const int* sortedItems = m_sortedItems.data();
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		float* sortedPosition = m_sortedPosition[axis].data();
+		for(int sorted = 0; sorted < count; ++sorted)
+			sortedPosition[sorted] = position[axis][sortedItems[sorted]];
+	}
+}
+
+
+// Finds all pairs of items closer than the distance in the order of the last update.
+void SweepAndPrune::Sweep(float distance, std::vector<CollisionPair>& pairs)
+{
+	pairs.clear();
+
+	const int count = static_cast<int>(m_sortedItems.size());
+	int numOfChunks = (count + SweepChunkSize - 1) / SweepChunkSize;
+	if (m_threadPool == NULL || numOfChunks < 2)
+	{
+		SweepRange(0, count, distance, pairs);
+		return;
+	}
+
+	if (static_cast<int>(m_chunkPairs.size()) < numOfChunks)
+		m_chunkPairs.resize(numOfChunks);
+
+	m_threadPool->ParallelFor(numOfChunks, [&](int chunk)
+	{
+		int begin = chunk * SweepChunkSize;
+		int end = begin + SweepChunkSize < count ? begin + SweepChunkSize : count;
+		m_chunkPairs[chunk].clear();
+		SweepRange(begin, end, distance, m_chunkPairs[chunk]);
+	});
+
+	for(int chunk = 0; chunk < numOfChunks; ++chunk)
+		pairs.insert(pairs.end(), m_chunkPairs[chunk].begin(), m_chunkPairs[chunk].end());
+}
+
+
+// Gets the axis the items spread most along, the variance along the current axis counts
+// SortAxisSwitchRatio times. The axis with the largest variance separates the most items,
+// for a row of pendulums that is one of the horizontal axes.
+int SweepAndPrune::ChooseSortAxis(int count, const float* const position[3], int currentAxis)
+{
+	int sortAxis = 0;
+	double largestVariance = -1.0;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		double sum = 0.0;
+		double squaredSum = 0.0;
+		for(int item = 0; item < count; ++item)
+		{
+			sum += position[axis][item];
+			squaredSum += static_cast<double>(position[axis][item]) * position[axis][item];
+		}
+
+		double variance = count > 0 ? squaredSum / count - (sum / count) * (sum / count) : 0.0;
+		if (axis == currentAxis)
+			variance *= SortAxisSwitchRatio;
+		if (variance > largestVariance)
+		{
+			largestVariance = variance;
+			sortAxis = axis;
+		}
+	}
+	return sortAxis;
+}
+
+
+// Sorts the items from scratch along the indicated axis.
+void SweepAndPrune::Rebuild(int count, const float* const position[3], int sortAxis)
+{
+	m_sortAxis = sortAxis;
+	++m_numOfRebuilds;
+
+	m_sortedItems.resize(count);
+	m_sortedKeys.resize(count);
+	for(int axis = 0; axis < 3; ++axis)
+		m_sortedPosition[axis].resize(count);
+
+	const float* key = position[m_sortAxis];
+	for(int item = 0; item < count; ++item)
+		m_sortedItems[item] = item;
+	std::sort(m_sortedItems.begin(), m_sortedItems.end(), [key](int first, int second) { return key[first] < key[second]; });
+}
+
+
+// Reads the keys of the items in the current order.
+void SweepAndPrune::ReadKeys(int count, const float* key)
+{
+	const int* sortedItems = m_sortedItems.data();
+	float* sortedKeys = m_sortedKeys.data();
+	for(int sorted = 0; sorted < count; ++sorted)
+		sortedKeys[sorted] = key[sortedItems[sorted]];
+}
+
+
+// Moves every item back until the one before it is not larger. Items that kept their place
+// cost a single comparison.
+bool SweepAndPrune::RepairOrder(int count, long long maxNumOfSwaps)
+{
+	int* sortedItems = m_sortedItems.data();
+	float* sortedKeys = m_sortedKeys.data();
+	m_numOfSwaps = 0;
+	for(int sorted = 1; sorted < count; ++sorted)
+	{
+		float currentKey = sortedKeys[sorted];
+		int currentItem = sortedItems[sorted];
+		int target = sorted;
+		while (target > 0 && sortedKeys[target - 1] > currentKey)
+		{
+			sortedKeys[target] = sortedKeys[target - 1];
+			sortedItems[target] = sortedItems[target - 1];
+			--target;
+		}
+		sortedKeys[target] = currentKey;
+		sortedItems[target] = currentItem;
+		m_numOfSwaps += sorted - target;
+		if (m_numOfSwaps > maxNumOfSwaps)
+			return false;
+	}
+	return true;
+}
+
+
+// Sweeps a range of sorted items against the items after them.
+// Every item only looks ahead until the key is a full distance away, so each pair is
+// found exactly once.
+void SweepAndPrune::SweepRange(int begin, int end, float distance, std::vector<CollisionPair>& pairs)
+{
+	const int count = static_cast<int>(m_sortedItems.size());
+	const float squaredDistance = distance * distance;
+	const float* positionX = m_sortedPosition[0].data();
+	const float* positionY = m_sortedPosition[1].data();
+	const float* positionZ = m_sortedPosition[2].data();
+	const float* sortedKeys = m_sortedKeys.data();
+
+	for(int sorted = begin; sorted < end; ++sorted)
+	{
+		float limit = sortedKeys[sorted] + distance;
+		float x = positionX[sorted];
+		float y = positionY[sorted];
+		float z = positionZ[sorted];
+
+		for(int other = sorted + 1; other < count && sortedKeys[other] < limit; ++other)
+		{
+			float ox = positionX[other] - x;
+			float oy = positionY[other] - y;
+			float oz = positionZ[other] - z;
+			if (ox * ox + oy * oy + oz * oz >= squaredDistance)
+				continue;
+
+			int item = m_sortedItems[sorted];
+			int otherItem = m_sortedItems[other];
+			CollisionPair pair = {item < otherItem ? item : otherItem, item < otherItem ? otherItem : item};
+			pairs.push_back(pair);
+		}
+	}
+}
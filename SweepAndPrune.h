@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Broadphase.h"
+#include <stddef.h>
+#include <vector>
+
+// Sorts the items along one axis and only compares items whose intervals on that axis
+// overlap. The order is kept from step to step and repaired with an insertion sort, which
+// costs one pass when nothing moved past its neighbour. The smoothly moving pendulums
+// change their order rarely, so the sort stays close to linear. When the items move too far
+// for the repair it gives up and sorts from scratch, along the axis they spread most along by then.
+class SweepAndPrune : public Broadphase
+{
+public:
+	SweepAndPrune();
+
+	// Repairs the order and finds all pairs of items closer than the distance. If the number of
+	// items changed, the order is built from scratch along the axis the items spread most along.
+	virtual void FindPairs(int count, const float* const position[3], float distance, std::vector<CollisionPair>& pairs);
+
+	// The two halves of FindPairs. Repairs the order of the items at their new positions,
+	// or sorts them from scratch if the repair would cost more.
+	void UpdateOrder(int count, const float* const position[3]);
+	// Finds all pairs of items closer than the distance in the order of the last update.
+	void Sweep(float distance, std::vector<CollisionPair>& pairs);
+
+	// Sets the thread pool the sweep is distributed on, NULL runs it on the calling thread.
+	virtual void SetThreadPool(WorkStealingPool* threadPool) { m_threadPool = threadPool; }
+
+	// Gets the number of swaps the insertion sort needed in the last call, up to where it gave up.
+	long long GetNumOfSwaps() { return m_numOfSwaps; }
+	// Gets the number of times the order was sorted from scratch.
+	int GetNumOfRebuilds() { return m_numOfRebuilds; }
+	// Gets the axis the items are sorted along.
+	int GetSortAxis() { return m_sortAxis; }
+
+private:
+	// The axis the items are sorted along.
+	int m_sortAxis;
+	// The items in sorted order and their coordinate along the sort axis.
+	std::vector<int> m_sortedItems;
+	std::vector<float> m_sortedKeys;
+	// The positions of the items in sorted order, gathered for the sweep.
+	std::vector<float> m_sortedPosition[3];
+	// The swaps of the last insertion sort.
+	long long m_numOfSwaps;
+	// The sorts from scratch so far.
+	int m_numOfRebuilds;
+	// Set when the last repair needed many swaps, the next update checks the sort axis then.
+	bool m_checkSortAxis;
+
+	// The pairs found by every chunk of a sweep, joined in chunk order.
+	std::vector<std::vector<CollisionPair> > m_chunkPairs;
+
+	// The pool the sweep is run on, NULL for the calling thread.
+	WorkStealingPool* m_threadPool;
+
+	// Gets the axis the items spread most along, the current axis is preferred unless another
+	// one spreads them clearly more. Pass -1 as current axis to have no preference.
+	int ChooseSortAxis(int count, const float* const position[3], int currentAxis);
+	// Sorts the items from scratch along the indicated axis.
+	void Rebuild(int count, const float* const position[3], int sortAxis);
+	// Reads the keys of the items in the current order.
+	void ReadKeys(int count, const float* key);
+	// Repairs the order of the keys with an insertion sort. Returns false if it gave up after
+	// the indicated number of swaps, the order is broken then.
+	bool RepairOrder(int count, long long maxNumOfSwaps);
+	// Sweeps a range of sorted items against the items after them.
+	void SweepRange(int begin, int end, float distance, std::vector<CollisionPair>& pairs);
+};
@@ -0,0 +1,461 @@
+#include "TrajectoryCodec.h"
+#include <math.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// The largest float below 2^31, larger rounded samples do not fit into 32 bit integers.
+static const float MaxQuantizedSample = 2147483520.0f;
+// The most residuals of a group that can be exceptions to its width.
+static const int MaxExceptionsPerGroup = 255;
+// The bits an exception takes besides its packed bits: its position in the group and its high bits.
+static const int ExceptionBits = 8 + 32;
+
+
+// Rounds the number of bytes up to whole words.
+static size_t AlignToWords(size_t bytes)
+{
+	return (bytes + 3) / 4 * 4;
+}
+
+
+// Gets the number of groups the residuals of a column are packed in.
+static size_t GetNumOfGroups(int numOfFrames, int numOfPendulums)
+{
+	size_t numOfSamples = static_cast<size_t>(numOfFrames) * numOfPendulums;
+	return (numOfSamples + CodecGroupSize - 1) / CodecGroupSize;
+}
+
+
+// Maps a residual to an unsigned integer, 0, -1, 1, -2, 2 ... to 0, 1, 2, 3, 4 ...
+static inline unsigned int EncodeResidual(unsigned int residual)
+{
+	return (residual << 1) ^ (0u - (residual >> 31));
+}
+
+
+// Maps an unsigned integer back to the residual.
+static inline unsigned int DecodeResidual(unsigned int value)
+{
+	return (value >> 1) ^ (0u - (value & 1));
+}
+
+
+// Gets the number of bits of a residual.
+static inline int GetBitWidth(unsigned int value)
+{
+#ifdef _MSC_VER
+	unsigned long highestBit;
+	return _BitScanReverse(&highestBit, value) ? static_cast<int>(highestBit) + 1 : 0;
+#else
+	return value != 0 ? 32 - __builtin_clz(value) : 0;
+#endif
+}
+
+
+// Counts the residuals of a group that need more than the indicated number of bits.
+static int CountExceptions(const unsigned int* __restrict values, int width)
+{
+	int count = 0;
+	for(int i = 0; i < CodecGroupSize; ++i)
+		count += (values[i] >> width) != 0 ? 1 : 0;
+	return count;
+}
+
+
+// Chooses the width a group is packed with. The residuals that need more bits are exceptions, their
+// high bits are stored apart, which pays when a few outliers, the jump of a bob that fell asleep or
+// bounced off another, would otherwise widen all residuals of the group. The narrower widths are
+// tried until the exceptions alone take more bits than the best width so far, they only get more.
+// Returns the width and the number of exceptions.
+static int ChooseGroupWidth(const unsigned int* __restrict values, int& numOfExceptions)
+{
+	unsigned int bits[CodecLanes] = {0};
+	for(int row = 0; row < CodecGroupSize; row += CodecLanes)
+	{
+		for(int lane = 0; lane < CodecLanes; ++lane)
+			bits[lane] |= values[row + lane];
+	}
+	unsigned int allBits = 0;
+	for(int lane = 0; lane < CodecLanes; ++lane)
+		allBits |= bits[lane];
+
+	int maxWidth = GetBitWidth(allBits);
+	int bestWidth = maxWidth;
+	int bestBits = maxWidth * CodecGroupSize;
+	numOfExceptions = 0;
+	for(int width = maxWidth - 1; width >= 0; --width)
+	{
+		int exceptions = CountExceptions(values, width);
+		if (exceptions > MaxExceptionsPerGroup || exceptions * ExceptionBits >= bestBits)
+			break;
+		int packedBits = width * CodecGroupSize + exceptions * ExceptionBits;
+		if (packedBits < bestBits)
+		{
+			bestWidth = width;
+			bestBits = packedBits;
+			numOfExceptions = exceptions;
+		}
+	}
+	return bestWidth;
+}
+
+
+// Packs the low bits of a group of residuals with the indicated width into 8 * width words.
+// Residual i goes into the stream of lane i % 8, the streams are interleaved word by word.
+static void PackGroup(const unsigned int* __restrict values, int width, unsigned int* __restrict words)
+{
+	if (width == 0)
+		return;
+
+	// The high bits of the exceptions are cut off.
+	unsigned int mask = width < 32 ? (1u << width) - 1 : ~0u;
+	unsigned int buffer[CodecLanes] = {0};
+	int filled = 0;
+	for(int row = 0; row < CodecGroupSize; row += CodecLanes)
+	{
+		const unsigned int* rowValues = values + row;
+		for(int lane = 0; lane < CodecLanes; ++lane)
+			buffer[lane] |= (rowValues[lane] & mask) << filled;
+		filled += width;
+		if (filled >= 32)
+		{
+			for(int lane = 0; lane < CodecLanes; ++lane)
+				words[lane] = buffer[lane];
+			words += CodecLanes;
+			filled -= 32;
+			// The bits of the residuals that did not fit into the words start the next ones.
+			for(int lane = 0; lane < CodecLanes; ++lane)
+				buffer[lane] = filled > 0 ? (rowValues[lane] & mask) >> (width - filled) : 0;
+		}
+	}
+}
+
+
+// Unpacks a group of residuals with the indicated width.
+static void UnpackGroup(const unsigned int* __restrict words, int width, unsigned int* __restrict values)
+{
+	if (width == 0)
+	{
+		memset(values, 0, sizeof(unsigned int) * CodecGroupSize);
+		return;
+	}
+
+	unsigned int mask = width < 32 ? (1u << width) - 1 : ~0u;
+	int consumed = 0;
+	for(int row = 0; row < CodecGroupSize; row += CodecLanes)
+	{
+		unsigned int* rowValues = values + row;
+		for(int lane = 0; lane < CodecLanes; ++lane)
+			rowValues[lane] = words[lane] >> consumed;
+		consumed += width;
+		if (consumed >= 32)
+		{
+			words += CodecLanes;
+			consumed -= 32;
+			// The residuals that did not fit end in the next words.
+			if (consumed > 0)
+			{
+				for(int lane = 0; lane < CodecLanes; ++lane)
+					rowValues[lane] |= words[lane] << (width - consumed);
+			}
+		}
+		for(int lane = 0; lane < CodecLanes; ++lane)
+			rowValues[lane] &= mask;
+	}
+}
+
+
+// Gets the most bytes an encoded column of the indicated size takes: the header, the widths and
+// exception counts of the groups and all groups with the full width. A group only has exceptions
+// if they take fewer bits than the full width, only the padding of their positions comes on top.
+size_t TrajectoryCodec::GetMaxEncodedBytes(int numOfFrames, int numOfPendulums)
+{
+	size_t numOfGroups = GetNumOfGroups(numOfFrames, numOfPendulums);
+	return sizeof(EncodedColumnHeader) + 2 * AlignToWords(numOfGroups) + sizeof(unsigned int) * CodecGroupSize * numOfGroups + 4;
+}
+
+
+// Encodes a column with the predictor that packs smallest, or stores the floats if they can not be quantized
+// or packing does not make them smaller. The output has to be aligned to four bytes.
+size_t TrajectoryCodec::EncodeColumn(const float* column, int numOfFrames, int numOfPendulums, float errorBound, unsigned char* output)
+{
+	size_t numOfSamples = static_cast<size_t>(numOfFrames) * numOfPendulums;
+	size_t numOfGroups = GetNumOfGroups(numOfFrames, numOfPendulums);
+	size_t rawBytes = sizeof(EncodedColumnHeader) + sizeof(float) * numOfSamples;
+	EncodedColumnHeader* header = reinterpret_cast<EncodedColumnHeader*>(output);
+
+	m_quantized.resize(numOfSamples);
+	if (errorBound > 0.0f && QuantizeColumn(column, numOfSamples, 0.5f / errorBound))
+	{
+		// The padding of the last group stays zero and packs into no bits.
+		m_residuals.assign(numOfGroups * CodecGroupSize, 0);
+		int predictor = ChoosePredictor(numOfFrames, numOfPendulums);
+		PredictColumn(predictor, numOfFrames, numOfPendulums);
+
+		unsigned char* widths = output + sizeof(EncodedColumnHeader);
+		unsigned char* exceptionCounts = widths + AlignToWords(numOfGroups);
+		unsigned int* words = reinterpret_cast<unsigned int*>(exceptionCounts + AlignToWords(numOfGroups));
+		memset(widths, 0, 2 * AlignToWords(numOfGroups));
+		m_exceptionPositions.clear();
+		m_exceptionValues.clear();
+		for(size_t group = 0; group < numOfGroups; ++group)
+		{
+			const unsigned int* values = &m_residuals[group * CodecGroupSize];
+			int numOfExceptions;
+			int width = ChooseGroupWidth(values, numOfExceptions);
+			widths[group] = static_cast<unsigned char>(width);
+			exceptionCounts[group] = static_cast<unsigned char>(numOfExceptions);
+			PackGroup(values, width, words);
+			words += CodecLanes * width;
+			for(int i = 0; numOfExceptions > 0 && i < CodecGroupSize; ++i)
+			{
+				if ((values[i] >> width) != 0)
+				{
+					m_exceptionPositions.push_back(static_cast<unsigned char>(i));
+					m_exceptionValues.push_back(values[i] >> width);
+				}
+			}
+		}
+
+		// The positions of the exceptions and their high bits follow the groups.
+		unsigned char* positions = reinterpret_cast<unsigned char*>(words);
+		size_t numOfExceptions = m_exceptionPositions.size();
+		memset(positions, 0, AlignToWords(numOfExceptions));
+		if (numOfExceptions > 0)
+		{
+			memcpy(positions, m_exceptionPositions.data(), numOfExceptions);
+			memcpy(positions + AlignToWords(numOfExceptions), m_exceptionValues.data(), sizeof(unsigned int) * numOfExceptions);
+		}
+
+		size_t bytes = positions + AlignToWords(numOfExceptions) + sizeof(unsigned int) * numOfExceptions - output;
+		if (bytes < rawBytes)
+		{
+			header->m_bytes = static_cast<unsigned int>(bytes);
+			header->m_predictor = predictor;
+			return bytes;
+		}
+	}
+
+	header->m_bytes = static_cast<unsigned int>(rawBytes);
+	header->m_predictor = PredictorRaw;
+	if (numOfSamples > 0)
+		memcpy(output + sizeof(EncodedColumnHeader), column, sizeof(float) * numOfSamples);
+	return rawBytes;
+}
+
+
+// Decodes a column: unpacks the residuals, restores the high bits of the exceptions, adds the
+// residuals to the predictions frame after frame and scales the quantized samples back.
+bool TrajectoryCodec::DecodeColumn(const unsigned char* input, size_t bytes, int numOfFrames, int numOfPendulums, float errorBound, float* column)
+{
+	size_t numOfSamples = static_cast<size_t>(numOfFrames) * numOfPendulums;
+	size_t numOfGroups = GetNumOfGroups(numOfFrames, numOfPendulums);
+	if (bytes < sizeof(EncodedColumnHeader))
+		return false;
+	const EncodedColumnHeader* header = reinterpret_cast<const EncodedColumnHeader*>(input);
+	if (header->m_bytes > bytes)
+		return false;
+
+	if (header->m_predictor == PredictorRaw)
+	{
+		if (header->m_bytes != sizeof(EncodedColumnHeader) + sizeof(float) * numOfSamples)
+			return false;
+		if (numOfSamples > 0)
+			memcpy(column, input + sizeof(EncodedColumnHeader), sizeof(float) * numOfSamples);
+		return true;
+	}
+	if (header->m_predictor >= NumOfPredictors || !(errorBound > 0.0f))
+		return false;
+
+	const unsigned char* widths = input + sizeof(EncodedColumnHeader);
+	const unsigned char* exceptionCounts = widths + AlignToWords(numOfGroups);
+	size_t offset = sizeof(EncodedColumnHeader) + 2 * AlignToWords(numOfGroups);
+	if (offset > header->m_bytes)
+		return false;
+
+	m_residuals.resize(numOfGroups * CodecGroupSize);
+	size_t numOfExceptions = 0;
+	for(size_t group = 0; group < numOfGroups; ++group)
+	{
+		int width = widths[group];
+		size_t groupBytes = sizeof(unsigned int) * CodecLanes * width;
+		if (width > 32 || (width == 32 && exceptionCounts[group] > 0) || offset + groupBytes > header->m_bytes)
+			return false;
+		UnpackGroup(reinterpret_cast<const unsigned int*>(input + offset), width, &m_residuals[group * CodecGroupSize]);
+		offset += groupBytes;
+		numOfExceptions += exceptionCounts[group];
+	}
+	if (offset + AlignToWords(numOfExceptions) + sizeof(unsigned int) * numOfExceptions != header->m_bytes)
+		return false;
+
+	const unsigned char* positions = input + offset;
+	const unsigned int* exceptionValues = reinterpret_cast<const unsigned int*>(positions + AlignToWords(numOfExceptions));
+	size_t exception = 0;
+	for(size_t group = 0; group < numOfGroups; ++group)
+	{
+		unsigned int* values = &m_residuals[group * CodecGroupSize];
+		for(int count = 0; count < exceptionCounts[group]; ++count, ++exception)
+			values[positions[exception]] |= exceptionValues[exception] << widths[group];
+	}
+
+	m_quantized.resize(numOfSamples);
+	ReconstructColumn(header->m_predictor, numOfFrames, numOfPendulums);
+
+	float step = 2.0f * errorBound;
+	const int* __restrict quantized = m_quantized.data();
+	for(size_t sample = 0; sample < numOfSamples; ++sample)
+		column[sample] = static_cast<float>(quantized[sample]) * step;
+	return true;
+}
+
+
+// Rounds the samples to the nearest multiples of the step. Returns false if a sample is not finite
+// or too large for a 32 bit integer.
+bool TrajectoryCodec::QuantizeColumn(const float* column, size_t numOfSamples, float invStep)
+{
+	const float* __restrict samples = column;
+	int* __restrict quantized = m_quantized.data();
+	int outside = 0;
+	for(size_t sample = 0; sample < numOfSamples; ++sample)
+	{
+		float scaled = samples[sample] * invStep;
+		outside |= fabsf(scaled) < MaxQuantizedSample ? 0 : 1;
+		// From 2^23 on every float is an integer and adding a half would round to even instead.
+		float rounding = fabsf(scaled) < 8388608.0f ? 0.5f : 0.0f;
+		quantized[sample] = static_cast<int>(scaled + (scaled >= 0.0f ? rounding : -rounding));
+	}
+	return outside == 0;
+}
+
+
+// Maps the residuals of the quantized samples to their prediction. The first frames take predictors
+// of the degree the frames before them allow. The arithmetic wraps around, so the decoder gets
+// back every integer exactly, however large the residuals are.
+void TrajectoryCodec::PredictColumn(int predictor, int numOfFrames, int numOfPendulums)
+{
+	for(int frame = 0; frame < numOfFrames; ++frame)
+	{
+		size_t offset = static_cast<size_t>(frame) * numOfPendulums;
+		const unsigned int* __restrict current = reinterpret_cast<const unsigned int*>(m_quantized.data()) + offset;
+		unsigned int* __restrict residuals = m_residuals.data() + offset;
+		int degree = frame < predictor ? frame : predictor;
+		if (degree == 0)
+		{
+			for(int i = 0; i < numOfPendulums; ++i)
+				residuals[i] = EncodeResidual(current[i]);
+		}
+		else if (degree == PredictorConstant)
+		{
+			const unsigned int* __restrict previous = current - numOfPendulums;
+			for(int i = 0; i < numOfPendulums; ++i)
+				residuals[i] = EncodeResidual(current[i] - previous[i]);
+		}
+		else if (degree == PredictorLinear)
+		{
+			const unsigned int* __restrict previous = current - numOfPendulums;
+			const unsigned int* __restrict beforePrevious = previous - numOfPendulums;
+			for(int i = 0; i < numOfPendulums; ++i)
+				residuals[i] = EncodeResidual(current[i] - 2 * previous[i] + beforePrevious[i]);
+		}
+		else
+		{
+			const unsigned int* __restrict previous = current - numOfPendulums;
+			const unsigned int* __restrict beforePrevious = previous - numOfPendulums;
+			const unsigned int* __restrict first = beforePrevious - numOfPendulums;
+			for(int i = 0; i < numOfPendulums; ++i)
+				residuals[i] = EncodeResidual(current[i] - 3 * previous[i] + 3 * beforePrevious[i] - first[i]);
+		}
+	}
+}
+
+
+// Restores the quantized samples frame after frame by adding the residuals to the predictions.
+void TrajectoryCodec::ReconstructColumn(int predictor, int numOfFrames, int numOfPendulums)
+{
+	for(int frame = 0; frame < numOfFrames; ++frame)
+	{
+		size_t offset = static_cast<size_t>(frame) * numOfPendulums;
+		unsigned int* __restrict current = reinterpret_cast<unsigned int*>(m_quantized.data()) + offset;
+		const unsigned int* __restrict residuals = m_residuals.data() + offset;
+		int degree = frame < predictor ? frame : predictor;
+		if (degree == 0)
+		{
+			for(int i = 0; i < numOfPendulums; ++i)
+				current[i] = DecodeResidual(residuals[i]);
+		}
+		else if (degree == PredictorConstant)
+		{
+			const unsigned int* __restrict previous = current - numOfPendulums;
+			for(int i = 0; i < numOfPendulums; ++i)
+				current[i] = DecodeResidual(residuals[i]) + previous[i];
+		}
+		else if (degree == PredictorLinear)
+		{
+			const unsigned int* __restrict previous = current - numOfPendulums;
+			const unsigned int* __restrict beforePrevious = previous - numOfPendulums;
+			for(int i = 0; i < numOfPendulums; ++i)
+				current[i] = DecodeResidual(residuals[i]) + 2 * previous[i] - beforePrevious[i];
+		}
+		else
+		{
+			const unsigned int* __restrict previous = current - numOfPendulums;
+			const unsigned int* __restrict beforePrevious = previous - numOfPendulums;
+			const unsigned int* __restrict first = beforePrevious - numOfPendulums;
+			for(int i = 0; i < numOfPendulums; ++i)
+				current[i] = DecodeResidual(residuals[i]) + 3 * previous[i] - 3 * beforePrevious[i] + first[i];
+		}
+	}
+}
+
+
+// Estimates the bits of the residuals of every predictor from the differences of the quantized samples,
+// the residual of the constant predictor is the first difference, that of the linear one the second and
+// that of the quadratic one the third. A run of the pendulums of a frame counts with the width of its
+// largest residual, as a packed group does. Returns the predictor with the fewest bits.
+int TrajectoryCodec::ChoosePredictor(int numOfFrames, int numOfPendulums)
+{
+	// The first two frames have the same residuals with every predictor.
+	size_t bits[NumOfPredictors] = {0};
+	for(int frame = 2; frame < numOfFrames; ++frame)
+	{
+		const unsigned int* current = reinterpret_cast<const unsigned int*>(m_quantized.data()) + static_cast<size_t>(frame) * numOfPendulums;
+		const unsigned int* previous = current - numOfPendulums;
+		const unsigned int* beforePrevious = previous - numOfPendulums;
+		// In the third frame the quadratic predictor is still linear, its first sample is then read but not used.
+		const unsigned int* first = frame > 2 ? beforePrevious - numOfPendulums : beforePrevious;
+		for(int begin = 0; begin < numOfPendulums; begin += CodecGroupSize)
+		{
+			int end = begin + CodecGroupSize < numOfPendulums ? begin + CodecGroupSize : numOfPendulums;
+			unsigned int constantBits = 0;
+			unsigned int linearBits = 0;
+			unsigned int quadraticBits = 0;
+			for(int i = begin; i < end; ++i)
+			{
+				unsigned int firstDifference = current[i] - previous[i];
+				unsigned int previousDifference = previous[i] - beforePrevious[i];
+				unsigned int secondDifference = firstDifference - previousDifference;
+				unsigned int thirdDifference = secondDifference - (previousDifference - (beforePrevious[i] - first[i]));
+				constantBits |= EncodeResidual(firstDifference);
+				linearBits |= EncodeResidual(secondDifference);
+				quadraticBits |= EncodeResidual(thirdDifference);
+			}
+			if (frame == 2)
+				quadraticBits = linearBits;
+
+			unsigned int runBits[NumOfPredictors] = {0, constantBits, linearBits, quadraticBits};
+			for(int predictor = PredictorConstant; predictor < NumOfPredictors; ++predictor)
+				bits[predictor] += static_cast<size_t>(GetBitWidth(runBits[predictor])) * (end - begin);
+		}
+	}
+
+	int bestPredictor = PredictorConstant;
+	for(int predictor = PredictorLinear; predictor < NumOfPredictors; ++predictor)
+	{
+		if (bits[predictor] < bits[bestPredictor])
+			bestPredictor = predictor;
+	}
+	return bestPredictor;
+}
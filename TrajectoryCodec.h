@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// The number of residuals that share one bit width. They are packed as eight interleaved
+// streams of 32 bit words, residual i into stream i % 8, so the eight streams are the lanes
+// of a 256 bit vector and all of them are shifted by the same amounts.
+const int CodecGroupSize = 256;
+const int CodecLanes = 8;
+
+// How the samples of an encoded column are predicted from the samples of the frames before.
+enum TrajectoryPredictor
+{
+	// The floats are stored as they are, for columns the quantization can not represent.
+	PredictorRaw = 0,
+	// The sample of the previous frame.
+	PredictorConstant = 1,
+	// The line through the samples of the two previous frames.
+	PredictorLinear = 2,
+	// The parabola through the samples of the three previous frames.
+	PredictorQuadratic = 3,
+	NumOfPredictors
+};
+
+// The start of an encoded column. Unless the floats are stored as they are, it is followed by
+// the width of every group, the number of exceptions of every group, the packed groups, the
+// positions of the exceptions in their groups and their high bits, every part padded to words.
+struct EncodedColumnHeader
+{
+	// The size of the encoded column, this header included.
+	unsigned int m_bytes;
+	unsigned int m_predictor;
+};
+
+// Compresses a column of recorded samples, frame after frame with one sample per pendulum,
+// to a bounded error. Every sample is rounded to the nearest multiple of twice the bound, so
+// the samples are integers from there on and the prediction runs on the same values on both
+// sides: the errors do not add up over the frames. The residuals to the prediction are mapped
+// to unsigned integers with small values for small residuals and bit packed in groups of
+// CodecGroupSize. Every group takes the width that packs it smallest, the few residuals that
+// need more bits are exceptions whose high bits are stored behind the groups. The first frame is
+// predicted by zero and the next ones by predictors of lower degree, so a column decodes
+// without any other data. Every column takes the predictor estimated to pack smallest.
+// All loops run over the pendulums of a frame with the same operation for every one of them,
+// so the compiler vectorizes them across the bobs.
+class TrajectoryCodec
+{
+public:
+	// Gets the most bytes an encoded column of the indicated size takes.
+	static size_t GetMaxEncodedBytes(int numOfFrames, int numOfPendulums);
+
+	// Encodes a column so no decoded sample is further from the original than the bound, plus
+	// the rounding of the floats, at most two units in the last place of the sample. With a bound
+	// of 0, samples too large for the bound or residuals that do not pack smaller the floats are
+	// stored as they are. The output has to be aligned to four bytes and hold GetMaxEncodedBytes.
+	// Returns the number of bytes written to the output.
+	size_t EncodeColumn(const float* column, int numOfFrames, int numOfPendulums, float errorBound, unsigned char* output);
+	// Decodes a column encoded with the same size and bound. Returns false if the data is no
+	// column of this size.
+	bool DecodeColumn(const unsigned char* input, size_t bytes, int numOfFrames, int numOfPendulums, float errorBound, float* column);
+
+private:
+	// The samples rounded to multiples of twice the bound.
+	std::vector<int> m_quantized;
+	// The mapped residuals, padded with zeros to whole groups.
+	std::vector<unsigned int> m_residuals;
+	// The positions in their groups and the high bits of the residuals that are exceptions.
+	std::vector<unsigned char> m_exceptionPositions;
+	std::vector<unsigned int> m_exceptionValues;
+
+	// Rounds the samples to multiples of the step. Returns false if a sample is too large for it.
+	bool QuantizeColumn(const float* column, size_t numOfSamples, float invStep);
+	// Maps the residuals of the quantized samples to the prediction of the indicated predictor.
+	void PredictColumn(int predictor, int numOfFrames, int numOfPendulums);
+	// Restores the quantized samples from the residuals.
+	void ReconstructColumn(int predictor, int numOfFrames, int numOfPendulums);
+	// Estimates which predictor leaves the residuals with the fewest bits.
+	int ChoosePredictor(int numOfFrames, int numOfPendulums);
+};
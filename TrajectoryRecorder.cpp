@@ -0,0 +1,383 @@
+#include "TrajectoryRecorder.h"
+#include "PendulumBatch.h"
+#include "AlignedMemory.h"
+#include <chrono>
+#include <string.h>
+
+
+// The tag every trajectory file starts with.
+static const char TrajectoryMagic[8] = {'P', 'N', 'D', 'T', 'R', 'A', 'J', 0};
+
+
+// Opens a file for writing in binary mode.
+static FILE* OpenFileForWriting(const char* fileName)
+{
+#ifdef _MSC_VER
+	FILE* file = NULL;
+	if (fopen_s(&file, fileName, "wb") != 0)
+		return NULL;
+	return file;
+#else
+	return fopen(fileName, "wb");
+#endif
+}
+
+
+// Rounds the number of bytes up to the alignment of the blocks in the file.
+static size_t AlignBlockBytes(size_t bytes)
+{
+	return (bytes + TrajectoryBlockAlignment - 1) / TrajectoryBlockAlignment * TrajectoryBlockAlignment;
+}
+
+
+// Rounds the number of bytes up to the alignment of the columns.
+static size_t AlignColumnBytes(size_t bytes)
+{
+	return (bytes + SimulationColumnAlignment - 1) / SimulationColumnAlignment * SimulationColumnAlignment;
+}
+
+
+TrajectoryRecorder::TrajectoryRecorder()
+{
+	m_file = NULL;
+	memset(&m_header, 0, sizeof(m_header));
+	m_numOfColumns = 0;
+	m_positionErrorBound = 0.0f;
+	m_velocityErrorBound = 0.0f;
+	m_currentBlock = -1;
+	m_closing = false;
+	m_numOfFrames = 0;
+	m_numOfStalls = 0;
+	m_stallSeconds = 0.0;
+	m_maxQueuedBlocks = 0;
+	m_numOfBlocksWritten = 0;
+	m_bytesWritten = 0;
+	m_writeFailed = false;
+}
+
+
+// Closes the file.
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+	Close();
+}
+
+
+// Creates the file, allocates the blocks and starts the writer.
+bool TrajectoryRecorder::Open(const char* fileName, int numOfPendulums, bool recordVelocities, int framesPerBlock, int numOfBlocks)
+{
+	Close();
+	if (numOfPendulums < 0 || framesPerBlock < 1 || numOfBlocks < 1)
+		return false;
+
+	memcpy(m_header.m_magic, TrajectoryMagic, sizeof(m_header.m_magic));
+	m_header.m_version = TrajectoryFileVersion;
+	m_header.m_headerSize = sizeof(TrajectoryFileHeader);
+	m_header.m_numOfPendulums = numOfPendulums;
+	m_header.m_flags = recordVelocities ? TrajectoryVelocities : 0;
+	m_header.m_framesPerBlock = framesPerBlock;
+	m_header.m_numOfBlocks = 0;
+	m_header.m_numOfFrames = 0;
+	m_header.m_indexOffset = 0;
+	m_header.m_positionErrorBound = m_positionErrorBound > 0.0f ? m_positionErrorBound : 0.0f;
+	m_header.m_velocityErrorBound = recordVelocities && m_velocityErrorBound > 0.0f ? m_velocityErrorBound : 0.0f;
+	m_numOfColumns = recordVelocities ? 6 : 3;
+
+	// Every block is one allocation: the steps, the times and the columns, each column aligned.
+	size_t stepBytes = AlignColumnBytes(sizeof(unsigned long long) * framesPerBlock);
+	size_t timeBytes = AlignColumnBytes(sizeof(double) * framesPerBlock);
+	size_t columnBytes = AlignColumnBytes(sizeof(float) * static_cast<size_t>(framesPerBlock) * numOfPendulums);
+	m_blocks.resize(numOfBlocks);
+	for(int index = 0; index < numOfBlocks; ++index)
+	{
+		Block& block = m_blocks[index];
+		block.m_memory = AllocateAligned(stepBytes + timeBytes + columnBytes * m_numOfColumns);
+		block.m_numOfFrames = 0;
+		if (block.m_memory == NULL)
+			continue;
+		char* memory = static_cast<char*>(block.m_memory);
+		block.m_steps = reinterpret_cast<unsigned long long*>(memory);
+		block.m_times = reinterpret_cast<double*>(memory + stepBytes);
+		for(int column = 0; column < m_numOfColumns; ++column)
+			block.m_columns[column] = reinterpret_cast<float*>(memory + stepBytes + timeBytes + columnBytes * column);
+	}
+	for(int index = 0; index < numOfBlocks; ++index)
+	{
+		if (m_blocks[index].m_memory == NULL)
+		{
+			FreeBlocks();
+			return false;
+		}
+	}
+	// The pages of the blocks are touched once here, so they are not faulted in while recording.
+	for(int index = 0; index < numOfBlocks; ++index)
+		memset(m_blocks[index].m_memory, 0, stepBytes + timeBytes + columnBytes * m_numOfColumns);
+
+	m_file = OpenFileForWriting(fileName);
+	if (m_file == NULL)
+	{
+		FreeBlocks();
+		return false;
+	}
+	// The blocks are large and written in one piece, a stream buffer would only copy them once more.
+	setvbuf(m_file, NULL, _IONBF, 0);
+	if (fwrite(&m_header, sizeof(m_header), 1, m_file) != 1)
+	{
+		fclose(m_file);
+		m_file = NULL;
+		FreeBlocks();
+		return false;
+	}
+
+	// The writer encodes into this buffer, every encoded column is a whole number of words.
+	if (IsCompressing())
+		m_encodedColumns.resize(TrajectoryCodec::GetMaxEncodedBytes(framesPerBlock, numOfPendulums) / sizeof(unsigned int) * m_numOfColumns);
+
+	m_fullBlocks.Reset(numOfBlocks);
+	m_freeBlocks.Reset(numOfBlocks);
+	for(int index = 0; index < numOfBlocks; ++index)
+		m_freeBlocks.Push(index);
+	m_currentBlock = -1;
+	m_closing = false;
+	m_numOfFrames = 0;
+	m_numOfStalls = 0;
+	m_stallSeconds = 0.0;
+	m_maxQueuedBlocks = 0;
+	m_numOfBlocksWritten = 0;
+	m_bytesWritten = sizeof(m_header);
+	m_writeFailed = false;
+	m_index.clear();
+
+	m_writer = std::thread(&TrajectoryRecorder::WriterLoop, this);
+	return true;
+}
+
+
+// Copies the current state of the batch into the next frame of the current block
+// and hands the block to the writer when it is full.
+bool TrajectoryRecorder::Record(PendulumBatch& batch)
+{
+	if (m_file == NULL || batch.GetNumberOfPendulums() != m_header.m_numOfPendulums)
+		return false;
+
+	if (m_currentBlock < 0)
+		m_currentBlock = ObtainFreeBlock();
+
+	Block& block = m_blocks[m_currentBlock];
+	int frame = block.m_numOfFrames;
+	size_t frameOffset = static_cast<size_t>(frame) * m_header.m_numOfPendulums;
+	float* positions[3];
+	float* velocities[3];
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		positions[axis] = block.m_columns[axis] + frameOffset;
+		velocities[axis] = m_numOfColumns > 3 ? block.m_columns[3 + axis] + frameOffset : NULL;
+	}
+	batch.ObtainCurrentStates(positions, m_numOfColumns > 3 ? velocities : NULL);
+	block.m_steps[frame] = batch.GetStepCount();
+	block.m_times[frame] = batch.GetSimulationTime();
+	++block.m_numOfFrames;
+	++m_numOfFrames;
+
+	if (block.m_numOfFrames == m_header.m_framesPerBlock)
+		SubmitBlock();
+	return true;
+}
+
+
+// Writes the frames that are left, stops the writer and completes the header.
+bool TrajectoryRecorder::Close()
+{
+	if (m_file == NULL)
+		return false;
+
+	if (m_currentBlock >= 0 && m_blocks[m_currentBlock].m_numOfFrames > 0)
+		SubmitBlock();
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_closing = true;
+	}
+	m_blockFull.notify_one();
+	m_writer.join();
+
+	m_header.m_numOfBlocks = static_cast<int>(m_numOfBlocksWritten);
+	m_header.m_numOfFrames = m_numOfFrames;
+	m_header.m_indexOffset = m_bytesWritten;
+	bool written = !m_writeFailed && WriteIndex() && fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+	written = fclose(m_file) == 0 && written;
+	m_file = NULL;
+	m_currentBlock = -1;
+	FreeBlocks();
+	m_encodedColumns.clear();
+	m_index.clear();
+	return written;
+}
+
+
+// Obtains the counters since the file was opened.
+void TrajectoryRecorder::ObtainStatistics(TrajectoryRecorderStatistics& statistics)
+{
+	statistics.m_numOfFrames = m_numOfFrames;
+	statistics.m_numOfBlocksWritten = m_numOfBlocksWritten;
+	statistics.m_bytesWritten = m_bytesWritten;
+	statistics.m_numOfStalls = m_numOfStalls;
+	statistics.m_stallSeconds = m_stallSeconds;
+	statistics.m_maxQueuedBlocks = m_maxQueuedBlocks;
+	statistics.m_writeFailed = m_writeFailed;
+}
+
+
+// Takes a written block. If the writer still has all of them, the simulation stalls until it returns one.
+int TrajectoryRecorder::ObtainFreeBlock()
+{
+	int block;
+	if (m_freeBlocks.Pop(block))
+	{
+		m_blocks[block].m_numOfFrames = 0;
+		return block;
+	}
+
+	std::chrono::steady_clock::time_point stallStart = std::chrono::steady_clock::now();
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_blockFree.wait(lock, [&] { return m_freeBlocks.Pop(block); });
+	}
+	++m_numOfStalls;
+	m_stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - stallStart).count();
+
+	m_blocks[block].m_numOfFrames = 0;
+	return block;
+}
+
+
+// Hands the current block to the writer and wakes it. The lock only orders the wake-up
+// with the writer going to sleep and is never held while writing.
+void TrajectoryRecorder::SubmitBlock()
+{
+	m_fullBlocks.Push(m_currentBlock);
+	m_currentBlock = -1;
+
+	int queuedBlocks = m_fullBlocks.GetSize();
+	if (queuedBlocks > m_maxQueuedBlocks)
+		m_maxQueuedBlocks = queuedBlocks;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+	}
+	m_blockFull.notify_one();
+}
+
+
+// Writes the full blocks in the order they were recorded until the file is closed.
+void TrajectoryRecorder::WriterLoop()
+{
+	for(;;)
+	{
+		int block;
+		if (!m_fullBlocks.Pop(block))
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			bool found = false;
+			m_blockFull.wait(lock, [&] { found = m_fullBlocks.Pop(block); return found || m_closing; });
+			if (!found)
+				return;
+		}
+
+		// After a failed write the blocks are still returned, so the simulation never waits for nothing.
+		if (!m_writeFailed)
+		{
+			if (WriteBlock(m_blocks[block]))
+				++m_numOfBlocksWritten;
+			else
+				m_writeFailed = true;
+		}
+
+		m_freeBlocks.Push(block);
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+		}
+		m_blockFree.notify_one();
+	}
+}
+
+
+// Writes a block: its header, the steps and times of its frames and its columns, encoded if compressing,
+// and the zeros up to the block alignment. The block is then added to the index.
+bool TrajectoryRecorder::WriteBlock(const Block& block)
+{
+	size_t frames = static_cast<size_t>(block.m_numOfFrames);
+	size_t columnEntries = frames * m_header.m_numOfPendulums;
+
+	size_t columnBytes = sizeof(float) * columnEntries * m_numOfColumns;
+	unsigned char* encodedColumns = reinterpret_cast<unsigned char*>(m_encodedColumns.data());
+	if (IsCompressing())
+	{
+		columnBytes = 0;
+		for(int column = 0; column < m_numOfColumns; ++column)
+		{
+			float errorBound = column < 3 ? m_header.m_positionErrorBound : m_header.m_velocityErrorBound;
+			columnBytes += m_codec.EncodeColumn(block.m_columns[column], block.m_numOfFrames, m_header.m_numOfPendulums, errorBound, encodedColumns + columnBytes);
+		}
+	}
+
+	TrajectoryBlockHeader blockHeader;
+	blockHeader.m_numOfFrames = block.m_numOfFrames;
+	blockHeader.m_reserved = 0;
+	blockHeader.m_payloadBytes = AlignBlockBytes((sizeof(unsigned long long) + sizeof(double)) * frames + columnBytes);
+	size_t padding = static_cast<size_t>(blockHeader.m_payloadBytes) - (sizeof(unsigned long long) + sizeof(double)) * frames - columnBytes;
+
+	if (fwrite(&blockHeader, sizeof(blockHeader), 1, m_file) != 1)
+		return false;
+	if (fwrite(block.m_steps, sizeof(unsigned long long), frames, m_file) != frames)
+		return false;
+	if (fwrite(block.m_times, sizeof(double), frames, m_file) != frames)
+		return false;
+	if (IsCompressing())
+	{
+		if (fwrite(encodedColumns, 1, columnBytes, m_file) != columnBytes)
+			return false;
+	}
+	else
+	{
+		for(int column = 0; column < m_numOfColumns; ++column)
+		{
+			if (fwrite(block.m_columns[column], sizeof(float), columnEntries, m_file) != columnEntries)
+				return false;
+		}
+	}
+	static const char zeros[TrajectoryBlockAlignment] = {0};
+	if (padding > 0 && fwrite(zeros, 1, padding, m_file) != padding)
+		return false;
+
+	TrajectoryBlockIndexEntry entry;
+	entry.m_offset = m_bytesWritten;
+	entry.m_firstStep = block.m_steps[0];
+	entry.m_firstTime = block.m_times[0];
+	entry.m_numOfFrames = block.m_numOfFrames;
+	entry.m_reserved = 0;
+	m_index.push_back(entry);
+
+	m_bytesWritten += sizeof(blockHeader) + blockHeader.m_payloadBytes;
+	return true;
+}
+
+
+// Writes the index behind the last block.
+bool TrajectoryRecorder::WriteIndex()
+{
+	if (m_index.empty())
+		return true;
+	if (fwrite(m_index.data(), sizeof(TrajectoryBlockIndexEntry), m_index.size(), m_file) != m_index.size())
+		return false;
+	m_bytesWritten += sizeof(TrajectoryBlockIndexEntry) * m_index.size();
+	return true;
+}
+
+
+// Frees the memory of the blocks.
+void TrajectoryRecorder::FreeBlocks()
+{
+	for(size_t index = 0; index < m_blocks.size(); ++index)
+		FreeAligned(m_blocks[index].m_memory);
+	m_blocks.clear();
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "TrajectoryCodec.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+class PendulumBatch;
+
+// The version of the trajectory file layout.
+const unsigned int TrajectoryFileVersion = 3;
+// The alignment of every block in the file, so the steps and times of a mapped file can be read in place.
+const size_t TrajectoryBlockAlignment = 8;
+
+// The flags of a trajectory file.
+enum TrajectoryFlags
+{
+	// The frames hold the velocities behind the positions.
+	TrajectoryVelocities = 1
+};
+
+// The start of a trajectory file. The counts are completed when the recorder is closed.
+struct TrajectoryFileHeader
+{
+	// "PNDTRAJ" and a zero.
+	char m_magic[8];
+	unsigned int m_version;
+	// The size of this structure, the first block follows right behind it.
+	unsigned int m_headerSize;
+	int m_numOfPendulums;
+	unsigned int m_flags;
+	// The number of frames of a full block.
+	int m_framesPerBlock;
+	int m_numOfBlocks;
+	unsigned long long m_numOfFrames;
+	// The error bounds the columns are compressed to, both 0 if the floats are stored as they are.
+	float m_positionErrorBound;
+	float m_velocityErrorBound;
+	// The position of the block index behind the last block, 0 if the file was not closed.
+	unsigned long long m_indexOffset;
+};
+
+// The start of every block of a trajectory file.
+struct TrajectoryBlockHeader
+{
+	int m_numOfFrames;
+	int m_reserved;
+	// The number of bytes of the block behind this header, padded to the block alignment.
+	unsigned long long m_payloadBytes;
+};
+
+// The entry of a block in the index of a trajectory file, sorted by time like the blocks.
+struct TrajectoryBlockIndexEntry
+{
+	// The position of the block header in the file.
+	unsigned long long m_offset;
+	unsigned long long m_firstStep;
+	double m_firstTime;
+	int m_numOfFrames;
+	int m_reserved;
+};
+
+// The counters of a recorder. A stall is a frame for which all blocks were still waiting for the
+// writer, so the simulation had to wait for the disk; the other frames never touch it.
+struct TrajectoryRecorderStatistics
+{
+	unsigned long long m_numOfFrames;
+	unsigned long long m_numOfBlocksWritten;
+	unsigned long long m_bytesWritten;
+	unsigned long long m_numOfStalls;
+	// The time the simulation spent waiting in the stalls.
+	double m_stallSeconds;
+	// The most blocks that were waiting for the writer at once.
+	int m_maxQueuedBlocks;
+	// Whether a write failed, the following blocks are dropped then.
+	bool m_writeFailed;
+};
+
+// Records the positions, and optionally the velocities, of all bobs of a batch after every step.
+// Record copies the state into a block of preallocated memory and returns, a background thread
+// writes the full blocks to the file. The blocks are passed between the threads through two
+// queues without locks, one of the full blocks and one of the written blocks. The lock is only
+// taken to wake a thread that sleeps and is never held while writing, so the simulation only
+// waits for the disk when all blocks are full.
+//
+// The file starts with a TrajectoryFileHeader. Blocks of up to m_framesPerBlock frames follow,
+// each a TrajectoryBlockHeader, the step number of every frame as a 64 bit integer, the simulated
+// time of every frame as a double and then the columns x, y, z and optionally vx, vy, vz. A column
+// holds every frame as one 32 bit float per pendulum in the order of the pendulum indices.
+// With an error bound every column is encoded by the TrajectoryCodec instead, starting with
+// its EncodedColumnHeader. The writer encodes the blocks, so it costs the simulation nothing.
+// Every block is padded to TrajectoryBlockAlignment. Behind the last block Close writes the
+// index, a TrajectoryBlockIndexEntry for every block, and stores its position in the header.
+class TrajectoryRecorder
+{
+public:
+	TrajectoryRecorder();
+	// Closes the file.
+	~TrajectoryRecorder();
+
+	// Creates the file for the indicated number of pendulums and starts the writer. A block holds
+	// the indicated number of frames and the indicated number of blocks is allocated up front.
+	// Returns false if the file can not be created or the memory not allocated.
+	bool Open(const char* fileName, int numOfPendulums, bool recordVelocities, int framesPerBlock, int numOfBlocks);
+	// Sets the error bounds the next file is compressed to. Smooth trajectories take a few bits per
+	// sample then, the more the longer the blocks are. 0 for both stores the floats as they are.
+	void SetErrorBounds(float positionErrorBound, float velocityErrorBound) { m_positionErrorBound = positionErrorBound; m_velocityErrorBound = velocityErrorBound; }
+	// Copies the current state of the batch into the next frame. Returns false if no file is open
+	// or the batch has another number of pendulums.
+	bool Record(PendulumBatch& batch);
+	// Writes the frames that are left, stops the writer and completes the header.
+	// Returns false if any write failed.
+	bool Close();
+	// Checks if a file is open.
+	bool IsOpen() { return m_file != NULL; }
+
+	// Obtains the counters since the file was opened. Called on the thread that records, it can be
+	// called while recording, the counters of the writer may lag behind by a block.
+	void ObtainStatistics(TrajectoryRecorderStatistics& statistics);
+
+private:
+	TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+	TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+	// Preallocated memory for the frames of one block.
+	struct Block
+	{
+		void* m_memory;
+		unsigned long long* m_steps;
+		double* m_times;
+		float* m_columns[6];
+		int m_numOfFrames;
+	};
+
+	// A ring of block numbers one thread pushes to and another pops from. It has room for all
+	// blocks, so pushing never fails, and the positions only grow, so it needs no locks.
+	class BlockQueue
+	{
+	public:
+		// Makes room for the indicated number of blocks and empties the queue.
+		void Reset(int numOfBlocks) { m_entries.assign(numOfBlocks, 0); m_head = 0; m_tail = 0; }
+		// Appends a block, only from the pushing thread.
+		void Push(int block)
+		{
+			unsigned int tail = m_tail.load(std::memory_order_relaxed);
+			m_entries[tail % m_entries.size()] = block;
+			m_tail.store(tail + 1, std::memory_order_release);
+		}
+		// Takes the oldest block, only from the popping thread. Returns false if the queue is empty.
+		bool Pop(int& block)
+		{
+			unsigned int head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tail.load(std::memory_order_acquire))
+				return false;
+			block = m_entries[head % m_entries.size()];
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+		// Gets the number of blocks in the queue.
+		int GetSize() { return static_cast<int>(m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire)); }
+
+	private:
+		std::vector<int> m_entries;
+		std::atomic<unsigned int> m_head;
+		std::atomic<unsigned int> m_tail;
+	};
+
+	FILE* m_file;
+	TrajectoryFileHeader m_header;
+	int m_numOfColumns;
+	// The error bounds of the next file.
+	float m_positionErrorBound;
+	float m_velocityErrorBound;
+
+	std::vector<Block> m_blocks;
+	// The full blocks on their way to the writer and the written blocks on their way back.
+	BlockQueue m_fullBlocks;
+	BlockQueue m_freeBlocks;
+	// The block the frames are recorded into, -1 if a free one has to be taken first.
+	int m_currentBlock;
+
+	std::thread m_writer;
+	// Protects the sleeping of the threads and the closing flag.
+	std::mutex m_lock;
+	// Wakes the writer when a block is full or the file is closed.
+	std::condition_variable m_blockFull;
+	// Wakes the simulation when a block is written.
+	std::condition_variable m_blockFree;
+	bool m_closing;
+
+	// The counters of the recording thread.
+	unsigned long long m_numOfFrames;
+	unsigned long long m_numOfStalls;
+	double m_stallSeconds;
+	int m_maxQueuedBlocks;
+	// The counters of the writer.
+	std::atomic<unsigned long long> m_numOfBlocksWritten;
+	std::atomic<unsigned long long> m_bytesWritten;
+	std::atomic<bool> m_writeFailed;
+
+	// The codec of the writer and the encoded columns of the block it writes.
+	TrajectoryCodec m_codec;
+	std::vector<unsigned int> m_encodedColumns;
+	// The index entries of the written blocks, only touched by the writer until it is stopped.
+	std::vector<TrajectoryBlockIndexEntry> m_index;
+
+	// Takes a written block, waits for the writer if there is none.
+	int ObtainFreeBlock();
+	// Hands the current block to the writer.
+	void SubmitBlock();
+	// The loop of the writer thread.
+	void WriterLoop();
+	// Checks if the columns of the open file are encoded.
+	bool IsCompressing() { return m_header.m_positionErrorBound > 0.0f || m_header.m_velocityErrorBound > 0.0f; }
+	// Writes a block to the file and adds it to the index.
+	bool WriteBlock(const Block& block);
+	// Writes the index behind the last block. Returns false if writing failed.
+	bool WriteIndex();
+	// Frees the memory of the blocks.
+	void FreeBlocks();
+};
@@ -0,0 +1,455 @@
+#include "TrajectoryReplay.h"
+#include "AlignedMemory.h"
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// The tag every trajectory file starts with.
+static const char TrajectoryMagic[8] = {'P', 'N', 'D', 'T', 'R', 'A', 'J', 0};
+
+
+// Gets the number of bytes of the steps and times of the indicated number of frames.
+static size_t GetFrameInfoBytes(int numOfFrames)
+{
+	return (sizeof(unsigned long long) + sizeof(double)) * static_cast<size_t>(numOfFrames);
+}
+
+
+TrajectoryReplay::TrajectoryReplay()
+{
+	m_base = NULL;
+	m_size = 0;
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#endif
+	memset(&m_header, 0, sizeof(m_header));
+	m_numOfColumns = 0;
+	for(int index = 0; index < 2; ++index)
+	{
+		m_decodedBlocks[index].m_columns = NULL;
+		m_decodedBlocks[index].m_block = -1;
+		m_decodedBlocks[index].m_numOfColumns = 0;
+		m_decodedBlocks[index].m_lastUse = 0;
+	}
+	m_numOfUses = 0;
+	m_numOfDecodedBlocks = 0;
+}
+
+
+// Unmaps the file.
+TrajectoryReplay::~TrajectoryReplay()
+{
+	Close();
+}
+
+
+// Maps the file read only, checks the header and reads or rebuilds the index.
+bool TrajectoryReplay::Open(const char* fileName)
+{
+	Close();
+
+#ifdef _WIN32
+	m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(TrajectoryFileHeader)))
+	{
+		Close();
+		return false;
+	}
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping != NULL)
+		m_base = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_base == NULL)
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = open(fileName, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(TrajectoryFileHeader)))
+	{
+		close(file);
+		return false;
+	}
+	void* base = mmap(NULL, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+	if (base == MAP_FAILED)
+		return false;
+	m_base = static_cast<const unsigned char*>(base);
+	m_size = static_cast<size_t>(status.st_size);
+#endif
+
+	memcpy(&m_header, m_base, sizeof(m_header));
+	if (memcmp(m_header.m_magic, TrajectoryMagic, sizeof(m_header.m_magic)) != 0 || m_header.m_version != TrajectoryFileVersion ||
+		m_header.m_headerSize != sizeof(TrajectoryFileHeader) || m_header.m_numOfPendulums < 0 || m_header.m_framesPerBlock < 1 ||
+		!(m_header.m_positionErrorBound >= 0.0f) || !(m_header.m_velocityErrorBound >= 0.0f))
+	{
+		Close();
+		return false;
+	}
+	m_numOfColumns = HasVelocities() ? 6 : 3;
+
+	if (!ReadIndex())
+		RebuildIndex();
+	m_header.m_numOfBlocks = static_cast<int>(m_index.size());
+	m_firstFrames.resize(m_index.size() + 1);
+	m_firstFrames[0] = 0;
+	for(size_t block = 0; block < m_index.size(); ++block)
+		m_firstFrames[block + 1] = m_firstFrames[block] + m_index[block].m_numOfFrames;
+	m_header.m_numOfFrames = m_firstFrames.back();
+
+	// The decoded blocks take the longest block of the file, which may be shorter than a full one.
+	if (IsCompressed() && !m_index.empty())
+	{
+		int maxFrames = 0;
+		for(size_t block = 0; block < m_index.size(); ++block)
+			maxFrames = std::max(maxFrames, m_index[block].m_numOfFrames);
+		size_t columnEntries = static_cast<size_t>(maxFrames) * m_header.m_numOfPendulums * m_numOfColumns;
+		for(int index = 0; index < 2; ++index)
+		{
+			m_decodedBlocks[index].m_columns = static_cast<float*>(AllocateAligned(sizeof(float) * std::max<size_t>(columnEntries, 1)));
+			if (m_decodedBlocks[index].m_columns == NULL)
+			{
+				Close();
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+// Unmaps the file and frees the decoded blocks.
+void TrajectoryReplay::Close()
+{
+	Unmap();
+	memset(&m_header, 0, sizeof(m_header));
+	m_numOfColumns = 0;
+	m_index.clear();
+	m_firstFrames.clear();
+	for(int index = 0; index < 2; ++index)
+	{
+		FreeAligned(m_decodedBlocks[index].m_columns);
+		m_decodedBlocks[index].m_columns = NULL;
+		m_decodedBlocks[index].m_block = -1;
+		m_decodedBlocks[index].m_numOfColumns = 0;
+		m_decodedBlocks[index].m_lastUse = 0;
+	}
+	m_numOfUses = 0;
+	m_numOfDecodedBlocks = 0;
+}
+
+
+// Gets the simulated time of the first frame.
+double TrajectoryReplay::GetStartTime()
+{
+	return m_index.empty() ? 0.0 : m_index.front().m_firstTime;
+}
+
+
+// Gets the simulated time of the last frame.
+double TrajectoryReplay::GetEndTime()
+{
+	return m_index.empty() ? 0.0 : GetFrameTime(m_header.m_numOfFrames - 1);
+}
+
+
+// Finds the block whose first time is the last one at or before the time, then the frame in its times.
+unsigned long long TrajectoryReplay::FindFrame(double time)
+{
+	if (m_index.empty())
+		return 0;
+	std::vector<TrajectoryBlockIndexEntry>::const_iterator next = std::upper_bound(m_index.begin(), m_index.end(), time,
+		[](double value, const TrajectoryBlockIndexEntry& entry) { return value < entry.m_firstTime; });
+	if (next == m_index.begin())
+		return 0;
+	int block = static_cast<int>(next - m_index.begin()) - 1;
+
+	const double* times = GetBlockTimes(block);
+	int frame = static_cast<int>(std::upper_bound(times, times + m_index[block].m_numOfFrames, time) - times) - 1;
+	return m_firstFrames[block] + (frame > 0 ? frame : 0);
+}
+
+
+// Gets the simulated time of the indicated frame.
+double TrajectoryReplay::GetFrameTime(unsigned long long frame)
+{
+	if (frame >= m_header.m_numOfFrames)
+		return 0.0;
+	int block = FindBlock(frame);
+	return GetBlockTimes(block)[frame - m_firstFrames[block]];
+}
+
+
+// Gets the step of the indicated frame.
+unsigned long long TrajectoryReplay::GetFrameStep(unsigned long long frame)
+{
+	if (frame >= m_header.m_numOfFrames)
+		return 0;
+	int block = FindBlock(frame);
+	const unsigned long long* steps = reinterpret_cast<const unsigned long long*>(m_base + m_index[block].m_offset + sizeof(TrajectoryBlockHeader));
+	return steps[frame - m_firstFrames[block]];
+}
+
+
+// Gets the columns of a frame inside the mapped or decoded block.
+bool TrajectoryReplay::ObtainFrameColumns(unsigned long long frame, const float* positions[3], const float* velocities[3])
+{
+	if (frame >= m_header.m_numOfFrames)
+		return false;
+	int block = FindBlock(frame);
+	const float* columns = ObtainBlockColumns(block, velocities != NULL ? m_numOfColumns : 3);
+	if (columns == NULL)
+		return false;
+
+	size_t numOfPendulums = static_cast<size_t>(m_header.m_numOfPendulums);
+	size_t columnEntries = numOfPendulums * m_index[block].m_numOfFrames;
+	const float* frameColumns = columns + numOfPendulums * (frame - m_firstFrames[block]);
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		positions[axis] = frameColumns + columnEntries * axis;
+		if (velocities != NULL)
+			velocities[axis] = HasVelocities() ? frameColumns + columnEntries * (3 + axis) : NULL;
+	}
+	return true;
+}
+
+
+// Obtains the positions of all pendulums between the frames around the time.
+bool TrajectoryReplay::ObtainInterpolatedPositions(double time, float* const positions[3])
+{
+	if (m_header.m_numOfFrames == 0)
+		return false;
+	unsigned long long frame;
+	unsigned long long nextFrame;
+	float alpha = FindFramesAround(time, frame, nextFrame);
+
+	// The second block decoded keeps the first one, so both frames stay valid.
+	const float* previous[3];
+	const float* next[3];
+	if (!ObtainFrameColumns(frame, previous, NULL) || !ObtainFrameColumns(nextFrame, next, NULL))
+		return false;
+	int numOfPendulums = m_header.m_numOfPendulums;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float* previousAxis = previous[axis];
+		const float* nextAxis = next[axis];
+		float* result = positions[axis];
+		for(int pendulum = 0; pendulum < numOfPendulums; ++pendulum)
+			result[pendulum] = previousAxis[pendulum] + alpha * (nextAxis[pendulum] - previousAxis[pendulum]);
+	}
+	return true;
+}
+
+
+// Obtains the position of one pendulum between the frames around the time.
+bool TrajectoryReplay::ObtainInterpolatedPosition(double time, int pendulum, float position[3])
+{
+	if (m_header.m_numOfFrames == 0 || pendulum < 0 || pendulum >= m_header.m_numOfPendulums)
+		return false;
+	unsigned long long frame;
+	unsigned long long nextFrame;
+	float alpha = FindFramesAround(time, frame, nextFrame);
+
+	const float* previous[3];
+	const float* next[3];
+	if (!ObtainFrameColumns(frame, previous, NULL) || !ObtainFrameColumns(nextFrame, next, NULL))
+		return false;
+	for(int axis = 0; axis < 3; ++axis)
+		position[axis] = previous[axis][pendulum] + alpha * (next[axis][pendulum] - previous[axis][pendulum]);
+	return true;
+}
+
+
+// Finds the frames around the time and the fraction of the way from the first to the second.
+float TrajectoryReplay::FindFramesAround(double time, unsigned long long& frame, unsigned long long& nextFrame)
+{
+	frame = FindFrame(time);
+	nextFrame = frame + 1 < m_header.m_numOfFrames ? frame + 1 : frame;
+	double frameTime = GetFrameTime(frame);
+	double nextTime = GetFrameTime(nextFrame);
+	if (!(nextTime > frameTime) || !(time > frameTime))
+		return 0.0f;
+	return static_cast<float>(std::min((time - frameTime) / (nextTime - frameTime), 1.0));
+}
+
+
+// Checks the index stored behind the blocks: it has to lie between the blocks and the end of the
+// file and its blocks have to follow each other in the order of the file.
+bool TrajectoryReplay::ReadIndex()
+{
+	unsigned long long indexOffset = m_header.m_indexOffset;
+	if (indexOffset < sizeof(TrajectoryFileHeader) || indexOffset % TrajectoryBlockAlignment != 0 || m_header.m_numOfBlocks < 0)
+		return false;
+	unsigned long long indexBytes = sizeof(TrajectoryBlockIndexEntry) * static_cast<unsigned long long>(m_header.m_numOfBlocks);
+	if (indexOffset + indexBytes != m_size)
+		return false;
+
+	const TrajectoryBlockIndexEntry* entries = reinterpret_cast<const TrajectoryBlockIndexEntry*>(m_base + indexOffset);
+	unsigned long long offset = sizeof(TrajectoryFileHeader);
+	for(int block = 0; block < m_header.m_numOfBlocks; ++block)
+	{
+		if (entries[block].m_offset != offset || !IsBlockConsistent(offset, indexOffset))
+		{
+			m_index.clear();
+			return false;
+		}
+		const TrajectoryBlockHeader* blockHeader = reinterpret_cast<const TrajectoryBlockHeader*>(m_base + offset);
+		if (entries[block].m_numOfFrames != blockHeader->m_numOfFrames)
+		{
+			m_index.clear();
+			return false;
+		}
+		offset += sizeof(TrajectoryBlockHeader) + blockHeader->m_payloadBytes;
+	}
+	if (offset != indexOffset)
+		return false;
+	m_index.assign(entries, entries + m_header.m_numOfBlocks);
+	return true;
+}
+
+
+// Rebuilds the index from the block headers, up to the first block that does not fit the file.
+void TrajectoryReplay::RebuildIndex()
+{
+	m_index.clear();
+	unsigned long long offset = sizeof(TrajectoryFileHeader);
+	while (IsBlockConsistent(offset, m_size))
+	{
+		const TrajectoryBlockHeader* blockHeader = reinterpret_cast<const TrajectoryBlockHeader*>(m_base + offset);
+		const unsigned long long* steps = reinterpret_cast<const unsigned long long*>(blockHeader + 1);
+		const double* times = reinterpret_cast<const double*>(steps + blockHeader->m_numOfFrames);
+
+		TrajectoryBlockIndexEntry entry;
+		entry.m_offset = offset;
+		entry.m_firstStep = steps[0];
+		entry.m_firstTime = times[0];
+		entry.m_numOfFrames = blockHeader->m_numOfFrames;
+		entry.m_reserved = 0;
+		m_index.push_back(entry);
+		offset += sizeof(TrajectoryBlockHeader) + blockHeader->m_payloadBytes;
+	}
+}
+
+
+// Checks that the block header at the offset fits in front of the end, that its number of frames
+// fits the file header and that its payload holds the steps and times, and all columns unless the
+// file is compressed.
+bool TrajectoryReplay::IsBlockConsistent(unsigned long long offset, unsigned long long end)
+{
+	if (offset % TrajectoryBlockAlignment != 0 || offset + sizeof(TrajectoryBlockHeader) > end)
+		return false;
+	const TrajectoryBlockHeader* blockHeader = reinterpret_cast<const TrajectoryBlockHeader*>(m_base + offset);
+	if (blockHeader->m_numOfFrames < 1 || blockHeader->m_numOfFrames > m_header.m_framesPerBlock)
+		return false;
+	if (blockHeader->m_payloadBytes % TrajectoryBlockAlignment != 0 || blockHeader->m_payloadBytes > end - offset - sizeof(TrajectoryBlockHeader))
+		return false;
+
+	size_t requiredBytes = GetFrameInfoBytes(blockHeader->m_numOfFrames);
+	if (!IsCompressed())
+		requiredBytes += sizeof(float) * static_cast<size_t>(blockHeader->m_numOfFrames) * m_header.m_numOfPendulums * m_numOfColumns;
+	return blockHeader->m_payloadBytes >= requiredBytes;
+}
+
+
+// Gets the block of the indicated frame by a binary search over the first frames of the blocks.
+int TrajectoryReplay::FindBlock(unsigned long long frame)
+{
+	return static_cast<int>(std::upper_bound(m_firstFrames.begin(), m_firstFrames.end(), frame) - m_firstFrames.begin()) - 1;
+}
+
+
+// Gets the times of the frames of the indicated block, right behind its steps.
+const double* TrajectoryReplay::GetBlockTimes(int block)
+{
+	const unsigned char* steps = m_base + m_index[block].m_offset + sizeof(TrajectoryBlockHeader);
+	return reinterpret_cast<const double*>(steps + sizeof(unsigned long long) * m_index[block].m_numOfFrames);
+}
+
+
+// Gets the first column of the indicated block. The columns of plain floats are used in the mapping,
+// encoded ones are decoded into the decoded block that was used longest ago. A block decoded before
+// only decodes the columns it does not have yet.
+const float* TrajectoryReplay::ObtainBlockColumns(int block, int numOfColumns)
+{
+	const TrajectoryBlockIndexEntry& entry = m_index[block];
+	const unsigned char* columns = m_base + entry.m_offset + sizeof(TrajectoryBlockHeader) + GetFrameInfoBytes(entry.m_numOfFrames);
+	if (!IsCompressed())
+		return reinterpret_cast<const float*>(columns);
+
+	++m_numOfUses;
+	int index = m_decodedBlocks[0].m_lastUse <= m_decodedBlocks[1].m_lastUse ? 0 : 1;
+	if (m_decodedBlocks[1 - index].m_block == block)
+		index = 1 - index;
+	DecodedBlock& decoded = m_decodedBlocks[index];
+	decoded.m_lastUse = m_numOfUses;
+	if (decoded.m_block != block)
+	{
+		decoded.m_block = block;
+		decoded.m_numOfColumns = 0;
+		++m_numOfDecodedBlocks;
+	}
+	if (decoded.m_numOfColumns >= numOfColumns)
+		return decoded.m_columns;
+
+	// The encoded columns follow each other, the ones before are skipped by their sizes.
+	const TrajectoryBlockHeader* blockHeader = reinterpret_cast<const TrajectoryBlockHeader*>(m_base + entry.m_offset);
+	size_t bytes = static_cast<size_t>(blockHeader->m_payloadBytes) - GetFrameInfoBytes(entry.m_numOfFrames);
+	size_t columnEntries = static_cast<size_t>(entry.m_numOfFrames) * m_header.m_numOfPendulums;
+	for(int column = 0; column < numOfColumns; ++column)
+	{
+		if (column >= decoded.m_numOfColumns)
+		{
+			float errorBound = column < 3 ? m_header.m_positionErrorBound : m_header.m_velocityErrorBound;
+			if (!m_codec.DecodeColumn(columns, bytes, entry.m_numOfFrames, m_header.m_numOfPendulums, errorBound, decoded.m_columns + columnEntries * column))
+			{
+				decoded.m_block = -1;
+				return NULL;
+			}
+			decoded.m_numOfColumns = column + 1;
+		}
+		size_t columnBytes = reinterpret_cast<const EncodedColumnHeader*>(columns)->m_bytes;
+		columns += columnBytes;
+		bytes -= columnBytes;
+	}
+	return decoded.m_columns;
+}
+
+
+// Unmaps the file.
+void TrajectoryReplay::Unmap()
+{
+#ifdef _WIN32
+	if (m_base != NULL)
+		UnmapViewOfFile(m_base);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#else
+	if (m_base != NULL)
+		munmap(const_cast<unsigned char*>(m_base), m_size);
+#endif
+	m_base = NULL;
+	m_size = 0;
+}
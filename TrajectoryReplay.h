@@ -0,0 +1,118 @@
+#pragma once
+
+#include "TrajectoryRecorder.h"
+#include "TrajectoryCodec.h"
+#include <stddef.h>
+#include <vector>
+
+// Replays a trajectory file written by the TrajectoryRecorder. The file is mapped read only, so
+// opening it reads the header and the index and nothing else, and the columns of a file of plain
+// floats are used right where they are in the mapping. Finding the frame of a time is a binary
+// search over the index and then over the times of one block. A compressed block is decoded as a
+// whole, and as every block starts without a predecessor, a seek decodes exactly one block, only
+// the positions unless the velocities are asked for. The
+// two blocks decoded last are kept, so playing forward and interpolating across the end of a block
+// decode every block once. A file whose recorder was not closed has no index; it is rebuilt from
+// the block headers then, up to the last block that was written completely.
+class TrajectoryReplay
+{
+public:
+	TrajectoryReplay();
+	// Unmaps the file.
+	~TrajectoryReplay();
+
+	// Maps the file and reads its index. Returns false if the file is no trajectory of this version.
+	bool Open(const char* fileName);
+	// Unmaps the file and frees the decoded blocks.
+	void Close();
+	// Checks if a file is open.
+	bool IsOpen() { return m_base != NULL; }
+
+	// Gets the header of the file, with the counts of the rebuilt index if it had none.
+	const TrajectoryFileHeader& GetHeader() { return m_header; }
+	int GetNumberOfPendulums() { return m_header.m_numOfPendulums; }
+	unsigned long long GetNumberOfFrames() { return m_header.m_numOfFrames; }
+	// Checks if the file holds the velocities.
+	bool HasVelocities() { return (m_header.m_flags & TrajectoryVelocities) != 0; }
+	// Gets the simulated time of the first and of the last frame.
+	double GetStartTime();
+	double GetEndTime();
+
+	// Finds the last frame at or before the time, the first frame for earlier times.
+	unsigned long long FindFrame(double time);
+	// Gets the simulated time and the step of the indicated frame.
+	double GetFrameTime(unsigned long long frame);
+	unsigned long long GetFrameStep(unsigned long long frame);
+
+	// Gets the columns of a frame without copying them, one float per pendulum in the order of the
+	// pendulum indices. The velocities may be NULL and are NULL columns if the file has none. The
+	// columns stay valid until another block is decoded twice. Returns false if the frame does not
+	// exist or its block is damaged.
+	bool ObtainFrameColumns(unsigned long long frame, const float* positions[3], const float* velocities[3]);
+	// Obtains the positions of all pendulums at the time, interpolated linearly between the frames
+	// around it. Times outside of the recording get the first or the last frame.
+	bool ObtainInterpolatedPositions(double time, float* const positions[3]);
+	// Obtains the position of one pendulum at the time, interpolated like above.
+	bool ObtainInterpolatedPosition(double time, int pendulum, float position[3]);
+
+	// Gets the number of blocks decoded since the file was opened.
+	unsigned long long GetNumOfDecodedBlocks() { return m_numOfDecodedBlocks; }
+
+private:
+	TrajectoryReplay(const TrajectoryReplay&) = delete;
+	TrajectoryReplay& operator=(const TrajectoryReplay&) = delete;
+
+	// A block decoded into memory of its own.
+	struct DecodedBlock
+	{
+		float* m_columns;
+		// The block, -1 if none was decoded yet, and the number of its columns decoded so far.
+		int m_block;
+		int m_numOfColumns;
+		// When it was used last, the older one is replaced.
+		unsigned long long m_lastUse;
+	};
+
+	// The mapped file and its size.
+	const unsigned char* m_base;
+	size_t m_size;
+#ifdef _WIN32
+	// The handles of the file and of the mapping object.
+	void* m_file;
+	void* m_mapping;
+#endif
+
+	TrajectoryFileHeader m_header;
+	int m_numOfColumns;
+	// The blocks in the order of the file and the first frame of every block, with the number
+	// of frames as the last entry.
+	std::vector<TrajectoryBlockIndexEntry> m_index;
+	std::vector<unsigned long long> m_firstFrames;
+
+	// The codec and the last two decoded blocks of a compressed file.
+	TrajectoryCodec m_codec;
+	DecodedBlock m_decodedBlocks[2];
+	unsigned long long m_numOfUses;
+	unsigned long long m_numOfDecodedBlocks;
+
+	// Checks if the columns of the file are encoded.
+	bool IsCompressed() { return m_header.m_positionErrorBound > 0.0f || m_header.m_velocityErrorBound > 0.0f; }
+	// Checks the index stored behind the blocks.
+	bool ReadIndex();
+	// Rebuilds the index by walking the blocks from the start of the file.
+	void RebuildIndex();
+	// Checks that the block header at the offset fits the file and the header of the file.
+	bool IsBlockConsistent(unsigned long long offset, unsigned long long end);
+	// Finds the frames around the time, the same frame twice at the ends of the recording.
+	// Returns the fraction of the way from the first to the second.
+	float FindFramesAround(double time, unsigned long long& frame, unsigned long long& nextFrame);
+	// Gets the block of the indicated frame.
+	int FindBlock(unsigned long long frame);
+	// Gets the times of the frames of the indicated block.
+	const double* GetBlockTimes(int block);
+	// Gets the first column of the indicated block, decoding the indicated number of columns if
+	// the file is compressed. Returns NULL if the block is damaged.
+	const float* ObtainBlockColumns(int block, int numOfColumns);
+	// Unmaps the file.
+	void Unmap();
+};
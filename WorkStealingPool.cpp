@@ -0,0 +1,181 @@
+#include "WorkStealingPool.h"
+
+
+// Starts the indicated number of threads, 0 uses one thread per hardware core.
+WorkStealingPool::WorkStealingPool(int numOfThreads)
+{
+	m_generation = 0;
+	m_shutdown = false;
+	m_task = NULL;
+	m_remainingTasks = 0;
+
+	StartThreads(numOfThreads);
+}
+
+
+// Stops the threads.
+WorkStealingPool::~WorkStealingPool()
+{
+	StopThreads();
+}
+
+
+// Restarts the pool with the indicated number of threads, 0 uses one per hardware core.
+void WorkStealingPool::SetNumOfThreads(int numOfThreads)
+{
+	StopThreads();
+	StartThreads(numOfThreads);
+}
+
+
+// Runs the task for every index in [0, count) and returns when all are done.
+// Every participant gets a contiguous block of indices, so neighbouring tasks that touch
+// neighbouring memory stay on one core unless they are stolen.
+void WorkStealingPool::ParallelFor(int count, const std::function<void(int)>& task)
+{
+	if (count <= 0)
+		return;
+
+	int participants = GetNumOfThreads();
+	if (participants == 1 || count == 1)
+	{
+		for(int index = 0; index < count; ++index)
+			task(index);
+		return;
+	}
+
+	m_task = &task;
+	m_remainingTasks = count;
+
+	for(int participant = 0; participant < participants; ++participant)
+	{
+		int begin = static_cast<int>(static_cast<long long>(count) * participant / participants);
+		int end = static_cast<int>(static_cast<long long>(count) * (participant + 1) / participants);
+
+		std::lock_guard<std::mutex> queueLock(m_queues[participant]->m_lock);
+		for(int index = begin; index < end; ++index)
+			m_queues[participant]->m_indices.push_back(index);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		++m_generation;
+	}
+	m_workAvailable.notify_all();
+
+	RunTasks(0);
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_workDone.wait(lock, [this] { return m_remainingTasks.load() == 0; });
+	m_task = NULL;
+}
+
+
+// Starts the worker threads.
+void WorkStealingPool::StartThreads(int numOfThreads)
+{
+	if (numOfThreads <= 0)
+		numOfThreads = static_cast<int>(std::thread::hardware_concurrency());
+	if (numOfThreads <= 0)
+		numOfThreads = 1;
+
+	m_shutdown = false;
+	for(int participant = 0; participant < numOfThreads; ++participant)
+		m_queues.push_back(new TaskQueue());
+
+	for(int participant = 1; participant < numOfThreads; ++participant)
+		m_workers.push_back(std::thread(&WorkStealingPool::WorkerLoop, this, participant));
+}
+
+
+// Stops and joins the worker threads.
+void WorkStealingPool::StopThreads()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_shutdown = true;
+	}
+	m_workAvailable.notify_all();
+
+	for(size_t worker = 0; worker < m_workers.size(); ++worker)
+		m_workers[worker].join();
+	m_workers.clear();
+
+	for(size_t participant = 0; participant < m_queues.size(); ++participant)
+		delete m_queues[participant];
+	m_queues.clear();
+}
+
+
+// The loop of one worker thread.
+void WorkStealingPool::WorkerLoop(int participant)
+{
+	unsigned int seenGeneration = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		seenGeneration = m_generation;
+	}
+
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_workAvailable.wait(lock, [&] { return m_shutdown || m_generation != seenGeneration; });
+			if (m_shutdown)
+				return;
+			seenGeneration = m_generation;
+		}
+
+		RunTasks(participant);
+	}
+}
+
+
+// Runs tasks until no queue has any left.
+void WorkStealingPool::RunTasks(int participant)
+{
+	int index;
+	while (ObtainTask(participant, index))
+	{
+		(*m_task)(index);
+
+		if (m_remainingTasks.fetch_sub(1) == 1)
+		{
+			// Taking the lock makes sure the caller is either waiting or has not checked yet.
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_workDone.notify_all();
+		}
+	}
+}
+
+
+// Takes the next task of the own queue or steals one, returns false if there is none.
+bool WorkStealingPool::ObtainTask(int participant, int& index)
+{
+	{
+		TaskQueue* own = m_queues[participant];
+		std::lock_guard<std::mutex> queueLock(own->m_lock);
+		if (!own->m_indices.empty())
+		{
+			index = own->m_indices.front();
+			own->m_indices.pop_front();
+			return true;
+		}
+	}
+
+	// Steal from the back of the others, starting with the neighbour to spread the thieves.
+	int participants = static_cast<int>(m_queues.size());
+	for(int offset = 1; offset < participants; ++offset)
+	{
+		TaskQueue* victim = m_queues[(participant + offset) % participants];
+		std::lock_guard<std::mutex> queueLock(victim->m_lock);
+		if (!victim->m_indices.empty())
+		{
+			index = victim->m_indices.back();
+			victim->m_indices.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A pool of worker threads that runs indexed tasks. Every thread owns a queue of task
+// indices and works through it front to back; a thread that runs dry steals from the back
+// of the other queues, so uneven tasks still keep all cores busy.
+class WorkStealingPool
+{
+public:
+	// Starts the indicated number of threads, 0 uses one thread per hardware core.
+	WorkStealingPool(int numOfThreads);
+	~WorkStealingPool();
+
+	// Restarts the pool with the indicated number of threads, 0 uses one per hardware core.
+	// The thread that calls ParallelFor counts as one of them.
+	void SetNumOfThreads(int numOfThreads);
+	// Gets the number of threads working on a ParallelFor, including the calling thread.
+	int GetNumOfThreads() { return static_cast<int>(m_queues.size()); }
+
+	// Runs the task for every index in [0, count) and returns when all are done.
+	// The calling thread works on the tasks as well.
+	void ParallelFor(int count, const std::function<void(int)>& task);
+
+private:
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// The task queue of one thread.
+	struct TaskQueue
+	{
+		std::mutex m_lock;
+		std::deque<int> m_indices;
+	};
+
+	// The worker threads, the calling thread is participant 0 and has no entry here.
+	std::vector<std::thread> m_workers;
+	// The queues of all participants.
+	std::vector<TaskQueue*> m_queues;
+
+	// Protects the generation and the shutdown flag.
+	std::mutex m_lock;
+	// Wakes the workers when a new ParallelFor starts.
+	std::condition_variable m_workAvailable;
+	// Wakes the caller when the last task is done.
+	std::condition_variable m_workDone;
+	// Counts the ParallelFor calls, the workers compare it to see new work.
+	unsigned int m_generation;
+	// Tells the workers to exit.
+	bool m_shutdown;
+
+	// The task of the current ParallelFor.
+	const std::function<void(int)>* m_task;
+	// The number of tasks of the current ParallelFor not finished yet.
+	std::atomic<int> m_remainingTasks;
+
+	// Starts the worker threads.
+	void StartThreads(int numOfThreads);
+	// Stops and joins the worker threads.
+	void StopThreads();
+	// The loop of one worker thread.
+	void WorkerLoop(int participant);
+	// Runs tasks until no queue has any left.
+	void RunTasks(int participant);
+	// Takes the next task of the own queue or steals one, returns false if there is none.
+	bool ObtainTask(int participant, int& index);
+};
@@ -0,0 +1,56 @@
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include "PendulumIntegrator.h"
+#include <stdio.h>
+#include <vector>
+
+
+// The time step of the batch benchmarks.
+static const float BatchDeltaTime = 1.0f / 120.0f;
+
+
+// Steps a PendulumBatch against one PendulumIntegrator per bob, as the ensembles ran before.
+// The batch is stepped once per UpdateSimulation call and with all steps in one Step call,
+// which keeps every chunk in the cache for all of them.
+void RunBatchThroughputBenchmark(const BenchmarkOptions& options)
+{
+	int count = ScaleSize(options, 2000000, 1000);
+	const int steps = 20;
+	PendulumSet pendulums(count);
+
+	std::vector<PendulumIntegrator> integrators;
+	integrators.reserve(count);
+	for(int i = 0; i < count; ++i)
+	{
+		float anchorPoint[3];
+		float position[3];
+		pendulums.ObtainPendulum(i, anchorPoint, position);
+		integrators.push_back(PendulumIntegrator(anchorPoint));
+		integrators.back().SetPendulumPosition(position);
+	}
+	double scalarSeconds = MeasureFastestRun(3, [&]
+	{
+		for(int step = 0; step < steps; ++step)
+		{
+			for(int i = 0; i < count; ++i)
+				integrators[i].UpdateSimulation(BatchDeltaTime);
+		}
+	});
+
+	PendulumBatch batch(count);
+	pendulums.Fill(batch);
+	double updateSeconds = MeasureFastestRun(3, [&]
+	{
+		for(int step = 0; step < steps; ++step)
+			batch.UpdateSimulation(BatchDeltaTime);
+	});
+	double stepSeconds = MeasureFastestRun(3, [&] { batch.Step(BatchDeltaTime, steps); });
+
+	double bobSteps = static_cast<double>(count) * steps;
+	printf("%d pendulums, %d steps, one thread\n", count, steps);
+	printf("%-36s %14s %10s\n", "path", "bob-steps/s", "speedup");
+	printf("%-36s %14.3g %10.2f\n", "PendulumIntegrator per bob", bobSteps / scalarSeconds, 1.0);
+	printf("%-36s %14.3g %10.2f\n", "PendulumBatch::UpdateSimulation", bobSteps / updateSeconds, scalarSeconds / updateSeconds);
+	printf("%-36s %14.3g %10.2f\n", "PendulumBatch::Step", bobSteps / stepSeconds, scalarSeconds / stepSeconds);
+	printf("target 1e8 bob-steps/s: %s\n", bobSteps / updateSeconds >= 1e8 ? "met" : "missed");
+}
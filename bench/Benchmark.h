@@ -0,0 +1,88 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+class PendulumBatch;
+
+// The settings every benchmark gets from the command line.
+struct BenchmarkOptions
+{
+	// Multiplies the problem sizes, below 1 for a quick check that everything runs.
+	double m_scale;
+	// The most threads the benchmarks with a thread pool use, 0 for one per hardware core.
+	int m_maxThreads;
+};
+
+// Gets the seconds since an arbitrary start.
+double GetBenchmarkTime();
+
+// Scales a problem size with the options, it does not fall below the minimum.
+int ScaleSize(const BenchmarkOptions& options, int size, int minimum);
+
+// Runs the work the indicated number of times and returns the seconds of the fastest run.
+double MeasureFastestRun(int repetitions, const std::function<void()>& work);
+
+// Fills the anchors and the displaced start positions of a set of pendulums spread over a cube,
+// one column per axis. The same seed gives the same pendulums.
+void CreateRandomPendulums(int count, float spread, unsigned int seed, float* const anchorPoint[3], float* const position[3]);
+
+
+// Holds the start state of a set of random pendulums, one vector per axis.
+struct PendulumSet
+{
+	std::vector<float> m_anchorPoint[3];
+	std::vector<float> m_position[3];
+
+	// Creates the indicated number of random pendulums spread over a cube.
+	PendulumSet(int count, float spread = 1000.0f, unsigned int seed = 1);
+
+	// Gets the number of pendulums.
+	int GetNumOfPendulums() const { return static_cast<int>(m_position[0].size()); }
+	// Obtains the anchor and the start position of the indicated pendulum.
+	void ObtainPendulum(int index, float anchorPoint[3], float position[3]) const;
+	// Adds all pendulums to the batch.
+	void Fill(PendulumBatch& batch) const;
+};
+
+
+// The benchmarks, each prints its own table.
+
+// Steps a PendulumBatch against one PendulumIntegrator per bob.
+void RunBatchThroughputBenchmark(const BenchmarkOptions& options);
+
+// Measures cost and error of every integration scheme against the closed form.
+void RunSchemeAccuracyBenchmark(const BenchmarkOptions& options);
+
+// Steps the batch with uniform and with individual parameters against the hard coded constants.
+void RunParameterBenchmark(const BenchmarkOptions& options);
+
+// Steps the batch on a growing number of threads, strong and weak scaling.
+void RunScalingBenchmark(const BenchmarkOptions& options);
+
+// Steps a SpringNetwork of more than a million springs with the explicit step.
+void RunSpringThroughputBenchmark(const BenchmarkOptions& options);
+
+// Races StepImplicit against the explicit Step on stiff springs to 60 s of simulated time.
+void RunImplicitSpringBenchmark(const BenchmarkOptions& options);
+
+// Measures the error of StepXpbd against its cost over iterations and substeps.
+void RunXpbdConvergenceBenchmark(const BenchmarkOptions& options);
+
+// Measures the broadphases over the number of points and their density.
+void RunBroadphaseBenchmark(const BenchmarkOptions& options);
+
+// Measures build, refit and ray queries of the PickingBvh over a million objects.
+void RunPickingBenchmark(const BenchmarkOptions& options);
+
+// Measures the overhead of the noise against the noise free steps.
+void RunNoiseBenchmark(const BenchmarkOptions& options);
+
+// Measures the overhead of the event detection against the step without predicates.
+void RunEventBenchmark(const BenchmarkOptions& options);
+
+// Measures the bandwidth of saving and restoring a checkpoint.
+void RunCheckpointBenchmark(const BenchmarkOptions& options);
+
+// Measures the compression ratio and the encoded and decoded samples per second of the trajectory codec.
+void RunCodecBenchmark(const BenchmarkOptions& options);
@@ -0,0 +1,177 @@
+// -------------------------------------------------------------------------------------
+// Runs the benchmarks of the simulation: PendulumBench [--scale s] [--threads n] [name ...]
+// Without names every benchmark runs.
+// -------------------------------------------------------------------------------------
+
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// A benchmark that can be selected by name.
+struct NamedBenchmark
+{
+	const char* m_name;
+	void (*m_function)(const BenchmarkOptions& options);
+};
+
+static const NamedBenchmark Benchmarks[] =
+{
+	{"batch", RunBatchThroughputBenchmark},
+	{"schemes", RunSchemeAccuracyBenchmark},
+	{"parameters", RunParameterBenchmark},
+	{"scaling", RunScalingBenchmark},
+	{"springs", RunSpringThroughputBenchmark},
+	{"implicit", RunImplicitSpringBenchmark},
+	{"xpbd", RunXpbdConvergenceBenchmark},
+	{"broadphase", RunBroadphaseBenchmark},
+	{"picking", RunPickingBenchmark},
+	{"noise", RunNoiseBenchmark},
+	{"events", RunEventBenchmark},
+	{"checkpoint", RunCheckpointBenchmark},
+	{"codec", RunCodecBenchmark}
+};
+static const int NumOfBenchmarks = sizeof(Benchmarks) / sizeof(Benchmarks[0]);
+
+
+// Gets the seconds since an arbitrary start.
+double GetBenchmarkTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Scales a problem size with the options, it does not fall below the minimum.
+int ScaleSize(const BenchmarkOptions& options, int size, int minimum)
+{
+	double scaled = size * options.m_scale;
+	return scaled > minimum ? static_cast<int>(scaled) : minimum;
+}
+
+
+// Runs the work the indicated number of times and returns the seconds of the fastest run.
+double MeasureFastestRun(int repetitions, const std::function<void()>& work)
+{
+	double fastest = 0.0;
+	for(int repetition = 0; repetition < repetitions; ++repetition)
+	{
+		double start = GetBenchmarkTime();
+		work();
+		double seconds = GetBenchmarkTime() - start;
+		if (repetition == 0 || seconds < fastest)
+			fastest = seconds;
+	}
+	return fastest;
+}
+
+
+// Fills the anchors and the displaced start positions of a set of pendulums spread over a cube.
+void CreateRandomPendulums(int count, float spread, unsigned int seed, float* const anchorPoint[3], float* const position[3])
+{
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<float> anchorDistribution(-spread, spread);
+	std::uniform_real_distribution<float> displacementDistribution(-3.0f, 3.0f);
+	for(int i = 0; i < count; ++i)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+			anchorPoint[axis][i] = anchorDistribution(generator);
+		for(int axis = 0; axis < 3; ++axis)
+			position[axis][i] = anchorPoint[axis][i] + displacementDistribution(generator);
+	}
+}
+
+
+// Creates the indicated number of random pendulums spread over a cube.
+PendulumSet::PendulumSet(int count, float spread, unsigned int seed)
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		m_anchorPoint[axis].resize(count);
+		m_position[axis].resize(count);
+	}
+	float* anchorPoint[3] = {m_anchorPoint[0].data(), m_anchorPoint[1].data(), m_anchorPoint[2].data()};
+	float* position[3] = {m_position[0].data(), m_position[1].data(), m_position[2].data()};
+	CreateRandomPendulums(count, spread, seed, anchorPoint, position);
+}
+
+
+// Obtains the anchor and the start position of the indicated pendulum.
+void PendulumSet::ObtainPendulum(int index, float anchorPoint[3], float position[3]) const
+{
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		anchorPoint[axis] = m_anchorPoint[axis][index];
+		position[axis] = m_position[axis][index];
+	}
+}
+
+
+// Adds all pendulums to the batch.
+void PendulumSet::Fill(PendulumBatch& batch) const
+{
+	for(int i = 0; i < GetNumOfPendulums(); ++i)
+	{
+		float anchorPoint[3];
+		float position[3];
+		ObtainPendulum(i, anchorPoint, position);
+		batch.AddPendulum(anchorPoint);
+		batch.SetPendulumPosition(i, position);
+	}
+}
+
+
+// Parses the options and runs the selected benchmarks.
+int main(int argc, char** argv)
+{
+	BenchmarkOptions options;
+	options.m_scale = 1.0;
+	options.m_maxThreads = 0;
+
+	bool selected[NumOfBenchmarks] = {false};
+	bool anySelected = false;
+	for(int argument = 1; argument < argc; ++argument)
+	{
+		if (strcmp(argv[argument], "--scale") == 0 && argument + 1 < argc)
+			options.m_scale = atof(argv[++argument]);
+		else if (strcmp(argv[argument], "--threads") == 0 && argument + 1 < argc)
+			options.m_maxThreads = atoi(argv[++argument]);
+		else
+		{
+			bool found = false;
+			for(int benchmark = 0; benchmark < NumOfBenchmarks; ++benchmark)
+			{
+				if (strcmp(argv[argument], Benchmarks[benchmark].m_name) == 0)
+				{
+					selected[benchmark] = true;
+					anySelected = true;
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				printf("usage: PendulumBench [--scale s] [--threads n] [name ...]\nbenchmarks:");
+				for(int benchmark = 0; benchmark < NumOfBenchmarks; ++benchmark)
+					printf(" %s", Benchmarks[benchmark].m_name);
+				printf("\n");
+				return 1;
+			}
+		}
+	}
+	if (!(options.m_scale > 0.0))
+		options.m_scale = 1.0;
+
+	for(int benchmark = 0; benchmark < NumOfBenchmarks; ++benchmark)
+	{
+		if (anySelected && !selected[benchmark])
+			continue;
+		printf("== %s\n", Benchmarks[benchmark].m_name);
+		Benchmarks[benchmark].m_function(options);
+		printf("\n");
+		fflush(stdout);
+	}
+	return 0;
+}
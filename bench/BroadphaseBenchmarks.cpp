@@ -0,0 +1,171 @@
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include "SpatialHashGrid.h"
+#include "SweepAndPrune.h"
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+
+// The radius of the bobs, two of them touch below twice this distance.
+static const float BroadphaseBobRadius = 1.0f;
+// The most points sweep and prune is measured with. Points spread over a volume overlap on the
+// sort axis in slabs that hold more points the more there are, so the sweep grows quadratically
+// and takes seconds per call beyond this.
+static const int MaxSweepAndPrunePoints = 300000;
+
+
+// Holds random points in a cube, one column per axis, and moves them a little like a step does.
+struct BroadphasePoints
+{
+	std::vector<float> m_position[3];
+	// The distance every point moves per step, at most a fiftieth of the radius per axis.
+	std::vector<float> m_motion[3];
+
+	// Spreads the points over a cube so every point has the indicated number of neighbours
+	// closer than the contact distance on average.
+	BroadphasePoints(int count, float neighbours)
+	{
+		const float contactDistance = 2.0f * BroadphaseBobRadius;
+		float contactVolume = 4.0f / 3.0f * 3.14159265f * contactDistance * contactDistance * contactDistance;
+		float side = cbrtf(count * contactVolume / neighbours);
+		std::mt19937 generator(5);
+		std::uniform_real_distribution<float> positionDistribution(0.0f, side);
+		std::uniform_real_distribution<float> motionDistribution(-0.02f * BroadphaseBobRadius, 0.02f * BroadphaseBobRadius);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_position[axis].resize(count);
+			m_motion[axis].resize(count);
+			for(int i = 0; i < count; ++i)
+			{
+				m_position[axis][i] = positionDistribution(generator);
+				m_motion[axis][i] = motionDistribution(generator);
+			}
+		}
+	}
+
+	// Moves every point on by its motion, as the bobs move smoothly from step to step.
+	void Move()
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			for(size_t i = 0; i < m_position[axis].size(); ++i)
+				m_position[axis][i] += m_motion[axis][i];
+		}
+	}
+
+	// Gets the columns in the form the broadphases take them.
+	void ObtainColumns(const float* columns[3])
+	{
+		for(int axis = 0; axis < 3; ++axis)
+			columns[axis] = m_position[axis].data();
+	}
+};
+
+
+// Measures both broadphases on one set of points. The hash grid is timed for the build and
+// the query separately. Sweep and prune is timed for the repair of the order after the points
+// moved on by a step, next to a sort from scratch of the same keys, and for the sweep.
+static void MeasureBroadphases(int count, float neighbours)
+{
+	const float contactDistance = 2.0f * BroadphaseBobRadius;
+	BroadphasePoints points(count, neighbours);
+	const float* position[3];
+	points.ObtainColumns(position);
+	std::vector<CollisionPair> pairs;
+
+	SpatialHashGrid grid;
+	double buildSeconds = MeasureFastestRun(3, [&] { grid.Build(count, position, contactDistance); });
+	double querySeconds = MeasureFastestRun(3, [&] { grid.FindPairs(contactDistance, pairs); });
+	size_t gridPairs = pairs.size();
+
+	printf("%9d %10.2f %10zu %12.1f %12.1f", count, neighbours, gridPairs, 1e9 * buildSeconds / count, 1e9 * querySeconds / count);
+	if (count > MaxSweepAndPrunePoints)
+	{
+		printf(" %12s %12s %12s %12s\n", "-", "-", "-", "-");
+		return;
+	}
+
+	// The first update sorts from scratch, the following ones only repair the order.
+	SweepAndPrune sweepAndPrune;
+	sweepAndPrune.UpdateOrder(count, position);
+	const int steps = 3;
+	double repairSeconds = 1e30;
+	long long swaps = 0;
+	for(int step = 0; step < steps; ++step)
+	{
+		points.Move();
+		double start = GetBenchmarkTime();
+		sweepAndPrune.UpdateOrder(count, position);
+		double seconds = GetBenchmarkTime() - start;
+		repairSeconds = seconds < repairSeconds ? seconds : repairSeconds;
+		swaps += sweepAndPrune.GetNumOfSwaps();
+	}
+	double sweepSeconds = MeasureFastestRun(3, [&] { sweepAndPrune.Sweep(contactDistance, pairs); });
+
+	// The sort from scratch of the same keys that the repair replaces.
+	const float* key = position[sweepAndPrune.GetSortAxis()];
+	std::vector<int> sortedItems(count);
+	double sortSeconds = MeasureFastestRun(3, [&]
+	{
+		for(int item = 0; item < count; ++item)
+			sortedItems[item] = item;
+		std::sort(sortedItems.begin(), sortedItems.end(), [key](int first, int second) { return key[first] < key[second]; });
+	});
+
+	printf(" %12.1f %12.1f %12.1f %12lld\n", 1e9 * sortSeconds / count, 1e9 * repairSeconds / count, 1e9 * sweepSeconds / count, swaps / steps);
+}
+
+
+// Measures the cost of the bob collisions in a step: the batch with colliding bobs against the
+// same batch without collisions, for both broadphases.
+static void MeasureBatchCollisions(int count)
+{
+	const float deltaTime = 1.0f / 120.0f;
+	const int steps = 10;
+	// The anchors are 8 radii apart on average, so the bobs swinging by up to 3 in every
+	// direction run into some of their neighbours.
+	PendulumSet pendulums(count, cbrtf(static_cast<float>(count)) * 4.0f * BroadphaseBobRadius);
+
+	const char* names[] = {"no collisions", "hash grid", "sweep and prune"};
+	double baseSeconds = 0.0;
+	for(int setup = 0; setup < 3; ++setup)
+	{
+		PendulumBatch batch(count);
+		pendulums.Fill(batch);
+		if (setup > 0)
+		{
+			batch.EnableCollisions(BroadphaseBobRadius, 0.5f);
+			batch.SetBroadphase(setup == 1 ? BroadphaseHashGrid : BroadphaseSweepAndPrune);
+		}
+		double start = GetBenchmarkTime();
+		batch.Step(deltaTime, steps);
+		double seconds = GetBenchmarkTime() - start;
+		if (setup == 0)
+			baseSeconds = seconds;
+		printf("%-20s %14.1f %12.2f\n", names[setup], 1e9 * seconds / (static_cast<double>(count) * steps), seconds / baseSeconds);
+	}
+}
+
+
+// Measures SpatialHashGrid and SweepAndPrune over the number of points and their density,
+// given as the average number of neighbours a point touches. All costs are nanoseconds per
+// point, the repair includes gathering the positions in the new order for the sweep. Then measures what the collisions add to a step of the batch.
+void RunBroadphaseBenchmark(const BenchmarkOptions& options)
+{
+	const int sizes[] = {10000, 100000, 1000000};
+	const float densities[] = {0.1f, 1.0f, 8.0f};
+	printf("%9s %10s %10s %12s %12s %12s %12s %12s %12s\n", "points", "neighbours", "pairs", "grid build", "grid query", "std::sort", "SAP repair", "SAP sweep", "swaps/step");
+	for(int size : sizes)
+	{
+		for(float neighbours : densities)
+			MeasureBroadphases(ScaleSize(options, size, 1000), neighbours);
+	}
+
+	int count = ScaleSize(options, 100000, 1000);
+	printf("\n%d pendulums in a block, ns per bob step\n", count);
+	printf("%-20s %14s %12s\n", "collisions", "ns/bob-step", "slowdown");
+	MeasureBatchCollisions(count);
+}
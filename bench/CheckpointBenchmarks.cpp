@@ -0,0 +1,77 @@
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include <stdio.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+
+static const char* const CheckpointBenchmarkFile = "PendulumBench.checkpoint";
+
+
+// Returns the size of the file in bytes, zero if it does not exist.
+static double GetFileSize(const char* fileName)
+{
+#ifdef _WIN32
+	struct __stat64 status;
+	if (_stat64(fileName, &status) != 0)
+		return 0.0;
+#else
+	struct stat status;
+	if (stat(fileName, &status) != 0)
+		return 0.0;
+#endif
+	return static_cast<double>(status.st_size);
+}
+
+
+// Restores the checkpoint into a new batch and hashes the state, so every page of the columns
+// is read once. Prints the time of the restore alone and with the hash, in GB/s of the file.
+static void MeasureRestore(const char* name, bool verifyChecksum, double fileSize, unsigned long long savedHash)
+{
+	// The restore alone keeps its fastest run too.
+	double restoreSeconds = 1e30;
+	unsigned long long hash = 0;
+	double seconds = MeasureFastestRun(3, [&]
+	{
+		PendulumBatch batch(1);
+		double start = GetBenchmarkTime();
+		if (!batch.RestoreCheckpoint(CheckpointBenchmarkFile, verifyChecksum))
+			printf("%s: the checkpoint could not be restored\n", name);
+		double runSeconds = GetBenchmarkTime() - start;
+		if (runSeconds < restoreSeconds)
+			restoreSeconds = runSeconds;
+		hash = batch.ComputeStateHash();
+	});
+	printf("%-28s %12.2f GB/s %12.2f GB/s%s\n", name, fileSize / restoreSeconds * 1e-9, fileSize / seconds * 1e-9,
+		hash == savedHash ? "" : "  hash differs");
+}
+
+
+// Saves the state of a few million pendulums and restores it with and without the verification
+// of the checksum. The file stays in the page cache, so this is the bandwidth of the copies and
+// the checksum rather than of the disk.
+void RunCheckpointBenchmark(const BenchmarkOptions& options)
+{
+	int count = ScaleSize(options, 4000000, 1000);
+	PendulumSet pendulums(count);
+	PendulumBatch batch(count);
+	pendulums.Fill(batch);
+	batch.Step(1.0f / 120.0f, 10);
+	unsigned long long savedHash = batch.ComputeStateHash();
+
+	double saveSeconds = MeasureFastestRun(3, [&]
+	{
+		if (!batch.SaveCheckpoint(CheckpointBenchmarkFile))
+			printf("the checkpoint could not be saved\n");
+	});
+	double fileSize = GetFileSize(CheckpointBenchmarkFile);
+
+	printf("%d pendulums, %.1f MB checkpoint\n", count, fileSize * 1e-6);
+	printf("%-28s %17s %17s\n", "", "restore", "restore and read");
+	printf("%-28s %12.2f GB/s\n", "save", fileSize / saveSeconds * 1e-9);
+	MeasureRestore("restore", false, fileSize, savedHash);
+	MeasureRestore("restore verified", true, fileSize, savedHash);
+
+	remove(CheckpointBenchmarkFile);
+}
@@ -0,0 +1,82 @@
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include "TrajectoryCodec.h"
+#include <stdio.h>
+#include <vector>
+
+
+// The time step of the recorded frames.
+static const float CodecDeltaTime = 1.0f / 120.0f;
+
+
+// Records the x positions of the pendulums over the indicated frames, frame after frame with one
+// sample per pendulum like the recorder hands its blocks to the codec.
+static void RecordCodecColumn(const PendulumSet& pendulums, int numOfFrames, float noiseTemperature, std::vector<float>& column)
+{
+	int count = pendulums.GetNumOfPendulums();
+	PendulumBatch batch(count);
+	pendulums.Fill(batch);
+	if (noiseTemperature > 0.0f)
+		batch.EnableNoise(noiseTemperature, 3);
+	// A second of swinging, so the column does not start at rest.
+	batch.Step(CodecDeltaTime, 120);
+
+	column.resize(static_cast<size_t>(numOfFrames) * count);
+	std::vector<float> unused[2];
+	for(int axis = 0; axis < 2; ++axis)
+		unused[axis].resize(count);
+	for(int frame = 0; frame < numOfFrames; ++frame)
+	{
+		float* positionColumns[3] = {&column[static_cast<size_t>(frame) * count], unused[0].data(), unused[1].data()};
+		batch.ObtainCurrentStates(positionColumns, NULL);
+		batch.Step(CodecDeltaTime, 1);
+	}
+}
+
+
+// Encodes and decodes the column at the indicated bound and prints the ratio to the floats
+// and the encoded and decoded samples per second.
+static void MeasureCodecColumn(const char* name, const std::vector<float>& column, int numOfFrames, int numOfPendulums, float errorBound)
+{
+	TrajectoryCodec codec;
+	// Words, so the output is aligned to four bytes.
+	std::vector<unsigned int> encoded(TrajectoryCodec::GetMaxEncodedBytes(numOfFrames, numOfPendulums) / sizeof(unsigned int) + 1);
+	unsigned char* output = reinterpret_cast<unsigned char*>(encoded.data());
+	size_t bytes = 0;
+	double encodeSeconds = MeasureFastestRun(3, [&] { bytes = codec.EncodeColumn(column.data(), numOfFrames, numOfPendulums, errorBound, output); });
+
+	std::vector<float> decoded(column.size());
+	bool decodedAll = true;
+	double decodeSeconds = MeasureFastestRun(3, [&]
+	{
+		decodedAll = codec.DecodeColumn(output, bytes, numOfFrames, numOfPendulums, errorBound, decoded.data());
+	});
+
+	double numOfSamples = static_cast<double>(column.size());
+	printf("%-24s %8d %10g %8.2fx %14.3g %14.3g%s\n", name, numOfFrames, errorBound, numOfSamples * sizeof(float) / bytes,
+		numOfSamples / encodeSeconds, numOfSamples / decodeSeconds, decodedAll ? "" : "  not decoded");
+}
+
+
+// Measures the trajectory codec on recorded positions: the compression ratio and the encoded and
+// decoded samples per second for the block lengths and bounds of typical recordings.
+void RunCodecBenchmark(const BenchmarkOptions& options)
+{
+	int count = ScaleSize(options, 200000, 1000);
+	PendulumSet pendulums(count);
+
+	printf("%d pendulums, x positions, one thread\n", count);
+	printf("%-24s %8s %10s %9s %14s %14s\n", "motion", "frames", "bound", "ratio", "encoded/s", "decoded/s");
+	std::vector<float> column;
+	const int frames[] = {32, 128};
+	const float errorBounds[] = {1e-4f, 1e-3f};
+	for(int numOfFrames : frames)
+	{
+		RecordCodecColumn(pendulums, numOfFrames, 0.0f, column);
+		for(float errorBound : errorBounds)
+			MeasureCodecColumn("swinging", column, numOfFrames, count, errorBound);
+		RecordCodecColumn(pendulums, numOfFrames, 1.0f, column);
+		for(float errorBound : errorBounds)
+			MeasureCodecColumn("swinging with noise", column, numOfFrames, count, errorBound);
+	}
+}
@@ -0,0 +1,97 @@
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include "PendulumPhysics.h"
+#include <stdio.h>
+
+
+// The time step of the event benchmarks.
+static const float EventDeltaTime = 1.0f / 120.0f;
+
+
+// The height of the bob above the point where the spring carries it, a user predicate as simple as the built in ones.
+static float GetHeightAboveEquilibrium(const float position[3], const float[3], const float anchorPoint[3], void*)
+{
+	const float equilibriumOffset = PendulumPhysics::earthAcceleration / (PendulumPhysics::invMass * PendulumPhysics::springConstant);
+	return position[1] - (anchorPoint[1] + equilibriumOffset);
+}
+
+
+// Creates a predicate of the indicated function that fires regularly on swinging pendulums.
+static EventPredicate CreateBenchmarkPredicate(EventFunction function)
+{
+	EventPredicate predicate;
+	predicate.m_function = function;
+	switch (function)
+	{
+	case EventExtension:
+		predicate.m_threshold = 10.0f;
+		break;
+	case EventSpeed:
+		predicate.m_threshold = 1.0f;
+		break;
+	case EventCustom:
+		predicate.m_stateFunction = GetHeightAboveEquilibrium;
+		break;
+	default:
+		break;
+	}
+	return predicate;
+}
+
+
+// Steps the pendulums with the indicated predicates and prints the throughput, the events
+// found per step and the overhead against the step without predicates.
+static void MeasureEventSetup(const char* name, const PendulumSet& pendulums, int steps, const EventFunction* functions, int numOfFunctions, double& baseSeconds)
+{
+	// The pendulums start at rest and would swing in phase, so every event would fall into the
+	// same steps. Half a second of strong noise spreads their phases before the measurement.
+	PendulumBatch batch(pendulums.GetNumOfPendulums());
+	pendulums.Fill(batch);
+	batch.EnableNoise(40.0f, 3);
+	batch.Step(EventDeltaTime, 60);
+	batch.DisableNoise();
+	for(int function = 0; function < numOfFunctions; ++function)
+		batch.AddEventPredicate(CreateBenchmarkPredicate(functions[function]));
+
+	// The events of the last run are counted, every run clears those of the one before.
+	int numOfEvents = 0;
+	double seconds = MeasureFastestRun(3, [&]
+	{
+		batch.ClearEvents();
+		batch.Step(EventDeltaTime, steps);
+		numOfEvents = batch.GetNumOfEvents();
+	});
+	if (numOfFunctions == 0)
+		baseSeconds = seconds;
+
+	double bobSteps = static_cast<double>(pendulums.GetNumOfPendulums()) * steps;
+	printf("%-28s %14.3g %14.1f %10.1f %%\n", name, bobSteps / seconds, static_cast<double>(numOfEvents) / steps, 100.0 * (seconds / baseSeconds - 1.0));
+}
+
+
+// Measures what the event detection adds to Step: one predicate of every kind on its own and all
+// built in kinds together, against the step without predicates.
+void RunEventBenchmark(const BenchmarkOptions& options)
+{
+	int count = ScaleSize(options, 1000000, 1000);
+	const int steps = 20;
+	PendulumSet pendulums(count);
+
+	printf("%d pendulums, %d steps, one thread\n", count, steps);
+	printf("%-28s %14s %14s %11s\n", "predicates", "bob-steps/s", "events/step", "overhead");
+	double baseSeconds = 0.0;
+	MeasureEventSetup("none", pendulums, steps, NULL, 0, baseSeconds);
+
+	const EventFunction displacement[] = {EventDisplacement};
+	const EventFunction extension[] = {EventExtension};
+	const EventFunction extensionRate[] = {EventExtensionRate};
+	const EventFunction speed[] = {EventSpeed};
+	const EventFunction custom[] = {EventCustom};
+	const EventFunction builtIn[] = {EventDisplacement, EventExtension, EventExtensionRate, EventSpeed};
+	MeasureEventSetup("displacement", pendulums, steps, displacement, 1, baseSeconds);
+	MeasureEventSetup("extension", pendulums, steps, extension, 1, baseSeconds);
+	MeasureEventSetup("extension rate", pendulums, steps, extensionRate, 1, baseSeconds);
+	MeasureEventSetup("speed", pendulums, steps, speed, 1, baseSeconds);
+	MeasureEventSetup("custom", pendulums, steps, custom, 1, baseSeconds);
+	MeasureEventSetup("all four built in", pendulums, steps, builtIn, 4, baseSeconds);
+}
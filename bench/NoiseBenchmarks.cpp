@@ -0,0 +1,92 @@
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include "PendulumKernels.h"
+#include <stdio.h>
+#include <vector>
+
+
+// The time step of the noise benchmarks.
+static const float NoiseDeltaTime = 1.0f / 120.0f;
+
+static const char* const NoiseLevelNames[] = {"scalar", "SSE", "AVX2", "AVX-512"};
+
+
+// Measures the noise kernel alone on every level the processor supports, in normal triples per second.
+static void MeasureNoiseKernels(int count)
+{
+	std::vector<int> streams(count);
+	for(int i = 0; i < count; ++i)
+		streams[i] = i;
+	std::vector<float> normal[3];
+	for(int axis = 0; axis < 3; ++axis)
+		normal[axis].resize(count);
+
+	printf("%-36s %14s\n", "noise kernel", "triples/s");
+	for(int level = SimdLevelScalar; level <= PendulumKernels::DetectSimdLevel(); ++level)
+	{
+		GaussianNoiseKernel kernel = PendulumKernels::GetGaussianNoiseKernel(static_cast<SimdLevel>(level));
+		unsigned long long step = 0;
+		double seconds = MeasureFastestRun(3, [&]
+		{
+			kernel(count, streams.data(), step++, 7, normal[0].data(), normal[1].data(), normal[2].data());
+		});
+		printf("%-36s %14.3g\n", NoiseLevelNames[level], count / seconds);
+	}
+}
+
+
+// Measures one stepping path without and with noise and prints both and the overhead.
+static void MeasureNoisePath(const char* path, const PendulumSet& pendulums, int steps, void (*advance)(PendulumBatch& batch, int steps))
+{
+	double seconds[2];
+	for(int noise = 0; noise < 2; ++noise)
+	{
+		PendulumBatch batch(pendulums.GetNumOfPendulums());
+		pendulums.Fill(batch);
+		if (noise)
+			batch.EnableNoise(1.0f, 7);
+		seconds[noise] = MeasureFastestRun(3, [&] { advance(batch, steps); });
+	}
+	double bobSteps = static_cast<double>(pendulums.GetNumOfPendulums()) * steps;
+	printf("%-36s %14.3g %14.3g %10.1f %%\n", path, bobSteps / seconds[0], bobSteps / seconds[1], 100.0 * (seconds[1] / seconds[0] - 1.0));
+}
+
+
+// Advances the batch with one Step call.
+static void AdvanceWithStep(PendulumBatch& batch, int steps)
+{
+	batch.Step(NoiseDeltaTime, steps);
+}
+
+
+// Advances the batch with one UpdateSimulation call per step.
+static void AdvanceWithUpdate(PendulumBatch& batch, int steps)
+{
+	for(int step = 0; step < steps; ++step)
+		batch.UpdateSimulation(NoiseDeltaTime);
+}
+
+
+// Advances the batch with one UpdateSimulationExact call per step.
+static void AdvanceWithExactUpdate(PendulumBatch& batch, int steps)
+{
+	for(int step = 0; step < steps; ++step)
+		batch.UpdateSimulationExact(NoiseDeltaTime);
+}
+
+
+// Measures what ApplyNoise adds to a step: the noise kernel alone per SIMD level, then every
+// stepping path of the batch without and with noise.
+void RunNoiseBenchmark(const BenchmarkOptions& options)
+{
+	int count = ScaleSize(options, 1000000, 1000);
+	const int steps = 20;
+	MeasureNoiseKernels(count);
+
+	PendulumSet pendulums(count);
+	printf("\n%d pendulums, %d steps, one thread\n", count, steps);
+	printf("%-36s %14s %14s %11s\n", "path", "bob-steps/s", "with noise", "overhead");
+	MeasureNoisePath("PendulumBatch::Step", pendulums, steps, AdvanceWithStep);
+	MeasureNoisePath("PendulumBatch::UpdateSimulation", pendulums, steps, AdvanceWithUpdate);
+	MeasureNoisePath("PendulumBatch::UpdateSimulationExact", pendulums, steps, AdvanceWithExactUpdate);
+}
@@ -0,0 +1,142 @@
+#include "Benchmark.h"
+#include "AlignedMemory.h"
+#include "IntegrationSchemes.h"
+#include "PendulumBatch.h"
+#include <stdio.h>
+
+
+// The time step of the parameter benchmarks.
+static const float ParameterDeltaTime = 1.0f / 120.0f;
+
+
+// Holds the state of the pendulums in columns like the batch did before it had parameters,
+// and steps it with the constants of PendulumPhysics written into the loop.
+struct HardCodedPendulums
+{
+	int m_numOfPendulums;
+	float* m_anchorPoint[3];
+	float* m_position[3];
+	float* m_velocity[3];
+
+	// Copies the start state of the pendulums into the columns.
+	explicit HardCodedPendulums(const PendulumSet& pendulums)
+	{
+		m_numOfPendulums = pendulums.GetNumOfPendulums();
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			m_anchorPoint[axis] = AllocateColumn(m_numOfPendulums);
+			m_position[axis] = AllocateColumn(m_numOfPendulums);
+			m_velocity[axis] = AllocateColumn(m_numOfPendulums);
+			for(int i = 0; i < m_numOfPendulums; ++i)
+			{
+				m_anchorPoint[axis][i] = pendulums.m_anchorPoint[axis][i];
+				m_position[axis][i] = pendulums.m_position[axis][i];
+				m_velocity[axis][i] = 0.0f;
+			}
+		}
+	}
+
+	~HardCodedPendulums()
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			FreeAligned(m_anchorPoint[axis]);
+			FreeAligned(m_position[axis]);
+			FreeAligned(m_velocity[axis]);
+		}
+	}
+
+	HardCodedPendulums(const HardCodedPendulums&) = delete;
+	HardCodedPendulums& operator=(const HardCodedPendulums&) = delete;
+
+	// Advances all pendulums axis by axis, gravity only acts on the vertical axis.
+	template <class IntegrationScheme>
+	void UpdateSimulation(float deltaTime)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			const float* __restrict anchor = m_anchorPoint[axis];
+			float* __restrict position = m_position[axis];
+			float* __restrict velocity = m_velocity[axis];
+			float gravity = axis == 1 ? PendulumPhysics::earthAcceleration : 0.0f;
+			for(int i = 0; i < m_numOfPendulums; ++i)
+			{
+				AxisSpringForce force = {gravity, anchor[i], 0.0f};
+				IntegrationScheme::Advance(position[i], velocity[i], force, deltaTime);
+			}
+		}
+	}
+};
+
+
+// Prints one row of the parameter table.
+static void PrintParameterRow(const char* path, double bobSteps, double seconds, double baselineSeconds)
+{
+	printf("%-40s %14.3g %12.2f\n", path, bobSteps / seconds, baselineSeconds / seconds);
+}
+
+
+// Steps the same pendulums with one scheme on every parameter path.
+template <class IntegrationScheme>
+static void RunParameterPaths(const char* scheme, const PendulumSet& pendulums, int steps)
+{
+	int count = pendulums.GetNumOfPendulums();
+	double bobSteps = static_cast<double>(count) * steps;
+	char path[64];
+
+	HardCodedPendulums hardCoded(pendulums);
+	double baselineSeconds = MeasureFastestRun(3, [&]
+	{
+		for(int step = 0; step < steps; ++step)
+			hardCoded.UpdateSimulation<IntegrationScheme>(ParameterDeltaTime);
+	});
+	snprintf(path, sizeof(path), "%s, hard coded constants", scheme);
+	PrintParameterRow(path, bobSteps, baselineSeconds, baselineSeconds);
+
+	PendulumBatch uniform(count);
+	pendulums.Fill(uniform);
+	double uniformSeconds = MeasureFastestRun(3, [&]
+	{
+		for(int step = 0; step < steps; ++step)
+			uniform.UpdateSimulation<IntegrationScheme>(ParameterDeltaTime);
+	});
+	snprintf(path, sizeof(path), "%s, UniformParameters", scheme);
+	PrintParameterRow(path, bobSteps, uniformSeconds, baselineSeconds);
+
+	// Every pendulum gets its own parameters, so the columns are read in the loop.
+	PendulumBatch individual(count);
+	pendulums.Fill(individual);
+	for(int i = 0; i < count; ++i)
+	{
+		PendulumParameters parameters;
+		parameters.m_invMass = 1.0f + (i % 7) * 0.25f;
+		parameters.m_springConstant = 0.25f + (i % 5) * 0.125f;
+		individual.SetPendulumParameters(i, parameters);
+	}
+	double columnSeconds = MeasureFastestRun(3, [&]
+	{
+		for(int step = 0; step < steps; ++step)
+			individual.UpdateSimulation<IntegrationScheme>(ParameterDeltaTime);
+	});
+	snprintf(path, sizeof(path), "%s, ColumnParameters", scheme);
+	PrintParameterRow(path, bobSteps, columnSeconds, baselineSeconds);
+
+	printf("%s: UniformParameters is %s the hard coded path\n", scheme,
+		uniformSeconds <= baselineSeconds * 1.05 ? "no slower than" : "SLOWER than");
+}
+
+
+// Steps the batch with the parameters folded in by UniformParameters and read from the columns
+// by ColumnParameters, against a copy of the loop that had the constants hard coded.
+// The uniform path has to be as fast as the hard coded one, within 5 % of noise.
+void RunParameterBenchmark(const BenchmarkOptions& options)
+{
+	int count = ScaleSize(options, 1000000, 1000);
+	const int steps = 20;
+	PendulumSet pendulums(count);
+
+	printf("%d pendulums, %d steps, one thread\n", count, steps);
+	printf("%-40s %14s %12s\n", "path", "bob-steps/s", "speedup");
+	RunParameterPaths<ExplicitEulerScheme>("explicit Euler", pendulums, steps);
+	RunParameterPaths<RungeKutta4Scheme>("Runge-Kutta 4", pendulums, steps);
+}
@@ -0,0 +1,77 @@
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include "PendulumPhysics.h"
+#include "PickingBvh.h"
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+
+// Builds the tree over a million objects, a bob and a spring per pendulum, and casts rays from a
+// camera outside the block at random points inside it. Then refits the tree after the pendulums
+// moved and casts the rays again. Prints the build and refit time and the cost per ray with the
+// share of rays that hit for the new and for the refit tree.
+void RunPickingBenchmark(const BenchmarkOptions& options)
+{
+	int count = ScaleSize(options, 500000, 1000);
+	// The anchors are 8 radii of a bob apart on average, so most rays pass through several pendulums.
+	float spread = cbrtf(static_cast<float>(count)) * 4.0f * PendulumPhysics::bobRadius;
+	PendulumSet pendulums(count, spread);
+	PendulumBatch batch(count);
+	pendulums.Fill(batch);
+
+	std::vector<float> position[3];
+	for(int axis = 0; axis < 3; ++axis)
+		position[axis].resize(count);
+	float* positionColumns[3] = {position[0].data(), position[1].data(), position[2].data()};
+	const float* anchorColumns[3] = {pendulums.m_anchorPoint[0].data(), pendulums.m_anchorPoint[1].data(), pendulums.m_anchorPoint[2].data()};
+	batch.ObtainCurrentStates(positionColumns, NULL);
+
+	PickingBvh bvh;
+	double buildSeconds = MeasureFastestRun(3, [&]
+	{
+		bvh.Build(count, anchorColumns, positionColumns, PendulumPhysics::bobRadius, PendulumPhysics::springRadius);
+	});
+
+	const int numOfRays = ScaleSize(options, 100000, 1000);
+	std::mt19937 generator(9);
+	std::uniform_real_distribution<float> targetDistribution(-spread, spread);
+	std::vector<float> direction[3];
+	for(int axis = 0; axis < 3; ++axis)
+		direction[axis].resize(numOfRays);
+	const float origin[3] = {0.0f, 0.0f, -4.0f * spread};
+	for(int ray = 0; ray < numOfRays; ++ray)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+			direction[axis][ray] = targetDistribution(generator) - origin[axis];
+	}
+
+	int numOfHits = 0;
+	auto castRays = [&]
+	{
+		numOfHits = 0;
+		for(int ray = 0; ray < numOfRays; ++ray)
+		{
+			const float rayDirection[3] = {direction[0][ray], direction[1][ray], direction[2][ray]};
+			PickingHit hit;
+			if (bvh.IntersectRay(origin, rayDirection, hit))
+				++numOfHits;
+		}
+	};
+	double builtQuerySeconds = MeasureFastestRun(3, castRays);
+	int builtHits = numOfHits;
+
+	// A second of motion moves the bobs by about their size, the tree keeps its shape.
+	batch.Step(1.0f / 120.0f, 120);
+	batch.ObtainCurrentStates(positionColumns, NULL);
+	double refitSeconds = MeasureFastestRun(3, [&] { bvh.Refit(anchorColumns, positionColumns); });
+
+	double querySeconds = MeasureFastestRun(3, castRays);
+
+	printf("%d objects of %d pendulums, %d rays\n", 2 * count, count, numOfRays);
+	printf("%-12s %12.3f ms\n", "build", 1000.0 * buildSeconds);
+	printf("%-12s %12.3f ms\n", "refit", 1000.0 * refitSeconds);
+	printf("%-12s %12.1f ns/ray, %.1f %% hit\n", "query", 1e9 * builtQuerySeconds / numOfRays, 100.0 * builtHits / numOfRays);
+	printf("%-12s %12.1f ns/ray, %.1f %% hit\n", "refit query", 1e9 * querySeconds / numOfRays, 100.0 * numOfHits / numOfRays);
+}
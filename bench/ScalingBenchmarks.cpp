@@ -0,0 +1,70 @@
+#include "Benchmark.h"
+#include "PendulumBatch.h"
+#include "WorkStealingPool.h"
+#include <stdio.h>
+#include <vector>
+
+
+// The time step of the scaling benchmarks.
+static const float ScalingDeltaTime = 1.0f / 120.0f;
+// The steps of one Step call, all of them run on the pool without returning to the caller.
+static const int ScalingSteps = 20;
+
+
+// Gets the thread counts to measure: the powers of two up to the limit and the limit itself.
+static std::vector<int> GetThreadCounts(const BenchmarkOptions& options)
+{
+	int maxThreads = options.m_maxThreads;
+	if (maxThreads <= 0)
+	{
+		WorkStealingPool hardwarePool(0);
+		maxThreads = hardwarePool.GetNumOfThreads();
+	}
+	std::vector<int> threadCounts;
+	for(int numOfThreads = 1; numOfThreads < maxThreads; numOfThreads *= 2)
+		threadCounts.push_back(numOfThreads);
+	threadCounts.push_back(maxThreads);
+	return threadCounts;
+}
+
+
+// Steps a batch of the indicated size on the pool and returns the bob steps per second.
+static double MeasureBatchOnPool(WorkStealingPool& pool, int count)
+{
+	PendulumSet pendulums(count);
+	PendulumBatch batch(count);
+	pendulums.Fill(batch);
+	batch.SetThreadPool(&pool);
+	double seconds = MeasureFastestRun(3, [&] { batch.Step(ScalingDeltaTime, ScalingSteps); });
+	return static_cast<double>(count) * ScalingSteps / seconds;
+}
+
+
+// Steps the batch on 1 to the most threads. Strong scaling keeps the number of pendulums,
+// weak scaling gives every thread the same number. The efficiency is the speedup over one
+// thread divided by the threads in the strong case and the throughput per thread relative
+// to one thread in the weak case, 1 is perfect scaling.
+void RunScalingBenchmark(const BenchmarkOptions& options)
+{
+	std::vector<int> threadCounts = GetThreadCounts(options);
+	int strongCount = ScaleSize(options, 4000000, 4096);
+	int weakCountPerThread = ScaleSize(options, 1000000, 4096);
+	WorkStealingPool pool(1);
+
+	printf("strong: %d pendulums, weak: %d pendulums per thread, %d steps per Step call\n", strongCount, weakCountPerThread, ScalingSteps);
+	printf("%8s %14s %10s %14s %10s\n", "threads", "strong b-s/s", "efficiency", "weak b-s/s", "efficiency");
+	double strongBase = 0.0;
+	double weakBase = 0.0;
+	for(int numOfThreads : threadCounts)
+	{
+		pool.SetNumOfThreads(numOfThreads);
+		double strong = MeasureBatchOnPool(pool, strongCount);
+		double weak = MeasureBatchOnPool(pool, weakCountPerThread * numOfThreads);
+		if (numOfThreads == 1)
+		{
+			strongBase = strong;
+			weakBase = weak;
+		}
+		printf("%8d %14.3g %10.2f %14.3g %10.2f\n", numOfThreads, strong, strong / (strongBase * numOfThreads), weak, weak / (weakBase * numOfThreads));
+	}
+}
@@ -0,0 +1,106 @@
+#include "Benchmark.h"
+#include "AnalyticPendulum.h"
+#include "IntegrationSchemes.h"
+#include "PendulumBatch.h"
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+
+// The simulated time every scheme runs for before it is compared with the closed form.
+static const double SchemeDuration = 10.0;
+// The number of pendulums compared with the closed form, the error is the largest among them.
+static const int NumOfSchemeSamples = 1000;
+
+
+// Holds the positions of the closed form solution of the sampled pendulums at the end of the run.
+struct ExactPositions
+{
+	std::vector<float> m_position[3];
+
+	// Seeks an AnalyticPendulum per sample to the end of the run.
+	ExactPositions(const PendulumSet& pendulums, int numOfSamples)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+			m_position[axis].resize(numOfSamples);
+		for(int i = 0; i < numOfSamples; ++i)
+		{
+			float anchorPoint[3];
+			float position[3];
+			pendulums.ObtainPendulum(i, anchorPoint, position);
+			AnalyticPendulum pendulum(anchorPoint);
+			pendulum.SetPendulumPosition(position);
+			pendulum.SeekTo(SchemeDuration);
+			pendulum.ObtainCurrentPosition(position);
+			for(int axis = 0; axis < 3; ++axis)
+				m_position[axis][i] = position[axis];
+		}
+	}
+
+	// Gets the largest distance of the sampled pendulums of the batch from the closed form.
+	float ComputeLargestError(PendulumBatch& batch) const
+	{
+		float largest = 0.0f;
+		for(int i = 0; i < static_cast<int>(m_position[0].size()); ++i)
+		{
+			float position[3];
+			batch.ObtainCurrentPosition(i, position);
+			float squaredError = 0.0f;
+			for(int axis = 0; axis < 3; ++axis)
+				squaredError += (position[axis] - m_position[axis][i]) * (position[axis] - m_position[axis][i]);
+			// A diverged scheme gives NaN, which has to count as the largest error.
+			if (!(sqrtf(squaredError) <= largest))
+				largest = sqrtf(squaredError);
+		}
+		return largest;
+	}
+};
+
+
+// Runs one scheme over the whole duration and prints its cost and its error.
+template <class IntegrationScheme>
+static void RunScheme(const char* name, const PendulumSet& pendulums, const ExactPositions& exact, float deltaTime, bool exactStep)
+{
+	int steps = static_cast<int>(SchemeDuration / deltaTime + 0.5);
+	PendulumBatch batch(pendulums.GetNumOfPendulums());
+	pendulums.Fill(batch);
+
+	double start = GetBenchmarkTime();
+	for(int step = 0; step < steps; ++step)
+	{
+		if (exactStep)
+			batch.UpdateSimulationExact(deltaTime);
+		else
+			batch.UpdateSimulation<IntegrationScheme>(deltaTime);
+	}
+	double seconds = GetBenchmarkTime() - start;
+
+	double bobSteps = static_cast<double>(pendulums.GetNumOfPendulums()) * steps;
+	printf("%-18s %8.4f %12.3f %14.3g %14.3g\n", name, deltaTime, seconds, 1e9 * seconds / bobSteps, exact.ComputeLargestError(batch));
+}
+
+
+// Measures every scheme at several time steps: the wall time to reach the end of the run, the
+// cost per bob step and the largest distance from the closed form of AnalyticPendulum.
+// Schemes of higher order reach the same error with larger steps, which pays for their cost.
+// The exact propagator shows the floor the rounding of the float positions sets, it grows with
+// the number of steps.
+void RunSchemeAccuracyBenchmark(const BenchmarkOptions& options)
+{
+	int count = ScaleSize(options, 100000, 1000);
+	PendulumSet pendulums(count);
+	ExactPositions exact(pendulums, count < NumOfSchemeSamples ? count : NumOfSchemeSamples);
+
+	printf("%d pendulums for %g s, error of %d of them against AnalyticPendulum\n", count, SchemeDuration,
+		count < NumOfSchemeSamples ? count : NumOfSchemeSamples);
+	printf("%-18s %8s %12s %14s %14s\n", "scheme", "dt", "seconds", "ns/bob-step", "largest error");
+	const float deltaTimes[] = {1.0f / 30.0f, 1.0f / 60.0f, 1.0f / 120.0f, 1.0f / 240.0f, 1.0f / 480.0f};
+	for(float deltaTime : deltaTimes)
+	{
+		RunScheme<ExplicitEulerScheme>("explicit Euler", pendulums, exact, deltaTime, false);
+		RunScheme<SymplecticEulerScheme>("symplectic Euler", pendulums, exact, deltaTime, false);
+		RunScheme<VelocityVerletScheme>("velocity Verlet", pendulums, exact, deltaTime, false);
+		RunScheme<RungeKutta4Scheme>("Runge-Kutta 4", pendulums, exact, deltaTime, false);
+		RunScheme<ExplicitEulerScheme>("exact propagator", pendulums, exact, deltaTime, true);
+	}
+}
@@ -0,0 +1,211 @@
+#include "Benchmark.h"
+#include "PendulumPhysics.h"
+#include "SpringNetwork.h"
+#include "WorkStealingPool.h"
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+
+
+// The time step of the spring network benchmarks.
+static const float SpringDeltaTime = 1.0f / 120.0f;
+
+
+// The length of a link when the chains are created.
+static const float ChainLinkLength = sqrtf(0.5f * 0.5f + 1.0f);
+
+
+// Creates chains of the indicated length hanging from fixed nodes side by side. The links start
+// displaced sideways, so all of them swing. With a rest length of 0 the springs pull the links
+// together, with ChainLinkLength they start relaxed.
+static std::unique_ptr<SpringNetwork> CreateChains(int numOfChains, int numOfLinks, float springConstant, float restLength = 0.0f)
+{
+	std::unique_ptr<SpringNetwork> network(new SpringNetwork(numOfChains * (numOfLinks + 1), numOfChains * numOfLinks));
+	for(int chain = 0; chain < numOfChains; ++chain)
+	{
+		float anchorPoint[3] = {static_cast<float>(chain % 100) * 10.0f, 0.0f, static_cast<float>(chain / 100) * 10.0f};
+		int previous = network->AddNode(anchorPoint, 0.0f);
+		for(int link = 0; link < numOfLinks; ++link)
+		{
+			float position[3] = {anchorPoint[0] + 0.5f * (link + 1), anchorPoint[1] - 1.0f * (link + 1), anchorPoint[2]};
+			int node = network->AddNode(position, PendulumPhysics::invMass);
+			network->AddSpring(previous, node, springConstant, PendulumPhysics::dampingVelocity, restLength);
+			previous = node;
+		}
+	}
+	return network;
+}
+
+
+// Steps a network of more than a million springs with the explicit Step, on the calling
+// thread and on the thread pool, and prints the springs and nodes advanced per second.
+void RunSpringThroughputBenchmark(const BenchmarkOptions& options)
+{
+	const int numOfLinks = 100;
+	int numOfChains = ScaleSize(options, 10000, 10);
+	const int steps = 10;
+	std::unique_ptr<SpringNetwork> network = CreateChains(numOfChains, numOfLinks, PendulumPhysics::springConstant);
+	// The first step builds the adjacency, it is not part of the measurement.
+	network->Step(SpringDeltaTime, 1);
+
+	WorkStealingPool pool(options.m_maxThreads);
+	double springSteps = static_cast<double>(network->GetNumOfSprings()) * steps;
+	double nodeSteps = static_cast<double>(network->GetNumOfNodes()) * steps;
+	printf("%d chains of %d links: %d nodes, %d springs, %d steps\n", numOfChains, numOfLinks, network->GetNumOfNodes(), network->GetNumOfSprings(), steps);
+	printf("%-24s %16s %16s\n", "threads", "spring-steps/s", "node-steps/s");
+
+	double seconds = MeasureFastestRun(3, [&] { network->Step(SpringDeltaTime, steps); });
+	printf("%-24s %16.3g %16.3g\n", "calling thread", springSteps / seconds, nodeSteps / seconds);
+
+	network->SetThreadPool(&pool);
+	seconds = MeasureFastestRun(3, [&] { network->Step(SpringDeltaTime, steps); });
+	char threads[32];
+	snprintf(threads, sizeof(threads), "pool of %d", pool.GetNumOfThreads());
+	printf("%-24s %16.3g %16.3g\n", threads, springSteps / seconds, nodeSteps / seconds);
+}
+
+
+// The simulated time the implicit and the explicit step race to.
+static const double StiffDuration = 60.0;
+// The spring constant of the stiff chains. The explicit Euler step only damps the oscillations
+// for time steps below the damping velocity over the spring constant, here 2.5e-4 s.
+static const float StiffSpringConstant = 200.0f;
+
+
+// Gets the largest distance of a node from the same node of the reference.
+// A diverged network gives the largest float.
+static float ComputeLargestDistance(SpringNetwork& network, SpringNetwork& reference)
+{
+	float largest = 0.0f;
+	for(int node = 0; node < network.GetNumOfNodes(); ++node)
+	{
+		float position[3];
+		float referencePosition[3];
+		network.ObtainNodePosition(node, position);
+		reference.ObtainNodePosition(node, referencePosition);
+		float squaredDistance = 0.0f;
+		for(int axis = 0; axis < 3; ++axis)
+			squaredDistance += (position[axis] - referencePosition[axis]) * (position[axis] - referencePosition[axis]);
+		if (!(squaredDistance <= largest * largest))
+			largest = squaredDistance < 3.4e38f ? sqrtf(squaredDistance) : 3.4e38f;
+	}
+	return largest;
+}
+
+
+// Runs stiff chains to 60 s of simulated time: the explicit Step at the frame step, where
+// it blows up, and at the small step it needs to stay stable, against StepImplicit at the frame step.
+// Prints the wall time, the conjugate gradient iterations per implicit step and the largest
+// distance from the stable explicit run.
+void RunImplicitSpringBenchmark(const BenchmarkOptions& options)
+{
+	const int numOfLinks = 50;
+	int numOfChains = ScaleSize(options, 20, 1);
+	const int explicitSubsteps = 64;
+	int frames = static_cast<int>(StiffDuration / SpringDeltaTime + 0.5);
+
+	std::unique_ptr<SpringNetwork> reference = CreateChains(numOfChains, numOfLinks, StiffSpringConstant);
+	double start = GetBenchmarkTime();
+	reference->Step(SpringDeltaTime / explicitSubsteps, frames * explicitSubsteps);
+	double explicitSeconds = GetBenchmarkTime() - start;
+
+	std::unique_ptr<SpringNetwork> unstable = CreateChains(numOfChains, numOfLinks, StiffSpringConstant);
+	start = GetBenchmarkTime();
+	unstable->Step(SpringDeltaTime, frames);
+	double unstableSeconds = GetBenchmarkTime() - start;
+
+	std::unique_ptr<SpringNetwork> implicit = CreateChains(numOfChains, numOfLinks, StiffSpringConstant);
+	long long solverIterations = 0;
+	start = GetBenchmarkTime();
+	for(int frame = 0; frame < frames; ++frame)
+	{
+		implicit->StepImplicit(SpringDeltaTime, 1);
+		solverIterations += implicit->GetNumOfSolverIterations();
+	}
+	double implicitSeconds = GetBenchmarkTime() - start;
+
+	printf("%d chains of %d links with spring constant %g, %g s simulated\n", numOfChains, numOfLinks, StiffSpringConstant, StiffDuration);
+	printf("%-28s %10s %10s %12s %14s\n", "step", "dt", "seconds", "CG/step", "distance");
+	printf("%-28s %10.3g %10.3f %12s %14.3g\n", "Step", SpringDeltaTime, unstableSeconds, "-", ComputeLargestDistance(*unstable, *reference));
+	printf("%-28s %10.3g %10.3f %12s %14s\n", "Step, stable reference", SpringDeltaTime / explicitSubsteps, explicitSeconds, "-", "0");
+	printf("%-28s %10.3g %10.3f %12.1f %14.3g\n", "StepImplicit", SpringDeltaTime, implicitSeconds,
+		static_cast<double>(solverIterations) / frames, ComputeLargestDistance(*implicit, *reference));
+	printf("StepImplicit reaches %g s %.1f times faster than the stable Step\n", StiffDuration, explicitSeconds / implicitSeconds);
+}
+
+
+// The spring constant of the XPBD benchmark. The compliance per substep stays far below the
+// inverse masses up to 16 substeps, so the relaxed links are nearly rigid and the Gauss-Seidel
+// iterations need many passes to carry a correction along a chain.
+static const float XpbdSpringConstant = 1e8f;
+// The iterations of the converged solve every setting is compared with.
+static const int XpbdReferenceIterations = 4096;
+
+
+// Gets the largest stretch of a link relative to its rest length, the residual of the constraints.
+static float ComputeLargestStretch(SpringNetwork& network, int numOfLinks)
+{
+	float largest = 0.0f;
+	for(int node = 0; node < network.GetNumOfNodes(); ++node)
+	{
+		if (node % (numOfLinks + 1) == 0)
+			continue;
+		float position[3];
+		float previousPosition[3];
+		network.ObtainNodePosition(node, position);
+		network.ObtainNodePosition(node - 1, previousPosition);
+		float squaredLength = 0.0f;
+		for(int axis = 0; axis < 3; ++axis)
+			squaredLength += (position[axis] - previousPosition[axis]) * (position[axis] - previousPosition[axis]);
+		float stretch = fabsf(sqrtf(squaredLength) - ChainLinkLength) / ChainLinkLength;
+		largest = stretch > largest ? stretch : largest;
+	}
+	return largest;
+}
+
+
+// Steps chains of nearly rigid links with StepXpbd over a grid of constraint iterations and
+// substeps. After the first frame the error is the largest distance from a solve with the same
+// substeps and XpbdReferenceIterations iterations, and the stretch is the largest of the links,
+// the residual of the constraints. The time per frame is taken over the following frames.
+// Prints the digits of stretch the iterations remove per millisecond of frame time, against a
+// single iteration with the same substeps.
+void RunXpbdConvergenceBenchmark(const BenchmarkOptions& options)
+{
+	const int numOfLinks = 20;
+	int numOfChains = ScaleSize(options, 20, 1);
+	const int frames = 30;
+
+	printf("%d chains of %d links with spring constant %g, %d frames, reference with %d iterations\n",
+		numOfChains, numOfLinks, XpbdSpringConstant, frames, XpbdReferenceIterations);
+	printf("%10s %10s %12s %14s %14s %14s\n", "substeps", "iterations", "ms/frame", "distance", "stretch", "digits/ms");
+	const int substepSettings[] = {1, 2, 4, 8, 16};
+	const int iterationSettings[] = {1, 2, 4, 8, 16, 32, 64, 128, 256};
+	for(int substeps : substepSettings)
+	{
+		std::unique_ptr<SpringNetwork> reference = CreateChains(numOfChains, numOfLinks, XpbdSpringConstant, ChainLinkLength);
+		reference->SetXpbdIterations(XpbdReferenceIterations);
+		reference->SetXpbdSubsteps(substeps);
+		reference->StepXpbd(SpringDeltaTime, 1);
+
+		float baseStretch = 0.0f;
+		for(int iterations : iterationSettings)
+		{
+			std::unique_ptr<SpringNetwork> network = CreateChains(numOfChains, numOfLinks, XpbdSpringConstant, ChainLinkLength);
+			network->SetXpbdIterations(iterations);
+			network->SetXpbdSubsteps(substeps);
+			network->StepXpbd(SpringDeltaTime, 1);
+			double error = ComputeLargestDistance(*network, *reference);
+			float stretch = ComputeLargestStretch(*network, numOfLinks);
+
+			double start = GetBenchmarkTime();
+			network->StepXpbd(SpringDeltaTime, frames);
+			double milliseconds = 1000.0 * (GetBenchmarkTime() - start) / frames;
+
+			if (iterations == 1)
+				baseStretch = stretch;
+			double digitsPerMillisecond = stretch > 0.0f ? log10(baseStretch / stretch) / milliseconds : 0.0;
+			printf("%10d %10d %12.4f %14.3g %14.3g %14.3g\n", substeps, iterations, milliseconds, error, stretch, digitsPerMillisecond);
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#include "Test.h"
+#include "AnalyticPendulum.h"
+#include <math.h>
+
+
+// An over damped pendulum seeked far into the future rests at its equilibrium, and at short
+// times the transition still matches the textbook form with cosh and sinh.
+bool TestOverdampedSeek()
+{
+	bool passed = true;
+	// beta = 5 and omega0 = 1, cosh and sinh of omega * t alone overflow from about 145 s on.
+	PendulumParameters parameters;
+	parameters.m_invMass = 1.0f;
+	parameters.m_springConstant = 1.0f;
+	parameters.m_dampingVelocity = 10.0f;
+
+	double beta = 0.5 * parameters.m_invMass * parameters.m_dampingVelocity;
+	double omegaSquared = parameters.m_invMass * parameters.m_springConstant;
+	double omega = sqrt(beta * beta - omegaSquared);
+	const double time = 5.0;
+	double decay = exp(-beta * time);
+	double reference[4] =
+	{
+		decay * (cosh(omega * time) + beta / omega * sinh(omega * time)),
+		decay * (sinh(omega * time) / omega),
+		decay * (-omegaSquared / omega * sinh(omega * time)),
+		decay * (cosh(omega * time) - beta / omega * sinh(omega * time))
+	};
+	double transition[4];
+	AnalyticPendulum::ComputeStateTransition(parameters, time, transition);
+	for(int element = 0; element < 4; ++element)
+	{
+		passed &= CheckTest(fabs(transition[element] - reference[element]) <= 1e-12 * fabs(reference[element]),
+			"transition element %d is %.17g instead of %.17g", element, transition[element], reference[element]);
+	}
+
+	const double seekTimes[] = {200.0, 3600.0};
+	for(double seekTime : seekTimes)
+	{
+		float anchorPoint[3] = {10.0f, 20.0f, -30.0f};
+		AnalyticPendulum pendulum(anchorPoint, parameters);
+		float start[3] = {13.0f, 15.0f, -28.0f};
+		pendulum.SetPendulumPosition(start);
+		passed &= CheckTest(pendulum.SeekTo(seekTime), "the pendulum could not seek to %g s", seekTime);
+
+		float position[3], velocity[3];
+		pendulum.ObtainCurrentPosition(position);
+		pendulum.ObtainCurrentVelocity(velocity);
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			double gravity = axis == 1 ? parameters.m_earthAcceleration : 0.0;
+			double equilibrium = AnalyticPendulum::ComputeEquilibrium(parameters, anchorPoint[axis], gravity);
+			passed &= CheckTest(isfinite(position[axis]) && isfinite(velocity[axis]), "axis %d is not finite at %g s", axis, seekTime);
+			passed &= CheckTest(fabs(position[axis] - equilibrium) < 1e-4 && fabs(velocity[axis]) < 1e-4,
+				"axis %d is at %g with velocity %g at %g s instead of resting at %g", axis, position[axis], velocity[axis], seekTime, equilibrium);
+		}
+	}
+	return passed;
+}
@@ -0,0 +1,97 @@
+#include "Test.h"
+#include "SweepAndPrune.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+static const int BroadphaseTestCount = 3000;
+static const float BroadphaseTestDistance = 2.0f;
+
+
+// Finds the pairs closer than the distance by comparing every item with every other.
+static void FindPairsBruteForce(const std::vector<float> position[3], std::vector<CollisionPair>& pairs)
+{
+	pairs.clear();
+	int count = static_cast<int>(position[0].size());
+	for(int first = 0; first < count; ++first)
+	{
+		for(int second = first + 1; second < count; ++second)
+		{
+			float squaredDistance = 0.0f;
+			for(int axis = 0; axis < 3; ++axis)
+				squaredDistance += (position[axis][second] - position[axis][first]) * (position[axis][second] - position[axis][first]);
+			if (squaredDistance < BroadphaseTestDistance * BroadphaseTestDistance)
+			{
+				CollisionPair pair = {first, second};
+				pairs.push_back(pair);
+			}
+		}
+	}
+}
+
+
+// Checks that sweep and prune finds the same pairs as the brute force search.
+static bool CheckSweepAndPrunePairs(SweepAndPrune& sweepAndPrune, const std::vector<float> position[3], const char* name)
+{
+	const float* columns[3] = {position[0].data(), position[1].data(), position[2].data()};
+	std::vector<CollisionPair> pairs, expected;
+	sweepAndPrune.FindPairs(BroadphaseTestCount, columns, BroadphaseTestDistance, pairs);
+	FindPairsBruteForce(position, expected);
+
+	auto less = [](const CollisionPair& first, const CollisionPair& second)
+	{
+		return first.m_first < second.m_first || (first.m_first == second.m_first && first.m_second < second.m_second);
+	};
+	std::sort(pairs.begin(), pairs.end(), less);
+	bool same = pairs.size() == expected.size();
+	for(size_t pair = 0; same && pair < pairs.size(); ++pair)
+		same = pairs[pair].m_first == expected[pair].m_first && pairs[pair].m_second == expected[pair].m_second;
+	return CheckTest(same, "%s: %zu pairs instead of %zu", name, pairs.size(), expected.size());
+}
+
+
+// Sweep and prune gives up repairing an order that was turned around and sorts from scratch,
+// and picks the axis again when the items spread along another one.
+bool TestSweepAndPruneReorder()
+{
+	bool passed = true;
+	std::mt19937 generator(17);
+	std::uniform_real_distribution<float> longDistribution(0.0f, 1000.0f);
+	std::uniform_real_distribution<float> shortDistribution(0.0f, 10.0f);
+	std::vector<float> position[3];
+	for(int axis = 0; axis < 3; ++axis)
+		position[axis].resize(BroadphaseTestCount);
+	for(int i = 0; i < BroadphaseTestCount; ++i)
+	{
+		position[0][i] = longDistribution(generator);
+		position[1][i] = shortDistribution(generator);
+		position[2][i] = shortDistribution(generator);
+	}
+
+	SweepAndPrune sweepAndPrune;
+	passed &= CheckSweepAndPrunePairs(sweepAndPrune, position, "first call");
+	passed &= CheckTest(sweepAndPrune.GetSortAxis() == 0, "sorted along axis %d instead of 0", sweepAndPrune.GetSortAxis());
+
+	// The mirrored row takes n^2 / 2 swaps to repair, the repair gives up at about n log n.
+	for(int i = 0; i < BroadphaseTestCount; ++i)
+		position[0][i] = 1000.0f - position[0][i];
+	int numOfRebuilds = sweepAndPrune.GetNumOfRebuilds();
+	passed &= CheckSweepAndPrunePairs(sweepAndPrune, position, "mirrored");
+	passed &= CheckTest(sweepAndPrune.GetNumOfRebuilds() == numOfRebuilds + 1, "the mirrored row was not sorted from scratch");
+	// The budget is n (log2 n + 1) swaps, the insertion it gives up in adds at most n more.
+	passed &= CheckTest(sweepAndPrune.GetNumOfSwaps() <= 13LL * BroadphaseTestCount, "the repair took %lld swaps before it gave up", sweepAndPrune.GetNumOfSwaps());
+
+	// The row turns into the z axis, which then separates the items best.
+	position[0].swap(position[2]);
+	passed &= CheckSweepAndPrunePairs(sweepAndPrune, position, "turned");
+	passed &= CheckTest(sweepAndPrune.GetSortAxis() == 2, "sorted along axis %d instead of 2", sweepAndPrune.GetSortAxis());
+
+	// A small motion is repaired in place.
+	for(int i = 0; i < BroadphaseTestCount; ++i)
+		position[2][i] += 0.01f * shortDistribution(generator);
+	numOfRebuilds = sweepAndPrune.GetNumOfRebuilds();
+	passed &= CheckSweepAndPrunePairs(sweepAndPrune, position, "moved");
+	passed &= CheckTest(sweepAndPrune.GetNumOfRebuilds() == numOfRebuilds, "a small motion was sorted from scratch");
+	return passed;
+}
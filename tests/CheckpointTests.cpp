@@ -0,0 +1,111 @@
+#include "Test.h"
+#include "PendulumBatch.h"
+#include "PendulumCheckpoint.h"
+#include "PendulumPhysics.h"
+#include <random>
+#include <stdio.h>
+
+
+static const char* const CheckpointTestFile = "CheckpointTest.checkpoint";
+static const int CheckpointTestCount = 3 * PendulumChunkSize + 11;
+static const float CheckpointDeltaTime = 1.0f / 120.0f;
+
+
+// Fills a batch with random pendulums, some with their own parameters, and lets them sleep,
+// so the checkpoint has parameter columns and slots out of order.
+static void CreateCheckpointPendulums(PendulumBatch& batch)
+{
+	std::mt19937 generator(13);
+	std::uniform_real_distribution<float> anchorDistribution(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> displacementDistribution(-3.0f, 3.0f);
+	for(int i = 0; i < CheckpointTestCount; ++i)
+	{
+		float anchorPoint[3];
+		for(int axis = 0; axis < 3; ++axis)
+			anchorPoint[axis] = anchorDistribution(generator);
+		batch.AddPendulum(anchorPoint);
+
+		// Every fourth pendulum starts at its equilibrium and soon falls asleep.
+		const float equilibriumOffset = PendulumPhysics::earthAcceleration / (PendulumPhysics::invMass * PendulumPhysics::springConstant);
+		float position[3] = {anchorPoint[0], anchorPoint[1] + equilibriumOffset, anchorPoint[2]};
+		if (i % 4 != 0)
+		{
+			for(int axis = 0; axis < 3; ++axis)
+				position[axis] = anchorPoint[axis] + displacementDistribution(generator);
+		}
+		batch.SetPendulumPosition(i, position);
+
+		if (i % 7 == 0)
+		{
+			PendulumParameters parameters;
+			parameters.m_dampingVelocity = 0.1f;
+			batch.SetPendulumParameters(i, parameters);
+		}
+	}
+	batch.EnableSleeping(0.05f, 0.05f, 10);
+}
+
+
+// The state hash of a restored batch equals the hash before the save, with and without the
+// verification of the checksum, and both batches go on in the same bits. A damaged file is
+// rejected and leaves the state alone.
+bool TestCheckpointRoundTrip()
+{
+	bool passed = true;
+	{
+		PendulumBatch batch(CheckpointTestCount);
+		CreateCheckpointPendulums(batch);
+		batch.Step(CheckpointDeltaTime, 30);
+		passed &= CheckTest(batch.GetNumOfActivePendulums() < CheckpointTestCount, "no pendulum fell asleep");
+
+		// The noise wakes the sleepers but leaves them in their slots. It goes on after a restore
+		// in the same bits only if its seed and the step count came along.
+		batch.EnableNoise(0.01f, 5);
+		batch.Step(CheckpointDeltaTime, 5);
+		unsigned long long savedHash = batch.ComputeStateHash();
+		if (!CheckTest(batch.SaveCheckpoint(CheckpointTestFile), "the checkpoint could not be written"))
+			return false;
+
+		for(int verify = 0; verify < 2; ++verify)
+		{
+			PendulumBatch restored(1);
+			if (!CheckTest(restored.RestoreCheckpoint(CheckpointTestFile, verify != 0), "the checkpoint could not be restored"))
+				return false;
+			unsigned long long restoredHash = restored.ComputeStateHash();
+			passed &= CheckTest(restoredHash == savedHash, "restored hash %016llx, saved %016llx%s", restoredHash, savedHash, verify ? " with verification" : "");
+			passed &= CheckTest(restored.GetNumberOfPendulums() == CheckpointTestCount && restored.GetNumOfActivePendulums() == batch.GetNumOfActivePendulums(),
+				"restored %d pendulums, %d active, saved %d, %d active", restored.GetNumberOfPendulums(), restored.GetNumOfActivePendulums(),
+				CheckpointTestCount, batch.GetNumOfActivePendulums());
+			passed &= CheckTest(restored.GetStepCount() == batch.GetStepCount(), "restored step count %llu, saved %llu", restored.GetStepCount(), batch.GetStepCount());
+		}
+
+		// Both go on from the same state with the same settings.
+		PendulumBatch restored(1);
+		restored.RestoreCheckpoint(CheckpointTestFile, true);
+		batch.Step(CheckpointDeltaTime, 30);
+		restored.Step(CheckpointDeltaTime, 30);
+		passed &= CheckTest(restored.ComputeStateHash() == batch.ComputeStateHash(), "the restored batch went on differently");
+	}
+
+	// A flipped byte in the first column fails the checksum, the end of the file is only padding.
+	FILE* file = fopen(CheckpointTestFile, "r+b");
+	if (CheckTest(file != NULL, "the checkpoint could not be opened"))
+	{
+		const long columnByte = static_cast<long>(CheckpointAlignment) + 5;
+		fseek(file, columnByte, SEEK_SET);
+		int value = fgetc(file);
+		fseek(file, columnByte, SEEK_SET);
+		fputc(value ^ 0x10, file);
+		fclose(file);
+
+		PendulumBatch untouched(1);
+		float anchorPoint[3] = {1.0f, 2.0f, 3.0f};
+		untouched.AddPendulum(anchorPoint);
+		unsigned long long untouchedHash = untouched.ComputeStateHash();
+		passed &= CheckTest(!untouched.RestoreCheckpoint(CheckpointTestFile, true), "a damaged checkpoint was restored");
+		passed &= CheckTest(untouched.ComputeStateHash() == untouchedHash && untouched.GetNumberOfPendulums() == 1, "a failed restore changed the state");
+	}
+
+	remove(CheckpointTestFile);
+	return passed;
+}
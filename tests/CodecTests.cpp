@@ -0,0 +1,147 @@
+#include "Test.h"
+#include "TrajectoryCodec.h"
+#include <math.h>
+#include <random>
+#include <string.h>
+#include <vector>
+
+
+// The random columns the round trip test encodes.
+static const int CodecTestCases = 600;
+
+
+// The distance from the magnitude of the sample to the next larger float.
+static float GetUlp(float sample)
+{
+	float magnitude = fabsf(sample);
+	return nextafterf(magnitude, INFINITY) - magnitude;
+}
+
+
+// Fills a column with swinging samples of random amplitude, some pendulums at rest and a few
+// outliers that need more bits than the rest of their group. A few cases get a sample the
+// quantization can not represent, so the floats are stored as they are.
+static void CreateCodecColumn(std::mt19937& generator, int numOfFrames, int numOfPendulums, std::vector<float>& column)
+{
+	std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+	std::vector<float> amplitude(numOfPendulums), offset(numOfPendulums), frequency(numOfPendulums), phase(numOfPendulums);
+	for(int i = 0; i < numOfPendulums; ++i)
+	{
+		bool resting = unitDistribution(generator) < 0.2f;
+		amplitude[i] = resting ? 0.0f : powf(10.0f, -2.0f + 5.0f * unitDistribution(generator));
+		offset[i] = 1000.0f * (unitDistribution(generator) - 0.5f);
+		frequency[i] = 0.5f * unitDistribution(generator);
+		phase[i] = 6.28f * unitDistribution(generator);
+	}
+
+	column.resize(static_cast<size_t>(numOfFrames) * numOfPendulums);
+	for(int frame = 0; frame < numOfFrames; ++frame)
+	{
+		for(int i = 0; i < numOfPendulums; ++i)
+		{
+			float sample = offset[i] + amplitude[i] * sinf(frequency[i] * frame + phase[i]);
+			if (unitDistribution(generator) < 0.01f)
+				sample += 1000.0f * (unitDistribution(generator) - 0.5f);
+			column[static_cast<size_t>(frame) * numOfPendulums + i] = sample;
+		}
+	}
+
+	float special = unitDistribution(generator);
+	size_t sample = static_cast<size_t>(unitDistribution(generator) * (column.size() - 1));
+	if (special < 0.03f)
+		column[sample] = NAN;
+	else if (special < 0.06f)
+		column[sample] = 1e30f;
+}
+
+
+// Every decoded sample is within the bound plus two units in the last place of the original, or
+// the same bits if the floats were stored as they are. Truncated columns are rejected. The cases
+// have to cover the raw floats, many widths of the groups and groups with exceptions.
+bool TestCodecRoundTrip()
+{
+	bool passed = true;
+	std::mt19937 generator(11);
+	std::uniform_int_distribution<int> frameDistribution(1, 40);
+	std::uniform_int_distribution<int> pendulumDistribution(1, 700);
+	std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+
+	TrajectoryCodec codec;
+	std::vector<float> column, decoded;
+	// Words, so the output is aligned to four bytes.
+	std::vector<unsigned int> encoded, truncated;
+	int numOfRawCases = 0;
+	int numOfCasesWithExceptions = 0;
+	bool widthUsed[33] = {false};
+	for(int testCase = 0; testCase < CodecTestCases && passed; ++testCase)
+	{
+		int numOfFrames = frameDistribution(generator);
+		int numOfPendulums = pendulumDistribution(generator);
+		CreateCodecColumn(generator, numOfFrames, numOfPendulums, column);
+		float errorBound = testCase % 25 == 0 ? 0.0f : powf(10.0f, -6.0f + 5.0f * unitDistribution(generator));
+
+		encoded.assign(TrajectoryCodec::GetMaxEncodedBytes(numOfFrames, numOfPendulums) / sizeof(unsigned int) + 1, 0);
+		unsigned char* output = reinterpret_cast<unsigned char*>(encoded.data());
+		size_t bytes = codec.EncodeColumn(column.data(), numOfFrames, numOfPendulums, errorBound, output);
+		passed &= CheckTest(bytes <= TrajectoryCodec::GetMaxEncodedBytes(numOfFrames, numOfPendulums), "case %d: %zu bytes are more than the most", testCase, bytes);
+
+		decoded.assign(column.size(), 0.0f);
+		if (!CheckTest(codec.DecodeColumn(output, bytes, numOfFrames, numOfPendulums, errorBound, decoded.data()),
+			"case %d: %d frames of %d pendulums at %g could not be decoded", testCase, numOfFrames, numOfPendulums, errorBound))
+			return false;
+
+		const EncodedColumnHeader* header = reinterpret_cast<const EncodedColumnHeader*>(output);
+		if (header->m_predictor == PredictorRaw)
+		{
+			++numOfRawCases;
+			passed &= CheckTest(memcmp(column.data(), decoded.data(), sizeof(float) * column.size()) == 0, "case %d: the raw floats changed", testCase);
+		}
+		else
+		{
+			for(size_t sample = 0; sample < column.size() && passed; ++sample)
+			{
+				float error = fabsf(decoded[sample] - column[sample]);
+				passed &= CheckTest(error <= errorBound + 2.0f * GetUlp(column[sample]), "case %d: sample %zu decoded to %.9g instead of %.9g at %g",
+					testCase, sample, decoded[sample], column[sample], errorBound);
+			}
+
+			// The widths of the groups and then their numbers of exceptions follow the header.
+			size_t numOfGroups = (column.size() + CodecGroupSize - 1) / CodecGroupSize;
+			const unsigned char* widths = output + sizeof(EncodedColumnHeader);
+			const unsigned char* exceptionCounts = widths + (numOfGroups + 3) / 4 * 4;
+			bool exceptions = false;
+			for(size_t group = 0; group < numOfGroups; ++group)
+			{
+				widthUsed[widths[group] <= 32 ? widths[group] : 0] = true;
+				exceptions = exceptions || exceptionCounts[group] > 0;
+			}
+			if (exceptions)
+				++numOfCasesWithExceptions;
+		}
+
+		// A column cut short is rejected, whether the header still gives the full size or was
+		// changed to the size of the cut.
+		const size_t cuts[] = {bytes - sizeof(unsigned int), bytes / 2, sizeof(EncodedColumnHeader), 0};
+		for(size_t cut : cuts)
+		{
+			if (cut >= bytes)
+				continue;
+			passed &= CheckTest(!codec.DecodeColumn(output, cut, numOfFrames, numOfPendulums, errorBound, decoded.data()),
+				"case %d: a column cut to %zu of %zu bytes was decoded", testCase, cut, bytes);
+			if (cut < sizeof(EncodedColumnHeader))
+				continue;
+			truncated.assign(encoded.begin(), encoded.begin() + (cut + sizeof(unsigned int) - 1) / sizeof(unsigned int));
+			reinterpret_cast<EncodedColumnHeader*>(truncated.data())->m_bytes = static_cast<unsigned int>(cut);
+			passed &= CheckTest(!codec.DecodeColumn(reinterpret_cast<const unsigned char*>(truncated.data()), cut, numOfFrames, numOfPendulums, errorBound, decoded.data()),
+				"case %d: a column cut to %zu of %zu bytes with a matching header was decoded", testCase, cut, bytes);
+		}
+	}
+
+	int numOfWidths = 0;
+	for(int width = 0; width <= 32; ++width)
+		numOfWidths += widthUsed[width] ? 1 : 0;
+	passed &= CheckTest(numOfRawCases > 0, "no case stored the raw floats");
+	passed &= CheckTest(numOfCasesWithExceptions > 0, "no case packed exceptions");
+	passed &= CheckTest(numOfWidths >= 8, "the groups took only %d widths", numOfWidths);
+	return passed;
+}
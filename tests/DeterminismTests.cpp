@@ -0,0 +1,115 @@
+#include "Test.h"
+#include "PendulumBatch.h"
+#include "PendulumKernels.h"
+#include "WorkStealingPool.h"
+#include <random>
+#include <stdio.h>
+
+
+// Several chunks and a partial one, so the pool has work to distribute.
+static const int DeterminismTestCount = 5 * PendulumChunkSize + 37;
+static const int DeterminismTestSteps = 30;
+static const float DeterminismDeltaTime = 1.0f / 120.0f;
+
+static const char* const SimdLevelNames[] = {"scalar", "SSE", "AVX2", "AVX-512"};
+
+
+// The ways the batch is advanced, each gets its own reference hash.
+enum DeterminismPath
+{
+	DeterminismPathStep,
+	DeterminismPathUpdate,
+	DeterminismPathExact,
+	NumOfDeterminismPaths
+};
+
+static const char* const DeterminismPathNames[] = {"Step", "UpdateSimulation", "UpdateSimulationExact"};
+
+
+// Runs the same random pendulums along the path and returns the hash of the final state.
+static unsigned long long ComputeFinalHash(DeterminismPath path, bool noise, WorkStealingPool* pool)
+{
+	PendulumBatch batch(DeterminismTestCount);
+	std::mt19937 generator(3);
+	std::uniform_real_distribution<float> anchorDistribution(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> displacementDistribution(-3.0f, 3.0f);
+	for(int i = 0; i < DeterminismTestCount; ++i)
+	{
+		float anchorPoint[3];
+		float position[3];
+		for(int axis = 0; axis < 3; ++axis)
+			anchorPoint[axis] = anchorDistribution(generator);
+		for(int axis = 0; axis < 3; ++axis)
+			position[axis] = anchorPoint[axis] + displacementDistribution(generator);
+		batch.AddPendulum(anchorPoint);
+		batch.SetPendulumPosition(i, position);
+	}
+	if (noise)
+		batch.EnableNoise(1.0f, 11);
+	batch.SetThreadPool(pool);
+
+	switch (path)
+	{
+	case DeterminismPathStep:
+		// Uneven calls, so the hash does not depend on how the steps are grouped either.
+		batch.Step(DeterminismDeltaTime, DeterminismTestSteps / 3);
+		batch.Step(DeterminismDeltaTime, DeterminismTestSteps - DeterminismTestSteps / 3);
+		break;
+	case DeterminismPathUpdate:
+		for(int step = 0; step < DeterminismTestSteps; ++step)
+			batch.UpdateSimulation(DeterminismDeltaTime);
+		break;
+	default:
+		for(int step = 0; step < DeterminismTestSteps; ++step)
+			batch.UpdateSimulationExact(DeterminismDeltaTime);
+		break;
+	}
+	return batch.ComputeStateHash();
+}
+
+
+// In the deterministic mode the final state hash is the same on every SIMD level the processor
+// supports and for any number of threads, with and without a pool, for the Euler and the exact
+// steps, with and without noise. The reference is the scalar level on the calling thread.
+bool TestDeterministicHashes()
+{
+	SimdLevel savedLevel = PendulumKernels::GetSimdLevel();
+	bool savedDeterministic = PendulumKernels::IsDeterministic();
+	PendulumKernels::SetDeterministic(true);
+	bool passed = true;
+
+	WorkStealingPool pool(1);
+	const int threadCounts[] = {0, 1, 2, 4};
+	for(int path = 0; path < NumOfDeterminismPaths; ++path)
+	{
+		for(int noise = 0; noise < 2; ++noise)
+		{
+			PendulumKernels::SetSimdLevel(SimdLevelScalar);
+			unsigned long long reference = ComputeFinalHash(static_cast<DeterminismPath>(path), noise != 0, NULL);
+
+			for(int level = SimdLevelScalar; level <= SimdLevelAVX512; ++level)
+			{
+				PendulumKernels::SetSimdLevel(static_cast<SimdLevel>(level));
+				if (PendulumKernels::GetSimdLevel() != level)
+				{
+					printf("  skipped %s, the processor does not support it\n", SimdLevelNames[level]);
+					continue;
+				}
+
+				for(int numOfThreads : threadCounts)
+				{
+					// 0 threads runs without a pool.
+					if (numOfThreads > 0)
+						pool.SetNumOfThreads(numOfThreads);
+					unsigned long long hash = ComputeFinalHash(static_cast<DeterminismPath>(path), noise != 0, numOfThreads > 0 ? &pool : NULL);
+					passed &= CheckTest(hash == reference, "%s%s, %s, %d threads: hash %016llx, scalar reference %016llx",
+						DeterminismPathNames[path], noise ? " with noise" : "", SimdLevelNames[level], numOfThreads, hash, reference);
+				}
+			}
+		}
+	}
+
+	PendulumKernels::SetSimdLevel(savedLevel);
+	PendulumKernels::SetDeterministic(savedDeterministic);
+	return passed;
+}
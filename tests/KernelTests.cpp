@@ -0,0 +1,188 @@
+#include "Test.h"
+#include "AlignedMemory.h"
+#include "PendulumKernels.h"
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+
+// An odd count, so every level runs its vector loop and its remainder.
+static const int KernelTestCount = 1037;
+// The steps every kernel takes. The differences to the scalar reference grow with them, so
+// a few steps keep the bound meaningful.
+static const int KernelTestSteps = 1;
+// The most units in the last place a fused multiply add kernel may be away from the scalar reference.
+static const long long KernelUlpBound = 10;
+
+static const char* const SimdLevelNames[] = {"scalar", "SSE", "AVX2", "AVX-512"};
+
+
+// Holds one axis of the test pendulums in aligned columns.
+struct KernelTestAxis
+{
+	float* m_anchor;
+	float* m_position;
+	float* m_velocity;
+	float m_moments[NumOfAxisMoments][MomentLanes];
+
+	// Fills the columns with the same random pendulums for the same seed.
+	explicit KernelTestAxis(unsigned int seed)
+	{
+		m_anchor = AllocateColumn(KernelTestCount);
+		m_position = AllocateColumn(KernelTestCount);
+		m_velocity = AllocateColumn(KernelTestCount);
+		std::mt19937 generator(seed);
+		std::uniform_real_distribution<float> anchorDistribution(10.0f, 100.0f);
+		std::uniform_real_distribution<float> offsetDistribution(-3.0f, 3.0f);
+		for(int i = 0; i < KernelTestCount; ++i)
+		{
+			// Anchors and velocities away from 0, so a few units in the last place are not lost in cancellation.
+			m_anchor[i] = i % 3 == 0 ? -anchorDistribution(generator) : anchorDistribution(generator);
+			m_position[i] = m_anchor[i] + offsetDistribution(generator);
+			float speed = 1.0f + fabsf(offsetDistribution(generator));
+			m_velocity[i] = i % 2 == 0 ? speed : -speed;
+		}
+		memset(m_moments, 0, sizeof(m_moments));
+	}
+
+	~KernelTestAxis()
+	{
+		FreeAligned(m_anchor);
+		FreeAligned(m_position);
+		FreeAligned(m_velocity);
+	}
+
+	KernelTestAxis(const KernelTestAxis&) = delete;
+	KernelTestAxis& operator=(const KernelTestAxis&) = delete;
+};
+
+
+// Gets the largest distance in units in the last place between two columns.
+static long long GetLargestUlpDistance(const float* first, const float* second, int count)
+{
+	long long largest = 0;
+	for(int i = 0; i < count; ++i)
+	{
+		long long distance = GetUlpDistance(first[i], second[i]);
+		if (distance > largest)
+			largest = distance;
+	}
+	return largest;
+}
+
+
+// Gets the largest difference between two sets of moments relative to the size of the sums.
+static double GetLargestMomentError(const float first[NumOfAxisMoments][MomentLanes], const float second[NumOfAxisMoments][MomentLanes])
+{
+	double largest = 0.0;
+	for(int moment = 0; moment < NumOfAxisMoments; ++moment)
+	{
+		for(int lane = 0; lane < MomentLanes; ++lane)
+		{
+			double error = fabs(first[moment][lane] - second[moment][lane]) / (fabs(second[moment][lane]) + 1.0);
+			if (error > largest)
+				largest = error;
+		}
+	}
+	return largest;
+}
+
+
+// Steps the axis with the Euler kernel of the current level, the moments are summed up on the last step.
+static void StepEulerAxis(KernelTestAxis& axis, float gravity, bool withMoments)
+{
+	EulerAxisKernel kernel = PendulumKernels::GetEulerAxisKernel();
+	for(int step = 0; step < KernelTestSteps; ++step)
+	{
+		bool lastStep = step == KernelTestSteps - 1;
+		kernel(KernelTestCount, gravity, 1.0f / 120.0f, axis.m_anchor, axis.m_position, axis.m_velocity, withMoments && lastStep ? axis.m_moments : NULL);
+	}
+}
+
+
+// Steps the axis with the propagator kernel of the current level, the moments are summed up on the last step.
+static void StepPropagatorAxis(KernelTestAxis& axis, float gravity, bool withMoments)
+{
+	// The exact transition of an oscillator with the angular frequency 2 over 1/120 s.
+	const float angle = 2.0f / 120.0f;
+	const float transition[4] = {cosf(angle), sinf(angle) / 2.0f, -2.0f * sinf(angle), cosf(angle)};
+	PropagatorAxisKernel kernel = PendulumKernels::GetPropagatorAxisKernel();
+	for(int step = 0; step < KernelTestSteps; ++step)
+	{
+		bool lastStep = step == KernelTestSteps - 1;
+		kernel(KernelTestCount, transition, gravity / 4.0f, axis.m_anchor, axis.m_position, axis.m_velocity, withMoments && lastStep ? axis.m_moments : NULL);
+	}
+}
+
+
+// Runs the stepping on every level the processor supports and compares it with the scalar
+// reference: in the deterministic mode bit for bit, else within the bound of units in the last place.
+static bool TestKernelLevels(void (*stepAxis)(KernelTestAxis& axis, float gravity, bool withMoments))
+{
+	SimdLevel savedLevel = PendulumKernels::GetSimdLevel();
+	bool savedDeterministic = PendulumKernels::IsDeterministic();
+	bool passed = true;
+
+	const float gravities[] = {0.0f, -9.81f};
+	for(int deterministic = 0; deterministic < 2; ++deterministic)
+	{
+		PendulumKernels::SetDeterministic(deterministic != 0);
+		long long bound = deterministic ? 0 : KernelUlpBound;
+		for(float gravity : gravities)
+		{
+			for(int withMoments = 0; withMoments < 2; ++withMoments)
+			{
+				KernelTestAxis reference(7);
+				PendulumKernels::SetSimdLevel(SimdLevelScalar);
+				stepAxis(reference, gravity, withMoments != 0);
+
+				for(int level = SimdLevelSSE; level <= SimdLevelAVX512; ++level)
+				{
+					PendulumKernels::SetSimdLevel(static_cast<SimdLevel>(level));
+					if (PendulumKernels::GetSimdLevel() != level)
+					{
+						printf("  skipped %s, the processor does not support it\n", SimdLevelNames[level]);
+						continue;
+					}
+
+					KernelTestAxis axis(7);
+					stepAxis(axis, gravity, withMoments != 0);
+					long long positionUlps = GetLargestUlpDistance(axis.m_position, reference.m_position, KernelTestCount);
+					long long velocityUlps = GetLargestUlpDistance(axis.m_velocity, reference.m_velocity, KernelTestCount);
+					passed &= CheckTest(positionUlps <= bound && velocityUlps <= bound,
+						"%s%s, gravity %g: position %lld and velocity %lld ulps from scalar, bound %lld",
+						SimdLevelNames[level], deterministic ? " deterministic" : "", gravity, positionUlps, velocityUlps, bound);
+
+					// The moments sum up the same pendulums in the same lanes, only the rounding of the state differs.
+					if (withMoments)
+					{
+						double momentError = GetLargestMomentError(axis.m_moments, reference.m_moments);
+						double momentBound = deterministic ? 0.0 : 1e-5;
+						passed &= CheckTest(momentError <= momentBound, "%s%s, gravity %g: moments %g from scalar, bound %g",
+							SimdLevelNames[level], deterministic ? " deterministic" : "", gravity, momentError, momentBound);
+					}
+				}
+			}
+		}
+	}
+
+	PendulumKernels::SetSimdLevel(savedLevel);
+	PendulumKernels::SetDeterministic(savedDeterministic);
+	return passed;
+}
+
+
+// Every SIMD level of the Euler kernel stays within the bound of the scalar reference.
+bool TestEulerKernels()
+{
+	return TestKernelLevels(StepEulerAxis);
+}
+
+
+// Every SIMD level of the propagator kernel stays within the bound of the scalar reference.
+bool TestPropagatorKernels()
+{
+	return TestKernelLevels(StepPropagatorAxis);
+}
@@ -0,0 +1,80 @@
+#include "Test.h"
+#include "PendulumBatch.h"
+#include <math.h>
+#include <stdio.h>
+
+
+static const float SleepingDeltaTime = 1.0f / 120.0f;
+static const float SleepingBobRadius = 1.0f;
+// The most steps until the swinging bob reaches the resting one.
+static const int MaxStepsToContact = 600;
+
+
+// Advances the batch by one step along the indicated path.
+static void AdvanceBatch(PendulumBatch& batch, bool useStep)
+{
+	if (useStep)
+		batch.Step(SleepingDeltaTime, 1);
+	else
+		batch.UpdateSimulation(SleepingDeltaTime);
+}
+
+
+// Hangs a bob at rest at its equilibrium and a second one beside it, displaced away from the
+// first, so it swings over and strikes it. The resting bob is quiet from the first step on.
+static void CreateCollidingPendulums(PendulumBatch& batch)
+{
+	const float equilibriumOffset = PendulumPhysics::earthAcceleration / (PendulumPhysics::invMass * PendulumPhysics::springConstant);
+	float restingAnchor[3] = {0.0f, 0.0f, 0.0f};
+	float restingPosition[3] = {0.0f, equilibriumOffset, 0.0f};
+	float swingingAnchor[3] = {2.0f * SleepingBobRadius + 0.5f, 0.0f, 0.0f};
+	float swingingPosition[3] = {swingingAnchor[0] + 2.0f, equilibriumOffset, 0.0f};
+	batch.AddPendulum(restingAnchor);
+	batch.SetPendulumPosition(0, restingPosition);
+	batch.AddPendulum(swingingAnchor);
+	batch.SetPendulumPosition(1, swingingPosition);
+	batch.EnableCollisions(SleepingBobRadius, 0.5f);
+}
+
+
+// A resting bob that is about to fall asleep in the step it is struck keeps the impulse: with
+// the quiet steps set to the step of the first contact, it moves off like without sleeping.
+static bool TestStruckQuietPendulum(bool useStep)
+{
+	const char* path = useStep ? "Step" : "UpdateSimulation";
+
+	PendulumBatch reference(2);
+	CreateCollidingPendulums(reference);
+	int contactStep = 0;
+	float referenceVelocity[3] = {0.0f, 0.0f, 0.0f};
+	while (contactStep < MaxStepsToContact && fabsf(referenceVelocity[0]) < 0.1f)
+	{
+		AdvanceBatch(reference, useStep);
+		reference.ObtainCurrentVelocity(0, referenceVelocity);
+		++contactStep;
+	}
+	if (!CheckTest(contactStep < MaxStepsToContact, "%s: the bobs never touched", path))
+		return false;
+
+	PendulumBatch batch(2);
+	CreateCollidingPendulums(batch);
+	batch.EnableSleeping(0.01f, 0.01f, contactStep);
+	for(int step = 0; step < contactStep; ++step)
+		AdvanceBatch(batch, useStep);
+
+	float velocity[3];
+	batch.ObtainCurrentVelocity(0, velocity);
+	bool passed = CheckTest(!batch.IsSleeping(0), "%s: the struck bob fell asleep in step %d", path, contactStep);
+	passed &= CheckTest(fabsf(velocity[0] - referenceVelocity[0]) <= 1e-5f * fabsf(referenceVelocity[0]),
+		"%s: the struck bob moves with %g after step %d, without sleeping with %g", path, velocity[0], contactStep, referenceVelocity[0]);
+	return passed;
+}
+
+
+// A bob struck in the step it would fall asleep in keeps the impulse on both stepping paths.
+bool TestSleepingCollisions()
+{
+	bool passed = TestStruckQuietPendulum(true);
+	passed &= TestStruckQuietPendulum(false);
+	return passed;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// Prints the message of a failed check, formatted like printf, if the condition is false.
+// Returns the condition, so a test can stop or carry on.
+bool CheckTest(bool condition, const char* format, ...);
+
+// Gets the number of floats between the two, 0 for equal bits and for +0 and -0.
+long long GetUlpDistance(float first, float second);
+
+
+// The tests, each returns false if any of its checks failed.
+
+// Every SIMD level of the Euler kernel stays within a few units in the last place of the scalar reference.
+bool TestEulerKernels();
+
+// Every SIMD level of the propagator kernel stays within a few units in the last place of the scalar reference.
+bool TestPropagatorKernels();
+
+// The final state hash in the deterministic mode does not depend on the SIMD level or the threads.
+bool TestDeterministicHashes();
+
+// A quiet pendulum that is struck does not fall asleep and keeps the impulse.
+bool TestSleepingCollisions();
+
+// A restored checkpoint has the state hash of the saved batch and a damaged one is rejected.
+bool TestCheckpointRoundTrip();
+
+// Decoded trajectory samples stay within the error bound and truncated columns are rejected.
+bool TestCodecRoundTrip();
+
+// An over damped pendulum seeked an hour ahead is finite and rests at its equilibrium.
+bool TestOverdampedSeek();
+
+// Sweep and prune sorts from scratch when the repair would cost more and picks the sort axis again.
+bool TestSweepAndPruneReorder();
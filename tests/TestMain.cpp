@@ -0,0 +1,92 @@
+// -------------------------------------------------------------------------------------
+// Runs the tests of the simulation: PendulumTests [name ...]
+// Without names every test runs. Returns 1 if any of them failed.
+// -------------------------------------------------------------------------------------
+
+#include "Test.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+
+// A test that can be selected by name.
+struct NamedTest
+{
+	const char* m_name;
+	bool (*m_function)();
+};
+
+static const NamedTest Tests[] =
+{
+	{"EulerKernels", TestEulerKernels},
+	{"PropagatorKernels", TestPropagatorKernels},
+	{"DeterministicHashes", TestDeterministicHashes},
+	{"SleepingCollisions", TestSleepingCollisions},
+	{"CheckpointRoundTrip", TestCheckpointRoundTrip},
+	{"CodecRoundTrip", TestCodecRoundTrip},
+	{"OverdampedSeek", TestOverdampedSeek},
+	{"SweepAndPruneReorder", TestSweepAndPruneReorder}
+};
+static const int NumOfTests = sizeof(Tests) / sizeof(Tests[0]);
+
+
+// Prints the message of a failed check if the condition is false.
+bool CheckTest(bool condition, const char* format, ...)
+{
+	if (!condition)
+	{
+		va_list arguments;
+		va_start(arguments, format);
+		printf("  failed: ");
+		vprintf(format, arguments);
+		printf("\n");
+		va_end(arguments);
+	}
+	return condition;
+}
+
+
+// Gets the number of floats between the two. The bits of a float are ordered like its value
+// once the negative ones are mirrored, so the distance is the difference of the mapped bits.
+long long GetUlpDistance(float first, float second)
+{
+	int firstBits;
+	int secondBits;
+	memcpy(&firstBits, &first, sizeof(firstBits));
+	memcpy(&secondBits, &second, sizeof(secondBits));
+	long long firstOrder = firstBits < 0 ? -static_cast<long long>(firstBits & 0x7FFFFFFF) : firstBits;
+	long long secondOrder = secondBits < 0 ? -static_cast<long long>(secondBits & 0x7FFFFFFF) : secondBits;
+	return firstOrder > secondOrder ? firstOrder - secondOrder : secondOrder - firstOrder;
+}
+
+
+// Runs the selected tests.
+int main(int argc, char** argv)
+{
+	int numOfFailures = 0;
+	int numOfRuns = 0;
+	for(int test = 0; test < NumOfTests; ++test)
+	{
+		bool selected = argc <= 1;
+		for(int argument = 1; argument < argc; ++argument)
+			selected = selected || strcmp(argv[argument], Tests[test].m_name) == 0;
+		if (!selected)
+			continue;
+
+		printf("%s\n", Tests[test].m_name);
+		fflush(stdout);
+		bool passed = Tests[test].m_function();
+		printf("%s %s\n", passed ? "passed" : "FAILED", Tests[test].m_name);
+		fflush(stdout);
+		++numOfRuns;
+		if (!passed)
+			++numOfFailures;
+	}
+
+	if (numOfRuns == 0)
+	{
+		printf("no such test\n");
+		return 1;
+	}
+	return numOfFailures > 0 ? 1 : 0;
+}